@@ -0,0 +1,194 @@
+// rdma_chan.c
+// librdmademo: 基于 RDMA Write 的远端环形缓冲区通道，见 rdma_chan.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdma_chan.h"
+#include "rdma_cq.h"
+#include "rdma_pipeline.h"
+
+#define CHAN_DISCONNECT_CHECK   0xffff  // 等待信用时每自旋多少次检查一次对端断开
+
+// 通道一端需要注册的缓冲区大小：环 + 独占一个缓存行的信用字
+size_t rdma_chan_buf_size(uint32_t nslots, size_t slot_size) {
+    return CHAN_CREDIT_OFFSET(nslots, slot_size) + 64;
+}
+
+// 建立通道一端
+int rdma_chan_init(struct rdma_chan *ch, struct rdma_connection *conn, int role,
+                   uint32_t nslots, size_t slot_size, const struct rdma_mr_info *remote) {
+    size_t need = rdma_chan_buf_size(nslots, slot_size);
+
+    memset(ch, 0, sizeof(*ch));
+    if (nslots == 0 || slot_size <= CHAN_TRAILER_SIZE || slot_size % 8) {
+        fprintf(stderr, "通道参数无效: %u 个槽，槽大小 %zu (须为 8 的倍数且大于 %d)\n",
+                nslots, slot_size, CHAN_TRAILER_SIZE);
+        return -1;
+    }
+    if (conn->buf_size < need || remote->length < need) {
+        fprintf(stderr, "通道缓冲区太小: 本端 %zu，对端 %u，需要 %zu 字节\n",
+                conn->buf_size, remote->length, need);
+        return -1;
+    }
+    ch->conn      = conn;
+    ch->role      = role;
+    ch->ring      = conn->buf;
+    ch->slot_size = slot_size;
+    ch->nslots    = nslots;
+    ch->credit    = (volatile uint64_t *)(conn->buf + CHAN_CREDIT_OFFSET(nslots, slot_size));
+    ch->rkey      = remote->rkey;
+    // 生产者写对端的环，消费者写对端的信用字
+    ch->remote_addr  = role == CHAN_PRODUCER ? remote->vaddr
+                                             : remote->vaddr + CHAN_CREDIT_OFFSET(nslots, slot_size);
+    ch->credit_batch = nslots / 4 > 0 ? nslots / 4 : 1;
+    ch->signal_every = conn->opts.max_send_wr / 2 > 0 ? conn->opts.max_send_wr / 2 : 1;
+    return 0;
+}
+
+// 回收完成通知。block 非 0 时至少等到一个
+static int chan_reap(struct rdma_chan *ch, int block) {
+    struct ibv_wc   wc[PIPELINE_POLL_BATCH];
+    int             n;
+
+    while (ch->pending > 0) {
+        n = rdma_cq_poll(ch->conn, wc, PIPELINE_POLL_BATCH, block ? -1 : 0);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "通道写入失败: %s\n", ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+        }
+        ch->pending -= n;
+        block = 0;
+    }
+    return 0;
+}
+
+// 投递一个 RDMA Write。未请求通知的 WR 也占用发送队列，
+// 按 已请求的通知数 * signal_every + 未通知数 估算未完成 WR 数，发送队列将满时先等待一个通知
+static int chan_post(struct rdma_chan *ch, uintptr_t local, uint32_t len, uint64_t remote_addr) {
+    struct rdma_connection *conn = ch->conn;
+    struct ibv_sge          sge;
+    struct ibv_send_wr      wr, *bad_wr = NULL;
+
+    while (ch->pending * ch->signal_every + ch->unsignaled + 1 > conn->opts.max_send_wr) {
+        if (chan_reap(ch, 1)) {
+            return -1;
+        }
+    }
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = local;
+    sge.length = len;
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list             = &sge;
+    wr.num_sge             = len ? 1 : 0;
+    wr.opcode              = IBV_WR_RDMA_WRITE;
+    wr.send_flags          = rdma_inline_flag(conn, len);
+    wr.wr.rdma.remote_addr = remote_addr;
+    wr.wr.rdma.rkey        = ch->rkey;
+    if (++ch->unsignaled >= ch->signal_every) {
+        wr.send_flags |= IBV_SEND_SIGNALED;
+        ch->unsignaled = 0;
+        ch->pending++;
+    }
+    if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败\n");
+        return -1;
+    }
+    return chan_reap(ch, 0);
+}
+
+// 生产者：写一条消息
+int rdma_chan_send(struct rdma_chan *ch, const void *data, uint32_t len) {
+    struct rdma_chan_trailer *t;
+    char                     *end;
+    uint64_t                  spins = 0;
+
+    if (len > rdma_chan_max_msg(ch)) {
+        fprintf(stderr, "消息长度 %u 超过槽容量 %zu\n", len, rdma_chan_max_msg(ch));
+        return -1;
+    }
+    // 环满：等待消费者写回信用
+    while (ch->tail - __atomic_load_n(ch->credit, __ATOMIC_ACQUIRE) >= ch->nslots) {
+        if (spins++ == 0) {
+            ch->stalls++;
+        }
+        if (chan_reap(ch, 0)) {
+            return -1;
+        }
+        if ((spins & CHAN_DISCONNECT_CHECK) == 0 && rdma_check_disconnect(ch->conn)) {
+            fprintf(stderr, "等待信用时对端已断开\n");
+            return -1;
+        }
+    }
+    // 暂存区与远端环布局相同：消息右对齐，尾部位于槽末尾，一个 WR 写完整条消息
+    end = ch->ring + (ch->tail % ch->nslots) * ch->slot_size + ch->slot_size - CHAN_TRAILER_SIZE;
+    t   = (struct rdma_chan_trailer *)end;
+    memcpy(end - len, data, len);
+    t->len = len;
+    t->seq = (uint32_t)(ch->tail + 1);
+    if (chan_post(ch, (uintptr_t)(end - len), len + CHAN_TRAILER_SIZE,
+                  ch->remote_addr + (uint64_t)(end - len - ch->ring))) {
+        return -1;
+    }
+    ch->tail++;
+    return 0;
+}
+
+// 生产者：等待已投递的写入全部完成
+int rdma_chan_drain(struct rdma_chan *ch) {
+    // 补一个请求通知的零长度写，RC 按序完成，它完成时之前的写入都已完成
+    if (ch->unsignaled > 0) {
+        ch->unsignaled = ch->signal_every - 1;
+        if (chan_post(ch, 0, 0, ch->remote_addr)) {
+            return -1;
+        }
+    }
+    while (ch->pending > 0) {
+        if (chan_reap(ch, 1)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 消费者：检查下一条消息
+int rdma_chan_recv(struct rdma_chan *ch, const char **msg, uint32_t *len) {
+    char                     *end = ch->ring + (ch->head % ch->nslots) * ch->slot_size
+                                    + ch->slot_size - CHAN_TRAILER_SIZE;
+    struct rdma_chan_trailer *t = (struct rdma_chan_trailer *)end;
+
+    // 尾部序号最后到达，读到期望值后再读长度和内容
+    if (__atomic_load_n(&t->seq, __ATOMIC_ACQUIRE) != (uint32_t)(ch->head + 1)) {
+        return 0;
+    }
+    *len = t->len;
+    if (*len > rdma_chan_max_msg(ch)) {
+        fprintf(stderr, "通道消息长度 %u 无效\n", *len);
+        return -1;
+    }
+    *msg = end - *len;
+    return 1;
+}
+
+// 消费者：处理完当前消息
+int rdma_chan_release(struct rdma_chan *ch) {
+    ch->head++;
+    if (ch->head - ch->acked < ch->credit_batch) {
+        return 0;
+    }
+    // 信用字只增不减，上一次写回尚未读完时被改写也无妨
+    *ch->credit = ch->head;
+    ch->acked   = ch->head;
+    ch->credit_writes++;
+    return chan_post(ch, (uintptr_t)ch->credit, sizeof(uint64_t), ch->remote_addr);
+}
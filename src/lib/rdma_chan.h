@@ -0,0 +1,84 @@
+// rdma_chan.h
+// librdmademo: 基于 RDMA Write 的远端环形缓冲区通道，单生产者、单消费者。
+// 消费者（接收端）暴露一个 nslots 个槽的环，生产者把第 n 条消息写到第 n % nslots 个槽；
+// 消息右对齐放在槽内，紧跟一个 8 字节尾部 {长度, 序号}，尾部正好位于槽的末尾，
+// 一条消息只需一个 RDMA Write（长度 + 8 字节）。序号为 n + 1，消费者轮询当前槽的尾部序号，
+// 等于期望值即表示整条消息已到达（依赖 HCA 按地址递增顺序写入同一个 WR 的数据，主流网卡均满足）；
+// 上一圈留下的旧数据序号不同，不会被误认。
+// 流控基于信用：消费者处理完消息后推进 head，每 credit_batch 条把 head 用 RDMA Write 写回生产者缓冲区的
+// 信用字；生产者只有在 tail - head < nslots 时才写下一个槽，环满时自旋等待信用，不会覆盖未处理的消息。
+// 两端各注册一块 rdma_chan_buf_size() 字节的缓冲区，前 nslots * slot_size 字节是环（生产者一端为暂存区），
+// 之后是信用字，并通过 private_data 交换 MR 信息（rdma_pack_mr_info）。
+// 发送 WR 每 signal_every 个才请求一次完成通知；通道不是线程安全的。
+
+#ifndef RDMA_CHAN_H
+#define RDMA_CHAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rdma_common.h"
+
+#define CHAN_DEFAULT_SLOTS      256
+#define CHAN_TRAILER_SIZE       8       // 每个槽末尾的 {长度, 序号}
+#define CHAN_CREDIT_OFFSET(nslots, slot_size)   ((size_t)(nslots) * (slot_size))
+
+// 通道一端的角色
+enum {
+    CHAN_PRODUCER = 0,
+    CHAN_CONSUMER,
+};
+
+// 槽尾部
+struct rdma_chan_trailer {
+    uint32_t        len;            // 消息长度
+    uint32_t        seq;            // 消息序号 + 1，写在最后，0 表示空槽
+};
+
+struct rdma_chan {
+    struct rdma_connection *conn;
+    int                     role;           // CHAN_PRODUCER / CHAN_CONSUMER
+    char                   *ring;           // 本端的环（消费者）或暂存区（生产者），位于 conn->buf
+    size_t                  slot_size;
+    uint32_t                nslots;
+    volatile uint64_t      *credit;         // 本端信用字：生产者处由消费者写入，消费者处作为写回的源
+    uint64_t                remote_addr;    // 生产者：远端环地址；消费者：远端信用字地址
+    uint32_t                rkey;
+    uint64_t                tail;           // 生产者：已写入的消息数
+    uint64_t                head;           // 消费者：已处理的消息数
+    uint64_t                acked;          // 消费者：最近一次写回的 head
+    uint32_t                credit_batch;   // 消费者每处理多少条写回一次信用
+    int                     signal_every;   // 每隔多少个 WR 请求一次完成通知
+    int                     unsignaled;     // 上次通知以来投递的 WR 数
+    int                     pending;        // 已请求、尚未回收的完成通知数
+    uint64_t                stalls;         // 生产者因环满而等待的次数
+    uint64_t                credit_writes;  // 消费者写回信用的次数
+};
+
+// 通道一端需要注册的缓冲区大小
+size_t rdma_chan_buf_size(uint32_t nslots, size_t slot_size);
+
+// 在已连接的 conn 上建立通道一端。conn->buf 至少 rdma_chan_buf_size() 字节且已清零，
+// remote 为对端缓冲区的 MR 信息（主机字节序），两端的 nslots/slot_size 必须一致
+int rdma_chan_init(struct rdma_chan *ch, struct rdma_connection *conn, int role,
+                   uint32_t nslots, size_t slot_size, const struct rdma_mr_info *remote);
+
+// 单条消息的最大长度
+static inline size_t rdma_chan_max_msg(const struct rdma_chan *ch) {
+    return ch->slot_size - CHAN_TRAILER_SIZE;
+}
+
+// 生产者：写一条消息，环满时等待信用。成功返回 0，对端断开或出错返回 -1
+int rdma_chan_send(struct rdma_chan *ch, const void *data, uint32_t len);
+
+// 生产者：等待已投递的写入全部完成
+int rdma_chan_drain(struct rdma_chan *ch);
+
+// 消费者：不阻塞地检查下一条消息，到达时返回 1，*msg/*len 指向环内的消息，
+// 在 rdma_chan_release 之前有效；尚未到达返回 0，尾部内容无效返回 -1
+int rdma_chan_recv(struct rdma_chan *ch, const char **msg, uint32_t *len);
+
+// 消费者：处理完当前消息，攒够 credit_batch 条时把 head 写回生产者。出错返回 -1
+int rdma_chan_release(struct rdma_chan *ch);
+
+#endif // RDMA_CHAN_H
@@ -0,0 +1,449 @@
+// rdma_common.c
+// librdmademo: rdma_cm 连接管理公共实现，见 rdma_common.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include "rdma_common.h"
+#include "rdma_cq.h"
+
+// 填充默认连接参数
+void rdma_conn_opts_init(struct rdma_conn_opts *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->cq_depth            = DEFAULT_CQ_DEPTH;
+    opts->max_send_wr         = DEFAULT_MAX_SEND_WR;
+    opts->max_recv_wr         = DEFAULT_MAX_RECV_WR;
+    opts->max_send_sge        = DEFAULT_MAX_SGE;
+    opts->max_recv_sge        = DEFAULT_MAX_SGE;
+    opts->max_inline_data     = DEFAULT_MAX_INLINE_DATA;
+    opts->inline_threshold    = -1;
+    opts->initiator_depth     = DEFAULT_RD_ATOMIC;
+    opts->responder_resources = DEFAULT_RD_ATOMIC;
+    opts->retry_count         = DEFAULT_RETRY_COUNT;
+    opts->rnr_retry_count     = DEFAULT_RETRY_COUNT;
+    opts->poll_mode           = RDMA_POLL_BUSY;
+    opts->poll_spin_us        = DEFAULT_POLL_SPIN_US;
+    opts->listen_backlog      = DEFAULT_LISTEN_BACKLOG;
+    opts->qp_type             = IBV_QPT_RC;
+}
+
+// 初始化会话资源
+int rdma_connection_init(struct rdma_connection *conn, int role, const char *ip, int port,
+                         const struct rdma_conn_opts *opts) {
+    struct sockaddr_in addr;
+    int                ret = 0;
+
+    memset(conn, 0, sizeof(*conn));
+    if (opts) {
+        conn->opts = *opts;
+    } else {
+        rdma_conn_opts_init(&conn->opts);
+    }
+
+    conn->ec = rdma_create_event_channel();
+    if (!conn->ec) {
+        fprintf(stderr, "rdma_create_event_channel 失败\n");
+        return -1;
+    }
+
+  /*RDMA_PS_TCP：用于基于 TCP 的 RDMA 通信（如 RoCE、iWARP）。
+    RDMA_PS_IPOIB：用于 IP over InfiniBand。
+    RDMA_PS_UDP：用于基于 UDP 的 RDMA 通信。
+    RDMA_PS_IB：用于原生 InfiniBand 通信。
+    */
+    ret = rdma_create_id(conn->ec, &conn->cm_id, NULL, conn->opts.qp_type == IBV_QPT_UD ? RDMA_PS_UDP : RDMA_PS_TCP);
+    if (ret) {
+        fprintf(stderr, "rdma_create_id 失败 %d\n", ret);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+    if (role == ROLE_SERVER) {
+        conn->listen_id = conn->cm_id;
+        ret = rdma_bind_addr(conn->cm_id, (struct sockaddr*)&addr);
+        if (ret) {
+            fprintf(stderr, "rdma_bind_addr 失败 %d\n", ret);
+            return -1;
+        }
+      /*监听
+        rdma_listen监听队列的最大长度默认为 1，当队列满时，新连接请求会被拒绝。
+        多客户端服务端需要调大 opts.listen_backlog。
+        */
+        ret = rdma_listen(conn->cm_id, conn->opts.listen_backlog);
+        if (ret) {
+            fprintf(stderr, "rdma_listen 失败 %d\n", ret);
+            return -1;
+        }
+    } else {
+        ret = rdma_resolve_addr(conn->cm_id, NULL, (struct sockaddr*)&addr, DEFAULT_RESOLVE_TIMEOUT);
+        if (ret) {
+            fprintf(stderr, "rdma_resolve_addr 失败 %d\n", ret);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 资源释放
+void rdma_connection_cleanup(struct rdma_connection *conn) {
+    // 先销毁 QP，否则 cm id 无法释放
+    if (conn->qp)      rdma_destroy_qp(conn->cm_id);
+    if (conn->mr)      ibv_dereg_mr(conn->mr);
+    if (!conn->cq_shared) {
+        // 销毁 CQ 前必须确认所有已取出的完成事件
+        if (conn->cq)      rdma_cq_ack_events(conn);
+        if (conn->cq)      ibv_destroy_cq(conn->cq);
+        if (conn->comp_ch) ibv_destroy_comp_channel(conn->comp_ch);
+    }
+    if (conn->pd && !conn->pd_shared) ibv_dealloc_pd(conn->pd);
+    if (conn->cm_id && conn->cm_id != conn->listen_id) rdma_destroy_id(conn->cm_id);
+    if (conn->listen_id) rdma_destroy_id(conn->listen_id);
+    if (conn->ec)      rdma_destroy_event_channel(conn->ec);
+    if (conn->buf)     free(conn->buf);
+    memset(conn, 0, sizeof(*conn));
+}
+
+// 事件等待
+int wait_event(struct rdma_connection *conn, enum rdma_cm_event_type expect, struct rdma_cm_event **evt) {
+    int ret = 0;
+
+    ret = rdma_get_cm_event(conn->ec, evt);
+    if (ret) {
+        fprintf(stderr, "rdma_get_cm_event 失败 %d\n", ret);
+        return -1;
+    }
+
+    if ((*evt)->event != expect) {
+        fprintf(stderr, "期望事件 %d, 实际事件 %d\n", expect, (*evt)->event);
+        rdma_ack_cm_event(*evt);
+        return -1;
+    }
+    return 0;
+}
+
+// 非阻塞检查对端是否断开
+int rdma_check_disconnect(struct rdma_connection *conn) {
+    struct rdma_cm_event *evt = NULL;
+    struct pollfd         pfd;
+    int                   disconnected;
+
+    pfd.fd      = conn->ec->fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) <= 0) {
+        return 0;
+    }
+    if (rdma_get_cm_event(conn->ec, &evt)) {
+        fprintf(stderr, "rdma_get_cm_event 失败\n");
+        return -1;
+    }
+    disconnected = evt->event == RDMA_CM_EVENT_DISCONNECTED;
+    rdma_ack_cm_event(evt);
+    return disconnected;
+}
+
+// 客户端：地址解析完成后解析路由，成功后才能继续创建 QP 和建立连接。
+int rdma_client_resolve(struct rdma_connection *conn) {
+    struct rdma_cm_event *evt = NULL;
+
+    if (wait_event(conn, RDMA_CM_EVENT_ADDR_RESOLVED, &evt)) {
+        fprintf(stderr, "地址解析失败\n");
+        return -1;
+    }
+    rdma_ack_cm_event(evt);
+
+    if (rdma_resolve_route(conn->cm_id, DEFAULT_RESOLVE_TIMEOUT)) {
+        fprintf(stderr, "路由解析失败\n");
+        return -1;
+    }
+
+    //已找到到目标的路由
+    if (wait_event(conn, RDMA_CM_EVENT_ROUTE_RESOLVED, &evt)) {
+        fprintf(stderr, "路由解析事件失败\n");
+        return -1;
+    }
+    rdma_ack_cm_event(evt);
+    return 0;
+}
+
+// 创建完成通道和 CQ
+int rdma_create_cq(struct rdma_connection *conn, struct ibv_context *verbs, int depth) {
+    //当 CQ 上有完成事件（如发送/接收完成），并且你为 CQ 关联了 comp_channel，内核会通过该 channel 发送事件通知
+    conn->comp_ch = ibv_create_comp_channel(verbs);
+    if (!conn->comp_ch) {
+        fprintf(stderr, "ibv_create_comp_channel 失败\n");
+        return -1;
+    }
+    conn->cq = ibv_create_cq(verbs, depth, NULL, conn->comp_ch, 0);
+    if (!conn->cq) {
+        fprintf(stderr, "ibv_create_cq 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 创建QP等资源
+int build_qp(struct rdma_connection *conn) {
+    struct ibv_qp_init_attr qp_attr;
+    struct ibv_device_attr  dev_attr;
+
+    if (!conn->pd) {
+        conn->pd = ibv_alloc_pd(conn->cm_id->verbs);
+    }
+    if (!conn->pd) {
+        fprintf(stderr, "ibv_alloc_pd 失败\n");
+        return -1;
+    }
+    if (!conn->cq && rdma_create_cq(conn, conn->cm_id->verbs, conn->opts.cq_depth)) {
+        return -1;
+    }
+
+    //创建QP
+    memset(&qp_attr, 0, sizeof(qp_attr));
+    qp_attr.send_cq          = conn->cq;
+    qp_attr.recv_cq          = conn->cq;
+    qp_attr.srq              = conn->srq;
+    /*
+    IBV_QPT_RC：支持可靠、面向连接的通信，保证数据可靠到达，支持 RDMA 读写和发送/接收。
+    IBV_QPT_UC：面向连接但不保证可靠性，支持 RDMA 写和发送/接收，不支持 RDMA 读。
+    IBV_QPT_UD：无连接、无可靠性保证，支持一对多通信，常用于广播/多播或管理报文。
+    IBV_QPT_RAW_PACKET：允许直接发送/接收原始以太网帧。
+    IBV_QPT_XRC_SEND：用于 XRC 发送队列。
+    IBV_QPT_XRC_RECV：用于 XRC 接收队列。
+    IBV_QPT_DRIVER：用于驱动程序特定的队列类型。
+    */
+    qp_attr.qp_type             = conn->opts.qp_type;
+    qp_attr.cap.max_send_wr     = conn->opts.max_send_wr;
+    qp_attr.cap.max_recv_wr     = conn->srq ? 0 : conn->opts.max_recv_wr;
+    qp_attr.cap.max_send_sge    = conn->opts.max_send_sge;
+    qp_attr.cap.max_recv_sge    = conn->srq ? 0 : conn->opts.max_recv_sge;
+    // SGE 数超过设备上限时创建会失败，先按 max_sge 截断
+    if (ibv_query_device(conn->cm_id->verbs, &dev_attr) == 0) {
+        if (qp_attr.cap.max_send_sge > (uint32_t)dev_attr.max_sge) qp_attr.cap.max_send_sge = dev_attr.max_sge;
+        if (qp_attr.cap.max_recv_sge > (uint32_t)dev_attr.max_sge) qp_attr.cap.max_recv_sge = dev_attr.max_sge;
+    }
+    qp_attr.cap.max_inline_data = conn->opts.max_inline_data > conn->opts.inline_threshold ?
+                                  conn->opts.max_inline_data : conn->opts.inline_threshold;
+    // 设备不支持请求的内联上限时创建会失败，逐次减半重试
+    while (rdma_create_qp(conn->cm_id, conn->pd, &qp_attr)) {
+        if (qp_attr.cap.max_inline_data == 0) {
+            fprintf(stderr, "rdma_create_qp 失败\n");
+            return -1;
+        }
+        qp_attr.cap.max_inline_data /= 2;
+    }
+    conn->qp = conn->cm_id->qp;
+    // 创建后 cap 中是设备实际授予的值（可能大于请求值）
+    conn->inline_max = qp_attr.cap.max_inline_data;
+    conn->send_sge   = qp_attr.cap.max_send_sge;
+    if (conn->opts.inline_threshold >= 0 && (uint32_t)conn->opts.inline_threshold < conn->inline_max) {
+        conn->inline_max = conn->opts.inline_threshold;
+    }
+    return 0;
+}
+
+// 注册内存
+int reg_mem(struct rdma_connection *conn, size_t size, int access) {
+    if (posix_memalign((void**)&conn->buf, 4096, size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        return -1;
+    }
+    memset(conn->buf, 0, size);
+    conn->buf_size = size;
+    /*
+    IBV_ACCESS_LOCAL_WRITE：允许本地进程写该内存。
+    IBV_ACCESS_REMOTE_WRITE：允许远程节点通过 RDMA Write 操作写本地内存。
+    IBV_ACCESS_REMOTE_READ：允许远程节点通过 RDMA Read 操作读本地内存。
+    IBV_ACCESS_REMOTE_ATOMIC：允许远程节点对本地内存执行原子操作。
+    IBV_ACCESS_MW_BIND：允许该内存区域被绑定到内存窗口。
+    IBV_ACCESS_ZERO_BASED：允许注册零基址内存。
+    IBV_ACCESS_ON_DEMAND：支持按需分页。
+    IBV_ACCESS_HUGETLB：允许注册 HugeTLB（大页）内存。
+    IBV_ACCESS_RELAXED_ORDERING：允许放宽内存访问顺序。
+    */
+    conn->mr = ibv_reg_mr(conn->pd, conn->buf, size, access);
+    if (!conn->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 投递 n 个零长度接收 WR
+int rdma_post_empty_recv(struct rdma_connection *conn, int n) {
+    struct ibv_recv_wr wr, *bad_wr = NULL;
+
+    memset(&wr, 0, sizeof(wr));
+    for (int i = 0; i < n; ++i) {
+        if (ibv_post_recv(conn->qp, &wr, &bad_wr)) {
+            fprintf(stderr, "ibv_post_recv 失败\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 发送一条零长度的通知消息
+int rdma_send_empty(struct rdma_connection *conn) {
+    struct ibv_send_wr wr, *bad_wr = NULL;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.opcode     = IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send (SEND) 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 等待指定类型的完成事件
+int rdma_wait_completion(struct rdma_connection *conn, enum ibv_wc_opcode opcode, struct ibv_wc *wc) {
+    struct ibv_wc tmp;
+
+    if (!wc) {
+        wc = &tmp;
+    }
+    while (1) {
+        int n = rdma_cq_poll(conn, wc, 1, -1);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (wc->status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "完成队列错误: %s\n", ibv_wc_status_str(wc->status));
+            return -1;
+        }
+        if (wc->opcode == opcode) {
+            return 0;
+        }
+    }
+}
+
+// 客户端一步建立连接
+int rdma_client_connect(struct rdma_connection *conn, const char *ip, int port, const struct rdma_conn_opts *opts,
+                        size_t size, int access, struct rdma_mr_info *remote) {
+    struct rdma_cm_event  *evt = NULL;
+    struct rdma_conn_param conn_param;
+    struct rdma_mr_info    local_info;
+
+    if (rdma_connection_init(conn, ROLE_CLIENT, ip, port, opts)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        return -1;
+    }
+    if (rdma_client_resolve(conn)) {
+        return -1;
+    }
+    if (build_qp(conn)) {
+        fprintf(stderr, "传输队列创建失败\n");
+        return -1;
+    }
+    if (reg_mem(conn, size, access)) {
+        fprintf(stderr, "rdma 内存注册失败\n");
+        return -1;
+    }
+    rdma_pack_mr_info(&local_info, conn->buf, conn->buf_size, conn->mr);
+    rdma_fill_conn_param(conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
+    if (rdma_connect(conn->cm_id, &conn_param)) {
+        fprintf(stderr, "rdma_connect 失败\n");
+        return -1;
+    }
+    if (wait_event(conn, RDMA_CM_EVENT_ESTABLISHED, &evt)) {
+        fprintf(stderr, "等待连接建立成功事件失败\n");
+        return -1;
+    }
+    rdma_apply_peer_param(conn, evt);
+    if (remote && rdma_unpack_mr_info(evt, remote)) {
+        rdma_ack_cm_event(evt);
+        return -1;
+    }
+    rdma_ack_cm_event(evt);
+    return 0;
+}
+
+// 按对端限制收紧协商结果
+static void clamp_rd_atomic(struct rdma_connection *conn) {
+    if (!conn->peer_limits) {
+        return;
+    }
+    if (conn->initiator_depth > conn->peer_initiator_depth) {
+        conn->initiator_depth = conn->peer_initiator_depth;
+    }
+    if (conn->responder_resources > conn->peer_responder_resources) {
+        conn->responder_resources = conn->peer_responder_resources;
+    }
+}
+
+// 按连接参数填充 conn_param
+void rdma_fill_conn_param(struct rdma_connection *conn, struct rdma_conn_param *param) {
+    struct ibv_device_attr dev_attr;
+    int                    dev_init = 1, dev_resp = 1;
+
+    // 超过设备能力时 rdma_connect/rdma_accept 会失败，所以先按设备上限截断
+    if (conn->cm_id && conn->cm_id->verbs && ibv_query_device(conn->cm_id->verbs, &dev_attr) == 0) {
+        dev_init = dev_attr.max_qp_init_rd_atom;
+        dev_resp = dev_attr.max_qp_rd_atom;
+    } else {
+        fprintf(stderr, "ibv_query_device 失败，并发 RDMA Read/Atomic 数按 1 协商\n");
+    }
+    conn->initiator_depth     = conn->opts.initiator_depth;
+    conn->responder_resources = conn->opts.responder_resources;
+    if (conn->initiator_depth <= 0 || conn->initiator_depth > dev_init) {
+        conn->initiator_depth = dev_init;
+    }
+    if (conn->responder_resources <= 0 || conn->responder_resources > dev_resp) {
+        conn->responder_resources = dev_resp;
+    }
+    // conn_param 中为 uint8_t
+    if (conn->initiator_depth > 255)     conn->initiator_depth = 255;
+    if (conn->responder_resources > 255) conn->responder_resources = 255;
+    clamp_rd_atomic(conn);
+
+    memset(param, 0, sizeof(*param));
+    param->initiator_depth     = conn->initiator_depth;
+    param->responder_resources = conn->responder_resources;
+    param->retry_count         = conn->opts.retry_count;
+    param->rnr_retry_count     = conn->opts.rnr_retry_count;
+}
+
+// 取出对端的并发 RDMA Read/Atomic 限制
+void rdma_apply_peer_param(struct rdma_connection *conn, const struct rdma_cm_event *evt) {
+    conn->peer_limits              = 1;
+    conn->peer_initiator_depth     = evt->param.conn.initiator_depth;
+    conn->peer_responder_resources = evt->param.conn.responder_resources;
+    clamp_rd_atomic(conn);
+}
+
+// 把本端 MR 信息转换为网络字节序
+void rdma_pack_mr_info(struct rdma_mr_info *wire, const void *addr, size_t length, const struct ibv_mr *mr) {
+    wire->vaddr  = htobe64((uintptr_t)addr);
+    wire->rkey   = htobe32(mr->rkey);
+    wire->length = htobe32((uint32_t)length);
+}
+
+// 从 CM 事件的 private_data 中取出对端 MR 信息，需在 rdma_ack_cm_event 之前调用。
+// IB 传输会把 private_data 补齐到固定长度，所以只检查下限
+int rdma_unpack_mr_info(const struct rdma_cm_event *evt, struct rdma_mr_info *info) {
+    struct rdma_mr_info wire;
+
+    if (!evt->param.conn.private_data || evt->param.conn.private_data_len < sizeof(wire)) {
+        fprintf(stderr, "private_data 中没有 MR 信息 (长度 %d)\n", evt->param.conn.private_data_len);
+        return -1;
+    }
+    memcpy(&wire, evt->param.conn.private_data, sizeof(wire));
+    info->vaddr  = be64toh(wire.vaddr);
+    info->rkey   = be32toh(wire.rkey);
+    info->length = be32toh(wire.length);
+    return 0;
+}
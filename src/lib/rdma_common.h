@@ -0,0 +1,157 @@
+// rdma_common.h
+// librdmademo: 四个 demo（send/write/read/atomic）共用的 rdma_cm 连接管理代码。
+// 包括连接资源结构体、事件等待、QP 创建、内存注册和资源释放。
+//
+// RDMA 基本概念和接口说明见 README.md
+
+#ifndef RDMA_COMMON_H
+#define RDMA_COMMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <infiniband/verbs.h>
+#include <rdma/rdma_cma.h>
+
+// 角色定义
+#define ROLE_UNDEF      0
+#define ROLE_SERVER     1
+#define ROLE_CLIENT     2
+
+// 连接参数默认值（与原各 demo 中的硬编码值一致）
+#define DEFAULT_CQ_DEPTH        10
+#define DEFAULT_MAX_SEND_WR     10
+#define DEFAULT_MAX_RECV_WR     10
+#define DEFAULT_MAX_SGE         1
+#define DEFAULT_RD_ATOMIC       0       // 并发 RDMA Read/Atomic 数，0 表示按设备上限协商
+#define DEFAULT_RETRY_COUNT     7
+#define DEFAULT_RESOLVE_TIMEOUT 2000    // 地址/路由解析超时（毫秒）
+#define DEFAULT_LISTEN_BACKLOG  1       // 服务端监听队列长度
+#define DEFAULT_POLL_SPIN_US    50      // 自适应模式下阻塞前的忙轮询时长（微秒）
+#define DEFAULT_MAX_INLINE_DATA 256     // 向设备请求的内联数据上限（字节），不支持时逐次减半
+
+// 完成队列轮询策略，见 rdma_cq.h
+#define RDMA_POLL_BUSY          0       // 忙轮询：延迟最低，占满一个核
+#define RDMA_POLL_EVENT         1       // 事件驱动：通过完成通道阻塞等待，空闲时不占 CPU
+#define RDMA_POLL_ADAPTIVE      2       // 自适应：先忙轮询 poll_spin_us 微秒，仍无完成再阻塞
+
+// 可调的连接参数
+struct rdma_conn_opts {
+    int         cq_depth;               // 完成队列深度
+    int         max_send_wr;            // 发送队列深度
+    int         max_recv_wr;            // 接收队列深度
+    int         max_send_sge;           // 一次发送操作最多能用多少个sge数
+    int         max_recv_sge;           // 一次接收操作最多能用多少个sge数
+    int         max_inline_data;        // 向设备请求的内联数据上限（字节）
+    int         inline_threshold;       // 不超过该长度的 Send/Write 使用 IBV_SEND_INLINE，-1 表示设备授予的上限，0 禁用
+    int         initiator_depth;        // 发起方最大并发 RDMA Read/Atomic 操作数上限，0 表示设备上限
+    int         responder_resources;    // 响应方最大并发 RDMA Read/Atomic 操作数上限，0 表示设备上限
+    int         retry_count;            // 连接重试次数
+    int         rnr_retry_count;        // RNR 重试次数
+    int         poll_mode;              // 完成队列轮询策略 RDMA_POLL_*
+    int         poll_spin_us;           // 自适应模式的忙轮询时长（微秒）
+    int         listen_backlog;         // 服务端监听队列长度
+    int         qp_type;                // IBV_QPT_RC（默认）或 IBV_QPT_UD，UD 时 cm id 使用 RDMA_PS_UDP
+};
+
+// 资源结构体
+struct rdma_connection {
+    struct rdma_event_channel *ec;          // 事件通道
+    struct rdma_cm_id         *listen_id;   // 监听 cm id（仅服务端）
+    struct rdma_cm_id         *cm_id;       // cm id（服务端为连接请求的子 id）
+    struct ibv_pd             *pd;          // 保护域
+    int                        pd_shared;   // PD 由外部（如多客户端服务端）所有，cleanup 时不释放
+    struct ibv_comp_channel   *comp_ch;     // 完成通道
+    struct ibv_cq             *cq;          // 完成队列
+    int                        cq_shared;   // CQ 和完成通道由外部（如服务端工作线程）所有，cleanup 时不销毁
+    struct ibv_srq            *srq;         // 共享接收队列（外部所有），非 NULL 时 QP 不创建自己的接收队列
+    struct ibv_qp             *qp;          // 传输队列对
+    uint32_t                   inline_max;  // 实际使用的内联阈值：设备授予的上限与 opts.inline_threshold 中较小者
+    uint32_t                   send_sge;    // 设备实际授予的每个发送 WR 的 SGE 数
+    int                        initiator_depth;     // 协商后本端可同时发起的 RDMA Read/Atomic 数
+    int                        responder_resources; // 协商后本端为对端保留的 RDMA Read/Atomic 响应资源数
+    int                        peer_limits;         // 已从 CM 事件取得对端的限制
+    int                        peer_initiator_depth;     // 对端允许本端发起的上限（本端视角）
+    int                        peer_responder_resources; // 对端最多会发起的数量（本端视角）
+    struct ibv_mr             *mr;          // 内存注册
+    char                      *buf;         // 消息缓冲区
+    size_t                     buf_size;    // 消息缓冲区大小
+    struct rdma_conn_opts      opts;        // 连接参数
+    int                        cq_armed;    // 是否已调用 ibv_req_notify_cq 且尚未收到事件
+    unsigned int               cq_events;   // 已取出但尚未 ibv_ack_cq_events 的完成事件数
+};
+
+// 连接建立时通过 rdma_conn_param.private_data 交换的内存区域信息。
+// 线上为网络字节序，用 rdma_pack_mr_info/rdma_unpack_mr_info 转换
+struct rdma_mr_info {
+    uint64_t    vaddr;                  // 远端可访问的虚拟地址
+    uint32_t    rkey;                   // 远程访问密钥
+    uint32_t    length;                 // 区域长度
+} __attribute__((packed));
+
+// 填充默认连接参数
+void rdma_conn_opts_init(struct rdma_conn_opts *opts);
+
+// 初始化会话资源：服务端绑定并监听，客户端发起地址解析。opts 为 NULL 时使用默认参数
+int rdma_connection_init(struct rdma_connection *conn, int role, const char *ip, int port,
+                         const struct rdma_conn_opts *opts);
+
+// 资源释放
+void rdma_connection_cleanup(struct rdma_connection *conn);
+
+// 事件等待：成功时 *evt 需要调用者 rdma_ack_cm_event
+int wait_event(struct rdma_connection *conn, enum rdma_cm_event_type expect, struct rdma_cm_event **evt);
+
+// 非阻塞检查对端是否断开：收到 DISCONNECTED 返回 1，无事件返回 0，出错返回 -1
+int rdma_check_disconnect(struct rdma_connection *conn);
+
+// 客户端：等待地址解析完成并解析路由
+int rdma_client_resolve(struct rdma_connection *conn);
+
+// 在 verbs 设备上创建完成通道和 depth 深度的 CQ
+int rdma_create_cq(struct rdma_connection *conn, struct ibv_context *verbs, int depth);
+
+// 创建 PD/CQ/QP 等资源。conn->pd、conn->cq 已设置（共享 PD/CQ）时不再创建，conn->srq 非 NULL 时 QP 使用该 SRQ。
+// SGE 数按设备 max_sge 截断
+int build_qp(struct rdma_connection *conn);
+
+// 长度为 len 的 Send/Write 应使用的内联标志：不超过 conn->inline_max 时为 IBV_SEND_INLINE。
+// 内联时 HCA 不再 DMA 读取本地缓冲区，投递返回后缓冲区即可复用，lkey 也不会被检查
+static inline unsigned int rdma_inline_flag(const struct rdma_connection *conn, size_t len) {
+    return len > 0 && len <= conn->inline_max ? IBV_SEND_INLINE : 0;
+}
+
+// 分配并注册 size 字节、4K 对齐的缓冲区
+int reg_mem(struct rdma_connection *conn, size_t size, int access);
+
+// 投递 n 个零长度接收 WR，用于接收不带数据的通知消息
+int rdma_post_empty_recv(struct rdma_connection *conn, int n);
+
+// 发送一条零长度的通知消息（带完成通知）
+int rdma_send_empty(struct rdma_connection *conn);
+
+// 按连接的轮询策略等待，直到收到指定类型的完成事件，其他成功的完成事件被丢弃；wc 可为 NULL
+int rdma_wait_completion(struct rdma_connection *conn, enum ibv_wc_opcode opcode, struct ibv_wc *wc);
+
+// 客户端一步建立连接：地址/路由解析、创建 QP、注册 size 字节缓冲区并连接。
+// 本端 MR 信息随连接请求发出；remote 非 NULL 时从连接建立事件中取出服务端 MR 信息。
+// 失败时由调用者 rdma_connection_cleanup
+int rdma_client_connect(struct rdma_connection *conn, const char *ip, int port, const struct rdma_conn_opts *opts,
+                        size_t size, int access, struct rdma_mr_info *remote);
+
+// 按连接参数填充 rdma_connect/rdma_accept 使用的 conn_param。
+// initiator_depth/responder_resources 取 opts 上限、本端设备能力（max_qp_init_rd_atom/max_qp_rd_atom）
+// 和已知的对端限制中的最小值，结果记录在 conn->initiator_depth/responder_resources
+void rdma_fill_conn_param(struct rdma_connection *conn, struct rdma_conn_param *param);
+
+// 从 CM 事件取出对端的并发 RDMA Read/Atomic 限制（内核已换算为本端视角），需在 rdma_ack_cm_event 之前调用。
+// 服务端在 CONNECT_REQUEST 时调用（之后 rdma_fill_conn_param 会据此协商），
+// 客户端在 ESTABLISHED 时调用，把协商结果收紧到服务端接受的值
+void rdma_apply_peer_param(struct rdma_connection *conn, const struct rdma_cm_event *evt);
+
+// 把本端缓冲区的 MR 信息转换为网络字节序，用作 private_data
+void rdma_pack_mr_info(struct rdma_mr_info *wire, const void *addr, size_t length, const struct ibv_mr *mr);
+
+// 从 CM 事件的 private_data 中取出对端 MR 信息（主机字节序），长度不足返回 -1
+int rdma_unpack_mr_info(const struct rdma_cm_event *evt, struct rdma_mr_info *info);
+
+#endif // RDMA_COMMON_H
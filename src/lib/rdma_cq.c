@@ -0,0 +1,163 @@
+// rdma_cq.c
+// librdmademo: 完成队列轮询策略，见 rdma_cq.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "rdma_cq.h"
+#include "rdma_perf.h"
+
+#define CQ_SPIN_CHECK_MASK      1023    // 忙轮询时每 1024 次检查一次时钟
+
+// 确认已取出的完成事件
+void rdma_cq_ack_events(struct rdma_connection *conn) {
+    if (conn->cq_events) {
+        ibv_ack_cq_events(conn->cq, conn->cq_events);
+        conn->cq_events = 0;
+    }
+}
+
+// 单次非阻塞轮询
+static int poll_once(struct rdma_connection *conn, struct ibv_wc *wc, int max) {
+    int n = ibv_poll_cq(conn->cq, max, wc);
+    if (n < 0) {
+        fprintf(stderr, "ibv_poll_cq 失败\n");
+    }
+    return n;
+}
+
+// 忙轮询直到有完成、超过 spin_ns（0 表示不限）或到达 deadline（0 表示不限）
+static int spin_poll(struct rdma_connection *conn, struct ibv_wc *wc, int max,
+                     uint64_t spin_ns, uint64_t deadline) {
+    uint64_t start = rdma_now_ns();
+
+    for (uint64_t spins = 1; ; ++spins) {
+        int n = poll_once(conn, wc, max);
+        if (n != 0) {
+            return n;
+        }
+        if ((spins & CQ_SPIN_CHECK_MASK) == 0) {
+            uint64_t now = rdma_now_ns();
+            if ((spin_ns && now - start >= spin_ns) || (deadline && now >= deadline)) {
+                return 0;
+            }
+        }
+    }
+}
+
+// 事件驱动等待：武装 CQ，再次轮询以免漏掉武装前到达的完成，然后阻塞在完成通道上
+static int event_poll(struct rdma_connection *conn, struct ibv_wc *wc, int max, uint64_t deadline) {
+    struct ibv_cq *ev_cq = NULL;
+    void          *ev_ctx = NULL;
+    struct pollfd  pfd;
+
+    while (1) {
+        int n, wait_ms = -1;
+
+        if (!conn->cq_armed) {
+            if (ibv_req_notify_cq(conn->cq, 0)) {
+                fprintf(stderr, "ibv_req_notify_cq 失败\n");
+                return -1;
+            }
+            conn->cq_armed = 1;
+        }
+        n = poll_once(conn, wc, max);
+        if (n != 0) {
+            return n;
+        }
+
+        if (deadline) {
+            uint64_t now = rdma_now_ns();
+            if (now >= deadline) {
+                return 0;
+            }
+            wait_ms = (int)((deadline - now + 999999) / 1000000);
+        }
+        pfd.fd      = conn->comp_ch->fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        n = poll(&pfd, 1, wait_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "poll 完成通道失败\n");
+            return -1;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (ibv_get_cq_event(conn->comp_ch, &ev_cq, &ev_ctx)) {
+            fprintf(stderr, "ibv_get_cq_event 失败\n");
+            return -1;
+        }
+        // 事件触发后 CQ 自动解除武装，下一轮需要重新武装；事件确认有锁开销，批量进行
+        conn->cq_armed = 0;
+        if (++conn->cq_events >= CQ_EVENT_ACK_BATCH) {
+            rdma_cq_ack_events(conn);
+        }
+    }
+}
+
+// 按连接的轮询策略获取完成事件
+int rdma_cq_poll(struct rdma_connection *conn, struct ibv_wc *wc, int max, int timeout_ms) {
+    uint64_t deadline = 0;
+    int      n;
+
+    n = poll_once(conn, wc, max);
+    if (n != 0 || timeout_ms == 0) {
+        return n;
+    }
+    if (timeout_ms > 0) {
+        deadline = rdma_now_ns() + (uint64_t)timeout_ms * 1000000;
+    }
+
+    switch (conn->opts.poll_mode) {
+        case RDMA_POLL_EVENT:
+            return event_poll(conn, wc, max, deadline);
+        case RDMA_POLL_ADAPTIVE:
+            if (conn->opts.poll_spin_us > 0) {
+                n = spin_poll(conn, wc, max, (uint64_t)conn->opts.poll_spin_us * 1000, deadline);
+                if (n != 0 || (deadline && rdma_now_ns() >= deadline)) {
+                    return n;
+                }
+            }
+            return event_poll(conn, wc, max, deadline);
+        default:
+            return spin_poll(conn, wc, max, 0, deadline);
+    }
+}
+
+// 解析轮询策略
+int rdma_parse_poll_mode(const char *str, int *mode, int *spin_us) {
+    if (strcmp(str, "busy") == 0) {
+        *mode = RDMA_POLL_BUSY;
+    } else if (strcmp(str, "event") == 0) {
+        *mode = RDMA_POLL_EVENT;
+    } else if (strncmp(str, "adaptive", 8) == 0 && (str[8] == '\0' || str[8] == ':')) {
+        *mode = RDMA_POLL_ADAPTIVE;
+        if (str[8] == ':') {
+            *spin_us = atoi(str + 9);
+            if (*spin_us < 0) {
+                fprintf(stderr, "无效的忙轮询时长: %s\n", str + 9);
+                return -1;
+            }
+        }
+    } else {
+        fprintf(stderr, "无效的轮询策略: %s (可选 busy、event、adaptive[:<微秒>])\n", str);
+        return -1;
+    }
+    return 0;
+}
+
+// 轮询策略名称
+const char *rdma_poll_mode_name(int mode) {
+    switch (mode) {
+        case RDMA_POLL_EVENT:    return "event";
+        case RDMA_POLL_ADAPTIVE: return "adaptive";
+        default:                 return "busy";
+    }
+}
@@ -0,0 +1,33 @@
+// rdma_cq.h
+// librdmademo: 完成队列轮询策略。
+// build_qp 创建的 CQ 关联了完成通道 comp_ch，事件驱动模式下先 ibv_req_notify_cq 武装 CQ，
+// 再阻塞在完成通道上，被唤醒后 ibv_get_cq_event 取出事件并排空 CQ，需要时重新武装。
+// 策略由 rdma_conn_opts.poll_mode 选择：
+//   RDMA_POLL_BUSY      忙轮询，适合延迟敏感的热点连接
+//   RDMA_POLL_EVENT     事件驱动，适合大量空闲连接
+//   RDMA_POLL_ADAPTIVE  先忙轮询 poll_spin_us 微秒，超时后转为事件驱动
+
+#ifndef RDMA_CQ_H
+#define RDMA_CQ_H
+
+#include "rdma_common.h"
+
+#define CQ_EVENT_ACK_BATCH      16      // 累积多少个完成事件后批量 ibv_ack_cq_events
+#define CQ_CHECK_INTERVAL_MS    100     // 等待完成时检查对端断开的间隔（毫秒）
+
+// 按连接的轮询策略获取最多 max 个完成事件。
+// timeout_ms < 0 时一直等到有完成；timeout_ms == 0 时只轮询一次，不阻塞。
+// 返回取到的完成数，超时返回 0，出错返回 -1
+int rdma_cq_poll(struct rdma_connection *conn, struct ibv_wc *wc, int max, int timeout_ms);
+
+// 确认所有已取出的完成事件，销毁 CQ 前调用
+void rdma_cq_ack_events(struct rdma_connection *conn);
+
+// 解析轮询策略字符串："busy"、"event" 或 "adaptive[:<微秒>]"。
+// 未指定微秒数时 *spin_us 保持不变
+int rdma_parse_poll_mode(const char *str, int *mode, int *spin_us);
+
+// 轮询策略名称
+const char *rdma_poll_mode_name(int mode);
+
+#endif // RDMA_CQ_H
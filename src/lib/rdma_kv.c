@@ -0,0 +1,313 @@
+// rdma_kv.c
+// librdmademo: 可单边读取的键值表，见 rdma_kv.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdma_kv.h"
+#include "rdma_seqlock.h"
+
+// 值对象的内容上限：键 + 值
+static size_t kv_payload_max(const struct rdma_kv_hdr *hdr) {
+    return sizeof(uint64_t) + hdr->value_max;
+}
+
+// 键的候选桶：64 位混合函数（splitmix64 的末段）后，主桶取低 32 位、备用桶取高 32 位，两者相同时备用桶取相邻的桶
+uint32_t rdma_kv_bucket_of(uint64_t key, uint32_t nbuckets, int which) {
+    uint32_t primary, backup;
+
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    primary = (uint32_t)key & (nbuckets - 1);
+    if (!which) {
+        return primary;
+    }
+    backup = (uint32_t)(key >> 32) & (nbuckets - 1);
+    return backup != primary ? backup : primary ^ 1;
+}
+
+// 创建并注册表
+int rdma_kv_table_init(struct rdma_kv_table *t, struct ibv_pd *pd, uint32_t capacity, uint32_t value_max) {
+    struct rdma_kv_hdr *hdr;
+    uint32_t            nbuckets = 2;
+    size_t              obj_size, index_size;
+
+    memset(t, 0, sizeof(*t));
+    if (capacity == 0 || value_max == 0) {
+        fprintf(stderr, "键值表参数无效: 容量 %u，值上限 %u\n", capacity, value_max);
+        return -1;
+    }
+    while (nbuckets < (capacity + 1) / 2) {
+        nbuckets <<= 1;
+    }
+    obj_size   = rdma_seq_obj_size(sizeof(uint64_t) + value_max);
+    index_size = (size_t)nbuckets * KV_BUCKET_SIZE;
+    t->size    = sizeof(*hdr) + index_size + (size_t)capacity * obj_size;
+    if (posix_memalign((void **)&t->buf, 4096, t->size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        t->buf = NULL;
+        return -1;
+    }
+    memset(t->buf, 0, t->size);
+    hdr = (struct rdma_kv_hdr *)t->buf;
+    hdr->magic     = KV_MAGIC;
+    hdr->nbuckets  = nbuckets;
+    hdr->nslots    = capacity;
+    hdr->value_max = value_max;
+    hdr->obj_size  = obj_size;
+    hdr->index_off = sizeof(*hdr);
+    hdr->heap_off  = sizeof(*hdr) + index_size;
+    t->hdr   = hdr;
+    t->index = (struct rdma_kv_bucket *)(t->buf + hdr->index_off);
+    t->heap  = t->buf + hdr->heap_off;
+    pthread_mutex_init(&t->lock, NULL);
+    t->mr = ibv_reg_mr(pd, t->buf, t->size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!t->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        rdma_kv_table_destroy(t);
+        return -1;
+    }
+    return 0;
+}
+
+// 释放表
+void rdma_kv_table_destroy(struct rdma_kv_table *t) {
+    if (!t->buf) {
+        return;
+    }
+    if (t->mr) {
+        ibv_dereg_mr(t->mr);
+    }
+    pthread_mutex_destroy(&t->lock);
+    free(t->buf);
+    memset(t, 0, sizeof(*t));
+}
+
+// 依次在主桶、备用桶中查找键的条目，找不到时 *empty 为可插入的空条目（都满时为 NULL）。
+// 主桶有空条目时不再查备用桶，与客户端的查找规则一致。调用者持有锁
+static struct rdma_kv_entry *kv_lookup(struct rdma_kv_table *t, uint64_t key, struct rdma_kv_entry **empty) {
+    *empty = NULL;
+    for (int which = 0; which < 2 && !*empty; ++which) {
+        struct rdma_kv_entry *e = t->index[rdma_kv_bucket_of(key, t->hdr->nbuckets, which)].entries;
+
+        for (int i = 0; i < KV_BUCKET_ENTRIES; ++i) {
+            if (e[i].key == key) {
+                return &e[i];
+            }
+            // 条目从桶头开始连续使用，第一个空条目之后都是空的
+            if (e[i].key == 0) {
+                *empty = &e[i];
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 按 seqlock 顺序写值对象：内容为 [键][值]
+static void kv_write_value(struct rdma_kv_table *t, uint64_t slot, uint64_t key, const void *value, uint32_t len) {
+    char payload[sizeof(uint64_t) + len];
+
+    memcpy(payload, &key, sizeof(key));
+    memcpy(payload + sizeof(key), value, len);
+    rdma_seq_obj_write(t->heap + slot * t->hdr->obj_size, kv_payload_max(t->hdr), payload, sizeof(payload));
+}
+
+// 插入或更新
+int rdma_kv_put(struct rdma_kv_table *t, uint64_t key, const void *value, uint32_t len) {
+    struct rdma_kv_entry *e, *empty;
+    uint64_t              slot;
+    int                   ret = KV_OK;
+
+    if (key == 0 || len > t->hdr->value_max) {
+        return KV_INVALID;
+    }
+    pthread_mutex_lock(&t->lock);
+    e = kv_lookup(t, key, &empty);
+    if (e) {
+        kv_write_value(t, e->slot, key, value, len);
+    } else if (!empty || t->used >= t->hdr->nslots) {
+        ret = KV_FULL;
+    } else {
+        // 值对象和槽号都写好之后才发布键，客户端看到键时条目已经完整
+        slot = t->used++;
+        kv_write_value(t, slot, key, value, len);
+        empty->slot = slot;
+        __atomic_store_n(&empty->key, key, __ATOMIC_RELEASE);
+    }
+    if (ret == KV_OK) {
+        t->puts++;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
+
+// 服务端本地查找
+int rdma_kv_get_local(struct rdma_kv_table *t, uint64_t key, void *value, uint32_t *len) {
+    struct rdma_kv_entry      *e, *empty;
+    const struct rdma_seq_hdr *obj;
+    int                        ret = KV_NOT_FOUND;
+
+    pthread_mutex_lock(&t->lock);
+    t->gets++;
+    e = kv_lookup(t, key, &empty);
+    if (e) {
+        obj  = (const struct rdma_seq_hdr *)(t->heap + e->slot * t->hdr->obj_size);
+        *len = obj->len - sizeof(uint64_t);
+        memcpy(value, rdma_seq_obj_payload((void *)obj) + sizeof(uint64_t), *len);
+        ret = KV_OK;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return ret;
+}
+
+// 执行一个请求
+size_t rdma_kv_handle(struct rdma_kv_table *t, const struct rdma_kv_msg *req, struct rdma_kv_msg *resp) {
+    uint32_t op = req->op, len = req->len;
+    uint64_t id = req->id, key = req->key;
+
+    // resp 可能与 req 是同一块内存，先取出请求的字段
+    switch (op) {
+        case KV_OP_GET:
+            resp->status = rdma_kv_get_local(t, key, resp->value, &len);
+            break;
+        case KV_OP_PUT:
+            resp->status = rdma_kv_put(t, key, req->value, len);
+            len = 0;
+            break;
+        default:
+            resp->status = KV_INVALID;
+            break;
+    }
+    if (resp->status != KV_OK) {
+        len = 0;
+    }
+    resp->op  = op;
+    resp->id  = id;
+    resp->key = key;
+    resp->len = len;
+    return sizeof(*resp) + len;
+}
+
+// 同步读取远端 addr 处 len 字节到 local
+static int kv_read(struct rdma_kv_client *kc, uint64_t addr, void *local, uint32_t len) {
+    struct rdma_connection *conn = kc->conn;
+    struct ibv_sge          sge;
+    struct ibv_send_wr      wr, *bad_wr = NULL;
+    struct ibv_wc           wc;
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)local;
+    sge.length = len;
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list             = &sge;
+    wr.num_sge             = 1;
+    wr.opcode              = IBV_WR_RDMA_READ;
+    wr.send_flags          = IBV_SEND_SIGNALED;
+    wr.wr.rdma.remote_addr = addr;
+    wr.wr.rdma.rkey        = kc->rkey;
+    if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send (RDMA_READ) 失败\n");
+        return -1;
+    }
+    return rdma_wait_completion(conn, IBV_WC_RDMA_READ, &wc);
+}
+
+// 初始化客户端
+int rdma_kv_client_init(struct rdma_kv_client *kc, struct rdma_connection *conn, const struct rdma_mr_info *remote) {
+    struct rdma_kv_hdr *hdr = &kc->hdr;
+
+    memset(kc, 0, sizeof(*kc));
+    kc->conn = conn;
+    kc->base = remote->vaddr;
+    kc->rkey = remote->rkey;
+    if (conn->buf_size < sizeof(*hdr) || remote->length < sizeof(*hdr)) {
+        fprintf(stderr, "键值表客户端缓冲区或远端区域太小\n");
+        return -1;
+    }
+    if (kv_read(kc, kc->base, conn->buf, sizeof(*hdr))) {
+        return -1;
+    }
+    memcpy(hdr, conn->buf, sizeof(*hdr));
+    if (hdr->magic != KV_MAGIC || hdr->nbuckets == 0 || (hdr->nbuckets & (hdr->nbuckets - 1)) ||
+        hdr->heap_off + (uint64_t)hdr->nslots * hdr->obj_size > remote->length) {
+        fprintf(stderr, "远端不是有效的键值表\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 在读到的桶中查找键
+int rdma_kv_find(const struct rdma_kv_client *kc, const void *bucket, uint64_t key, uint64_t *slot) {
+    const struct rdma_kv_entry *e = bucket;
+
+    for (int i = 0; i < KV_BUCKET_ENTRIES; ++i) {
+        if (e[i].key == key && e[i].slot < kc->hdr.nslots) {
+            *slot = e[i].slot;
+            return KV_FIND_HIT;
+        }
+        if (e[i].key == 0) {
+            return KV_FIND_MISS;
+        }
+    }
+    return KV_FIND_NEXT;
+}
+
+// 检查读到的值对象
+int rdma_kv_check_value(const struct rdma_kv_client *kc, const void *obj, uint64_t key,
+                        const char **value, uint32_t *len) {
+    const struct rdma_seq_hdr *hdr = obj;
+    const char                *payload = rdma_seq_obj_payload((void *)obj);
+    uint64_t                   version, obj_key;
+
+    if (rdma_seq_obj_check(obj, kv_payload_max(&kc->hdr), 0, &version) != SEQ_OK) {
+        return KV_READ_VALUE;
+    }
+    memcpy(&obj_key, payload, sizeof(obj_key));
+    if (obj_key != key || hdr->len < sizeof(uint64_t) || hdr->len > kv_payload_max(&kc->hdr)) {
+        return KV_READ_INDEX;
+    }
+    *value = payload + sizeof(uint64_t);
+    *len   = hdr->len - sizeof(uint64_t);
+    return KV_READ_OK;
+}
+
+// 同步单边 GET
+int rdma_kv_get(struct rdma_kv_client *kc, uint64_t key, char *local, const char **value, uint32_t *len) {
+    uint64_t slot;
+    int      read_index = 1, found;
+
+    for (int i = 0; i <= KV_MAX_RETRIES; ++i) {
+        if (i > 0) {
+            kc->retries++;
+        }
+        for (int which = 0; read_index && which < 2; ++which) {
+            kc->index_reads++;
+            if (kv_read(kc, rdma_kv_bucket_addr(kc, key, which), local, KV_BUCKET_SIZE)) {
+                return -1;
+            }
+            found = rdma_kv_find(kc, local, key, &slot);
+            if (found == KV_FIND_HIT) {
+                read_index = 0;
+            } else if (found == KV_FIND_MISS || which == 1) {
+                return KV_NOT_FOUND;
+            }
+        }
+        kc->value_reads++;
+        if (kv_read(kc, rdma_kv_value_addr(kc, slot), local, kc->hdr.obj_size)) {
+            return -1;
+        }
+        switch (rdma_kv_check_value(kc, local, key, value, len)) {
+            case KV_READ_OK:    return KV_OK;
+            case KV_READ_VALUE: read_index = 0; break;
+            default:            read_index = 1; break;
+        }
+    }
+    fprintf(stderr, "键 %lu 重读 %d 次仍不一致\n", key, KV_MAX_RETRIES);
+    return -1;
+}
@@ -0,0 +1,160 @@
+// rdma_kv.h
+// librdmademo: 可单边读取的键值表。
+// 服务端把整张表注册为一个 MR，布局为：
+//   [表头 64 字节][索引: nbuckets 个 128 字节的桶][值堆: nslots 个带版本对象（见 rdma_seqlock.h）]
+// 每个桶 8 个条目 {键:8, 值槽号:8}，键 0 保留，表示空条目。每个键有两个由独立哈希决定的候选桶，
+// 插入时优先放进主桶，主桶满了才放进备用桶。不支持删除，桶满后一直是满的，所以主桶还有空条目时键一定不在备用桶中：
+// 客户端一个 RDMA Read 读主桶，再一个 RDMA Read 读值对象，GET 通常共两次单边读取，服务端 CPU 不参与；
+// 主桶已满且没有该键时才需要多读一次备用桶。
+// 值对象的内容为 [键:8][值]。写者只有服务端 CPU（表内加锁）：插入先写好值对象，再写条目的槽号，最后写键；
+// 更新在原值对象上按 seqlock 顺序写入，条目不变。不支持删除，条目发布后不再改变。
+// 客户端读到的值对象不一致时重读值对象，其中的键与条目不符（读到了正在发布的条目）时重读索引。
+// PUT 以及作为对照的双边 GET 以 struct rdma_kv_msg 经 Send/Recv 发给服务端，由 rdma_kv_handle 执行。
+// 表头、条目和消息都是主机字节序，两端需为相同字节序的机器。
+
+#ifndef RDMA_KV_H
+#define RDMA_KV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "rdma_common.h"
+
+#define KV_MAGIC                0x4b56544142ULL     // "KVTAB"
+#define KV_BUCKET_SIZE          128                 // 桶大小，两个缓存行，一次 RDMA Read 读取
+#define KV_BUCKET_ENTRIES       8
+#define KV_DEFAULT_VALUE_MAX    64                  // 默认的值长度上限
+#define KV_MAX_RETRIES          1000                // 单边 GET 的最大重读次数
+
+// 消息类型
+enum {
+    KV_OP_GET = 1,
+    KV_OP_PUT,
+};
+
+// 操作结果
+enum {
+    KV_OK = 0,
+    KV_NOT_FOUND,       // 键不存在
+    KV_FULL,            // 值堆已满或两个候选桶都已满
+    KV_INVALID,         // 键为 0、值超长或未知的消息类型
+};
+
+// 客户端在读到的桶中查找的结果
+enum {
+    KV_FIND_HIT = 0,    // 找到
+    KV_FIND_MISS,       // 桶中有空条目而没有该键，键不存在
+    KV_FIND_NEXT,       // 桶已满而没有该键，读主桶时应再读备用桶
+};
+
+// 客户端检查读到的值对象的结果
+enum {
+    KV_READ_OK = 0,
+    KV_READ_VALUE,      // 值对象不一致，重读值对象
+    KV_READ_INDEX,      // 值对象中的键不符，重读索引
+};
+
+// 表头，位于 MR 起始处
+struct rdma_kv_hdr {
+    uint64_t        magic;
+    uint32_t        nbuckets;       // 桶数（2 的幂，至少 2）
+    uint32_t        nslots;         // 值堆的对象数
+    uint32_t        value_max;      // 值长度上限
+    uint32_t        obj_size;       // 值对象大小
+    uint64_t        index_off;      // 索引相对表头的偏移
+    uint64_t        heap_off;       // 值堆相对表头的偏移
+    char            pad[24];
+};
+
+struct rdma_kv_entry {
+    uint64_t        key;            // 0 表示空条目
+    uint64_t        slot;           // 值对象序号
+};
+
+struct rdma_kv_bucket {
+    struct rdma_kv_entry entries[KV_BUCKET_ENTRIES];
+};
+
+// 请求和响应消息，值紧随其后
+struct rdma_kv_msg {
+    uint32_t        op;             // KV_OP_*
+    uint32_t        status;         // 响应的 KV_OK 等
+    uint64_t        id;             // 请求编号，响应原样带回
+    uint64_t        key;
+    uint32_t        len;            // 值长度
+    uint32_t        reserved;
+    char            value[];
+};
+
+#define KV_MSG_SIZE(value_max)  (sizeof(struct rdma_kv_msg) + (value_max))
+
+// 服务端的表
+struct rdma_kv_table {
+    char                   *buf;            // 整张表，4K 对齐
+    size_t                  size;
+    struct ibv_mr          *mr;
+    struct rdma_kv_hdr     *hdr;
+    struct rdma_kv_bucket  *index;
+    char                   *heap;
+    uint32_t                used;           // 已分配的值对象数
+    uint64_t                puts;           // 执行的 PUT 数
+    uint64_t                gets;           // 执行的双边 GET 数
+    pthread_mutex_t         lock;           // 串行化写者和双边 GET
+};
+
+// 单边读取的客户端
+struct rdma_kv_client {
+    struct rdma_connection *conn;
+    uint64_t                base;           // 远端表头地址
+    uint32_t                rkey;
+    struct rdma_kv_hdr      hdr;            // 表头的本地副本
+    uint64_t                index_reads;    // 读桶次数
+    uint64_t                value_reads;    // 读值对象次数
+    uint64_t                retries;        // 因不一致而重读的次数
+};
+
+// 在 pd 上创建并注册最多容纳 capacity 个键、值不超过 value_max 字节的表，远端可读。
+// 桶数取不小于 capacity / 2 的 2 的幂，条目装载率不超过 25%，主桶满的概率很小
+int rdma_kv_table_init(struct rdma_kv_table *t, struct ibv_pd *pd, uint32_t capacity, uint32_t value_max);
+
+// 注销并释放表，应在 PD 释放之前调用
+void rdma_kv_table_destroy(struct rdma_kv_table *t);
+
+// 插入或更新，返回 KV_OK/KV_FULL/KV_INVALID
+int rdma_kv_put(struct rdma_kv_table *t, uint64_t key, const void *value, uint32_t len);
+
+// 在服务端本地查找，值拷贝到 value（至少 value_max 字节），返回 KV_OK/KV_NOT_FOUND
+int rdma_kv_get_local(struct rdma_kv_table *t, uint64_t key, void *value, uint32_t *len);
+
+// 执行一个请求，把响应写入 resp（可与 req 相同，至少 KV_MSG_SIZE(value_max) 字节），返回响应长度
+size_t rdma_kv_handle(struct rdma_kv_table *t, const struct rdma_kv_msg *req, struct rdma_kv_msg *resp);
+
+// 键的主桶（which 为 0）或备用桶（which 为 1）
+uint32_t rdma_kv_bucket_of(uint64_t key, uint32_t nbuckets, int which);
+
+// 在已连接的 conn 上初始化客户端：用一个 RDMA Read 把表头读到 conn->buf 并校验。remote 为表的 MR 信息（主机字节序）
+int rdma_kv_client_init(struct rdma_kv_client *kc, struct rdma_connection *conn, const struct rdma_mr_info *remote);
+
+// 键的主桶或备用桶的地址，从这里读 KV_BUCKET_SIZE 字节
+static inline uint64_t rdma_kv_bucket_addr(const struct rdma_kv_client *kc, uint64_t key, int which) {
+    return kc->base + kc->hdr.index_off + (uint64_t)rdma_kv_bucket_of(key, kc->hdr.nbuckets, which) * KV_BUCKET_SIZE;
+}
+
+// 第 slot 个值对象的地址，从这里读 hdr.obj_size 字节
+static inline uint64_t rdma_kv_value_addr(const struct rdma_kv_client *kc, uint64_t slot) {
+    return kc->base + kc->hdr.heap_off + slot * kc->hdr.obj_size;
+}
+
+// 在读到的桶中查找键，返回 KV_FIND_*；KV_FIND_HIT 时给出值对象序号
+int rdma_kv_find(const struct rdma_kv_client *kc, const void *bucket, uint64_t key, uint64_t *slot);
+
+// 检查读到的值对象，返回 KV_READ_*；KV_READ_OK 时 *value/*len 指向对象中的值
+int rdma_kv_check_value(const struct rdma_kv_client *kc, const void *obj, uint64_t key,
+                        const char **value, uint32_t *len);
+
+// 同步单边 GET：依次 RDMA Read 桶和值对象到 local（位于 conn->buf 内，至少 KV_BUCKET_SIZE 和 obj_size 中较大者），
+// 不一致时重读。返回 KV_OK（*value/*len 指向 local 中的值）、KV_NOT_FOUND，出错或重读次数超过 KV_MAX_RETRIES 返回 -1
+int rdma_kv_get(struct rdma_kv_client *kc, uint64_t key, char *local, const char **value, uint32_t *len);
+
+#endif // RDMA_KV_H
@@ -0,0 +1,178 @@
+// rdma_lock.c
+// librdmademo: 基于 RDMA Compare and Swap 的远端锁表客户端，见 rdma_lock.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdma_lock.h"
+#include "rdma_perf.h"
+
+// 同步执行一个原子操作，取回远端原值
+static int lock_atomic(struct rdma_lock_client *lc, enum ibv_wr_opcode opcode, uint64_t addr,
+                       uint64_t compare_add, uint64_t swap, uint64_t *old_value) {
+    struct rdma_connection *conn = lc->conn;
+    struct ibv_sge          sge;
+    struct ibv_send_wr      wr, *bad_wr = NULL;
+    struct ibv_wc           wc;
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)conn->buf;
+    sge.length = sizeof(uint64_t);
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list               = &sge;
+    wr.num_sge               = 1;
+    wr.opcode                = opcode;
+    wr.send_flags            = IBV_SEND_SIGNALED;
+    wr.wr.atomic.remote_addr = addr;
+    wr.wr.atomic.rkey        = lc->rkey;
+    wr.wr.atomic.compare_add = compare_add;
+    wr.wr.atomic.swap        = swap;
+    if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send (ATOMIC) 失败\n");
+        return -1;
+    }
+    if (rdma_wait_completion(conn, opcode == IBV_WR_ATOMIC_CMP_AND_SWP ? IBV_WC_COMP_SWAP : IBV_WC_FETCH_ADD,
+                             &wc)) {
+        return -1;
+    }
+    *old_value = *(volatile uint64_t *)conn->buf;
+    return 0;
+}
+
+// 用 CAS 把锁字从 expect 换成 desired，成功返回 1，失败返回 0 并在 *cur 中给出当前值
+static int lock_cas(struct rdma_lock_client *lc, uint32_t idx, uint64_t expect, uint64_t desired, uint64_t *cur) {
+    if (lock_atomic(lc, IBV_WR_ATOMIC_CMP_AND_SWP, rdma_lock_addr(lc, idx), expect, desired, cur)) {
+        return -1;
+    }
+    lc->cas_ops++;
+    return *cur == expect;
+}
+
+// 本客户端的下一个锁字，序号跳过 0，保证锁字非 0
+static uint64_t lock_next_word(struct rdma_lock_client *lc) {
+    if (++lc->seq == 0) {
+        lc->seq = 1;
+    }
+    return RDMA_LOCK_WORD(lc->owner, lc->lease_ms, lc->seq);
+}
+
+// 初始化锁表客户端
+int rdma_lock_client_init(struct rdma_lock_client *lc, struct rdma_connection *conn,
+                          const struct rdma_mr_info *remote, size_t stride, uint32_t lease_ms) {
+    uint64_t id;
+
+    memset(lc, 0, sizeof(*lc));
+    if (stride < sizeof(uint64_t) || stride % sizeof(uint64_t) || remote->length / stride < 2) {
+        fprintf(stderr, "锁表参数无效: %u 字节，槽大小 %zu\n", remote->length, stride);
+        return -1;
+    }
+    if (conn->buf_size < sizeof(uint64_t)) {
+        fprintf(stderr, "锁表客户端缓冲区太小: %zu 字节\n", conn->buf_size);
+        return -1;
+    }
+    lc->conn     = conn;
+    lc->table    = remote->vaddr;
+    lc->rkey     = remote->rkey;
+    lc->nlocks   = remote->length / stride - 1;
+    lc->stride   = stride;
+    lc->lease_ms = lease_ms == 0 ? LOCK_DEFAULT_LEASE_MS
+                                 : (lease_ms > LOCK_MAX_LEASE_MS ? LOCK_MAX_LEASE_MS : lease_ms);
+    // 从分配器取得属主编号，编号 0 保留
+    if (lock_atomic(lc, IBV_WR_ATOMIC_FETCH_AND_ADD, lc->table, 1, 0, &id)) {
+        return -1;
+    }
+    lc->owner = (uint16_t)(id % 0xffff + 1);
+    lc->seed  = (unsigned int)(rdma_now_ns() ^ lc->owner);
+    return 0;
+}
+
+// 尝试加锁一次
+int rdma_lock_try(struct rdma_lock_client *lc, uint32_t idx, uint64_t *held) {
+    uint64_t word = lock_next_word(lc);
+    int      ret;
+
+    if (idx >= lc->nlocks) {
+        fprintf(stderr, "锁编号 %u 超出范围 (共 %u 个)\n", idx, lc->nlocks);
+        return -1;
+    }
+    ret = lock_cas(lc, idx, 0, word, held);
+    if (ret == 1) {
+        *held = word;
+    } else if (ret == 0) {
+        lc->busy++;
+    }
+    return ret;
+}
+
+// 加锁
+int rdma_lock_acquire(struct rdma_lock_client *lc, uint32_t idx, uint64_t *held) {
+    uint64_t cur, seen = 0, seen_ns = 0, backoff = LOCK_BACKOFF_MIN_NS, until;
+    int      ret;
+
+    for (;;) {
+        ret = rdma_lock_try(lc, idx, &cur);
+        if (ret != 0) {
+            *held = cur;
+            return ret < 0 ? -1 : 0;
+        }
+        // 以本端时钟计算同一个锁字保持不变的时长，超过其中的租约即抢占
+        if (cur != seen) {
+            seen    = cur;
+            seen_ns = rdma_now_ns();
+        } else if (rdma_now_ns() - seen_ns > (uint64_t)RDMA_LOCK_LEASE_MS(cur) * 1000000) {
+            uint64_t word = lock_next_word(lc);
+
+            ret = lock_cas(lc, idx, cur, word, &cur);
+            if (ret < 0) {
+                return -1;
+            }
+            if (ret == 1) {
+                lc->steals++;
+                *held = word;
+                return 0;
+            }
+        }
+        // 随机指数退避，避免所有等待者同时重试
+        until = rdma_now_ns() + rand_r(&lc->seed) % backoff;
+        while (rdma_now_ns() < until) {
+        }
+        if (backoff < LOCK_BACKOFF_MAX_NS) {
+            backoff *= 2;
+        }
+    }
+}
+
+// 续约
+int rdma_lock_renew(struct rdma_lock_client *lc, uint32_t idx, uint64_t *held) {
+    uint64_t word = lock_next_word(lc), cur;
+    int      ret;
+
+    ret = lock_cas(lc, idx, *held, word, &cur);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret == 0) {
+        lc->lost++;
+        return 1;
+    }
+    *held = word;
+    return 0;
+}
+
+// 解锁
+int rdma_lock_release(struct rdma_lock_client *lc, uint32_t idx, uint64_t held) {
+    uint64_t cur;
+    int      ret;
+
+    ret = lock_cas(lc, idx, held, 0, &cur);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret == 0) {
+        lc->lost++;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// rdma_lock.h
+// librdmademo: 基于 RDMA Compare and Swap 的远端锁表客户端。
+// 锁表是服务端一块支持远端原子操作的注册内存，按 stride 字节分槽：第 0 个槽的首字是属主编号分配器，
+// 第 i 个锁（从 0 开始）位于第 i + 1 个槽，锁字在槽首，槽内其余字节可存放受该锁保护的数据。
+// 锁字为 0 表示空闲，否则为 {属主编号:16, 租约毫秒数:16, 序号:32}：
+// 属主编号在 rdma_lock_client_init 时对分配器做 Fetch and Add 取得（超过 65535 个客户端后回绕），
+// 序号每次加锁或续约递增，因此每次持有的锁字都不同。
+// 租约不依赖两端时钟同步：等待者看到同一个锁字持续超过其中记录的租约时长，就认为持有者已失效，
+// 用 CAS 把这个锁字换成自己的（抢占）；持有者用 rdma_lock_renew 换一个新序号来续约，
+// 解锁时 CAS 失败说明锁已被抢占。
+// 所有操作都在连接上同步执行，使用 conn->buf 的前 8 字节接收原值；客户端不是线程安全的。
+
+#ifndef RDMA_LOCK_H
+#define RDMA_LOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rdma_common.h"
+
+#define LOCK_DEFAULT_LEASE_MS   100     // 默认租约时长（毫秒）
+#define LOCK_MAX_LEASE_MS       0xffff
+#define LOCK_BACKOFF_MIN_NS     1000    // 加锁失败后退避时长的初始上限
+#define LOCK_BACKOFF_MAX_NS     100000  // 退避时长上限
+
+// 锁字编码
+#define RDMA_LOCK_WORD(owner, lease_ms, seq) \
+    (((uint64_t)(owner) << 48) | ((uint64_t)((lease_ms) & 0xffff) << 32) | (uint32_t)(seq))
+#define RDMA_LOCK_OWNER(word)       ((uint16_t)((word) >> 48))
+#define RDMA_LOCK_LEASE_MS(word)    ((uint32_t)((word) >> 32) & 0xffff)
+#define RDMA_LOCK_SEQ(word)         ((uint32_t)(word))
+
+struct rdma_lock_client {
+    struct rdma_connection *conn;
+    uint64_t                table;          // 远端锁表地址
+    uint32_t                rkey;
+    uint32_t                nlocks;         // 锁数（不含分配器槽）
+    size_t                  stride;         // 槽大小
+    uint16_t                owner;          // 本客户端的属主编号，非 0
+    uint32_t                lease_ms;       // 加锁时写入锁字的租约时长
+    uint32_t                seq;            // 最近一次使用的序号
+    unsigned int            seed;           // 退避随机数种子
+    uint64_t                cas_ops;        // 执行的 CAS 数
+    uint64_t                busy;           // 因锁被占用而失败的 CAS 数
+    uint64_t                steals;         // 抢占租约过期的锁的次数
+    uint64_t                lost;           // 续约或解锁时发现锁已被抢占的次数
+};
+
+// 在已连接的 conn 上初始化锁表客户端。remote 为锁表的 MR 信息（主机字节序），
+// 至少 2 个槽；conn->buf 至少 8 字节。lease_ms 为 0 时使用 LOCK_DEFAULT_LEASE_MS
+int rdma_lock_client_init(struct rdma_lock_client *lc, struct rdma_connection *conn,
+                          const struct rdma_mr_info *remote, size_t stride, uint32_t lease_ms);
+
+// 第 idx 个锁的锁字地址，受保护的数据从其后 8 字节开始
+static inline uint64_t rdma_lock_addr(const struct rdma_lock_client *lc, uint32_t idx) {
+    return lc->table + (uint64_t)(idx + 1) * lc->stride;
+}
+
+// 尝试加锁一次。成功返回 1，*held 为本次持有的锁字；锁被占用返回 0，*held 为当前锁字；出错返回 -1
+int rdma_lock_try(struct rdma_lock_client *lc, uint32_t idx, uint64_t *held);
+
+// 加锁，失败时随机指数退避后重试，锁字超过租约未变化时抢占。成功返回 0，出错返回 -1
+int rdma_lock_acquire(struct rdma_lock_client *lc, uint32_t idx, uint64_t *held);
+
+// 续约：把 *held 换成新序号的锁字。成功返回 0，锁已被抢占返回 1，出错返回 -1
+int rdma_lock_renew(struct rdma_lock_client *lc, uint32_t idx, uint64_t *held);
+
+// 解锁。成功返回 0，锁已被抢占返回 1（此时不修改锁字），出错返回 -1
+int rdma_lock_release(struct rdma_lock_client *lc, uint32_t idx, uint64_t held);
+
+#endif // RDMA_LOCK_H
@@ -0,0 +1,174 @@
+// rdma_mem_pool.c
+// librdmademo: 大页注册内存池，见 rdma_mem_pool.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "rdma_mem_pool.h"
+#include "rdma_perf.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT  26
+#endif
+
+static const char *region_kind_name(int kind) {
+    return kind == MEM_POOL_HUGETLB ? "hugetlb" : "thp";
+}
+
+// 申请一块 size 字节、按 huge_page 对齐的内存
+static char *region_map(size_t size, size_t huge_page, int *kind) {
+    int     shift = huge_page == MEM_POOL_HUGE_1G ? 30 : 21;
+    char   *p, *aligned;
+    size_t  head;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+    if (p != MAP_FAILED) {
+        *kind = MEM_POOL_HUGETLB;
+        return p;
+    }
+    // 没有预留该大小的大页：多映射一个大页用来对齐，再把首尾多余部分还回去
+    p = mmap(NULL, size + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "mmap %zu 字节失败: %s\n", size, strerror(errno));
+        return NULL;
+    }
+    aligned = (char *)(((uintptr_t)p + huge_page - 1) & ~(uintptr_t)(huge_page - 1));
+    head    = aligned - p;
+    if (head) {
+        munmap(p, head);
+    }
+    if (huge_page - head) {
+        munmap(aligned + size, huge_page - head);
+    }
+    if (madvise(aligned, size, MADV_HUGEPAGE)) {
+        // 内核未开启透明大页时仍可使用，只是退化为 4K 页
+        fprintf(stderr, "madvise(MADV_HUGEPAGE) 失败: %s\n", strerror(errno));
+    }
+    *kind = MEM_POOL_THP;
+    return aligned;
+}
+
+// 申请并注册一个新区域，槽号压入空闲栈。调用者持有锁
+static int pool_grow(struct rdma_mem_pool *pool) {
+    struct rdma_mem_region *r;
+    uint32_t               *slots;
+    uint64_t                t0;
+    int                     first;
+
+    if (pool->nregions >= MEM_POOL_MAX_REGIONS) {
+        fprintf(stderr, "内存池区域数已达上限 %d\n", MEM_POOL_MAX_REGIONS);
+        return -1;
+    }
+    first = pool->nregions * pool->slots_per_region;
+    slots = realloc(pool->free_slots, sizeof(*slots) * (first + pool->slots_per_region));
+    if (!slots) {
+        fprintf(stderr, "分配空闲槽表失败\n");
+        return -1;
+    }
+    pool->free_slots = slots;
+
+    r = &pool->regions[pool->nregions];
+    r->size = pool->region_size;
+    r->base = region_map(r->size, pool->huge_page, &r->kind);
+    if (!r->base) {
+        return -1;
+    }
+    // 先写一遍让页面就位，透明大页此时才会真正分配
+    memset(r->base, 0, r->size);
+    t0 = rdma_now_ns();
+    r->mr = ibv_reg_mr(pool->pd, r->base, r->size, pool->access);
+    if (!r->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败 (%zu 字节)\n", r->size);
+        munmap(r->base, r->size);
+        r->base = NULL;
+        return -1;
+    }
+    pool->reg_ns += rdma_now_ns() - t0;
+    pool->nregions++;
+    // 倒序压栈，先分配低地址的槽
+    for (int i = pool->slots_per_region - 1; i >= 0; --i) {
+        pool->free_slots[pool->nfree++] = first + i;
+    }
+    return 0;
+}
+
+// 初始化内存池
+int rdma_mem_pool_init(struct rdma_mem_pool *pool, struct ibv_pd *pd, size_t slot_size, int nslots,
+                       size_t huge_page, int access) {
+    size_t want;
+
+    memset(pool, 0, sizeof(*pool));
+    if (huge_page != MEM_POOL_HUGE_1G) {
+        huge_page = MEM_POOL_HUGE_2M;
+    }
+    pool->pd        = pd;
+    pool->access    = access;
+    pool->slot_size = (slot_size + 63) & ~(size_t)63;
+    pool->huge_page = huge_page;
+    want = pool->slot_size * (nslots > 0 ? nslots : 1);
+    if (want < MEM_POOL_REGION_SIZE) {
+        want = MEM_POOL_REGION_SIZE;
+    }
+    pool->region_size      = (want + huge_page - 1) & ~(huge_page - 1);
+    pool->slots_per_region = pool->region_size / pool->slot_size;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool_grow(pool);
+}
+
+// 分配一个槽
+int rdma_mem_pool_get(struct rdma_mem_pool *pool, struct rdma_mem_buf *buf) {
+    struct rdma_mem_region *r;
+    uint32_t                idx;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->nfree == 0 && pool_grow(pool)) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    idx = pool->free_slots[--pool->nfree];
+    pthread_mutex_unlock(&pool->lock);
+
+    r = &pool->regions[idx / pool->slots_per_region];
+    buf->addr  = r->base + (size_t)(idx % pool->slots_per_region) * pool->slot_size;
+    buf->size  = pool->slot_size;
+    buf->lkey  = r->mr->lkey;
+    buf->rkey  = r->mr->rkey;
+    buf->index = idx;
+    return 0;
+}
+
+// 归还槽
+void rdma_mem_pool_put(struct rdma_mem_pool *pool, const struct rdma_mem_buf *buf) {
+    pthread_mutex_lock(&pool->lock);
+    pool->free_slots[pool->nfree++] = buf->index;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// 打印统计
+void rdma_mem_pool_report(struct rdma_mem_pool *pool) {
+    int total = pool->nregions * pool->slots_per_region;
+
+    printf("内存池: %d 个 %zuM 区域 (%zuM 大页", pool->nregions, pool->region_size >> 20, pool->huge_page >> 20);
+    for (int i = 0; i < pool->nregions; ++i) {
+        printf("%s%s", i ? "/" : "，", region_kind_name(pool->regions[i].kind));
+    }
+    printf(")，%d 个 %zu 字节槽，已用 %d，注册耗时 %.2f ms\n",
+           total, pool->slot_size, total - pool->nfree, pool->reg_ns / 1e6);
+}
+
+// 释放内存池
+void rdma_mem_pool_destroy(struct rdma_mem_pool *pool) {
+    for (int i = 0; i < pool->nregions; ++i) {
+        struct rdma_mem_region *r = &pool->regions[i];
+
+        if (r->mr)   ibv_dereg_mr(r->mr);
+        if (r->base) munmap(r->base, r->size);
+    }
+    free(pool->free_slots);
+    pthread_mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(*pool));
+}
@@ -0,0 +1,78 @@
+// rdma_mem_pool.h
+// librdmademo: 大页注册内存池。
+// 每个连接各自 posix_memalign + ibv_reg_mr 时，MR 数量随连接线性增长，4K 页的 MR 在 HCA 上占用大量
+// MTT（地址转换表）项，注册时间也按页数增长；服务端暴露几个 GB 时这会成为瓶颈。
+// 内存池以大页区域为单位申请内存：优先 mmap(MAP_HUGETLB) 取 2M 或 1G 大页，
+// 没有预留大页时退回普通匿名内存并 madvise(MADV_HUGEPAGE) 请求透明大页。
+// 每个区域只注册一次，再切成固定大小的槽，分配出的槽带上所在区域的 lkey/rkey。
+// 槽用完时自动再申请一个区域，最多 MEM_POOL_MAX_REGIONS 个。分配和归还线程安全。
+
+#ifndef RDMA_MEM_POOL_H
+#define RDMA_MEM_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <infiniband/verbs.h>
+
+#define MEM_POOL_HUGE_2M        (2UL << 20)
+#define MEM_POOL_HUGE_1G        (1UL << 30)
+#define MEM_POOL_REGION_SIZE    (64UL << 20)    // 每个区域的最小大小，向上取整到大页大小
+#define MEM_POOL_MAX_REGIONS    64
+
+// 区域的内存来源
+enum {
+    MEM_POOL_HUGETLB = 0,       // MAP_HUGETLB 预留大页
+    MEM_POOL_THP,               // 普通匿名内存 + 透明大页
+};
+
+// 一个注册区域
+struct rdma_mem_region {
+    char           *base;
+    size_t          size;
+    struct ibv_mr  *mr;
+    int             kind;           // MEM_POOL_HUGETLB / MEM_POOL_THP
+};
+
+// 分配出的一个槽
+struct rdma_mem_buf {
+    char           *addr;
+    size_t          size;           // 槽大小
+    uint32_t        lkey;
+    uint32_t        rkey;
+    uint32_t        index;          // 槽号，归还时使用
+};
+
+struct rdma_mem_pool {
+    struct ibv_pd          *pd;
+    int                     access;         // 注册权限
+    size_t                  slot_size;      // 槽大小，按 64 字节对齐
+    size_t                  huge_page;      // 大页大小 MEM_POOL_HUGE_2M / MEM_POOL_HUGE_1G
+    size_t                  region_size;    // 每个区域的大小，为大页大小的整数倍
+    int                     slots_per_region;
+    int                     nregions;
+    struct rdma_mem_region  regions[MEM_POOL_MAX_REGIONS];
+    pthread_mutex_t         lock;
+    uint32_t               *free_slots;     // 空闲槽号栈
+    int                     nfree;
+    uint64_t                reg_ns;         // 注册全部区域的累计耗时
+};
+
+// 初始化内存池并申请第一个区域，至少容纳 nslots 个 slot_size 字节的槽。
+// huge_page 为 0 时使用 MEM_POOL_HUGE_2M
+int rdma_mem_pool_init(struct rdma_mem_pool *pool, struct ibv_pd *pd, size_t slot_size, int nslots,
+                       size_t huge_page, int access);
+
+// 分配一个槽（内容未清零），没有空闲槽时申请新区域，失败返回 -1
+int rdma_mem_pool_get(struct rdma_mem_pool *pool, struct rdma_mem_buf *buf);
+
+// 归还槽
+void rdma_mem_pool_put(struct rdma_mem_pool *pool, const struct rdma_mem_buf *buf);
+
+// 打印区域来源、槽数和注册耗时
+void rdma_mem_pool_report(struct rdma_mem_pool *pool);
+
+// 注销并释放所有区域
+void rdma_mem_pool_destroy(struct rdma_mem_pool *pool);
+
+#endif // RDMA_MEM_POOL_H
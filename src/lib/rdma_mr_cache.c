@@ -0,0 +1,313 @@
+// rdma_mr_cache.c
+// librdmademo: 内存注册缓存，见 rdma_mr_cache.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rdma_mr_cache.h"
+
+static uintptr_t page_size(void) {
+    static uintptr_t ps;
+
+    if (!ps) {
+        long n = sysconf(_SC_PAGESIZE);
+        ps = n > 0 ? (uintptr_t)n : 4096;
+    }
+    return ps;
+}
+
+// =================== 区间树（treap） ===================
+// 按 (start, 节点地址) 排序，每个节点维护子树最大 end，用于剪枝
+
+static void tree_update(struct rdma_mr_entry *e) {
+    e->max_end = e->end;
+    if (e->left && e->left->max_end > e->max_end)   e->max_end = e->left->max_end;
+    if (e->right && e->right->max_end > e->max_end) e->max_end = e->right->max_end;
+}
+
+static int tree_less(const struct rdma_mr_entry *a, const struct rdma_mr_entry *b) {
+    return a->start < b->start || (a->start == b->start && a < b);
+}
+
+static struct rdma_mr_entry *rotate_right(struct rdma_mr_entry *t) {
+    struct rdma_mr_entry *l = t->left;
+
+    t->left  = l->right;
+    l->right = t;
+    tree_update(t);
+    tree_update(l);
+    return l;
+}
+
+static struct rdma_mr_entry *rotate_left(struct rdma_mr_entry *t) {
+    struct rdma_mr_entry *r = t->right;
+
+    t->right = r->left;
+    r->left  = t;
+    tree_update(t);
+    tree_update(r);
+    return r;
+}
+
+static struct rdma_mr_entry *tree_insert(struct rdma_mr_entry *t, struct rdma_mr_entry *e) {
+    if (!t) {
+        e->left = e->right = NULL;
+        tree_update(e);
+        return e;
+    }
+    if (tree_less(e, t)) {
+        t->left = tree_insert(t->left, e);
+        if (t->left->prio > t->prio) {
+            t = rotate_right(t);
+        }
+    } else {
+        t->right = tree_insert(t->right, e);
+        if (t->right->prio > t->prio) {
+            t = rotate_left(t);
+        }
+    }
+    tree_update(t);
+    return t;
+}
+
+static struct rdma_mr_entry *tree_remove(struct rdma_mr_entry *t, struct rdma_mr_entry *e) {
+    if (!t) {
+        return NULL;
+    }
+    if (t == e) {
+        // 把要删除的节点向下旋转到只有一个子树为止
+        if (!e->left) {
+            return e->right;
+        }
+        if (!e->right) {
+            return e->left;
+        }
+        if (e->left->prio > e->right->prio) {
+            t = rotate_right(e);
+            t->right = tree_remove(t->right, e);
+        } else {
+            t = rotate_left(e);
+            t->left = tree_remove(t->left, e);
+        }
+    } else if (tree_less(e, t)) {
+        t->left = tree_remove(t->left, e);
+    } else {
+        t->right = tree_remove(t->right, e);
+    }
+    tree_update(t);
+    return t;
+}
+
+// 找一个完整覆盖 [a, b) 的区域
+static struct rdma_mr_entry *tree_find_cover(struct rdma_mr_entry *t, uintptr_t a, uintptr_t b) {
+    struct rdma_mr_entry *found;
+
+    if (!t || t->max_end < b) {
+        return NULL;
+    }
+    if ((found = tree_find_cover(t->left, a, b)) != NULL) {
+        return found;
+    }
+    if (t->start <= a && t->end >= b) {
+        return t;
+    }
+    // 右子树的 start 都不小于 t->start
+    if (t->start > a) {
+        return NULL;
+    }
+    return tree_find_cover(t->right, a, b);
+}
+
+// 找一个与 [a, b) 重叠的区域
+static struct rdma_mr_entry *tree_find_overlap(struct rdma_mr_entry *t, uintptr_t a, uintptr_t b) {
+    struct rdma_mr_entry *found;
+
+    if (!t || t->max_end <= a) {
+        return NULL;
+    }
+    if ((found = tree_find_overlap(t->left, a, b)) != NULL) {
+        return found;
+    }
+    if (t->start < b && t->end > a) {
+        return t;
+    }
+    if (t->start >= b) {
+        return NULL;
+    }
+    return tree_find_overlap(t->right, a, b);
+}
+
+// =================== LRU ===================
+static void lru_push(struct rdma_mr_cache *c, struct rdma_mr_entry *e) {
+    e->lru_prev = NULL;
+    e->lru_next = c->lru_head;
+    if (c->lru_head) {
+        c->lru_head->lru_prev = e;
+    } else {
+        c->lru_tail = e;
+    }
+    c->lru_head = e;
+}
+
+static void lru_remove(struct rdma_mr_cache *c, struct rdma_mr_entry *e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else             c->lru_head = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else             c->lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+// =================== 缓存 ===================
+// 注销并释放一个区域
+static void entry_release(struct rdma_mr_cache *c, struct rdma_mr_entry *e) {
+    if (e->mr) {
+        ibv_dereg_mr(e->mr);
+    }
+    c->pinned -= e->end - e->start;
+    free(e);
+}
+
+// 初始化缓存
+int rdma_mr_cache_init(struct rdma_mr_cache *c, struct ibv_pd *pd, size_t budget, int access) {
+    memset(c, 0, sizeof(*c));
+    c->pd     = pd;
+    c->access = access;
+    c->budget = budget ? budget : MR_CACHE_DEFAULT_BUDGET;
+    c->seed   = 2463534242u;
+    pthread_mutex_init(&c->lock, NULL);
+    return 0;
+}
+
+// 取得覆盖 [addr, addr+len) 的注册区域
+struct rdma_mr_entry *rdma_mr_cache_get(struct rdma_mr_cache *c, const void *addr, size_t len) {
+    uintptr_t             a = (uintptr_t)addr, b = a + (len ? len : 1);
+    uintptr_t             ps = page_size();
+    struct rdma_mr_entry *e;
+
+    pthread_mutex_lock(&c->lock);
+    e = tree_find_cover(c->root, a, b);
+    if (e) {
+        c->hits++;
+        if (e->refs++ == 0) {
+            lru_remove(c, e);
+        }
+        pthread_mutex_unlock(&c->lock);
+        return e;
+    }
+    c->misses++;
+
+    e = calloc(1, sizeof(*e));
+    if (!e) {
+        fprintf(stderr, "分配 MR 缓存项失败\n");
+        pthread_mutex_unlock(&c->lock);
+        return NULL;
+    }
+    // 扩展到整页：同一页内的其它缓冲区以后也能命中
+    e->start = a & ~(ps - 1);
+    e->end   = (b + ps - 1) & ~(ps - 1);
+    // 超出预算时从最久未用的区域开始注销
+    while (c->pinned + (e->end - e->start) > c->budget && c->lru_tail) {
+        struct rdma_mr_entry *victim = c->lru_tail;
+
+        lru_remove(c, victim);
+        c->root = tree_remove(c->root, victim);
+        entry_release(c, victim);
+        c->evictions++;
+    }
+    if (c->pinned + (e->end - e->start) > c->budget) {
+        fprintf(stderr, "超出注册内存预算: 已注册 %zu 字节，预算 %zu 字节\n", c->pinned, c->budget);
+        free(e);
+        pthread_mutex_unlock(&c->lock);
+        return NULL;
+    }
+    e->mr = ibv_reg_mr(c->pd, (void *)e->start, e->end - e->start, c->access);
+    if (!e->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        free(e);
+        pthread_mutex_unlock(&c->lock);
+        return NULL;
+    }
+    c->pinned += e->end - e->start;
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 17;
+    c->seed ^= c->seed << 5;
+    e->prio = c->seed;
+    e->refs = 1;
+    c->root = tree_insert(c->root, e);
+    pthread_mutex_unlock(&c->lock);
+    return e;
+}
+
+// 归还区域
+void rdma_mr_cache_put(struct rdma_mr_cache *c, struct rdma_mr_entry *e) {
+    pthread_mutex_lock(&c->lock);
+    if (--e->refs == 0) {
+        if (e->invalid) {
+            entry_release(c, e);
+        } else {
+            lru_push(c, e);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// 使重叠区域失效
+void rdma_mr_cache_invalidate(struct rdma_mr_cache *c, const void *addr, size_t len) {
+    uintptr_t             a = (uintptr_t)addr, b = a + len;
+    struct rdma_mr_entry *e;
+
+    pthread_mutex_lock(&c->lock);
+    while ((e = tree_find_overlap(c->root, a, b)) != NULL) {
+        c->root = tree_remove(c->root, e);
+        c->invalidations++;
+        if (e->refs == 0) {
+            lru_remove(c, e);
+            entry_release(c, e);
+        } else {
+            // 仍有 WR 在使用，等最后一次 put 时注销
+            e->invalid = 1;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// 使失效后 free
+void rdma_mr_cache_free(struct rdma_mr_cache *c, void *ptr, size_t len) {
+    if (ptr) {
+        rdma_mr_cache_invalidate(c, ptr, len);
+        free(ptr);
+    }
+}
+
+// 使失效后 munmap
+int rdma_mr_cache_munmap(struct rdma_mr_cache *c, void *addr, size_t len) {
+    rdma_mr_cache_invalidate(c, addr, len);
+    return munmap(addr, len);
+}
+
+// 打印统计
+void rdma_mr_cache_report(struct rdma_mr_cache *c) {
+    uint64_t total = c->hits + c->misses;
+
+    printf("MR 缓存: 命中 %lu，未命中 %lu (命中率 %.1f%%)，淘汰 %lu，失效 %lu，已注册 %zu / %zu 字节\n",
+           c->hits, c->misses, total ? 100.0 * c->hits / total : 0.0, c->evictions, c->invalidations,
+           c->pinned, c->budget);
+}
+
+// 注销所有区域
+void rdma_mr_cache_destroy(struct rdma_mr_cache *c) {
+    while (c->root) {
+        struct rdma_mr_entry *e = c->root;
+
+        if (e->refs) {
+            fprintf(stderr, "MR 缓存销毁时区域 [%#lx, %#lx) 仍在使用\n", e->start, e->end);
+        }
+        c->root = tree_remove(c->root, e);
+        entry_release(c, e);
+    }
+    pthread_mutex_destroy(&c->lock);
+    memset(c, 0, sizeof(*c));
+}
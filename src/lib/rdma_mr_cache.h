@@ -0,0 +1,72 @@
+// rdma_mr_cache.h
+// librdmademo: 内存注册缓存。
+// ibv_reg_mr 要钉住页面并写 HCA 的地址转换表，每次几十微秒；直接发送应用内存时反复注册同一缓冲区代价很大。
+// 缓存把注册过的区域（按页对齐扩展）放进以地址区间为键的区间树（treap，节点记录子树最大结束地址），
+// 查找覆盖 [addr, addr+len) 的已有 MR，命中时直接复用。
+// 不再使用的区域按 LRU 排列，已注册总字节数超过预算时从最久未用的开始注销。
+// 应用释放内存前必须通知缓存（rdma_mr_cache_invalidate，或用 rdma_mr_cache_free/rdma_mr_cache_munmap 代替
+// free/munmap），否则同一虚拟地址被重新映射后，旧 MR 仍指向原来的物理页。
+
+#ifndef RDMA_MR_CACHE_H
+#define RDMA_MR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <infiniband/verbs.h>
+
+#define MR_CACHE_DEFAULT_BUDGET     (1UL << 30)     // 默认注册内存预算（字节）
+
+// 一个缓存的注册区域
+struct rdma_mr_entry {
+    struct ibv_mr          *mr;
+    uintptr_t               start;          // 区域 [start, end)，按页对齐
+    uintptr_t               end;
+    int                     refs;           // 正在使用的次数，大于 0 时不会被注销
+    int                     invalid;        // 已失效：不再命中，最后一次 put 时注销
+    // 区间树
+    uintptr_t               max_end;        // 子树中最大的 end
+    uint32_t                prio;
+    struct rdma_mr_entry   *left, *right;
+    // LRU 链表（只包含 refs == 0 的区域），头部最近使用
+    struct rdma_mr_entry   *lru_prev, *lru_next;
+};
+
+struct rdma_mr_cache {
+    struct ibv_pd          *pd;
+    int                     access;         // 注册权限
+    size_t                  budget;         // 已注册总字节数上限
+    size_t                  pinned;         // 当前已注册总字节数（含失效但仍在使用的）
+    pthread_mutex_t         lock;
+    struct rdma_mr_entry   *root;
+    struct rdma_mr_entry   *lru_head, *lru_tail;
+    uint32_t                seed;           // treap 优先级的随机数种子
+    uint64_t                hits, misses, evictions, invalidations;
+};
+
+// 初始化缓存，budget 为 0 时使用 MR_CACHE_DEFAULT_BUDGET
+int rdma_mr_cache_init(struct rdma_mr_cache *c, struct ibv_pd *pd, size_t budget, int access);
+
+// 取得覆盖 [addr, addr+len) 的注册区域（引用计数加 1），未命中时注册，超出预算先按 LRU 注销。
+// 返回的 entry->mr 提供 lkey/rkey，用完调用 rdma_mr_cache_put。失败返回 NULL
+struct rdma_mr_entry *rdma_mr_cache_get(struct rdma_mr_cache *c, const void *addr, size_t len);
+
+// 归还 rdma_mr_cache_get 取得的区域
+void rdma_mr_cache_put(struct rdma_mr_cache *c, struct rdma_mr_entry *e);
+
+// 使与 [addr, addr+len) 重叠的区域失效，释放或 munmap 这段内存之前调用
+void rdma_mr_cache_invalidate(struct rdma_mr_cache *c, const void *addr, size_t len);
+
+// 使失效后再 free(ptr)，len 为分配时的大小
+void rdma_mr_cache_free(struct rdma_mr_cache *c, void *ptr, size_t len);
+
+// 使失效后再 munmap
+int rdma_mr_cache_munmap(struct rdma_mr_cache *c, void *addr, size_t len);
+
+// 打印命中率等统计
+void rdma_mr_cache_report(struct rdma_mr_cache *c);
+
+// 注销所有区域并释放缓存，此时不能再有未归还的区域
+void rdma_mr_cache_destroy(struct rdma_mr_cache *c);
+
+#endif // RDMA_MR_CACHE_H
@@ -0,0 +1,230 @@
+// rdma_multi.c
+// librdmademo: 多 QP、多线程客户端，见 rdma_multi.h
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "rdma_multi.h"
+#include "rdma_perf.h"
+
+// 工作线程参数
+struct multi_thread {
+    struct rdma_multi      *m;
+    pthread_t               tid;
+    int                     index;
+    int                    *go;         // 所有线程创建完成后置 1 同时开始计时，创建失败置 -1
+    int                     ret;
+};
+
+// 把当前线程绑定到第 index 个可用 CPU
+int rdma_pin_thread(int index) {
+    cpu_set_t allowed, one;
+    int       ncpu, target = -1;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return -1;
+    }
+    ncpu = CPU_COUNT(&allowed);
+    if (ncpu <= 0) {
+        return -1;
+    }
+    index %= ncpu;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && index-- == 0) {
+            target = cpu;
+            break;
+        }
+    }
+    CPU_ZERO(&one);
+    CPU_SET(target, &one);
+    return pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+}
+
+// 确保能打开 nqps 个连接所需的文件描述符：软限制不够时提高，最多到硬限制
+static void multi_raise_nofile(int nqps) {
+    struct rlimit lim;
+    rlim_t        need = (rlim_t)nqps * MULTI_FDS_PER_QP + MULTI_FDS_RESERVED;
+
+    if (getrlimit(RLIMIT_NOFILE, &lim) || lim.rlim_cur >= need) {
+        return;
+    }
+    lim.rlim_cur = lim.rlim_max != RLIM_INFINITY && lim.rlim_max < need ? lim.rlim_max : need;
+    if (setrlimit(RLIMIT_NOFILE, &lim) || lim.rlim_cur < need) {
+        fprintf(stderr, "文件描述符上限 %lu 不足以建立 %d 个连接，需要约 %lu (ulimit -n)\n",
+                (unsigned long)lim.rlim_cur, nqps, (unsigned long)need);
+    }
+}
+
+// 建立 nqps 个连接
+int rdma_multi_connect(struct rdma_multi *m, int nqps, int nthreads, const char *ip, int port,
+                       const struct rdma_conn_opts *opts, size_t size, int access, int need_remote) {
+    if (nqps < 1) {
+        fprintf(stderr, "QP 数 %d 无效\n", nqps);
+        return -1;
+    }
+    multi_raise_nofile(nqps);
+    m->qps = calloc(nqps, sizeof(*m->qps));
+    if (!m->qps) {
+        fprintf(stderr, "分配 QP 失败\n");
+        return -1;
+    }
+    m->nqps     = nqps;
+    m->nthreads = nthreads < 1 ? 1 : (nthreads > nqps ? nqps : nthreads);
+    for (int i = 0; i < nqps; ++i) {
+        struct rdma_multi_qp *q = &m->qps[i];
+
+        if (rdma_client_connect(&q->conn, ip, port, opts, size, access, need_remote ? &q->remote : NULL)) {
+            fprintf(stderr, "第 %d 个连接建立失败\n", i);
+            return -1;
+        }
+        q->thread          = i % m->nthreads;
+        q->sge.addr        = (uintptr_t)q->conn.buf;
+        q->sge.length      = size;
+        q->sge.lkey        = q->conn.mr->lkey;
+        q->wr.sg_list      = &q->sge;
+        q->wr.num_sge      = 1;
+    }
+    return 0;
+}
+
+// 线程主函数：交替推进名下各 QP 的流水线。只有一个 QP 时允许阻塞等待
+static void *multi_thread_main(void *arg) {
+    struct multi_thread        *t = arg;
+    struct rdma_multi          *m = t->m;
+    int                         mine = 0, remaining;
+
+    if (rdma_pin_thread(t->index)) {
+        fprintf(stderr, "线程 %d 绑定 CPU 失败\n", t->index);
+    }
+    for (int i = 0; i < m->nqps; ++i) {
+        mine += m->qps[i].thread == t->index;
+    }
+    remaining = mine;
+    while (__atomic_load_n(t->go, __ATOMIC_ACQUIRE) == 0) {
+    }
+    if (__atomic_load_n(t->go, __ATOMIC_ACQUIRE) < 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < m->nqps; ++i) {
+        if (m->qps[i].thread == t->index) {
+            rdma_pipeline_start(&m->qps[i].state, m->iters);
+            m->qps[i].start_ns = rdma_now_ns();
+        }
+    }
+    while (remaining > 0) {
+        for (int i = 0; i < m->nqps; ++i) {
+            struct rdma_multi_qp *q = &m->qps[i];
+
+            if (q->thread != t->index || q->state.completed >= q->state.total) {
+                continue;
+            }
+            if (rdma_pipeline_step(&q->conn, &q->wr, &m->pl, &q->state, mine == 1)) {
+                fprintf(stderr, "QP %d 流水线失败\n", i);
+                t->ret = -1;
+                return NULL;
+            }
+            if (q->state.completed >= q->state.total) {
+                q->end_ns = rdma_now_ns();
+                remaining--;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 所有 QP 各完成 m->iters 个 WR
+int rdma_multi_run(struct rdma_multi *m, size_t msg_size) {
+    struct multi_thread *threads;
+    int                  go = 0, started = 0, ret = 0;
+
+    threads = calloc(m->nthreads, sizeof(*threads));
+    if (!threads) {
+        fprintf(stderr, "分配线程失败\n");
+        return -1;
+    }
+    for (int i = 0; i < m->nqps; ++i) {
+        m->qps[i].sge.length = msg_size;
+    }
+    for (int i = 0; i < m->nthreads; ++i) {
+        threads[i].m     = m;
+        threads[i].index = i;
+        threads[i].go    = &go;
+        threads[i].ret   = 0;
+        if (pthread_create(&threads[i].tid, NULL, multi_thread_main, &threads[i])) {
+            fprintf(stderr, "创建线程失败\n");
+            ret = -1;
+            break;
+        }
+        started++;
+    }
+    __atomic_store_n(&go, ret ? -1 : 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i].tid, NULL);
+        ret |= threads[i].ret;
+    }
+    free(threads);
+    return ret;
+}
+
+// 打印每个 QP 和总体的吞吐量
+void rdma_multi_report(const struct rdma_multi *m, size_t msg_size) {
+    uint64_t first = UINT64_MAX, last = 0;
+
+    printf("消息大小 %zu 字节，%d 个 QP，%d 个线程，每个 QP %lu 次:\n", msg_size, m->nqps, m->nthreads, m->iters);
+    printf("  %4s %6s %14s %16s\n", "QP", "线程", "带宽(GB/s)", "消息速率(Mpps)");
+    for (int i = 0; i < m->nqps; ++i) {
+        const struct rdma_multi_qp *q = &m->qps[i];
+        double sec = (double)(q->end_ns - q->start_ns) / 1e9;
+
+        if (q->start_ns < first) first = q->start_ns;
+        if (q->end_ns > last)    last  = q->end_ns;
+        printf("  %4d %6d %14.3f %16.3f\n", i, q->thread,
+               sec > 0 ? (double)m->iters * msg_size / sec / 1e9 : 0.0,
+               sec > 0 ? (double)m->iters / sec / 1e6 : 0.0);
+    }
+    // 总体吞吐量按最早开始到最晚结束计算
+    if (last > first) {
+        double sec = (double)(last - first) / 1e9;
+        uint64_t total = m->iters * m->nqps;
+        printf("  %11s %14.3f %16.3f\n", "合计",
+               (double)total * msg_size / sec / 1e9, (double)total / sec / 1e6);
+    }
+}
+
+// 按 2 的幂扫描消息大小
+int rdma_multi_sweep(struct rdma_multi *m, size_t min_size, size_t max_size) {
+    for (int i = 0; i < m->nqps; ++i) {
+        if (max_size > m->qps[i].conn.buf_size ||
+            (m->qps[i].wr.opcode != IBV_WR_SEND && max_size > m->qps[i].remote.length)) {
+            fprintf(stderr, "QP %d 缓冲区不足: 最大消息 %zu 字节, 本地 %zu 字节, 远端 %u 字节\n",
+                    i, max_size, m->qps[i].conn.buf_size, m->qps[i].remote.length);
+            return -1;
+        }
+    }
+    for (size_t size = min_size; size; size = rdma_next_size(size, max_size)) {
+        if (rdma_multi_run(m, size)) {
+            return -1;
+        }
+        rdma_multi_report(m, size);
+    }
+    return 0;
+}
+
+// 断开并释放所有连接
+void rdma_multi_cleanup(struct rdma_multi *m) {
+    for (int i = 0; m->qps && i < m->nqps; ++i) {
+        if (m->qps[i].conn.qp) {
+            rdma_disconnect(m->qps[i].conn.cm_id);
+        }
+        rdma_connection_cleanup(&m->qps[i].conn);
+    }
+    free(m->qps);
+    m->qps  = NULL;
+    m->nqps = 0;
+}
@@ -0,0 +1,59 @@
+// rdma_multi.h
+// librdmademo: 多 QP、多线程客户端。
+// 向同一服务端建立 nqps 个独立连接（各自的 cm id/PD/CQ/QP/缓冲区），QP i 由线程 i % nthreads 驱动，
+// 线程绑定到不同 CPU，每个线程交替推进自己名下各 QP 的流水线，统计每个 QP 和总体的吞吐量。
+
+#ifndef RDMA_MULTI_H
+#define RDMA_MULTI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rdma_common.h"
+#include "rdma_pipeline.h"
+
+#define MULTI_FDS_PER_QP    2           // 每个连接的事件通道和完成通道
+#define MULTI_FDS_RESERVED  64          // 为进程其它文件预留的描述符数
+
+// 一个 QP 及其模板 WR
+struct rdma_multi_qp {
+    struct rdma_connection      conn;
+    struct rdma_mr_info         remote;     // 服务端为该连接注册的缓冲区
+    struct ibv_sge              sge;        // 模板 WR 的 SGE，长度由 rdma_multi_run 设置
+    struct ibv_send_wr          wr;         // 模板 WR，由调用者在连接后填写 opcode 和远端地址
+    int                         thread;     // 驱动该 QP 的线程
+    struct rdma_pipeline_state  state;      // 本轮的流水线进度，只由驱动线程访问
+    uint64_t                    start_ns;   // 本轮开始时间
+    uint64_t                    end_ns;     // 本轮全部完成时间
+};
+
+struct rdma_multi {
+    struct rdma_multi_qp   *qps;
+    int                     nqps;
+    int                     nthreads;
+    uint64_t                iters;      // 每个 QP 每轮投递的 WR 数
+    struct rdma_pipeline    pl;         // 每个 QP 的流水线参数
+};
+
+// 建立 nqps 个连接，每个连接注册 size 字节缓冲区，need_remote 非 0 时取得服务端 MR 信息（单边操作需要），
+// 模板 WR 的 SGE 指向本地缓冲区。opts 中 max_send_wr/cq_depth 应容纳流水线深度。
+// QP 数不设上限，文件描述符软限制不够时先提高到硬限制
+int rdma_multi_connect(struct rdma_multi *m, int nqps, int nthreads, const char *ip, int port,
+                       const struct rdma_conn_opts *opts, size_t size, int access, int need_remote);
+
+// 以 msg_size 字节消息让所有 QP 各完成 m->iters 个 WR（各线程同时开始）
+int rdma_multi_run(struct rdma_multi *m, size_t msg_size);
+
+// 打印每个 QP 和总体的带宽、消息速率
+void rdma_multi_report(const struct rdma_multi *m, size_t msg_size);
+
+// 按 2 的幂扫描消息大小，每个大小运行一轮并打印报告。单边操作要求服务端缓冲区不小于 max_size
+int rdma_multi_sweep(struct rdma_multi *m, size_t min_size, size_t max_size);
+
+// 断开并释放所有连接
+void rdma_multi_cleanup(struct rdma_multi *m);
+
+// 把当前线程绑定到可用 CPU 中的第 index 个（按可用数取模）
+int rdma_pin_thread(int index);
+
+#endif // RDMA_MULTI_H
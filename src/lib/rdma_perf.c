@@ -0,0 +1,203 @@
+// rdma_perf.c
+// librdmademo: 计时和吞吐量统计输出，见 rdma_perf.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rdma_perf.h"
+
+// 单调时钟，单位纳秒
+uint64_t rdma_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 打印吞吐量
+void rdma_report_throughput(const char *tag, uint64_t msgs, size_t msg_size, uint64_t elapsed_ns) {
+    double sec = elapsed_ns / 1e9;
+
+    if (sec <= 0) {
+        sec = 1e-9;
+    }
+    printf("%s 消息数: %lu, 消息大小: %zu 字节, 耗时: %.3f ms, 消息速率: %.0f msg/s, 带宽: %.3f GB/s\n",
+           tag, msgs, msg_size, elapsed_ns / 1e6, msgs / sec, (double)msgs * msg_size / sec / 1e9);
+}
+
+// 解析带 K/M/G 后缀的字节数
+size_t rdma_parse_size(const char *str) {
+    char  *end = NULL;
+    size_t size = strtoull(str, &end, 0);
+
+    switch (*end) {
+        case 'k': case 'K': size <<= 10; end++; break;
+        case 'm': case 'M': size <<= 20; end++; break;
+        case 'g': case 'G': size <<= 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0' && *end != ':') {
+        return 0;
+    }
+    return size;
+}
+
+// 解析 "<min>:<max>" 形式的消息大小范围
+int rdma_parse_size_range(const char *arg, size_t *min_size, size_t *max_size) {
+    const char *sep = strchr(arg, ':');
+
+    *min_size = rdma_parse_size(arg);
+    *max_size = sep ? rdma_parse_size(sep + 1) : *min_size;
+    if (*min_size == 0 || *max_size < *min_size) {
+        fprintf(stderr, "无效的消息大小范围: %s\n", arg);
+        return -1;
+    }
+    // 扫描按 2 的幂翻倍，起点不是 2 的幂时向上取整，最后一行总是 max
+    if (*min_size < *max_size && (*min_size & (*min_size - 1))) {
+        size_t size = 1;
+
+        while (size < *min_size) {
+            size *= 2;
+        }
+        if (size > *max_size) {
+            size = *max_size;
+        }
+        fprintf(stderr, "最小消息大小 %zu 不是 2 的幂，从 %zu 开始扫描\n", *min_size, size);
+        *min_size = size;
+    }
+    return 0;
+}
+
+// 扫描的下一个消息大小
+size_t rdma_next_size(size_t size, size_t max_size) {
+    if (size >= max_size) {
+        return 0;
+    }
+    return size * 2 < max_size ? size * 2 : max_size;
+}
+
+// 带宽表格表头
+void rdma_print_bw_header(void) {
+    printf("%12s %12s %14s %16s\n", "字节数", "迭代次数", "带宽(GB/s)", "消息速率(Mpps)");
+}
+
+// 带宽表格行
+void rdma_print_bw_row(size_t msg_size, uint64_t iters, uint64_t elapsed_ns) {
+    double sec = elapsed_ns / 1e9;
+
+    if (sec <= 0) {
+        sec = 1e-9;
+    }
+    printf("%12zu %12lu %14.3f %16.3f\n", msg_size, iters, (double)iters * msg_size / sec / 1e9, iters / sec / 1e6);
+}
+
+// 样本值对应的桶下标：小于 HIST_SUB_COUNT 的值一一对应，
+// 更大的值右移 shift 位后落在 [HIST_SUB_COUNT/2, HIST_SUB_COUNT) 中
+static int hist_index(uint64_t value) {
+    int msb, shift;
+
+    if (value < HIST_SUB_COUNT) {
+        return (int)value;
+    }
+    msb   = 63 - __builtin_clzll(value);
+    shift = msb - HIST_SUB_BITS + 1;
+    return shift * (HIST_SUB_COUNT / 2) + (int)(value >> shift);
+}
+
+// 桶内的最大值
+static uint64_t hist_bucket_high(int idx) {
+    int      shift;
+    uint64_t sub;
+
+    if (idx < HIST_SUB_COUNT) {
+        return idx;
+    }
+    shift = idx / (HIST_SUB_COUNT / 2) - 1;
+    sub   = idx - shift * (HIST_SUB_COUNT / 2);
+    return (sub << shift) + ((1ULL << shift) - 1);
+}
+
+// 直方图清零
+void rdma_hist_reset(struct rdma_histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+// 记录一个样本
+void rdma_hist_record(struct rdma_histogram *hist, uint64_t value) {
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min) hist->min = value;
+    if (value > hist->max) hist->max = value;
+}
+
+// 取百分位值：返回累计计数首次达到 percentile% 的桶的最大值
+uint64_t rdma_hist_percentile(const struct rdma_histogram *hist, double percentile) {
+    uint64_t target, seen = 0;
+
+    if (hist->total == 0) {
+        return 0;
+    }
+    target = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+    if (target < 1) target = 1;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        seen += hist->counts[i];
+        if (seen >= target) {
+            uint64_t high = hist_bucket_high(i);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+// 合并直方图
+void rdma_hist_merge(struct rdma_histogram *dst, const struct rdma_histogram *src) {
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum   += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+// 延迟表格表头
+void rdma_print_lat_header(void) {
+    printf("%10s %10s %9s %9s %9s %9s %9s %9s %9s\n",
+           "字节数", "迭代次数", "min(us)", "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)", "avg(us)");
+}
+
+// 延迟表格行
+void rdma_print_lat_row(size_t msg_size, const struct rdma_histogram *hist) {
+    if (hist->total == 0) {
+        printf("%10zu %10d\n", msg_size, 0);
+        return;
+    }
+    printf("%10zu %10lu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", msg_size, hist->total,
+           hist->min / 1e3, rdma_hist_percentile(hist, 50) / 1e3, rdma_hist_percentile(hist, 90) / 1e3,
+           rdma_hist_percentile(hist, 99) / 1e3, rdma_hist_percentile(hist, 99.9) / 1e3,
+           hist->max / 1e3, hist->sum / hist->total / 1e3);
+}
+
+// 从 /proc/self/status 读取常驻内存
+long rdma_rss_kb(int peak) {
+    const char *key = peak ? "VmHWM:" : "VmRSS:";
+    char        line[128];
+    long        kb = 0;
+    FILE       *f = fopen("/proc/self/status", "r");
+
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, strlen(key)) == 0) {
+            kb = strtol(line + strlen(key), NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
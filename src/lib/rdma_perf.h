@@ -0,0 +1,68 @@
+// rdma_perf.h
+// librdmademo: 计时和吞吐量统计输出。
+
+#ifndef RDMA_PERF_H
+#define RDMA_PERF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_DEFAULT_ITERS     1000    // 性能测试模式下每个消息大小的默认迭代次数
+#define BENCH_DEFAULT_DEPTH     64      // 性能测试模式下默认的流水线深度
+#define BENCH_RECV_DEPTH        256     // 性能测试模式下接收端预投递的接收 WR 数
+#define BENCH_INLINE_CMP_MAX     256     // 延迟测试时额外测量禁用内联的最大消息大小
+
+// 对数分桶延迟直方图（HDR 风格）：每个 2 的幂区间再细分为 HIST_SUB_COUNT/2 个子桶，
+// 相对误差约 1/(HIST_SUB_COUNT/2)，覆盖全部 64 位取值。
+// 小于 HIST_SUB_COUNT 的值各占一个桶（前两组），之后移位 1..64-HIST_SUB_BITS 各一组，
+// 最大下标为 (64 - HIST_SUB_BITS + 1) * (HIST_SUB_COUNT / 2) + HIST_SUB_COUNT / 2 - 1
+#define HIST_SUB_BITS           7
+#define HIST_SUB_COUNT          (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS            ((64 - HIST_SUB_BITS + 2) * (HIST_SUB_COUNT / 2))
+
+struct rdma_histogram {
+    uint64_t    counts[HIST_BUCKETS];   // 各桶计数
+    uint64_t    total;                  // 样本总数
+    uint64_t    min;                    // 最小值
+    uint64_t    max;                    // 最大值
+    double      sum;                    // 样本和，用于平均值
+};
+
+// 单调时钟，单位纳秒
+uint64_t rdma_now_ns(void);
+
+// 打印吞吐量：消息数、耗时、msg/s、GB/s
+void rdma_report_throughput(const char *tag, uint64_t msgs, size_t msg_size, uint64_t elapsed_ns);
+
+// 解析带 K/M/G 后缀的字节数，失败返回 0
+size_t rdma_parse_size(const char *str);
+
+// 解析 "<min>:<max>" 形式的消息大小范围，只给一个值时 min = max。
+// min < max 时 min 向上取整到 2 的幂
+int rdma_parse_size_range(const char *arg, size_t *min_size, size_t *max_size);
+
+// 扫描的下一个消息大小：翻倍，不超过 max_size 且最后一个总是 max_size，扫描结束返回 0。
+// 用法: for (size = min; size; size = rdma_next_size(size, max))
+size_t rdma_next_size(size_t size, size_t max_size);
+
+// 带宽表格：表头和每个消息大小一行
+void rdma_print_bw_header(void);
+void rdma_print_bw_row(size_t msg_size, uint64_t iters, uint64_t elapsed_ns);
+
+// 直方图：清零、记录一个样本（纳秒）、取百分位值（如 99.9）
+void rdma_hist_reset(struct rdma_histogram *hist);
+void rdma_hist_record(struct rdma_histogram *hist, uint64_t value);
+uint64_t rdma_hist_percentile(const struct rdma_histogram *hist, double percentile);
+
+// 把 src 的样本合并到 dst，用于汇总多个线程各自记录的直方图
+void rdma_hist_merge(struct rdma_histogram *dst, const struct rdma_histogram *src);
+
+// 延迟表格：表头和每个消息大小一行（单位微秒）
+void rdma_print_lat_header(void);
+void rdma_print_lat_row(size_t msg_size, const struct rdma_histogram *hist);
+
+// 进程常驻内存（KB）：peak 非 0 时为峰值（VmHWM），否则为当前值（VmRSS），读取失败返回 0。
+// 注册内存被钉住，一定计入常驻内存，可用来比较不同传输方式的内存开销
+long rdma_rss_kb(int peak);
+
+#endif // RDMA_PERF_H
@@ -0,0 +1,150 @@
+// rdma_pipeline.c
+// librdmademo: 流水线投递发送类 WR，见 rdma_pipeline.h
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rdma_cq.h"
+#include "rdma_perf.h"
+#include "rdma_pipeline.h"
+
+// 填充默认流水线参数
+void rdma_pipeline_init(struct rdma_pipeline *pl, int depth) {
+    memset(pl, 0, sizeof(*pl));
+    pl->depth        = depth > 0 ? depth : 1;
+    pl->signal_every = pl->depth / 4 > 0 ? pl->depth / 4 : 1;
+    pl->batch        = pl->depth < PIPELINE_MAX_BATCH ? pl->depth : PIPELINE_MAX_BATCH;
+}
+
+// 回收完成事件：信号 WR 的 wr_id 为截至该 WR 已投递的总数，完成即代表之前的 WR 全部完成。
+// block 非 0 时（流水线已满或已全部投递）按连接的轮询策略等待，否则只轮询一次
+static int reap_completions(struct rdma_connection *conn, uint64_t *completed, int block) {
+    struct ibv_wc wc[PIPELINE_POLL_BATCH];
+    int           n;
+
+    n = rdma_cq_poll(conn, wc, PIPELINE_POLL_BATCH, block ? -1 : 0);
+    if (n < 0) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "完成队列错误: %s (wr_id %lu)\n", ibv_wc_status_str(wc[i].status), wc[i].wr_id);
+            return -1;
+        }
+        // 接收完成不属于流水线
+        if (wc[i].opcode & IBV_WC_RECV) {
+            continue;
+        }
+        if (wc[i].wr_id > *completed) {
+            *completed = wc[i].wr_id;
+        }
+    }
+    return n;
+}
+
+// 开始一次流水线
+void rdma_pipeline_start(struct rdma_pipeline_state *st, uint64_t total) {
+    memset(st, 0, sizeof(*st));
+    st->total = total;
+}
+
+// 推进流水线一步
+int rdma_pipeline_step(struct rdma_connection *conn, const struct ibv_send_wr *tmpl,
+                       const struct rdma_pipeline *pl, struct rdma_pipeline_state *st, int may_block) {
+    struct ibv_send_wr  wrs[PIPELINE_MAX_BATCH];
+    struct ibv_sge      sges[PIPELINE_MAX_BATCH][PIPELINE_MAX_SGE];
+    struct ibv_send_wr *bad_wr = NULL;
+    uint64_t            total = st->total;
+    int                 depth = pl->depth, signal_every = pl->signal_every, batch = pl->batch;
+    int                 n = 0;
+
+    if (tmpl->num_sge > PIPELINE_MAX_SGE) {
+        fprintf(stderr, "流水线 WR 的 SGE 数 %d 超过上限 %d\n", tmpl->num_sge, PIPELINE_MAX_SGE);
+        return -1;
+    }
+    // 未信号的 WR 要等后续信号 WR 完成才能回收，通知间隔不能超过深度，否则会死锁
+    if (depth < 1) depth = 1;
+    if (signal_every < 1 || signal_every > depth) signal_every = depth;
+    if (batch < 1) batch = 1;
+    if (batch > PIPELINE_MAX_BATCH) batch = PIPELINE_MAX_BATCH;
+
+    // 填满流水线：一次 ibv_post_send 链接多个 WR，只敲一次门铃
+    while (st->posted < total && st->posted - st->completed < (uint64_t)depth && n < batch) {
+        struct ibv_send_wr *wr = &wrs[n];
+
+        *wr = *tmpl;
+        memcpy(sges[n], tmpl->sg_list, sizeof(struct ibv_sge) * tmpl->num_sge);
+        wr->sg_list = sges[n];
+        wr->next    = NULL;
+        if (pl->prep) {
+            pl->prep(wr, st->posted, pl->arg);
+        }
+        // 小消息自动内联（只适用于 Send/Write）
+        if (wr->opcode == IBV_WR_SEND || wr->opcode == IBV_WR_SEND_WITH_IMM ||
+            wr->opcode == IBV_WR_RDMA_WRITE || wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM) {
+            size_t len = 0;
+
+            for (int i = 0; i < wr->num_sge; ++i) {
+                len += wr->sg_list[i].length;
+            }
+            wr->send_flags |= rdma_inline_flag(conn, len);
+        }
+        st->posted++;
+        wr->wr_id = st->posted;
+        if (st->posted % signal_every == 0 || st->posted == total) {
+            wr->send_flags |= IBV_SEND_SIGNALED;
+        } else {
+            wr->send_flags &= ~IBV_SEND_SIGNALED;
+        }
+        if (n > 0) {
+            wrs[n - 1].next = wr;
+        }
+        n++;
+    }
+    if (n > 0 && ibv_post_send(conn->qp, &wrs[0], &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败 (已投递 %lu)\n", st->posted - n);
+        return -1;
+    }
+
+    if (st->completed < total &&
+        reap_completions(conn, &st->completed,
+                         may_block && (st->posted == total || st->posted - st->completed >= (uint64_t)depth)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// 流水线投递 total 个 WR
+int rdma_run_pipeline(struct rdma_connection *conn, const struct ibv_send_wr *tmpl,
+                      uint64_t total, const struct rdma_pipeline *pl) {
+    struct rdma_pipeline_state st;
+
+    rdma_pipeline_start(&st, total);
+    while (st.completed < total) {
+        if (rdma_pipeline_step(conn, tmpl, pl, &st, 1)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 带宽扫描
+int rdma_run_bw_sweep(struct rdma_connection *conn, struct ibv_send_wr *tmpl, size_t min_size,
+                      size_t max_size, uint64_t iters, const struct rdma_pipeline *pl) {
+    uint64_t start;
+
+    if (tmpl->num_sge != 1 || max_size > conn->buf_size) {
+        fprintf(stderr, "带宽扫描参数错误: 最大消息 %zu 字节, 缓冲区 %zu 字节\n", max_size, conn->buf_size);
+        return -1;
+    }
+    rdma_print_bw_header();
+    for (size_t size = min_size; size; size = rdma_next_size(size, max_size)) {
+        tmpl->sg_list[0].length = size;
+        start = rdma_now_ns();
+        if (rdma_run_pipeline(conn, tmpl, iters, pl)) {
+            return -1;
+        }
+        rdma_print_bw_row(size, iters, rdma_now_ns() - start);
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+// rdma_pipeline.h
+// librdmademo: 流水线投递发送类 WR（Send/RDMA Write/RDMA Read/Atomic）。
+// 保持最多 depth 个 WR 未完成，每 signal_every 个 WR 才请求一次完成通知，
+// 每次 ibv_post_send 用 wr.next 链接最多 batch 个 WR，并批量回收完成事件。
+// Send/Write 的总长度不超过连接的内联阈值（conn->inline_max）时自动加 IBV_SEND_INLINE。
+
+#ifndef RDMA_PIPELINE_H
+#define RDMA_PIPELINE_H
+
+#include <stdint.h>
+
+#include "rdma_common.h"
+
+#define PIPELINE_MAX_BATCH      32      // 单次 ibv_post_send 链接的最大 WR 数
+#define PIPELINE_POLL_BATCH     16      // 单次 ibv_poll_cq 回收的最大完成数
+#define PIPELINE_MAX_SGE        4       // 模板 WR 的最大 SGE 数
+
+// 每个 WR 投递前的回调：idx 为该 WR 在本次流水线中的序号（从 0 开始），
+// 可用于修改远端地址、本地 SGE 等。wr->wr_id 由流水线使用，不可修改。
+typedef void (*rdma_wr_prep_fn)(struct ibv_send_wr *wr, uint64_t idx, void *arg);
+
+// 流水线参数
+struct rdma_pipeline {
+    int             depth;          // 最大未完成 WR 数
+    int             signal_every;   // 每隔多少个 WR 请求一次完成通知
+    int             batch;          // 单次 ibv_post_send 链接的 WR 数
+    rdma_wr_prep_fn prep;           // 投递前回调，可为 NULL
+    void           *arg;            // 回调参数
+};
+
+// 一条流水线的进度，用于一个线程交替推进多个 QP 的流水线
+struct rdma_pipeline_state {
+    uint64_t        total;          // 要投递的 WR 总数
+    uint64_t        posted;         // 已投递数
+    uint64_t        completed;      // 已完成数
+};
+
+// 填充默认流水线参数：depth 个未完成 WR，每 depth/4 个 WR 通知一次
+void rdma_pipeline_init(struct rdma_pipeline *pl, int depth);
+
+// 以 tmpl 为模板投递 total 个 WR，直到全部完成。tmpl->num_sge 不能超过 PIPELINE_MAX_SGE
+int rdma_run_pipeline(struct rdma_connection *conn, const struct ibv_send_wr *tmpl,
+                      uint64_t total, const struct rdma_pipeline *pl);
+
+// 开始一条投递 total 个 WR 的流水线
+void rdma_pipeline_start(struct rdma_pipeline_state *st, uint64_t total);
+
+// 推进一步：投递窗口允许的 WR 并回收完成事件。may_block 为 0 时从不阻塞，
+// 否则窗口已满时按连接的轮询策略等待。st->completed == st->total 时完成
+int rdma_pipeline_step(struct rdma_connection *conn, const struct ibv_send_wr *tmpl,
+                       const struct rdma_pipeline *pl, struct rdma_pipeline_state *st, int may_block);
+
+// 带宽扫描：消息大小从 min_size 起按 2 的幂增长到 max_size，每个大小投递 iters 个 WR 并打印一行结果。
+// tmpl 只能有一个 SGE，其长度会被修改，本地缓冲区需不小于 max_size
+int rdma_run_bw_sweep(struct rdma_connection *conn, struct ibv_send_wr *tmpl, size_t min_size,
+                      size_t max_size, uint64_t iters, const struct rdma_pipeline *pl);
+
+#endif // RDMA_PIPELINE_H
@@ -0,0 +1,113 @@
+// rdma_recv_ring.c
+// librdmademo: 接收缓冲区环，见 rdma_recv_ring.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdma_recv_ring.h"
+
+// 计算槽数
+int rdma_recv_ring_slots(int want, size_t slot_size) {
+    size_t fit = RECV_RING_MAX_BYTES / (slot_size ? slot_size : 1);
+
+    if ((size_t)want > fit) {
+        want = (int)fit;
+    }
+    return want < 2 ? 2 : want;
+}
+
+// 创建并投递全部槽
+int rdma_recv_ring_init(struct rdma_recv_ring *ring, struct ibv_pd *pd, struct ibv_qp *qp,
+                        int nslots, size_t slot_size, int batch) {
+    memset(ring, 0, sizeof(*ring));
+    if (batch <= 0) {
+        batch = RECV_RING_BATCH;
+    }
+    // 至少一半的槽始终在接收队列上
+    if (batch > nslots / 2) {
+        batch = nslots / 2 > 0 ? nslots / 2 : 1;
+    }
+    ring->qp        = qp;
+    ring->nslots    = nslots;
+    ring->slot_size = slot_size;
+    ring->batch     = batch;
+
+    if (posix_memalign((void **)&ring->buf, 4096, (size_t)nslots * slot_size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        return -1;
+    }
+    memset(ring->buf, 0, (size_t)nslots * slot_size);
+    ring->sge = calloc(nslots, sizeof(*ring->sge));
+    ring->wr  = calloc(nslots, sizeof(*ring->wr));
+    if (!ring->sge || !ring->wr) {
+        fprintf(stderr, "分配接收 WR 失败\n");
+        return -1;
+    }
+    ring->mr = ibv_reg_mr(pd, ring->buf, (size_t)nslots * slot_size, IBV_ACCESS_LOCAL_WRITE);
+    if (!ring->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        return -1;
+    }
+
+    // 每个槽的 WR 固定不变，补投时只改 next
+    for (int i = 0; i < nslots; ++i) {
+        ring->sge[i].addr    = (uintptr_t)rdma_recv_ring_slot(ring, i);
+        ring->sge[i].length  = slot_size;
+        ring->sge[i].lkey    = ring->mr->lkey;
+        ring->wr[i].wr_id    = i;
+        ring->wr[i].sg_list  = &ring->sge[i];
+        ring->wr[i].num_sge  = 1;
+        if (i + 1 < nslots) {
+            ring->wr[i].next = &ring->wr[i + 1];
+        }
+    }
+    ring->head     = &ring->wr[0];
+    ring->tail     = &ring->wr[nslots - 1];
+    ring->npending = nslots;
+    return rdma_recv_ring_flush(ring);
+}
+
+// 归还一个槽，攒够一批时补投
+int rdma_recv_ring_release(struct rdma_recv_ring *ring, uint64_t slot) {
+    struct ibv_recv_wr *wr = &ring->wr[slot];
+
+    wr->next = NULL;
+    if (ring->tail) {
+        ring->tail->next = wr;
+    } else {
+        ring->head = wr;
+    }
+    ring->tail = wr;
+    if (++ring->npending < ring->batch) {
+        return 0;
+    }
+    return rdma_recv_ring_flush(ring);
+}
+
+// 一次 ibv_post_recv 补投整条链
+int rdma_recv_ring_flush(struct rdma_recv_ring *ring) {
+    struct ibv_recv_wr *bad_wr = NULL;
+
+    if (!ring->head) {
+        return 0;
+    }
+    ring->posts++;
+    if (ibv_post_recv(ring->qp, ring->head, &bad_wr)) {
+        fprintf(stderr, "ibv_post_recv 失败\n");
+        return -1;
+    }
+    ring->head     = NULL;
+    ring->tail     = NULL;
+    ring->npending = 0;
+    return 0;
+}
+
+// 释放接收环
+void rdma_recv_ring_destroy(struct rdma_recv_ring *ring) {
+    if (ring->mr)  ibv_dereg_mr(ring->mr);
+    if (ring->buf) free(ring->buf);
+    free(ring->sge);
+    free(ring->wr);
+    memset(ring, 0, sizeof(*ring));
+}
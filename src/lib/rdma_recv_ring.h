@@ -0,0 +1,55 @@
+// rdma_recv_ring.h
+// librdmademo: 接收缓冲区环。
+// 一块注册内存切成 nslots 个等长槽，每个槽有固定的接收 WR，wr_id 即槽号，完成事件据此找到数据，
+// 处理下一条消息前不必先把数据拷走。处理完的槽调用 rdma_recv_ring_release 归还，
+// 攒够 batch 个时把这些 WR 用 wr.next 串成一条链，一次 ibv_post_recv 补投，减少门铃次数。
+// 单线程使用；多个 QP 共享接收缓冲区见 rdma_srq.h。
+
+#ifndef RDMA_RECV_RING_H
+#define RDMA_RECV_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#define RECV_RING_BATCH         16              // 默认补投批量
+#define RECV_RING_MAX_BYTES     (64UL << 20)    // 接收环最多占用的内存，大消息时据此减少槽数
+
+struct rdma_recv_ring {
+    struct ibv_qp      *qp;
+    struct ibv_mr      *mr;
+    char               *buf;            // nslots * slot_size 字节
+    size_t              slot_size;
+    int                 nslots;
+    int                 batch;          // 攒够多少个槽补投一次
+    struct ibv_sge     *sge;            // 每个槽一个，固定指向槽缓冲区
+    struct ibv_recv_wr *wr;             // 每个槽一个，wr_id 为槽号，next 在补投时串链
+    struct ibv_recv_wr *head;           // 已归还、待补投的 WR 链
+    struct ibv_recv_wr *tail;
+    int                 npending;
+    uint64_t            posts;          // ibv_post_recv 调用次数
+};
+
+// 按消息大小和期望槽数计算实际槽数：总内存不超过 RECV_RING_MAX_BYTES，至少 2 个槽
+int rdma_recv_ring_slots(int want, size_t slot_size);
+
+// 在 pd 上为 qp 创建 nslots 个 slot_size 字节的接收槽并全部投递。
+// qp 的接收队列深度不能小于 nslots，batch <= 0 时使用 RECV_RING_BATCH（不超过槽数的一半）
+int rdma_recv_ring_init(struct rdma_recv_ring *ring, struct ibv_pd *pd, struct ibv_qp *qp,
+                        int nslots, size_t slot_size, int batch);
+
+// 槽号对应的缓冲区
+static inline char *rdma_recv_ring_slot(const struct rdma_recv_ring *ring, uint64_t slot) {
+    return ring->buf + slot * ring->slot_size;
+}
+
+// 归还处理完的槽，攒够一批时补投
+int rdma_recv_ring_release(struct rdma_recv_ring *ring, uint64_t slot);
+
+// 立即补投所有已归还的槽
+int rdma_recv_ring_flush(struct rdma_recv_ring *ring);
+
+// 释放接收环，应在 QP 销毁之后、PD 释放之前调用
+void rdma_recv_ring_destroy(struct rdma_recv_ring *ring);
+
+#endif // RDMA_RECV_RING_H
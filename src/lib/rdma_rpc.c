@@ -0,0 +1,447 @@
+// rdma_rpc.c
+// librdmademo: 基于 Send/Recv 的请求/响应 RPC，见 rdma_rpc.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdma_cq.h"
+#include "rdma_pipeline.h"
+#include "rdma_rpc.h"
+
+// 清空方法表
+void rdma_rpc_server_init(struct rdma_rpc_server *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+// 注册方法
+int rdma_rpc_register(struct rdma_rpc_server *s, uint16_t method, rdma_rpc_handler fn, void *arg) {
+    if (method >= RPC_MAX_METHODS || !fn) {
+        fprintf(stderr, "RPC 方法号 %u 无效\n", method);
+        return -1;
+    }
+    s->methods[method].fn  = fn;
+    s->methods[method].arg = arg;
+    return 0;
+}
+
+// 测试方法 echo：参数原样作为结果
+static int rpc_echo(void *data, uint32_t req_len, uint32_t resp_max, void *arg) {
+    return req_len <= resp_max ? (int)req_len : -1;
+}
+
+// 测试方法 null：结果为空
+static int rpc_null(void *data, uint32_t req_len, uint32_t resp_max, void *arg) {
+    return 0;
+}
+
+// 注册测试方法
+void rdma_rpc_register_bench(struct rdma_rpc_server *s) {
+    rdma_rpc_register(s, RPC_METHOD_ECHO, rpc_echo, NULL);
+    rdma_rpc_register(s, RPC_METHOD_NULL, rpc_null, NULL);
+}
+
+// 执行请求，响应就地写回
+uint32_t rdma_rpc_dispatch(struct rdma_rpc_server *s, void *msg, uint32_t byte_len, uint32_t msg_max) {
+    struct rdma_rpc_hdr    *hdr = msg;
+    struct rdma_rpc_method *m;
+    int                     ret;
+
+    if (byte_len < sizeof(*hdr) || hdr->len > byte_len - sizeof(*hdr)) {
+        // 头部不完整时编号也不可信，仍按原样带回，由客户端丢弃
+        if (byte_len < sizeof(*hdr)) {
+            memset((char *)msg + byte_len, 0, sizeof(*hdr) - byte_len);
+        }
+        hdr->status = RPC_BAD_REQUEST;
+        hdr->len    = 0;
+        return sizeof(*hdr);
+    }
+    m = hdr->method < RPC_MAX_METHODS ? &s->methods[hdr->method] : NULL;
+    if (!m || !m->fn) {
+        hdr->status = RPC_NO_METHOD;
+        hdr->len    = 0;
+        return sizeof(*hdr);
+    }
+    __atomic_add_fetch(&m->calls, 1, __ATOMIC_RELAXED);
+    ret = m->fn(hdr + 1, hdr->len, msg_max - sizeof(*hdr), m->arg);
+    if (ret < 0 || (uint32_t)ret > msg_max - sizeof(*hdr)) {
+        hdr->status = RPC_FAILED;
+        hdr->len    = 0;
+    } else {
+        hdr->status = RPC_OK;
+        hdr->len    = ret;
+    }
+    return sizeof(*hdr) + hdr->len;
+}
+
+// 分配调用槽、请求缓冲区和响应接收环，每个调用槽的请求占 stride 字节
+static int rpc_client_setup(struct rdma_rpc_client *rc, struct rdma_connection *conn, int depth, size_t msg_size,
+                            size_t stride) {
+    size_t send_size = (size_t)depth * stride;
+
+    memset(rc, 0, sizeof(*rc));
+    rc->conn     = conn;
+    rc->depth    = depth;
+    rc->msg_size = msg_size;
+    rc->stride   = stride;
+    rdma_hist_reset(&rc->hist);
+    if (depth <= 0 || depth > RPC_MAX_DEPTH || msg_size < sizeof(struct rdma_rpc_hdr)) {
+        fprintf(stderr, "RPC 客户端参数无效: 深度 %d，消息 %zu 字节\n", depth, msg_size);
+        return -1;
+    }
+    rc->calls      = calloc(depth, sizeof(*rc->calls));
+    rc->free_slots = calloc(depth, sizeof(*rc->free_slots));
+    if (!rc->calls || !rc->free_slots) {
+        fprintf(stderr, "分配调用槽失败\n");
+        return -1;
+    }
+    for (int i = 0; i < depth; ++i) {
+        rc->free_slots[i] = depth - 1 - i;
+    }
+    rc->nfree = depth;
+    if (posix_memalign((void **)&rc->send_buf, 4096, send_size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        rc->send_buf = NULL;
+        return -1;
+    }
+    memset(rc->send_buf, 0, send_size);
+    rc->send_mr = ibv_reg_mr(conn->pd, rc->send_buf, send_size, IBV_ACCESS_LOCAL_WRITE);
+    if (!rc->send_mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        return -1;
+    }
+    if (rdma_recv_ring_init(&rc->ring, conn->pd, conn->qp, 2 * depth, msg_size, 0)) {
+        fprintf(stderr, "接收环创建失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 初始化客户端
+int rdma_rpc_client_init(struct rdma_rpc_client *rc, struct rdma_connection *conn, int depth, size_t msg_size) {
+    return rpc_client_setup(rc, conn, depth, msg_size, msg_size);
+}
+
+// 初始化经 RDMA Write 发送请求的客户端
+int rdma_rpc_client_init_write(struct rdma_rpc_client *rc, struct rdma_connection *conn, int depth, size_t msg_size,
+                               const struct rdma_mr_info *remote) {
+    size_t stride = rdma_rpc_wslot_size(msg_size);
+
+    if (rpc_client_setup(rc, conn, depth, msg_size, stride)) {
+        return -1;
+    }
+    rc->remote_addr  = remote->vaddr;
+    rc->rkey         = remote->rkey;
+    rc->remote_slots = remote->length / stride;
+    if (rc->remote_slots < depth) {
+        fprintf(stderr, "服务端只有 %d 个 %zu 字节的请求槽，不足深度 %d\n", rc->remote_slots, stride, depth);
+        return -1;
+    }
+    return 0;
+}
+
+// 释放客户端
+void rdma_rpc_client_destroy(struct rdma_rpc_client *rc) {
+    rdma_recv_ring_destroy(&rc->ring);
+    if (rc->send_mr) {
+        ibv_dereg_mr(rc->send_mr);
+    }
+    free(rc->send_buf);
+    free(rc->calls);
+    free(rc->free_slots);
+    memset(rc, 0, sizeof(*rc));
+}
+
+// 归还调用槽；经 RDMA Write 发送时调用槽按序使用，不经空闲栈
+static void rpc_free_slot(struct rdma_rpc_client *rc, int slot) {
+    if (rc->remote_addr) {
+        rc->nfree++;
+    } else {
+        rc->free_slots[rc->nfree++] = slot;
+    }
+}
+
+// 发起一个调用
+int rdma_rpc_call(struct rdma_rpc_client *rc, uint16_t method, const void *args, uint32_t len,
+                  rdma_rpc_cb cb, void *ctx) {
+    struct rdma_rpc_call *call;
+    struct rdma_rpc_hdr  *hdr;
+    struct ibv_sge        sge;
+    struct ibv_send_wr    wr, *bad_wr = NULL;
+    int                   slot;
+
+    if (len > rc->msg_size - sizeof(*hdr)) {
+        fprintf(stderr, "RPC 参数 %u 字节超过上限 %zu\n", len, rc->msg_size - sizeof(*hdr));
+        return -1;
+    }
+    if (rc->remote_addr) {
+        // 经 RDMA Write 发送时按序使用调用槽：响应按序到达，第 n 个调用槽空闲时第 n - depth 个调用已经完成
+        slot = rc->seq % rc->depth;
+        if (rc->calls[slot].id) {
+            return 1;
+        }
+        rc->nfree--;
+    } else {
+        if (rc->nfree == 0) {
+            return 1;
+        }
+        slot = rc->free_slots[--rc->nfree];
+    }
+    call = &rc->calls[slot];
+    // 序号从 1 开始，编号不会为 0
+    call->id       = (++rc->seq << RPC_SLOT_BITS) | slot;
+    call->cb       = cb;
+    call->ctx      = ctx;
+    call->start_ns = rdma_now_ns();
+
+    memset(&sge, 0, sizeof(sge));
+    memset(&wr, 0, sizeof(wr));
+    if (rc->remote_addr) {
+        // 与服务端请求槽布局相同：消息按 8 字节对齐右对齐，尾部位于槽末尾
+        char                    *base = rc->send_buf + (size_t)slot * rc->stride;
+        char                    *end = base + rc->stride - RPC_TRAILER_SIZE;
+        struct rdma_rpc_trailer *t = (struct rdma_rpc_trailer *)end;
+        uint32_t                 padded = (sizeof(*hdr) + len + 7) & ~7u;
+
+        hdr    = (struct rdma_rpc_hdr *)(end - padded);
+        t->len = sizeof(*hdr) + len;
+        t->seq = (uint32_t)rc->seq;
+        sge.length = padded + RPC_TRAILER_SIZE;
+        wr.opcode  = IBV_WR_RDMA_WRITE;
+        wr.wr.rdma.remote_addr = rc->remote_addr + ((rc->seq - 1) % rc->remote_slots) * rc->stride +
+                                 (uint64_t)((char *)hdr - base);
+        wr.wr.rdma.rkey        = rc->rkey;
+    } else {
+        hdr = (struct rdma_rpc_hdr *)(rc->send_buf + (size_t)slot * rc->stride);
+        sge.length = sizeof(*hdr) + len;
+        wr.opcode  = IBV_WR_SEND;
+    }
+    hdr->id     = call->id;
+    hdr->method = method;
+    hdr->status = 0;
+    hdr->len    = len;
+    if (len) {
+        memcpy(hdr + 1, args, len);
+    }
+    sge.addr   = (uintptr_t)hdr;
+    sge.lkey   = rc->send_mr->lkey;
+    wr.wr_id      = slot;
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(rc->conn, sge.length);
+    if (ibv_post_send(rc->conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败\n");
+        call->id = 0;
+        rc->seq--;
+        rpc_free_slot(rc, slot);
+        return -1;
+    }
+    return 0;
+}
+
+// 处理一条响应：按编号找到调用，回调后释放调用槽
+static int rpc_on_response(struct rdma_rpc_client *rc, const struct ibv_wc *wc) {
+    const struct rdma_rpc_hdr *hdr = (const struct rdma_rpc_hdr *)rdma_recv_ring_slot(&rc->ring, wc->wr_id);
+    struct rdma_rpc_call      *call;
+    uint32_t                   slot;
+
+    if (wc->byte_len < sizeof(*hdr) || hdr->len > wc->byte_len - sizeof(*hdr)) {
+        fprintf(stderr, "收到不完整的 RPC 响应 (%u 字节)\n", wc->byte_len);
+        return -1;
+    }
+    slot = hdr->id & ((1u << RPC_SLOT_BITS) - 1);
+    if (slot >= (uint32_t)rc->depth || rc->calls[slot].id != hdr->id) {
+        fprintf(stderr, "收到未知编号 %lx 的 RPC 响应\n", hdr->id);
+        return -1;
+    }
+    call = &rc->calls[slot];
+    rdma_hist_record(&rc->hist, rdma_now_ns() - call->start_ns);
+    rc->completed++;
+    if (hdr->status != RPC_OK) {
+        rc->failed++;
+    }
+    if (call->cb) {
+        call->cb(call->ctx, hdr->status, hdr + 1, hdr->len);
+    }
+    call->id = 0;
+    rpc_free_slot(rc, slot);
+    return 0;
+}
+
+// 处理完成事件
+int rdma_rpc_poll(struct rdma_rpc_client *rc, int timeout_ms) {
+    struct ibv_wc wc[PIPELINE_POLL_BATCH];
+    int           n, done = 0;
+
+    n = rdma_cq_poll(rc->conn, wc, PIPELINE_POLL_BATCH, timeout_ms);
+    if (n < 0) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "RPC %s失败: %s\n", wc[i].opcode & IBV_WC_RECV ? "接收" : "发送",
+                    ibv_wc_status_str(wc[i].status));
+            return -1;
+        }
+        // 请求的发送完成不需要处理：收到响应时服务端已经收到了整条请求
+        if (!(wc[i].opcode & IBV_WC_RECV)) {
+            continue;
+        }
+        if (rpc_on_response(rc, &wc[i]) || rdma_recv_ring_release(&rc->ring, wc[i].wr_id)) {
+            return -1;
+        }
+        done++;
+    }
+    return done;
+}
+
+// 保持 depth 个调用未完成
+int rdma_rpc_run(struct rdma_rpc_client *rc, uint16_t method, const void *args, uint32_t len, uint64_t count,
+                 rdma_rpc_cb cb, void *ctx) {
+    uint64_t issued = 0, base = rc->completed;
+
+    while (rc->completed - base < count) {
+        // 补满空闲槽，再等待响应
+        while (issued < count) {
+            int ret = rdma_rpc_call(rc, method, args, len, cb, ctx);
+
+            if (ret < 0) {
+                return -1;
+            }
+            if (ret > 0) {
+                break;
+            }
+            issued++;
+        }
+        if (rdma_rpc_poll(rc, -1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 一个参数大小的调用状态，回调据此核对结果
+struct rpc_bench {
+    const char     *args;           // 参数内容
+    uint32_t        size;           // 参数大小
+    uint16_t        method;
+    uint64_t        bad;            // 结果内容不符的调用数
+};
+
+// 调用完成：echo 的结果应与参数相同，null 的结果为空；服务端返回错误的调用由 rc->failed 统计
+static void rpc_on_result(void *ctx, int status, const void *result, uint32_t len) {
+    struct rpc_bench *b = ctx;
+
+    if (status != RPC_OK) {
+        return;
+    }
+    if (b->method == RPC_METHOD_ECHO ? (len != b->size || memcmp(result, b->args, len) != 0) : len != 0) {
+        b->bad++;
+    }
+}
+
+// 扫描参数大小，每个大小调用 count 次
+int rdma_rpc_bench(struct rdma_rpc_client *rc, uint16_t method, size_t size_min, size_t size_max, uint64_t count) {
+    struct rdma_histogram  *hists = NULL;
+    struct rpc_bench        b;
+    char                   *args = NULL;
+    int                     nsizes = 0, ret = -1;
+
+    if (size_max + sizeof(struct rdma_rpc_hdr) > rc->msg_size) {
+        fprintf(stderr, "RPC 参数 %zu 字节超过消息上限 %zu 字节\n", size_max, rc->msg_size);
+        return -1;
+    }
+    for (size_t size = size_min; size; size = rdma_next_size(size, size_max)) {
+        nsizes++;
+    }
+    hists = calloc(nsizes, sizeof(*hists));
+    args  = malloc(size_max);
+    if (!hists || !args) {
+        fprintf(stderr, "分配测试缓冲区失败\n");
+        goto cleanup;
+    }
+    for (size_t i = 0; i < size_max; ++i) {
+        args[i] = (char)(i * 31 + 7);
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.args   = args;
+    b.method = method;
+    b.size   = size_min;
+    for (int k = 0; k < nsizes; ++k, b.size = rdma_next_size(b.size, size_max)) {
+        uint64_t ns;
+
+        rdma_hist_reset(&rc->hist);
+        ns = rdma_now_ns();
+        if (rdma_rpc_run(rc, method, args, b.size, count, rpc_on_result, &b)) {
+            fprintf(stderr, "[客户端] RPC 失败\n");
+            goto cleanup;
+        }
+        ns = rdma_now_ns() - ns;
+        rdma_report_throughput("[客户端]", count, b.size, ns);
+        hists[k] = rc->hist;
+    }
+    printf("[客户端] 调用延迟 (发出请求到收到响应):\n");
+    rdma_print_lat_header();
+    b.size = size_min;
+    for (int k = 0; k < nsizes; ++k, b.size = rdma_next_size(b.size, size_max)) {
+        rdma_print_lat_row(b.size, &hists[k]);
+    }
+    printf("[客户端] 共 %lu 次调用，服务端返回错误 %lu 次，结果不符 %lu 次\n", rc->completed, rc->failed, b.bad);
+    ret = 0;
+cleanup:
+    free(args);
+    free(hists);
+    return ret;
+}
+
+// 创建请求槽
+int rdma_rpc_wslots_init(struct rdma_rpc_wslots *ws, struct ibv_pd *pd, int nslots, size_t msg_size) {
+    size_t size;
+
+    memset(ws, 0, sizeof(*ws));
+    ws->msg_size  = msg_size;
+    ws->slot_size = rdma_rpc_wslot_size(msg_size);
+    ws->nslots    = nslots;
+    size = (size_t)nslots * ws->slot_size;
+    if (posix_memalign((void **)&ws->buf, 4096, size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        ws->buf = NULL;
+        return -1;
+    }
+    // 尾部序号全为 0，表示空槽
+    memset(ws->buf, 0, size);
+    ws->mr = ibv_reg_mr(pd, ws->buf, size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    if (!ws->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 释放请求槽
+void rdma_rpc_wslots_destroy(struct rdma_rpc_wslots *ws) {
+    if (ws->mr) {
+        ibv_dereg_mr(ws->mr);
+    }
+    free(ws->buf);
+    memset(ws, 0, sizeof(*ws));
+}
+
+// 轮询下一个槽的尾部序号
+char *rdma_rpc_wslots_poll(struct rdma_rpc_wslots *ws, uint32_t *len) {
+    char                    *base = ws->buf + (ws->head % ws->nslots) * ws->slot_size;
+    char                    *end = base + ws->slot_size - RPC_TRAILER_SIZE;
+    struct rdma_rpc_trailer *t = (struct rdma_rpc_trailer *)end;
+    uint32_t                 msg_len;
+
+    if (__atomic_load_n(&t->seq, __ATOMIC_ACQUIRE) != (uint32_t)(ws->head + 1)) {
+        return NULL;
+    }
+    ws->head++;
+    // 长度不合法时按空请求处理，rdma_rpc_dispatch 会返回 RPC_BAD_REQUEST
+    msg_len = t->len <= ws->msg_size ? t->len : 0;
+    memmove(base, end - ((msg_len + 7) & ~7u), msg_len);
+    *len = msg_len;
+    return base;
+}
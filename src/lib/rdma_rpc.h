@@ -0,0 +1,172 @@
+// rdma_rpc.h
+// librdmademo: 基于 Send/Recv 的请求/响应 RPC。
+// 每条消息以 struct rdma_rpc_hdr 开头，之后是参数或结果。
+// 客户端为每个未完成的调用分配一个槽，请求编号的低 16 位是槽号、高位是递增序号；
+// 服务端在响应中原样带回编号，客户端据此找到调用并核对序号，响应可以乱序到达。
+// 服务端按方法号查处理函数表，响应就地写在请求所在的接收缓冲区中，再从那里发回，不拷贝。
+// 请求也可以经 RDMA Write 发送（HERD 式）：服务端为每个客户端暴露 nslots 个请求槽，
+// 客户端把第 n 个请求写到第 n % nslots 个槽，消息右对齐、槽末尾是尾部 {长度, 序号}，一个 WR 写完；
+// 服务端按顺序轮询下一个槽的尾部序号（依赖 HCA 按地址递增顺序写入，同 rdma_chan.h），不消耗接收 WR，
+// 响应仍经 Send 发回。服务端按序处理、按序响应，客户端收到第 n 个响应后才会重写该槽。
+// 客户端不是线程安全的，每个连接一个。
+
+#ifndef RDMA_RPC_H
+#define RDMA_RPC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#include "rdma_common.h"
+#include "rdma_perf.h"
+#include "rdma_recv_ring.h"
+
+#define RPC_MAX_METHODS         64              // 方法号上限
+#define RPC_MAX_DEPTH           0xffff          // 每个连接的最大未完成调用数（槽号占 16 位）
+#define RPC_SLOT_BITS           16
+#define RPC_TRAILER_SIZE        8               // RDMA Write 请求槽末尾的 {长度, 序号}
+
+// 测试用的方法，由 rdma_rpc_register_bench 注册
+#define RPC_METHOD_ECHO         1               // 原样返回参数
+#define RPC_METHOD_NULL         2               // 返回空结果
+
+// 调用结果
+enum {
+    RPC_OK = 0,
+    RPC_NO_METHOD,      // 服务端没有注册该方法
+    RPC_BAD_REQUEST,    // 请求不完整
+    RPC_FAILED,         // 处理函数返回错误
+};
+
+// 消息头
+struct rdma_rpc_hdr {
+    uint64_t        id;             // 请求编号，响应原样带回
+    uint16_t        method;         // 方法号
+    uint16_t        status;         // 响应的 RPC_*
+    uint32_t        len;            // 头部之后的参数或结果长度
+};
+
+// RDMA Write 请求槽的尾部
+struct rdma_rpc_trailer {
+    uint32_t        len;            // 请求消息长度
+    uint32_t        seq;            // 请求序号，写在最后，0 表示空槽
+};
+
+// 服务端为一个客户端暴露的 RDMA Write 请求槽
+struct rdma_rpc_wslots {
+    char           *buf;            // nslots * slot_size 字节
+    struct ibv_mr  *mr;
+    size_t          msg_size;       // 消息（含头部）上限
+    size_t          slot_size;      // rdma_rpc_wslot_size(msg_size)
+    int             nslots;
+    uint64_t        head;           // 已取出的请求数
+};
+
+// 服务端处理函数：data 处是 req_len 字节的参数，结果就地写回 data（不超过 resp_max 字节），
+// 返回结果长度，出错返回负数
+typedef int (*rdma_rpc_handler)(void *data, uint32_t req_len, uint32_t resp_max, void *arg);
+
+struct rdma_rpc_method {
+    rdma_rpc_handler    fn;
+    void               *arg;
+    uint64_t            calls;          // 调用次数（原子访问，多个工作线程同时调用）
+};
+
+// 服务端方法表
+struct rdma_rpc_server {
+    struct rdma_rpc_method  methods[RPC_MAX_METHODS];
+};
+
+// 客户端调用完成的回调：status 为 RPC_*，result 指向接收缓冲区中的结果，回调返回后即失效
+typedef void (*rdma_rpc_cb)(void *ctx, int status, const void *result, uint32_t len);
+
+// 客户端的一个未完成调用
+struct rdma_rpc_call {
+    uint64_t        id;             // 0 表示空闲
+    rdma_rpc_cb     cb;
+    void           *ctx;
+    uint64_t        start_ns;
+};
+
+struct rdma_rpc_client {
+    struct rdma_connection *conn;
+    struct rdma_recv_ring   ring;           // 响应的接收槽
+    struct ibv_mr          *send_mr;
+    char                   *send_buf;       // 每个调用槽一条请求消息
+    size_t                  msg_size;       // 消息（含头部）上限
+    int                     depth;          // 调用槽数
+    struct rdma_rpc_call   *calls;
+    uint16_t               *free_slots;     // 空闲的调用槽
+    int                     nfree;
+    size_t                  stride;         // 请求缓冲区中每个调用槽的大小
+    uint64_t                remote_addr;    // 经 RDMA Write 发送时服务端请求槽的地址，0 表示经 Send 发送
+    uint32_t                rkey;
+    int                     remote_slots;   // 服务端请求槽数
+    uint64_t                seq;            // 请求序号
+    uint64_t                completed;      // 完成的调用数
+    uint64_t                failed;         // 结果不是 RPC_OK 的调用数
+    struct rdma_histogram   hist;           // 调用延迟（从发出到收到响应）
+};
+
+// 清空方法表
+void rdma_rpc_server_init(struct rdma_rpc_server *s);
+
+// 注册方法
+int rdma_rpc_register(struct rdma_rpc_server *s, uint16_t method, rdma_rpc_handler fn, void *arg);
+
+// 注册测试方法 RPC_METHOD_ECHO 和 RPC_METHOD_NULL
+void rdma_rpc_register_bench(struct rdma_rpc_server *s);
+
+// 执行收到的 byte_len 字节的请求消息，响应就地写回 msg（整条消息不超过 msg_max 字节），返回响应消息长度
+uint32_t rdma_rpc_dispatch(struct rdma_rpc_server *s, void *msg, uint32_t byte_len, uint32_t msg_max);
+
+// 在已连接的 conn 上初始化客户端：depth 个调用槽，每条消息（含头部）不超过 msg_size 字节。
+// 响应接收环有 2 * depth 个槽，批量补投时仍至少有 depth 个在接收队列上，所以 QP 的接收队列至少 2 * depth；
+// 请求的发送完成可能晚于响应，发送队列至少 2 * depth；CQ 至少 3 * depth
+int rdma_rpc_client_init(struct rdma_rpc_client *rc, struct rdma_connection *conn, int depth, size_t msg_size);
+
+// 同上，但请求经 RDMA Write 写入服务端的请求槽：remote 为服务端 rdma_rpc_wslots 的 MR 信息（主机字节序），
+// 两端的 msg_size 需一致，depth 不能超过服务端的槽数
+int rdma_rpc_client_init_write(struct rdma_rpc_client *rc, struct rdma_connection *conn, int depth, size_t msg_size,
+                               const struct rdma_mr_info *remote);
+
+// 释放客户端，应在 QP 销毁之后、PD 释放之前调用
+void rdma_rpc_client_destroy(struct rdma_rpc_client *rc);
+
+// 发起一个调用：参数拷贝到空闲槽中发出，完成时调用 cb。成功返回 0，没有空闲槽返回 1，出错返回 -1
+int rdma_rpc_call(struct rdma_rpc_client *rc, uint16_t method, const void *args, uint32_t len,
+                  rdma_rpc_cb cb, void *ctx);
+
+// 未完成的调用数
+static inline int rdma_rpc_outstanding(const struct rdma_rpc_client *rc) {
+    return rc->depth - rc->nfree;
+}
+
+// 处理完成事件，按连接的轮询策略等待最多 timeout_ms 毫秒（-1 一直等待）。返回本次完成的调用数，出错返回 -1
+int rdma_rpc_poll(struct rdma_rpc_client *rc, int timeout_ms);
+
+// 以同样的参数发起 count 个调用，保持 depth 个未完成，全部完成后返回 0，出错返回 -1
+int rdma_rpc_run(struct rdma_rpc_client *rc, uint16_t method, const void *args, uint32_t len, uint64_t count,
+                 rdma_rpc_cb cb, void *ctx);
+
+// 测试方法的吞吐量和延迟：按 rdma_next_size 从 size_min 扫描到 size_max，每个参数大小调用 count 次，
+// 保持 depth 个未完成，打印每秒调用数，最后打印调用延迟表格并核对结果（echo 应与参数相同，null 应为空）。
+// 参数（含头部）不能超过客户端的 msg_size。成功返回 0，出错返回 -1
+int rdma_rpc_bench(struct rdma_rpc_client *rc, uint16_t method, size_t size_min, size_t size_max, uint64_t count);
+
+// RDMA Write 请求槽的大小：消息上限按 8 字节对齐后加尾部，再按缓存行对齐
+static inline size_t rdma_rpc_wslot_size(size_t msg_size) {
+    return (((msg_size + 7) & ~(size_t)7) + RPC_TRAILER_SIZE + 63) & ~(size_t)63;
+}
+
+// 在 pd 上创建并注册 nslots 个请求槽，每条请求（含头部）不超过 msg_size 字节，远端可写
+int rdma_rpc_wslots_init(struct rdma_rpc_wslots *ws, struct ibv_pd *pd, int nslots, size_t msg_size);
+
+// 注销并释放请求槽
+void rdma_rpc_wslots_destroy(struct rdma_rpc_wslots *ws);
+
+// 取出下一条请求：消息移到槽首，返回其地址并给出长度，之后可在原处 rdma_rpc_dispatch（msg_max 为 ws->msg_size），
+// 再用 ws->mr 从原处发出响应；下一个槽还没有新请求时返回 NULL
+char *rdma_rpc_wslots_poll(struct rdma_rpc_wslots *ws, uint32_t *len);
+
+#endif // RDMA_RPC_H
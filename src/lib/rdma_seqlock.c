@@ -0,0 +1,148 @@
+// rdma_seqlock.c
+// librdmademo: 可被单边 RDMA Read 一致读取的带版本对象，见 rdma_seqlock.h
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rdma_seqlock.h"
+
+// CRC32（IEEE 802.3，反射多项式 0xEDB88320），每次处理 4 位
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    const uint8_t *p = data;
+
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+    }
+    return crc;
+}
+
+// 头部版本号、长度和内容的 CRC
+static uint32_t seq_obj_crc(uint64_t version, uint32_t len, const char *payload) {
+    uint32_t crc = 0xffffffff;
+
+    crc = crc32_update(crc, &version, sizeof(version));
+    crc = crc32_update(crc, &len, sizeof(len));
+    crc = crc32_update(crc, payload, len);
+    return ~crc;
+}
+
+static volatile uint64_t *seq_obj_tail(const void *obj, size_t payload_max) {
+    return (volatile uint64_t *)((char *)obj + rdma_seq_obj_size(payload_max) - sizeof(uint64_t));
+}
+
+// 对象大小：头部 + 内容 + 尾部版本号，按 SEQ_OBJ_ALIGN 对齐
+size_t rdma_seq_obj_size(size_t payload_max) {
+    size_t size = sizeof(struct rdma_seq_hdr) + payload_max + sizeof(uint64_t);
+
+    return (size + SEQ_OBJ_ALIGN - 1) & ~(size_t)(SEQ_OBJ_ALIGN - 1);
+}
+
+// 对象当前的版本号
+uint64_t rdma_seq_obj_version(const void *obj, size_t payload_max) {
+    return *seq_obj_tail(obj, payload_max);
+}
+
+// 写者：按 seqlock 顺序写入
+uint64_t rdma_seq_obj_write(void *obj, size_t payload_max, const void *data, uint32_t len) {
+    struct rdma_seq_hdr *hdr = obj;
+    volatile uint64_t   *tail = seq_obj_tail(obj, payload_max);
+    uint64_t             version = (*tail & ~1ULL) + 2;
+
+    if (len > payload_max) {
+        len = payload_max;
+    }
+    // 先把尾部标记为奇数，之后读到的副本尾部要么为奇数，要么是新版本号、与旧头部不等
+    __atomic_store_n(tail, version - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(rdma_seq_obj_payload(obj), data, len);
+    hdr->len = len;
+    hdr->crc = seq_obj_crc(version, len, rdma_seq_obj_payload(obj));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->version, version, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(tail, version, __ATOMIC_RELAXED);
+    return version;
+}
+
+// 检查读到的副本
+int rdma_seq_obj_check(const void *obj, size_t payload_max, int check_crc, uint64_t *version) {
+    const struct rdma_seq_hdr *hdr = obj;
+    uint64_t                   tail = *seq_obj_tail(obj, payload_max);
+
+    if (tail & 1) {
+        return SEQ_WRITING;
+    }
+    if (hdr->version != tail) {
+        return SEQ_TORN;
+    }
+    // 从未写入的对象版本号为 0，没有 CRC
+    if (check_crc && tail != 0 &&
+        (hdr->len > payload_max || hdr->crc != seq_obj_crc(tail, hdr->len, rdma_seq_obj_payload((void *)obj)))) {
+        return SEQ_BAD_CRC;
+    }
+    *version = tail;
+    return SEQ_OK;
+}
+
+// 初始化读者
+void rdma_seq_reader_init(struct rdma_seq_reader *rd, struct rdma_connection *conn,
+                          const struct rdma_mr_info *remote, size_t payload_max, int check_crc) {
+    memset(rd, 0, sizeof(*rd));
+    rd->conn        = conn;
+    rd->rkey        = remote->rkey;
+    rd->payload_max = payload_max;
+    rd->obj_size    = rdma_seq_obj_size(payload_max);
+    rd->check_crc   = check_crc;
+    rd->max_retries = SEQ_DEFAULT_RETRIES;
+}
+
+// 记录一次检查结果
+int rdma_seq_reader_account(struct rdma_seq_reader *rd, int result) {
+    switch (result) {
+        case SEQ_OK:      rd->reads++;   return 0;
+        case SEQ_WRITING: rd->writing++; break;
+        case SEQ_TORN:    rd->torn++;    break;
+        default:          rd->bad_crc++; break;
+    }
+    rd->retries++;
+    return 1;
+}
+
+// 同步读取一个对象，不一致时重读
+int rdma_seq_read(struct rdma_seq_reader *rd, uint64_t remote_addr, void *local, uint64_t *version) {
+    struct rdma_connection *conn = rd->conn;
+    struct ibv_sge          sge;
+    struct ibv_send_wr      wr, *bad_wr = NULL;
+    struct ibv_wc           wc;
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)local;
+    sge.length = rd->obj_size;
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list             = &sge;
+    wr.num_sge             = 1;
+    wr.opcode              = IBV_WR_RDMA_READ;
+    wr.send_flags          = IBV_SEND_SIGNALED;
+    wr.wr.rdma.remote_addr = remote_addr;
+    wr.wr.rdma.rkey        = rd->rkey;
+    for (int i = 0; i <= rd->max_retries; ++i) {
+        if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+            fprintf(stderr, "ibv_post_send (RDMA_READ) 失败\n");
+            return -1;
+        }
+        if (rdma_wait_completion(conn, IBV_WC_RDMA_READ, &wc)) {
+            return -1;
+        }
+        if (!rdma_seq_reader_account(rd, rdma_seq_obj_check(local, rd->payload_max, rd->check_crc, version))) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,81 @@
+// rdma_seqlock.h
+// librdmademo: 可被单边 RDMA Read 一致读取的带版本对象（seqlock）。
+// 对象布局（rdma_seq_obj_size() 字节，按 64 字节对齐）：
+//   [头部版本号:8][CRC:4][长度:4][内容: payload_max 字节]...[尾部版本号:8]
+// 尾部版本号位于对象的最后 8 字节。写者（拥有内存的一端，用 CPU 写）按以下顺序更新，版本号 v 始终为偶数：
+//   尾部 = v + 1（奇数，表示正在写）-> 长度、内容、CRC -> 头部 = v + 2 -> 尾部 = v + 2
+// 读者用一个 RDMA Read 读取整个对象，头尾版本号相等且为偶数才接受，否则重读。
+// 网卡按地址递增顺序读取时（先头部、后尾部），与写入重叠的读取要么看到奇数尾部，要么头尾不等；
+// CRC 覆盖头部版本号、长度和内容，不依赖网卡的读取顺序，开启校验后可检出上述顺序不成立时的撕裂读取。
+// 写者只能有一个；读者之间、读者与写者之间无需任何消息协调。
+
+#ifndef RDMA_SEQLOCK_H
+#define RDMA_SEQLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rdma_common.h"
+
+#define SEQ_OBJ_ALIGN           64
+#define SEQ_DEFAULT_RETRIES     1000    // 单个对象的默认最大重读次数
+
+// 对象头部
+struct rdma_seq_hdr {
+    uint64_t        version;        // 头部版本号，写完后更新为新的偶数版本
+    uint32_t        crc;            // 头部版本号、长度和内容的 CRC32
+    uint32_t        len;            // 内容长度
+};
+
+// 一次检查的结果
+enum {
+    SEQ_OK = 0,         // 一致
+    SEQ_WRITING,        // 尾部版本号为奇数，写者正在写
+    SEQ_TORN,           // 头尾版本号不等
+    SEQ_BAD_CRC,        // 版本号一致但 CRC 不符
+};
+
+// 读者
+struct rdma_seq_reader {
+    struct rdma_connection *conn;
+    uint32_t                rkey;
+    size_t                  payload_max;
+    size_t                  obj_size;
+    int                     check_crc;      // 非 0 时校验 CRC
+    int                     max_retries;    // 单个对象的最大重读次数
+    uint64_t                reads;          // 成功读取的对象数
+    uint64_t                retries;        // 重读次数
+    uint64_t                writing;        // 因写者正在写而重读的次数
+    uint64_t                torn;           // 因头尾版本号不等而重读的次数
+    uint64_t                bad_crc;        // 因 CRC 不符而重读的次数
+};
+
+// 内容上限为 payload_max 字节的对象大小
+size_t rdma_seq_obj_size(size_t payload_max);
+
+// 对象的内容
+static inline char *rdma_seq_obj_payload(void *obj) {
+    return (char *)obj + sizeof(struct rdma_seq_hdr);
+}
+
+// 对象当前的版本号（写者调用）
+uint64_t rdma_seq_obj_version(const void *obj, size_t payload_max);
+
+// 写者：按 seqlock 顺序把 len 字节的 data 写入对象，返回新版本号
+uint64_t rdma_seq_obj_write(void *obj, size_t payload_max, const void *data, uint32_t len);
+
+// 检查读到本地的对象副本，返回 SEQ_*；SEQ_OK 时 *version 为其版本号
+int rdma_seq_obj_check(const void *obj, size_t payload_max, int check_crc, uint64_t *version);
+
+// 初始化读者，remote 为对象所在的远端 MR（主机字节序）
+void rdma_seq_reader_init(struct rdma_seq_reader *rd, struct rdma_connection *conn,
+                          const struct rdma_mr_info *remote, size_t payload_max, int check_crc);
+
+// 同步读取 remote_addr 处的对象到 local（位于 conn->buf 内），不一致时重读。
+// 成功返回 0，*version 为读到的版本号；超过 max_retries 仍不一致返回 1；出错返回 -1
+int rdma_seq_read(struct rdma_seq_reader *rd, uint64_t remote_addr, void *local, uint64_t *version);
+
+// 记录一次检查结果，返回是否需要重读
+int rdma_seq_reader_account(struct rdma_seq_reader *rd, int result);
+
+#endif // RDMA_SEQLOCK_H
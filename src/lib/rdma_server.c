@@ -0,0 +1,698 @@
+// rdma_server.c
+// librdmademo: 多客户端服务端，见 rdma_server.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include "rdma_cq.h"
+#include "rdma_perf.h"
+#include "rdma_pipeline.h"
+#include "rdma_server.h"
+
+#define SERVER_EVENT_POLL_MS    100     // 监听线程检查停止标志的间隔（毫秒）
+#define SERVER_POLL_ROUNDS      64      // 工作线程每轮最多取出的完成事件批数，CQ 一直不空时也要照顾断开和 on_poll
+#define DRAIN_SQ_WR_ID          UINT64_MAX          // 发送队列冲刷标记的 wr_id
+#define DRAIN_RQ_WR_ID          (UINT64_MAX - 1)    // 接收队列冲刷标记的 wr_id
+
+// 排空连接时等待的事件
+enum {
+    DRAIN_SQ  = 1,      // 发送队列冲刷标记
+    DRAIN_RQ  = 2,      // 接收队列冲刷标记（未使用 SRQ 时）
+    DRAIN_SRQ = 4,      // IBV_EVENT_QP_LAST_WQE_REACHED（使用 SRQ 时）
+};
+
+// 释放一个连接：先断开（对端已断开时无害），销毁 QP 和 cm id 后再释放内存。
+// rdma_destroy_id 会等待监听线程确认该 id 上已取出的事件，因此之后释放 cli 是安全的
+static void client_destroy(struct rdma_server_client *cli) {
+    if (cli->conn.cm_id) {
+        rdma_disconnect(cli->conn.cm_id);
+    }
+    rdma_connection_cleanup(&cli->conn);
+    free(cli);
+}
+
+// 开始排空：断开并把 QP 转入错误状态（连接未建立时 rdma_disconnect 不会转换），之后已投递的 WR 都以 FLUSH_ERR 完成
+static void client_start_drain(struct rdma_server_client *cli) {
+    struct ibv_qp_attr attr;
+    int                wait = DRAIN_SQ | (cli->conn.srq ? 0 : DRAIN_RQ);
+
+    rdma_disconnect(cli->conn.cm_id);
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_ERR;
+    if (ibv_modify_qp(cli->conn.qp, &attr, IBV_QP_STATE)) {
+        fprintf(stderr, "[服务端] 连接 %lu 转入错误状态失败\n", cli->id);
+    }
+    // DRAIN_SRQ 在连接建立时即已置位，LAST_WQE_REACHED 可能早于这里到达
+    __atomic_or_fetch(&cli->drain_pending, wait, __ATOMIC_RELAXED);
+    cli->drain_start_ns = rdma_now_ns();
+}
+
+// 在队列末尾投递冲刷标记，它的完成之前该队列的 WR 都已完成。
+// 发送队列已满时投递失败，等之前的 WR 冲刷后下一轮重试
+static void client_post_drain(struct rdma_server_client *cli) {
+    if (!(cli->drain_posted & DRAIN_SQ)) {
+        struct ibv_send_wr wr, *bad_wr = NULL;
+
+        memset(&wr, 0, sizeof(wr));
+        wr.wr_id      = DRAIN_SQ_WR_ID;
+        wr.opcode     = IBV_WR_SEND;
+        wr.send_flags = IBV_SEND_SIGNALED;
+        if (ibv_post_send(cli->conn.qp, &wr, &bad_wr) == 0) {
+            cli->drain_posted |= DRAIN_SQ;
+        }
+    }
+    if (!cli->conn.srq && !(cli->drain_posted & DRAIN_RQ)) {
+        struct ibv_recv_wr wr, *bad_wr = NULL;
+
+        memset(&wr, 0, sizeof(wr));
+        wr.wr_id = DRAIN_RQ_WR_ID;
+        if (ibv_post_recv(cli->conn.qp, &wr, &bad_wr) == 0) {
+            cli->drain_posted |= DRAIN_RQ;
+        }
+    }
+}
+
+// qp_num 在哈希表中的起始位置（乘法散列，qp_num 通常连续分配）
+static uint32_t qp_table_slot(const struct rdma_server_worker *w, uint32_t qp_num) {
+    return (qp_num * 2654435761u) & w->qp_mask;
+}
+
+// 按 qp_num 查找连接，线性探测到空位为止
+static struct rdma_server_client *qp_table_find(const struct rdma_server_worker *w, uint32_t qp_num) {
+    for (uint32_t i = qp_table_slot(w, qp_num); w->qp_table[i]; i = (i + 1) & w->qp_mask) {
+        if (w->qp_table[i]->conn.qp->qp_num == qp_num) {
+            return w->qp_table[i];
+        }
+    }
+    return NULL;
+}
+
+// 插入连接，表大小不小于 2 * max_clients，一定有空位
+static void qp_table_insert(struct rdma_server_worker *w, struct rdma_server_client *cli) {
+    uint32_t i = qp_table_slot(w, cli->conn.qp->qp_num);
+
+    while (w->qp_table[i]) {
+        i = (i + 1) & w->qp_mask;
+    }
+    w->qp_table[i] = cli;
+}
+
+// 删除连接：把之后同一探测链上的项前移填补空位，不需要墓碑
+static void qp_table_remove(struct rdma_server_worker *w, struct rdma_server_client *cli) {
+    uint32_t i = qp_table_slot(w, cli->conn.qp->qp_num);
+
+    while (w->qp_table[i] != cli) {
+        if (!w->qp_table[i]) {
+            return;
+        }
+        i = (i + 1) & w->qp_mask;
+    }
+    w->qp_table[i] = NULL;
+    for (uint32_t j = (i + 1) & w->qp_mask; w->qp_table[j]; j = (j + 1) & w->qp_mask) {
+        uint32_t home = qp_table_slot(w, w->qp_table[j]->conn.qp->qp_num);
+
+        // home 不在 (i, j] 内时，j 上的项可以移到空位 i
+        if (((j - home) & w->qp_mask) >= ((j - i) & w->qp_mask)) {
+            w->qp_table[i] = w->qp_table[j];
+            w->qp_table[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+// 接管监听线程新接受的连接
+static void worker_adopt_pending(struct rdma_server_worker *w) {
+    struct rdma_server_client *cli;
+
+    pthread_mutex_lock(&w->lock);
+    while ((cli = w->pending) != NULL) {
+        w->pending = cli->next;
+        cli->next  = w->clients;
+        w->clients = cli;
+        qp_table_insert(w, cli);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+// 处理共享 CQ 上的一个完成事件：找到所属连接，交给 on_completion 或 on_flush
+static void worker_handle_wc(struct rdma_server_worker *w, struct ibv_wc *wc) {
+    struct rdma_server         *srv = w->server;
+    struct rdma_server_client  *cli;
+
+    // 完成事件可能早于接管到达（rdma_accept 后 QP 即可收包），找不到时再接管一次
+    cli = qp_table_find(w, wc->qp_num);
+    if (!cli) {
+        worker_adopt_pending(w);
+        cli = qp_table_find(w, wc->qp_num);
+    }
+    if (!cli) {
+        return;
+    }
+    if (cli->closing && (wc->wr_id == DRAIN_SQ_WR_ID || wc->wr_id == DRAIN_RQ_WR_ID)) {
+        __atomic_and_fetch(&cli->drain_pending, wc->wr_id == DRAIN_SQ_WR_ID ? ~DRAIN_SQ : ~DRAIN_RQ,
+                           __ATOMIC_RELAXED);
+        return;
+    }
+    if (wc->status != IBV_WC_SUCCESS || cli->closing) {
+        if (srv->ops.on_flush) {
+            srv->ops.on_flush(cli, wc, srv->arg);
+        }
+    }
+    if (cli->closing) {
+        return;
+    }
+    if (wc->status != IBV_WC_SUCCESS) {
+        // 断开时未完成的 WR 以 FLUSH_ERR 结束，不算错误
+        if (wc->status != IBV_WC_WR_FLUSH_ERR) {
+            fprintf(stderr, "[工作线程 %d] 连接 %lu 完成队列错误: %s\n",
+                    w->index, cli->id, ibv_wc_status_str(wc->status));
+        }
+        cli->closing = 1;
+        return;
+    }
+    if (srv->ops.on_completion && srv->ops.on_completion(cli, wc, srv->arg)) {
+        cli->closing = 1;
+    }
+}
+
+// 工作线程：接管新连接，轮询共享 CQ，处理断开
+static void *worker_main(void *arg) {
+    struct rdma_server_worker  *w = arg;
+    struct rdma_server         *srv = w->server;
+    struct ibv_wc               wc[PIPELINE_POLL_BATCH];
+
+    while (!srv->stop) {
+        struct rdma_server_client **pp, *cli;
+        int                         n, drained;
+
+        worker_adopt_pending(w);
+
+        // 先把 CQ 取空（最多 SERVER_POLL_ROUNDS 批）再调用 on_poll，发送完成及时归还各连接的发送队列。
+        // 需要轮询内存时不能阻塞在 CQ 上，之后的批次也不再等待
+        drained = 0;
+        for (int round = 0; round < SERVER_POLL_ROUNDS && !drained; ++round) {
+            n = rdma_cq_poll(&w->cq_owner, wc, PIPELINE_POLL_BATCH,
+                             round || srv->ops.on_poll ? 0 : CQ_CHECK_INTERVAL_MS);
+            if (n < 0) {
+                fprintf(stderr, "[工作线程 %d] 轮询完成队列失败\n", w->index);
+                return NULL;
+            }
+            drained = n < PIPELINE_POLL_BATCH;
+            for (int i = 0; i < n; ++i) {
+                worker_handle_wc(w, &wc[i]);
+            }
+        }
+
+        if (srv->ops.on_poll) {
+            for (cli = w->clients; cli; cli = cli->next) {
+                if (!cli->closing && srv->ops.on_poll(cli, srv->arg) < 0) {
+                    cli->closing = 1;
+                }
+            }
+        }
+
+        // 释放已断开或出错的连接：先排空，让未完成的 WR 以 FLUSH_ERR 冲刷到 CQ 交给 on_flush。
+        // 冲刷标记都已到达后，SRQ 上最后的接收完成可能仍在路上，再等一轮把 CQ 轮询空才销毁
+        pp = &w->clients;
+        while ((cli = *pp) != NULL) {
+            if (!cli->closing && __atomic_load_n(&cli->disconnected, __ATOMIC_ACQUIRE)) {
+                cli->closing = 1;
+            }
+            if (cli->closing == 1) {
+                client_start_drain(cli);
+                cli->closing = 2;
+            }
+            if (cli->closing == 2) {
+                client_post_drain(cli);
+                if (__atomic_load_n(&cli->drain_pending, __ATOMIC_ACQUIRE) == 0) {
+                    cli->closing = 3;
+                } else if (rdma_now_ns() - cli->drain_start_ns > SERVER_DRAIN_TIMEOUT_MS * 1000000ULL) {
+                    fprintf(stderr, "[工作线程 %d] 连接 %lu 排空超时，之后到达的完成将被丢弃\n", w->index, cli->id);
+                    cli->closing = 3;
+                }
+                pp = &cli->next;
+                continue;
+            }
+            if (cli->closing < 3 || !drained) {
+                pp = &cli->next;
+                continue;
+            }
+            *pp = cli->next;
+            qp_table_remove(w, cli);
+            if (srv->ops.on_disconnect) {
+                srv->ops.on_disconnect(cli, srv->arg);
+            }
+            client_destroy(cli);
+            pthread_mutex_lock(&w->lock);
+            w->nclients--;
+            pthread_mutex_unlock(&w->lock);
+        }
+    }
+    return NULL;
+}
+
+// 为工作线程创建共享 CQ 和连接哈希表，CQ 容量决定能服务的连接数
+static int worker_create_cq(struct rdma_server_worker *w, struct ibv_context *verbs) {
+    struct rdma_server     *srv = w->server;
+    struct ibv_device_attr  attr;
+    int                     depth = SERVER_WORKER_CQ_DEPTH;
+    int                     per_client = srv->opts.max_send_wr + srv->opts.max_recv_wr;
+    int                     reserved = 0;
+
+    if (ibv_query_device(verbs, &attr) == 0 && attr.max_cqe < depth) {
+        depth = attr.max_cqe;
+    }
+    if (srv->srq) {
+        // 使用 SRQ 时接收完成最多为槽数，与连接数无关
+        per_client = srv->opts.max_send_wr;
+        reserved   = srv->srq->nslots < depth / 2 ? srv->srq->nslots : depth / 2;
+    }
+    if (rdma_create_cq(&w->cq_owner, verbs, depth)) {
+        return -1;
+    }
+    w->max_clients = (depth - reserved) / per_client;
+    if (w->max_clients < 1) {
+        w->max_clients = 1;
+    }
+    // 哈希表装载率不超过一半
+    w->qp_mask = 1;
+    while (w->qp_mask + 1 < 2 * (uint32_t)w->max_clients) {
+        w->qp_mask = (w->qp_mask << 1) | 1;
+    }
+    w->qp_table = calloc(w->qp_mask + 1, sizeof(*w->qp_table));
+    if (!w->qp_table) {
+        fprintf(stderr, "分配连接哈希表失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 处理连接请求：选择工作线程，在其共享 CQ 上建立 QP，由应用准备资源后接受。
+// 拒绝时返回需要在 ack 事件之后销毁的 cm id
+static struct rdma_cm_id *handle_connect_request(struct rdma_server *srv, struct rdma_cm_event *evt) {
+    struct rdma_server_worker *w = NULL;
+    struct rdma_server_client *cli = NULL;
+    struct rdma_conn_param     conn_param;
+
+    // 从下一个工作线程开始找一个未满的
+    for (int i = 0; i < srv->nworkers && !w; ++i) {
+        struct rdma_server_worker *cand = &srv->workers[(srv->next_worker + i) % srv->nworkers];
+
+        pthread_mutex_lock(&cand->lock);
+        if (cand->nclients < cand->max_clients) {
+            cand->nclients++;
+            w = cand;
+        }
+        pthread_mutex_unlock(&cand->lock);
+    }
+    if (!w) {
+        fprintf(stderr, "[服务端] 工作线程已满，拒绝连接\n");
+        rdma_reject(evt->id, NULL, 0);
+        return evt->id;
+    }
+    srv->next_worker = (w->index + 1) % srv->nworkers;
+
+    cli = calloc(1, sizeof(*cli));
+    if (!cli) {
+        fprintf(stderr, "分配连接失败\n");
+        goto reject;
+    }
+    cli->worker          = w;
+    cli->id              = ++srv->next_id;
+    cli->conn.opts       = srv->opts;
+    cli->conn.cm_id      = evt->id;
+    cli->conn.comp_ch    = w->cq_owner.comp_ch;
+    cli->conn.cq         = w->cq_owner.cq;
+    cli->conn.cq_shared  = 1;
+    cli->conn.pd         = srv->pd;
+    cli->conn.pd_shared  = 1;
+    cli->conn.srq        = srv->srq ? srv->srq->srq : NULL;
+    if (build_qp(&cli->conn)) {
+        fprintf(stderr, "传输队列创建失败\n");
+        goto reject;
+    }
+    // 设备异步事件据此找到连接
+    cli->conn.qp->qp_context = cli;
+    if (cli->conn.srq) {
+        cli->drain_pending = DRAIN_SRQ;
+    }
+    rdma_apply_peer_param(&cli->conn, evt);
+    rdma_fill_conn_param(&cli->conn, &conn_param);
+    if (srv->ops.on_connect && srv->ops.on_connect(cli, evt, &conn_param, srv->arg)) {
+        goto reject;
+    }
+    // 接受前交给工作线程，accept 之后 QP 即可能产生完成事件
+    evt->id->context = cli;
+    pthread_mutex_lock(&w->lock);
+    cli->next  = w->pending;
+    w->pending = cli;
+    pthread_mutex_unlock(&w->lock);
+    if (rdma_accept(evt->id, &conn_param)) {
+        // 工作线程会在下一轮释放它
+        fprintf(stderr, "rdma_accept 失败\n");
+        __atomic_store_n(&cli->disconnected, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+
+reject:
+    rdma_reject(evt->id, NULL, 0);
+    if (cli) {
+        // 持有事件时不能销毁 cm id，交给调用者在 ack 之后处理
+        if (cli->conn.qp) {
+            rdma_destroy_qp(cli->conn.cm_id);
+            cli->conn.qp = NULL;
+        }
+        cli->conn.cm_id = NULL;
+        rdma_connection_cleanup(&cli->conn);
+        free(cli);
+    }
+    pthread_mutex_lock(&w->lock);
+    w->nclients--;
+    pthread_mutex_unlock(&w->lock);
+    return evt->id;
+}
+
+// 初始化服务端并开始监听
+int rdma_server_init(struct rdma_server *srv, const char *ip, int port, const struct rdma_conn_opts *opts,
+                     int nworkers, const struct rdma_server_ops *ops, void *arg) {
+    memset(srv, 0, sizeof(*srv));
+    if (opts) {
+        srv->opts = *opts;
+    } else {
+        rdma_conn_opts_init(&srv->opts);
+    }
+    if (srv->opts.listen_backlog < SERVER_LISTEN_BACKLOG) {
+        srv->opts.listen_backlog = SERVER_LISTEN_BACKLOG;
+    }
+    srv->ops      = *ops;
+    srv->arg      = arg;
+    srv->nworkers = nworkers > 0 ? nworkers : SERVER_DEFAULT_WORKERS;
+    srv->workers  = calloc(srv->nworkers, sizeof(*srv->workers));
+    if (!srv->workers) {
+        fprintf(stderr, "分配工作线程失败\n");
+        return -1;
+    }
+    for (int i = 0; i < srv->nworkers; ++i) {
+        srv->workers[i].server = srv;
+        srv->workers[i].index  = i;
+        srv->workers[i].cq_owner.opts = srv->opts;
+        pthread_mutex_init(&srv->workers[i].lock, NULL);
+    }
+    if (rdma_connection_init(&srv->listen, ROLE_SERVER, ip, port, &srv->opts)) {
+        return -1;
+    }
+    // 共享 PD/CQ 需要知道设备，监听地址必须是某个 RDMA 设备上的 IP
+    if (!srv->listen.cm_id->verbs) {
+        fprintf(stderr, "监听地址未绑定到 RDMA 设备，请指定设备上的 IP\n");
+        return -1;
+    }
+    srv->pd = ibv_alloc_pd(srv->listen.cm_id->verbs);
+    if (!srv->pd) {
+        fprintf(stderr, "ibv_alloc_pd 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 启用共享接收队列
+int rdma_server_enable_srq(struct rdma_server *srv, int nslots, size_t slot_size) {
+    srv->srq = calloc(1, sizeof(*srv->srq));
+    if (!srv->srq) {
+        fprintf(stderr, "分配 SRQ 失败\n");
+        return -1;
+    }
+    if (rdma_srq_create(srv->srq, srv->pd, nslots, slot_size)) {
+        fprintf(stderr, "创建共享接收队列失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 处理一个设备异步事件：SRQ 低水位时补投，LAST_WQE_REACHED 通知排空，其它事件只打印
+static int handle_async_event(struct rdma_server *srv) {
+    struct ibv_async_event     aevt;
+    struct rdma_server_client *cli;
+
+    if (ibv_get_async_event(srv->listen.cm_id->verbs, &aevt)) {
+        fprintf(stderr, "ibv_get_async_event 失败\n");
+        return -1;
+    }
+    switch (aevt.event_type) {
+        case IBV_EVENT_SRQ_LIMIT_REACHED:
+            if (srv->srq && rdma_srq_on_limit(srv->srq)) {
+                fprintf(stderr, "[服务端] SRQ 补投失败\n");
+            }
+            break;
+        case IBV_EVENT_QP_LAST_WQE_REACHED:
+            // 使用 SRQ 的 QP 进入错误状态后不会再消耗接收槽，工作线程据此判断排空。
+            // 事件 ack 之前 ibv_destroy_qp 会阻塞，此时访问 cli 是安全的
+            cli = aevt.element.qp->qp_context;
+            if (cli) {
+                __atomic_and_fetch(&cli->drain_pending, ~DRAIN_SRQ, __ATOMIC_RELEASE);
+            }
+            break;
+        default:
+            fprintf(stderr, "[服务端] 设备异步事件: %s\n", ibv_event_type_str(aevt.event_type));
+            break;
+    }
+    ibv_ack_async_event(&aevt);
+    return 0;
+}
+
+// 启动工作线程并处理 CM 事件
+int rdma_server_run(struct rdma_server *srv) {
+    struct rdma_cm_event *evt = NULL;
+    struct pollfd         pfd[2];
+
+    for (int i = 0; i < srv->nworkers; ++i) {
+        if (worker_create_cq(&srv->workers[i], srv->listen.cm_id->verbs)) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < srv->nworkers; ++i) {
+        if (pthread_create(&srv->workers[i].thread, NULL, worker_main, &srv->workers[i])) {
+            fprintf(stderr, "创建工作线程失败\n");
+            srv->stop = 1;
+            return -1;
+        }
+        srv->workers[i].started = 1;
+    }
+
+    while (!srv->stop) {
+        struct rdma_server_client *cli;
+        struct rdma_cm_id         *reject_id = NULL;
+        int                        n;
+
+        pfd[0].fd      = srv->listen.ec->fd;
+        pfd[0].events  = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd      = srv->listen.cm_id->verbs->async_fd;
+        pfd[1].events  = POLLIN;
+        pfd[1].revents = 0;
+        n = poll(pfd, 2, SERVER_EVENT_POLL_MS);
+        if (n < 0 && errno != EINTR) {
+            fprintf(stderr, "poll 事件通道失败\n");
+            return -1;
+        }
+        if (n > 0 && (pfd[1].revents & POLLIN) && handle_async_event(srv)) {
+            return -1;
+        }
+        if (n <= 0 || !(pfd[0].revents & POLLIN)) {
+            continue;
+        }
+        if (rdma_get_cm_event(srv->listen.ec, &evt)) {
+            fprintf(stderr, "rdma_get_cm_event 失败\n");
+            return -1;
+        }
+        cli = evt->id->context;
+        switch (evt->event) {
+            case RDMA_CM_EVENT_CONNECT_REQUEST:
+                reject_id = handle_connect_request(srv, evt);
+                break;
+            case RDMA_CM_EVENT_ESTABLISHED:
+                if (cli) {
+                    printf("[服务端] 连接 %lu 建立，由工作线程 %d 处理\n", cli->id, cli->worker->index);
+                }
+                break;
+            case RDMA_CM_EVENT_DISCONNECTED:
+            case RDMA_CM_EVENT_CONNECT_ERROR:
+            case RDMA_CM_EVENT_UNREACHABLE:
+            case RDMA_CM_EVENT_REJECTED:
+                if (cli) {
+                    __atomic_store_n(&cli->disconnected, 1, __ATOMIC_RELEASE);
+                }
+                break;
+            default:
+                break;
+        }
+        rdma_ack_cm_event(evt);
+        if (reject_id) {
+            rdma_destroy_id(reject_id);
+        }
+    }
+    return 0;
+}
+
+// 请求停止
+void rdma_server_stop(struct rdma_server *srv) {
+    srv->stop = 1;
+}
+
+// 停止工作线程并释放所有资源
+void rdma_server_cleanup(struct rdma_server *srv) {
+    srv->stop = 1;
+    for (int i = 0; srv->workers && i < srv->nworkers; ++i) {
+        struct rdma_server_worker *w = &srv->workers[i];
+        struct rdma_server_client *cli;
+
+        if (w->started) {
+            pthread_join(w->thread, NULL);
+        }
+        while ((cli = w->pending) != NULL) {
+            w->pending = cli->next;
+            cli->next  = w->clients;
+            w->clients = cli;
+        }
+        while ((cli = w->clients) != NULL) {
+            w->clients = cli->next;
+            if (srv->ops.on_disconnect) {
+                srv->ops.on_disconnect(cli, srv->arg);
+            }
+            client_destroy(cli);
+        }
+        free(w->qp_table);
+        rdma_connection_cleanup(&w->cq_owner);
+        pthread_mutex_destroy(&w->lock);
+    }
+    free(srv->workers);
+    // SRQ 和 PD 要在所有 QP 销毁之后释放
+    if (srv->srq) {
+        rdma_srq_destroy(srv->srq);
+        free(srv->srq);
+    }
+    if (srv->pd) {
+        ibv_dealloc_pd(srv->pd);
+    }
+    rdma_connection_cleanup(&srv->listen);
+    memset(srv, 0, sizeof(*srv));
+}
+
+// =================== SIGINT 停止 ===================
+static struct rdma_server *g_sigint_server;
+
+static void on_sigint(int sig) {
+    if (g_sigint_server) {
+        rdma_server_stop(g_sigint_server);
+    }
+}
+
+// 安装 SIGINT 处理函数
+void rdma_server_stop_on_sigint(struct rdma_server *srv) {
+    g_sigint_server = srv;
+    signal(SIGINT, srv ? on_sigint : SIG_DFL);
+}
+
+// =================== 被动服务端 ===================
+struct passive_server_arg {
+    size_t                  size;
+    int                     access;
+    struct rdma_mem_pool   *pool;       // 非 NULL 时缓冲区从大页内存池分配
+};
+
+// 每个连接的 MR 信息需要保存到 rdma_accept 之后
+struct passive_client_ctx {
+    struct rdma_mr_info info;
+    struct rdma_mem_buf buf;            // 从内存池分配的缓冲区
+};
+
+static int passive_on_connect(struct rdma_server_client *cli, const struct rdma_cm_event *evt,
+                              struct rdma_conn_param *param, void *arg) {
+    struct passive_server_arg *pa = arg;
+    struct passive_client_ctx *ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return -1;
+    }
+    if (pa->pool) {
+        // 槽所在的区域已注册，不再逐连接 ibv_reg_mr
+        if (rdma_mem_pool_get(pa->pool, &ctx->buf)) {
+            fprintf(stderr, "内存池分配失败\n");
+            free(ctx);
+            return -1;
+        }
+        memset(ctx->buf.addr, 0, pa->size);
+        ctx->info.vaddr  = htobe64((uintptr_t)ctx->buf.addr);
+        ctx->info.rkey   = htonl(ctx->buf.rkey);
+        ctx->info.length = htonl(pa->size);
+    } else {
+        if (reg_mem(&cli->conn, pa->size, pa->access)) {
+            fprintf(stderr, "rdma 内存注册失败\n");
+            free(ctx);
+            return -1;
+        }
+        rdma_pack_mr_info(&ctx->info, cli->conn.buf, cli->conn.buf_size, cli->conn.mr);
+    }
+    cli->ctx = ctx;
+    param->private_data     = &ctx->info;
+    param->private_data_len = sizeof(ctx->info);
+    return 0;
+}
+
+static void passive_on_disconnect(struct rdma_server_client *cli, void *arg) {
+    struct passive_server_arg *pa = arg;
+    struct passive_client_ctx *ctx = cli->ctx;
+
+    printf("[服务端] 连接 %lu 断开\n", cli->id);
+    if (pa->pool && ctx && ctx->buf.addr) {
+        rdma_mem_pool_put(pa->pool, &ctx->buf);
+    }
+    free(cli->ctx);
+    cli->ctx = NULL;
+}
+
+// 被动服务端主流程
+int rdma_run_passive_server(const char *ip, int port, const struct rdma_conn_opts *opts, int nworkers,
+                            size_t size, int access, size_t huge_page) {
+    struct rdma_server        srv;
+    struct rdma_mem_pool      pool;
+    struct passive_server_arg pa = { .size = size, .access = access };
+    struct rdma_server_ops    ops = {
+        .on_connect    = passive_on_connect,
+        .on_disconnect = passive_on_disconnect,
+    };
+    int                       ret;
+
+    if (rdma_server_init(&srv, ip, port, opts, nworkers, &ops, &pa)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        rdma_server_cleanup(&srv);
+        return -1;
+    }
+    if (huge_page) {
+        if (rdma_mem_pool_init(&pool, srv.pd, size, PASSIVE_POOL_SLOTS, huge_page, access)) {
+            rdma_mem_pool_destroy(&pool);
+            rdma_server_cleanup(&srv);
+            return -1;
+        }
+        pa.pool = &pool;
+        rdma_mem_pool_report(&pool);
+    }
+    rdma_server_stop_on_sigint(&srv);
+    printf("[服务端] 多客户端模式，%d 个工作线程，监听 %s:%d，Ctrl-C 退出...\n", srv.nworkers, ip, port);
+    ret = rdma_server_run(&srv);
+    rdma_server_stop_on_sigint(NULL);
+    // 所有连接释放后才能注销内存池
+    rdma_server_cleanup(&srv);
+    if (pa.pool) {
+        rdma_mem_pool_report(&pool);
+        rdma_mem_pool_destroy(&pool);
+    }
+    printf("[服务端] 退出。\n");
+    return ret;
+}
@@ -0,0 +1,122 @@
+// rdma_server.h
+// librdmademo: 多客户端服务端。
+// 监听线程保持监听 cm id 常驻，接受任意数量的客户端，并把建立的连接轮流分配给固定数量的工作线程。
+// 每个工作线程拥有自己的完成通道和 CQ，分给它的所有连接的 QP 共用这一个 CQ，
+// 完成事件按 wc.qp_num 在工作线程的哈希表中找到所属连接（与连接数无关）后交给回调处理。
+// 所有 CM 事件（包括各连接的断开）都在监听线程的事件通道上到达，
+// 断开时监听线程只做标记，由所属工作线程调用 on_disconnect 并释放连接资源。
+// 释放前工作线程先把 QP 转入错误状态并排空：在发送队列（未使用 SRQ 时还有接收队列）末尾投递冲刷标记，
+// 等标记的完成到达（使用 SRQ 时还要等 LAST_WQE_REACHED），保证连接上已投递的 WR 都已完成并交给 on_flush。
+// 所有连接共用服务端的 PD；启用 SRQ 后所有 QP 共用一个共享接收队列，
+// 监听线程同时监视设备异步事件，收到 SRQ_LIMIT_REACHED 时补投接收缓冲区。
+
+#ifndef RDMA_SERVER_H
+#define RDMA_SERVER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "rdma_common.h"
+#include "rdma_srq.h"
+#include "rdma_mem_pool.h"
+
+#define SERVER_DEFAULT_WORKERS      4       // 默认工作线程数
+#define SERVER_LISTEN_BACKLOG       128     // 多客户端模式的监听队列长度
+#define SERVER_WORKER_CQ_DEPTH      16384   // 每个工作线程共享 CQ 的深度（受设备 max_cqe 限制）
+#define PASSIVE_POOL_SLOTS          64      // 被动服务端内存池首个区域预留的连接数，用完再扩展
+#define SERVER_DRAIN_TIMEOUT_MS     2000    // 关闭连接时等待排空的上限（毫秒）
+
+struct rdma_server;
+struct rdma_server_worker;
+
+// 服务端的一个客户端连接
+struct rdma_server_client {
+    struct rdma_connection      conn;           // 连接资源，CQ 为工作线程共享
+    struct rdma_server_worker  *worker;         // 所属工作线程
+    uint64_t                    id;             // 连接编号，从 1 开始
+    int                         disconnected;   // 监听线程收到 DISCONNECTED 后置位（原子访问）
+    int                         closing;        // 工作线程决定关闭：1 待断开，2 排空中，3 已排空、CQ 再轮询空一次后释放
+    int                         drain_posted;   // 已投递的冲刷标记（工作线程访问）
+    int                         drain_pending;  // 尚未到达的冲刷标记和 LAST_WQE_REACHED（原子访问）
+    uint64_t                    drain_start_ns; // 开始排空的时间，超时后不再等待
+    void                       *ctx;            // 应用数据
+    struct rdma_server_client  *next;           // 工作线程内的链表
+};
+
+// 应用回调
+struct rdma_server_ops {
+    // 收到连接请求，QP 已创建（在监听线程中调用）：应注册内存、预投递接收，可设置 param->private_data。
+    // 返回非 0 拒绝该连接
+    int  (*on_connect)(struct rdma_server_client *cli, const struct rdma_cm_event *evt,
+                       struct rdma_conn_param *param, void *arg);
+    // 连接上的一个成功完成事件（在所属工作线程中调用），返回非 0 关闭该连接
+    int  (*on_completion)(struct rdma_server_client *cli, struct ibv_wc *wc, void *arg);
+    // 失败（含断开时冲刷）或在连接关闭过程中到达的完成事件（在所属工作线程中调用），可为 NULL。
+    // 用于回收 wr_id 对应的资源，如 SRQ 接收槽；错误完成的 opcode 无效，只能依据 wr_id。
+    // 连接在其已投递的所有 WR 都完成后才释放，这些完成都先于 on_disconnect 到达（排空超时除外）
+    void (*on_flush)(struct rdma_server_client *cli, struct ibv_wc *wc, void *arg);
+    // 连接断开，之后连接资源被释放（在所属工作线程中调用），可为 NULL
+    void (*on_disconnect)(struct rdma_server_client *cli, void *arg);
+    // 工作线程每轮对每个连接调用一次（在所属工作线程中调用），可为 NULL，用于轮询对端用 RDMA Write 写入的内存。
+    // 设置后工作线程不再阻塞等待完成事件，一直忙轮询；返回负数关闭该连接
+    int  (*on_poll)(struct rdma_server_client *cli, void *arg);
+};
+
+// 工作线程
+struct rdma_server_worker {
+    struct rdma_server         *server;
+    int                         index;
+    pthread_t                   thread;
+    int                         started;
+    struct rdma_connection      cq_owner;       // 只承载该线程的完成通道和 CQ，供 rdma_cq_poll 使用
+    int                         max_clients;    // CQ 能容纳的最大连接数
+    int                         nclients;       // 当前连接数（含待接管的）
+    pthread_mutex_t             lock;           // 保护 pending 和 nclients
+    struct rdma_server_client  *pending;        // 监听线程新接受、尚未被工作线程接管的连接
+    struct rdma_server_client  *clients;        // 工作线程正在服务的连接
+    struct rdma_server_client **qp_table;       // 按 qp_num 查找 clients 的开放寻址哈希表（工作线程访问）
+    uint32_t                    qp_mask;        // 表大小 - 1，表大小为 2 的幂且不小于 2 * max_clients
+};
+
+struct rdma_server {
+    struct rdma_connection      listen;         // 只使用事件通道和监听 cm id
+    struct ibv_pd              *pd;             // 所有连接共用的保护域
+    struct rdma_srq            *srq;            // 共享接收队列，NULL 表示每个 QP 使用自己的接收队列
+    struct rdma_conn_opts       opts;           // 每个连接的参数
+    struct rdma_server_ops      ops;
+    void                       *arg;
+    int                         nworkers;
+    struct rdma_server_worker  *workers;
+    int                         next_worker;    // 轮流分配
+    uint64_t                    next_id;
+    volatile int                stop;
+};
+
+// 初始化服务端并开始监听，监听地址必须是某个 RDMA 设备上的 IP。opts 为 NULL 时使用默认参数，nworkers <= 0 时使用 SERVER_DEFAULT_WORKERS
+int rdma_server_init(struct rdma_server *srv, const char *ip, int port, const struct rdma_conn_opts *opts,
+                     int nworkers, const struct rdma_server_ops *ops, void *arg);
+
+// 启用共享接收队列：nslots 个 slot_size 字节的接收槽，之后接受的连接都使用它。
+// 接收完成的 wc->wr_id 为槽号，应用处理完后用 rdma_srq_release(srv->srq, wr_id) 归还
+int rdma_server_enable_srq(struct rdma_server *srv, int nslots, size_t slot_size);
+
+// 启动工作线程并在当前线程处理 CM 事件，直到 rdma_server_stop 被调用
+int rdma_server_run(struct rdma_server *srv);
+
+// 请求停止，可在信号处理函数中调用
+void rdma_server_stop(struct rdma_server *srv);
+
+// 停止工作线程，断开并释放所有连接和服务端资源
+void rdma_server_cleanup(struct rdma_server *srv);
+
+// 安装 SIGINT 处理函数，Ctrl-C 时停止 srv（同一时刻只支持一个服务端）
+void rdma_server_stop_on_sigint(struct rdma_server *srv);
+
+// 被动服务端（供 RDMA Write/Read 等单边操作使用）：每个连接一块 size 字节、access 权限的缓冲区，
+// 通过 private_data 把 MR 信息发给客户端，之后不再参与数据传输，Ctrl-C 退出。
+// huge_page 为 0 时每个连接各自注册缓冲区；为 MEM_POOL_HUGE_2M/MEM_POOL_HUGE_1G 时从大页内存池分配，
+// 所有连接共用少数几个大 MR
+int rdma_run_passive_server(const char *ip, int port, const struct rdma_conn_opts *opts, int nworkers,
+                            size_t size, int access, size_t huge_page);
+
+#endif // RDMA_SERVER_H
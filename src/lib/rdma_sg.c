@@ -0,0 +1,145 @@
+// rdma_sg.c
+// librdmademo: 分散/聚合消息，见 rdma_sg.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "rdma_sg.h"
+
+// 按 QP 的 SGE 上限把 segs 拆成 WR 链并投递。opcode 为 Send 时最后一个 WR 换成 SEND_WITH_IMM；
+// 为 RDMA_WRITE_WITH_IMM 时前面的 WR 是普通 Write，只有最后一个带立即数 imm
+static int post_sg(struct rdma_connection *conn, enum ibv_wr_opcode opcode, const struct ibv_sge *segs,
+                   int nsegs, uint64_t remote_addr, uint32_t rkey, uint32_t imm, uint64_t wr_id, int signaled) {
+    struct ibv_send_wr  wrs[SG_MAX_SEGS], *bad_wr = NULL;
+    struct ibv_sge      sges[SG_MAX_SEGS];
+    int                 per_wr = conn->send_sge > 0 ? (int)conn->send_sge : 1;
+    int                 nwr = 0;
+    int                 with_imm = opcode == IBV_WR_RDMA_WRITE_WITH_IMM;
+
+    if (nsegs < 1 || nsegs > SG_MAX_SEGS) {
+        fprintf(stderr, "消息段数 %d 超出范围 1-%d\n", nsegs, SG_MAX_SEGS);
+        return -1;
+    }
+    // 整条链必须一次放进发送队列，否则只投递 bad_wr 之前的部分，远端收到半条消息
+    nwr = (nsegs + per_wr - 1) / per_wr;
+    if (nwr > conn->opts.max_send_wr) {
+        fprintf(stderr, "消息需要 %d 个 WR，超过发送队列深度 %d\n", nwr, conn->opts.max_send_wr);
+        return -1;
+    }
+    nwr = 0;
+    // 拷贝 SGE 数组，调用者的段描述可以立即复用
+    memcpy(sges, segs, sizeof(*segs) * nsegs);
+    for (int i = 0; i < nsegs; i += per_wr) {
+        struct ibv_send_wr *wr = &wrs[nwr];
+        size_t              len = 0;
+
+        memset(wr, 0, sizeof(*wr));
+        wr->sg_list = &sges[i];
+        wr->num_sge = nsegs - i < per_wr ? nsegs - i : per_wr;
+        wr->opcode  = with_imm ? IBV_WR_RDMA_WRITE : opcode;
+        for (int j = 0; j < wr->num_sge; ++j) {
+            len += sges[i + j].length;
+        }
+        wr->send_flags = rdma_inline_flag(conn, len);
+        if (wr->opcode == IBV_WR_RDMA_WRITE) {
+            wr->wr.rdma.remote_addr = remote_addr;
+            wr->wr.rdma.rkey        = rkey;
+            remote_addr += len;
+        }
+        if (nwr > 0) {
+            wrs[nwr - 1].next = wr;
+        }
+        nwr++;
+    }
+    // 最后一个 WR 携带 wr_id、完成通知，Send 时还带上分片数
+    wrs[nwr - 1].wr_id = wr_id;
+    if (signaled) {
+        wrs[nwr - 1].send_flags |= IBV_SEND_SIGNALED;
+    }
+    if (opcode == IBV_WR_SEND) {
+        wrs[nwr - 1].opcode   = IBV_WR_SEND_WITH_IMM;
+        wrs[nwr - 1].imm_data = htonl(nwr);
+    } else if (with_imm) {
+        wrs[nwr - 1].opcode   = IBV_WR_RDMA_WRITE_WITH_IMM;
+        wrs[nwr - 1].imm_data = htonl(imm);
+    }
+    if (ibv_post_send(conn->qp, &wrs[0], &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败: %d 个 WR 中已投递 %d 个，连接不能再使用\n",
+                nwr, bad_wr ? (int)(bad_wr - wrs) : 0);
+        return -1;
+    }
+    return nwr;
+}
+
+// 以 Send 发送一条分段消息
+int rdma_post_send_sg(struct rdma_connection *conn, const struct ibv_sge *segs, int nsegs,
+                      uint64_t wr_id, int signaled) {
+    return post_sg(conn, IBV_WR_SEND, segs, nsegs, 0, 0, 0, wr_id, signaled);
+}
+
+// 以 RDMA Write 写一条分段消息
+int rdma_post_write_sg(struct rdma_connection *conn, const struct ibv_sge *segs, int nsegs,
+                       uint64_t remote_addr, uint32_t rkey, uint64_t wr_id, int signaled) {
+    return post_sg(conn, IBV_WR_RDMA_WRITE, segs, nsegs, remote_addr, rkey, 0, wr_id, signaled);
+}
+
+// 以 RDMA Write 写一条分段消息，最后一个 WR 带立即数
+int rdma_post_write_imm_sg(struct rdma_connection *conn, const struct ibv_sge *segs, int nsegs,
+                           uint64_t remote_addr, uint32_t rkey, uint32_t imm, uint64_t wr_id, int signaled) {
+    return post_sg(conn, IBV_WR_RDMA_WRITE_WITH_IMM, segs, nsegs, remote_addr, rkey, imm, wr_id, signaled);
+}
+
+// 处理一个接收完成
+int rdma_sg_reasm_add(struct rdma_sg_reasm *r, const struct ibv_wc *wc, const char *data,
+                      const char **msg, size_t *len) {
+    int      last = (wc->wc_flags & IBV_WC_WITH_IMM) != 0;
+    uint32_t nfrags = last ? ntohl(wc->imm_data) : 0;
+
+    // 最常见的情况：整条消息在一个接收缓冲区里，直接交给调用者
+    if (last && nfrags == 1 && r->frags == 0) {
+        *msg = data;
+        *len = wc->byte_len;
+        return 1;
+    }
+    if (r->len + wc->byte_len > r->cap) {
+        size_t cap = r->cap ? r->cap : 4096;
+        char  *buf;
+
+        while (cap < r->len + wc->byte_len) {
+            cap *= 2;
+        }
+        buf = realloc(r->buf, cap);
+        if (!buf) {
+            fprintf(stderr, "分配重组缓冲区失败\n");
+            return -1;
+        }
+        r->buf = buf;
+        r->cap = cap;
+    }
+    memcpy(r->buf + r->len, data, wc->byte_len);
+    r->len += wc->byte_len;
+    r->frags++;
+    if (!last) {
+        return 0;
+    }
+    if ((uint32_t)r->frags != nfrags) {
+        fprintf(stderr, "消息分片数不符: 收到 %d 个，应为 %u 个\n", r->frags, nfrags);
+        r->len   = 0;
+        r->frags = 0;
+        return -1;
+    }
+    // 下一条消息从头拼接，本条内容在下一次调用前保持有效
+    *msg     = r->buf;
+    *len     = r->len;
+    r->len   = 0;
+    r->frags = 0;
+    return 1;
+}
+
+// 释放重组缓冲区
+void rdma_sg_reasm_free(struct rdma_sg_reasm *r) {
+    free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,54 @@
+// rdma_sg.h
+// librdmademo: 分散/聚合（scatter-gather）消息。
+// 一条消息由若干段已注册内存（struct ibv_sge 数组，类似 iovec）组成，如协议头 + 用户数据，
+// HCA 按 SGE 顺序直接从各段读取，不必先拷贝到一块连续缓冲区。
+// 段数超过 QP 的 send_sge 时拆成多个 WR，用一条 WR 链一次投递：
+//   Write：各 WR 依次写入远端连续地址，远端看到的仍是一块连续数据；
+//   Write with Immediate：同 Write，只有最后一个 WR 为 IBV_WR_RDMA_WRITE_WITH_IMM，远端在整条消息写完后
+//         才收到一个 IBV_WC_RECV_RDMA_WITH_IMM 完成（消耗一个接收 WR），可作为数据到达的通知；
+//   Send：每个 WR 在接收端消耗一个接收 WR，除最后一个外为 IBV_WR_SEND，
+//         最后一个为 IBV_WR_SEND_WITH_IMM，imm_data 为分片数（网络字节序），接收端用 rdma_sg_reasm 重组。
+// 只有最后一个 WR 可请求完成通知；总长度不超过内联阈值的 WR 自动内联。
+// 整条链一次投递，WR 数（段数 / send_sge 向上取整）不能超过 opts.max_send_wr，调用者还要保证发送队列有这么多空位：
+// 超过深度时直接拒绝；投递仍失败时已有一部分 WR 发出，远端可能收到半条消息，连接应当关闭。
+
+#ifndef RDMA_SG_H
+#define RDMA_SG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rdma_common.h"
+
+#define SG_MAX_SEGS     64      // 一条消息最多的段数
+
+// 以 Send 发送 segs 组成的一条消息，wr_id 和 signaled 作用于最后一个 WR。返回投递的 WR 数，失败返回 -1
+int rdma_post_send_sg(struct rdma_connection *conn, const struct ibv_sge *segs, int nsegs,
+                      uint64_t wr_id, int signaled);
+
+// 以 RDMA Write 把 segs 组成的一条消息写到远端 remote_addr 起的连续区域，返回投递的 WR 数，失败返回 -1
+int rdma_post_write_sg(struct rdma_connection *conn, const struct ibv_sge *segs, int nsegs,
+                       uint64_t remote_addr, uint32_t rkey, uint64_t wr_id, int signaled);
+
+// 同 rdma_post_write_sg，最后一个 WR 携带立即数 imm（主机字节序，内部转换为网络字节序）
+int rdma_post_write_imm_sg(struct rdma_connection *conn, const struct ibv_sge *segs, int nsegs,
+                           uint64_t remote_addr, uint32_t rkey, uint32_t imm, uint64_t wr_id, int signaled);
+
+// Send 消息的接收端重组状态
+struct rdma_sg_reasm {
+    char       *buf;            // 多分片消息的拼接缓冲区
+    size_t      cap;
+    size_t      len;            // 已拼接的字节数
+    int         frags;          // 已收到的分片数
+};
+
+// 处理一个接收完成，data 为该接收 WR 的缓冲区。消息完整时返回 1，*msg/*len 指向完整消息：
+// 单个分片时直接指向 data（不拷贝），多个分片时指向 r->buf，在下一次调用前有效。
+// 还需要更多分片返回 0（data 已拷走，可以立即补投），出错返回 -1
+int rdma_sg_reasm_add(struct rdma_sg_reasm *r, const struct ibv_wc *wc, const char *data,
+                      const char **msg, size_t *len);
+
+// 释放重组缓冲区
+void rdma_sg_reasm_free(struct rdma_sg_reasm *r);
+
+#endif // RDMA_SG_H
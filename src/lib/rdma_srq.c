@@ -0,0 +1,150 @@
+// rdma_srq.c
+// librdmademo: 共享接收队列，见 rdma_srq.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdma_srq.h"
+
+// 取出最多 SRQ_REFILL_BATCH 个已归还的槽（不足 min 个时不取）
+static int take_free(struct rdma_srq *s, uint32_t *slots, int min) {
+    int n = 0;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->nfree >= min) {
+        n = s->nfree < SRQ_REFILL_BATCH ? s->nfree : SRQ_REFILL_BATCH;
+        s->nfree -= n;
+        memcpy(slots, &s->free_slots[s->nfree], n * sizeof(*slots));
+    }
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+// 把 n 个槽链成一条 WR 链，一次 ibv_post_srq_recv 投递
+static int post_slots(struct rdma_srq *s, const uint32_t *slots, int n) {
+    struct ibv_sge      sge[SRQ_REFILL_BATCH];
+    struct ibv_recv_wr  wr[SRQ_REFILL_BATCH], *bad_wr = NULL;
+
+    for (int i = 0; i < n; ++i) {
+        sge[i].addr    = (uintptr_t)rdma_srq_slot(s, slots[i]);
+        sge[i].length  = s->slot_size;
+        sge[i].lkey    = s->mr->lkey;
+        wr[i].wr_id    = slots[i];
+        wr[i].sg_list  = &sge[i];
+        wr[i].num_sge  = 1;
+        wr[i].next     = i + 1 < n ? &wr[i + 1] : NULL;
+    }
+    if (ibv_post_srq_recv(s->srq, wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_srq_recv 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 补投已归还的槽，直到不足 min 个
+static int refill(struct rdma_srq *s, int min) {
+    uint32_t slots[SRQ_REFILL_BATCH];
+    int      n;
+
+    while ((n = take_free(s, slots, min)) > 0) {
+        if (post_slots(s, slots, n)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 武装 limit：已投递的接收 WR 低于 limit 时产生一次异步事件
+static int arm_limit(struct rdma_srq *s) {
+    struct ibv_srq_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.srq_limit = s->limit;
+    if (ibv_modify_srq(s->srq, &attr, IBV_SRQ_LIMIT)) {
+        fprintf(stderr, "ibv_modify_srq 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 创建 SRQ 并投递全部槽
+int rdma_srq_create(struct rdma_srq *s, struct ibv_pd *pd, int nslots, size_t slot_size) {
+    struct ibv_srq_init_attr init;
+    struct ibv_device_attr   dev;
+
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_init(&s->lock, NULL);
+    if (ibv_query_device(pd->context, &dev) == 0 && dev.max_srq_wr > 0 && nslots > dev.max_srq_wr) {
+        printf("SRQ 槽数 %d 超过设备上限，调整为 %d\n", nslots, dev.max_srq_wr);
+        nslots = dev.max_srq_wr;
+    }
+    s->nslots    = nslots;
+    s->slot_size = slot_size;
+    s->limit     = nslots / 4 > 0 ? nslots / 4 : 1;
+
+    if (posix_memalign((void **)&s->buf, 4096, (size_t)nslots * slot_size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        return -1;
+    }
+    memset(s->buf, 0, (size_t)nslots * slot_size);
+    s->free_slots = calloc(nslots, sizeof(*s->free_slots));
+    if (!s->free_slots) {
+        fprintf(stderr, "分配槽表失败\n");
+        return -1;
+    }
+    s->mr = ibv_reg_mr(pd, s->buf, (size_t)nslots * slot_size, IBV_ACCESS_LOCAL_WRITE);
+    if (!s->mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        return -1;
+    }
+
+    memset(&init, 0, sizeof(init));
+    init.attr.max_wr  = nslots;
+    init.attr.max_sge = 1;
+    s->srq = ibv_create_srq(pd, &init);
+    if (!s->srq) {
+        fprintf(stderr, "ibv_create_srq 失败\n");
+        return -1;
+    }
+
+    // 全部槽先当作已归还，一次补投完
+    for (int i = 0; i < nslots; ++i) {
+        s->free_slots[i] = nslots - 1 - i;
+    }
+    s->nfree = nslots;
+    if (refill(s, 1)) {
+        return -1;
+    }
+    return arm_limit(s);
+}
+
+// 归还一个槽，攒够一批时补投
+int rdma_srq_release(struct rdma_srq *s, uint64_t slot) {
+    int full;
+
+    pthread_mutex_lock(&s->lock);
+    s->free_slots[s->nfree++] = (uint32_t)slot;
+    full = s->nfree >= SRQ_REFILL_BATCH;
+    pthread_mutex_unlock(&s->lock);
+    return full ? refill(s, SRQ_REFILL_BATCH) : 0;
+}
+
+// limit 事件：补投全部已归还的槽后重新武装
+int rdma_srq_on_limit(struct rdma_srq *s) {
+    s->limit_events++;
+    if (refill(s, 1)) {
+        return -1;
+    }
+    return arm_limit(s);
+}
+
+// 释放 SRQ
+void rdma_srq_destroy(struct rdma_srq *s) {
+    if (s->srq)        ibv_destroy_srq(s->srq);
+    if (s->mr)         ibv_dereg_mr(s->mr);
+    if (s->buf)        free(s->buf);
+    if (s->free_slots) free(s->free_slots);
+    pthread_mutex_destroy(&s->lock);
+    memset(s, 0, sizeof(*s));
+}
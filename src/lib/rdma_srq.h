@@ -0,0 +1,50 @@
+// rdma_srq.h
+// librdmademo: 共享接收队列（SRQ）。
+// 同一 PD 下的多个 QP 共用一个 SRQ，接收缓冲区总量与连接数无关。
+// 缓冲区是一块注册内存切成的 nslots 个槽，接收 WR 的 wr_id 即槽号，完成事件据此找到数据。
+// 应用处理完一个槽后调用 rdma_srq_release 归还：攒够 SRQ_REFILL_BATCH 个时用一条 WR 链一次补投；
+// 另外 SRQ 武装了 limit，已投递的接收 WR 少于 limit 时设备产生 IBV_EVENT_SRQ_LIMIT_REACHED 异步事件，
+// 收到后调用 rdma_srq_on_limit 把所有已归还的槽补投回去并重新武装。
+
+#ifndef RDMA_SRQ_H
+#define RDMA_SRQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <infiniband/verbs.h>
+
+#define SRQ_DEFAULT_SLOTS       1024    // 默认接收槽数
+#define SRQ_REFILL_BATCH        32      // 归还多少个槽后批量补投
+
+struct rdma_srq {
+    struct ibv_srq     *srq;
+    struct ibv_mr      *mr;
+    char               *buf;            // nslots * slot_size 字节
+    size_t              slot_size;
+    int                 nslots;
+    int                 limit;          // 已投递数低于该值时触发 SRQ_LIMIT_REACHED
+    pthread_mutex_t     lock;           // 保护 free_slots/nfree，多个工作线程会同时归还
+    uint32_t           *free_slots;     // 已归还、尚未补投的槽
+    int                 nfree;
+    uint64_t            limit_events;   // 收到的 limit 事件数
+};
+
+// 在 pd 上创建 nslots 个 slot_size 字节槽的 SRQ（受设备 max_srq_wr 限制），投递全部槽并武装 limit
+int rdma_srq_create(struct rdma_srq *s, struct ibv_pd *pd, int nslots, size_t slot_size);
+
+// 槽号对应的缓冲区
+static inline char *rdma_srq_slot(const struct rdma_srq *s, uint64_t slot) {
+    return s->buf + slot * s->slot_size;
+}
+
+// 归还处理完的槽，攒够一批时补投（可在多个线程中调用）
+int rdma_srq_release(struct rdma_srq *s, uint64_t slot);
+
+// 处理 SRQ_LIMIT_REACHED：补投所有已归还的槽并重新武装 limit
+int rdma_srq_on_limit(struct rdma_srq *s);
+
+// 释放 SRQ，必须在所有关联的 QP 销毁之后、PD 释放之前调用
+void rdma_srq_destroy(struct rdma_srq *s);
+
+#endif // RDMA_SRQ_H
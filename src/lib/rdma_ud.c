@@ -0,0 +1,508 @@
+// rdma_ud.c
+// librdmademo: UD（不可靠数据报）传输的 Send/Recv，见 rdma_ud.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <arpa/inet.h>
+
+#include "rdma_cq.h"
+#include "rdma_perf.h"
+#include "rdma_pipeline.h"
+#include "rdma_ud.h"
+
+// 按 UD 覆盖连接参数
+static void ud_opts(struct rdma_conn_opts *o, const struct rdma_conn_opts *opts, int recv_slots) {
+    if (opts) {
+        *o = *opts;
+    } else {
+        rdma_conn_opts_init(o);
+    }
+    o->qp_type     = IBV_QPT_UD;
+    o->max_send_wr = UD_SEND_SLOTS;
+    o->max_recv_wr = recv_slots;
+    o->cq_depth    = recv_slots + UD_SEND_SLOTS + 1;
+}
+
+// 创建 UD QP、接收槽、发送槽和对端表
+static int ud_setup(struct rdma_ud *ud, int max_peers) {
+    struct ibv_port_attr port_attr;
+    int                  nslots = ud->conn.opts.max_recv_wr;
+
+    if (build_qp(&ud->conn)) {
+        fprintf(stderr, "传输队列创建失败\n");
+        return -1;
+    }
+    // UD 消息不能超过路径 MTU，取端口的当前 MTU（IBV_MTU_256 为 1，依次翻倍）
+    if (ibv_query_port(ud->conn.cm_id->verbs, ud->conn.cm_id->port_num, &port_attr)) {
+        fprintf(stderr, "ibv_query_port 失败\n");
+        return -1;
+    }
+    ud->mtu = 128u << port_attr.active_mtu;
+    if (ud->mtu > UD_MAX_MTU) {
+        ud->mtu = UD_MAX_MTU;
+    }
+    // 无论发送方是否带 GRH，HCA 都把接收缓冲区的前 40 字节留给 GRH
+    if (rdma_recv_ring_init(&ud->ring, ud->conn.pd, ud->conn.qp, nslots, UD_GRH_SIZE + ud->mtu, 0)) {
+        return -1;
+    }
+    if (posix_memalign((void **)&ud->send_buf, 4096, (size_t)UD_SEND_SLOTS * ud->mtu) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        return -1;
+    }
+    memset(ud->send_buf, 0, (size_t)UD_SEND_SLOTS * ud->mtu);
+    ud->send_mr = ibv_reg_mr(ud->conn.pd, ud->send_buf, (size_t)UD_SEND_SLOTS * ud->mtu, IBV_ACCESS_LOCAL_WRITE);
+    if (!ud->send_mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        return -1;
+    }
+    ud->peers = calloc(max_peers, sizeof(*ud->peers));
+    if (!ud->peers) {
+        fprintf(stderr, "分配对端表失败\n");
+        return -1;
+    }
+    ud->max_peers = max_peers;
+    return 0;
+}
+
+// 服务端初始化
+int rdma_ud_server_init(struct rdma_ud *ud, const char *ip, int port, const struct rdma_conn_opts *opts,
+                        int max_peers, int recv_slots) {
+    struct rdma_conn_opts o;
+
+    memset(ud, 0, sizeof(*ud));
+    if (max_peers <= 0) {
+        max_peers = UD_DEFAULT_MAX_PEERS;
+    }
+    if (recv_slots <= 0) {
+        recv_slots = UD_DEFAULT_RECV_SLOTS;
+    }
+    ud_opts(&o, opts, rdma_recv_ring_slots(recv_slots, UD_GRH_SIZE + UD_MAX_MTU));
+    o.listen_backlog = max_peers;
+    if (rdma_connection_init(&ud->conn, ROLE_SERVER, ip, port, &o)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        return -1;
+    }
+    // 共享 QP 建在监听 cm id 上，需要监听地址已绑定到 RDMA 设备
+    if (!ud->conn.cm_id->verbs) {
+        fprintf(stderr, "监听地址 %s 不属于 RDMA 设备\n", ip);
+        return -1;
+    }
+    return ud_setup(ud, max_peers);
+}
+
+// 客户端建立第 i 个对端：SIDR 请求中带上本端编号和发送窗口，应答中取得服务端的地址和为本端分配的编号
+static int ud_join(struct rdma_ud *ud, struct rdma_cm_id *id, int i, uint32_t window) {
+    struct rdma_ud_peer   *peer = &ud->peers[i];
+    struct rdma_cm_event  *evt = NULL;
+    struct rdma_conn_param param;
+    struct rdma_ud_join    join, reply;
+
+    join.peer   = htonl(i);
+    join.window = htonl(window);
+    memset(&param, 0, sizeof(param));
+    param.private_data     = &join;
+    param.private_data_len = sizeof(join);
+    // 只有第一个 cm id 上建了 QP，其余的由 qp_num 指明共享 QP
+    param.qp_num           = ud->conn.qp->qp_num;
+    if (rdma_connect(id, &param)) {
+        fprintf(stderr, "rdma_connect 失败\n");
+        return -1;
+    }
+    if (wait_event(&ud->conn, RDMA_CM_EVENT_ESTABLISHED, &evt)) {
+        fprintf(stderr, "对端 %d 建立失败\n", i);
+        return -1;
+    }
+    if (!evt->param.ud.private_data || evt->param.ud.private_data_len < sizeof(reply)) {
+        fprintf(stderr, "SIDR 应答中没有对端编号\n");
+        rdma_ack_cm_event(evt);
+        return -1;
+    }
+    memcpy(&reply, evt->param.ud.private_data, sizeof(reply));
+    peer->ah        = ibv_create_ah(ud->conn.pd, &evt->param.ud.ah_attr);
+    peer->qpn       = evt->param.ud.qp_num;
+    peer->qkey      = evt->param.ud.qkey;
+    peer->remote_id = ntohl(reply.peer);
+    peer->window    = window;
+    peer->next_seq  = 1;
+    peer->expect    = 1;
+    rdma_ack_cm_event(evt);
+    if (!peer->ah) {
+        fprintf(stderr, "ibv_create_ah 失败\n");
+        return -1;
+    }
+    ud->npeers++;
+    return 0;
+}
+
+// 为额外的对端创建 cm id 并解析地址和路由
+static int ud_resolve(struct rdma_ud *ud, struct rdma_cm_id **id, struct sockaddr_in *addr) {
+    struct rdma_cm_event *evt = NULL;
+
+    if (rdma_create_id(ud->conn.ec, id, NULL, RDMA_PS_UDP)) {
+        fprintf(stderr, "rdma_create_id 失败\n");
+        return -1;
+    }
+    if (rdma_resolve_addr(*id, NULL, (struct sockaddr *)addr, DEFAULT_RESOLVE_TIMEOUT)) {
+        fprintf(stderr, "rdma_resolve_addr 失败\n");
+        return -1;
+    }
+    if (wait_event(&ud->conn, RDMA_CM_EVENT_ADDR_RESOLVED, &evt)) {
+        fprintf(stderr, "地址解析失败\n");
+        return -1;
+    }
+    rdma_ack_cm_event(evt);
+    if (rdma_resolve_route(*id, DEFAULT_RESOLVE_TIMEOUT)) {
+        fprintf(stderr, "路由解析失败\n");
+        return -1;
+    }
+    if (wait_event(&ud->conn, RDMA_CM_EVENT_ROUTE_RESOLVED, &evt)) {
+        fprintf(stderr, "路由解析事件失败\n");
+        return -1;
+    }
+    rdma_ack_cm_event(evt);
+    return 0;
+}
+
+// 客户端初始化
+int rdma_ud_client_init(struct rdma_ud *ud, const char *ip, int port, const struct rdma_conn_opts *opts,
+                        int npeers, uint32_t window) {
+    struct rdma_conn_opts o;
+    struct sockaddr_in    addr;
+    uint64_t              want;
+
+    memset(ud, 0, sizeof(*ud));
+    if (npeers <= 0 || window == 0) {
+        fprintf(stderr, "对端数和发送窗口至少为 1\n");
+        return -1;
+    }
+    // 确认最多与未确认的消息一样多，再留一批补投的余量
+    want = (uint64_t)npeers * window + RECV_RING_BATCH;
+    ud_opts(&o, opts, rdma_recv_ring_slots(want > INT32_MAX ? INT32_MAX : (int)want, UD_GRH_SIZE + UD_MAX_MTU));
+    if (rdma_connection_init(&ud->conn, ROLE_CLIENT, ip, port, &o)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        return -1;
+    }
+    if (rdma_client_resolve(&ud->conn)) {
+        return -1;
+    }
+    if (ud_setup(ud, npeers)) {
+        return -1;
+    }
+    if (ud_join(ud, ud->conn.cm_id, 0, window)) {
+        return -1;
+    }
+    // SIDR 完成后 cm id 不再需要，额外的对端用完即销毁，只留下 AH
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+    for (int i = 1; i < npeers; ++i) {
+        struct rdma_cm_id *id = NULL;
+        int                ret;
+
+        ret = ud_resolve(ud, &id, &addr) || ud_join(ud, id, i, window);
+        if (id) {
+            rdma_destroy_id(id);
+        }
+        if (ret) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 服务端处理 CM 事件
+int rdma_ud_accept(struct rdma_ud *ud) {
+    struct rdma_cm_event *evt = NULL;
+    struct pollfd         pfd;
+    int                   accepted = 0;
+
+    pfd.fd     = ud->conn.ec->fd;
+    pfd.events = POLLIN;
+    while (pfd.revents = 0, poll(&pfd, 1, 0) > 0) {
+        struct rdma_cm_id     *child = NULL;
+        struct rdma_conn_param param;
+        struct rdma_ud_join    join, reply;
+
+        if (rdma_get_cm_event(ud->conn.ec, &evt)) {
+            fprintf(stderr, "rdma_get_cm_event 失败\n");
+            return -1;
+        }
+        if (evt->event != RDMA_CM_EVENT_CONNECT_REQUEST) {
+            rdma_ack_cm_event(evt);
+            continue;
+        }
+        child = evt->id;
+        if (ud->npeers >= ud->max_peers || !evt->param.ud.private_data ||
+            evt->param.ud.private_data_len < sizeof(join)) {
+            fprintf(stderr, "[UD] 拒绝对端：对端数已达上限 %d 或请求中没有窗口\n", ud->max_peers);
+            rdma_reject(child, NULL, 0);
+        } else {
+            struct rdma_ud_peer *peer = &ud->peers[ud->npeers];
+
+            memcpy(&join, evt->param.ud.private_data, sizeof(join));
+            memset(peer, 0, sizeof(*peer));
+            peer->remote_id = ntohl(join.peer);
+            peer->window    = ntohl(join.window) ? ntohl(join.window) : 1;
+            peer->qkey      = RDMA_UDP_QKEY;
+            peer->next_seq  = 1;
+            peer->expect    = 1;
+            reply.peer      = htonl(ud->npeers);
+            reply.window    = join.window;
+            memset(&param, 0, sizeof(param));
+            param.private_data     = &reply;
+            param.private_data_len = sizeof(reply);
+            param.qp_num           = ud->conn.qp->qp_num;
+            if (rdma_accept(child, &param)) {
+                fprintf(stderr, "rdma_accept 失败\n");
+            } else {
+                ud->npeers++;
+                accepted++;
+            }
+        }
+        // 应答已发出，子 cm id 不再需要
+        rdma_ack_cm_event(evt);
+        rdma_destroy_id(child);
+    }
+    return accepted;
+}
+
+// 释放资源：接收槽和发送槽的 MR、AH 要在 QP 销毁之后、PD 释放之前释放
+void rdma_ud_destroy(struct rdma_ud *ud) {
+    if (ud->conn.qp) {
+        rdma_destroy_qp(ud->conn.cm_id);
+        ud->conn.qp = NULL;
+    }
+    for (int i = 0; ud->peers && i < ud->npeers; ++i) {
+        if (ud->peers[i].ah) {
+            ibv_destroy_ah(ud->peers[i].ah);
+        }
+    }
+    free(ud->peers);
+    rdma_recv_ring_destroy(&ud->ring);
+    if (ud->send_mr) ibv_dereg_mr(ud->send_mr);
+    free(ud->send_buf);
+    rdma_connection_cleanup(&ud->conn);
+    memset(ud, 0, sizeof(*ud));
+}
+
+// 从下一个发送槽发出一条消息，没有空闲发送槽返回 1
+static int ud_post(struct rdma_ud *ud, struct rdma_ud_peer *peer, uint16_t type, uint32_t seq,
+                   const void *data, uint32_t len) {
+    char               *buf = ud->send_buf + (ud->send_head % UD_SEND_SLOTS) * ud->mtu;
+    struct rdma_ud_hdr *hdr = (struct rdma_ud_hdr *)buf;
+    struct ibv_sge      sge;
+    struct ibv_send_wr  wr, *bad_wr = NULL;
+
+    if (ud->inflight >= UD_SEND_SLOTS) {
+        return 1;
+    }
+    hdr->peer     = peer->remote_id;
+    hdr->seq      = seq;
+    hdr->type     = type;
+    hdr->reserved = 0;
+    hdr->len      = len;
+    if (len) {
+        memcpy(hdr + 1, data, len);
+    }
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)buf;
+    sge.length = sizeof(*hdr) + len;
+    sge.lkey   = ud->send_mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id             = ud->send_head;
+    wr.sg_list           = &sge;
+    wr.num_sge           = 1;
+    wr.opcode            = IBV_WR_SEND;
+    wr.send_flags        = IBV_SEND_SIGNALED | rdma_inline_flag(&ud->conn, sge.length);
+    wr.wr.ud.ah          = peer->ah;
+    wr.wr.ud.remote_qpn  = peer->qpn;
+    wr.wr.ud.remote_qkey = peer->qkey;
+    if (ibv_post_send(ud->conn.qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败\n");
+        return -1;
+    }
+    ud->send_head++;
+    ud->inflight++;
+    return 0;
+}
+
+// 发送数据
+int rdma_ud_send(struct rdma_ud *ud, int i, const void *data, uint32_t len) {
+    struct rdma_ud_peer *peer = &ud->peers[i];
+    uint32_t             outstanding = rdma_ud_outstanding(peer);
+    int                  ret;
+
+    if (len > rdma_ud_payload_max(ud) || !peer->ah) {
+        fprintf(stderr, "[UD] 消息长度 %u 超过上限 %u 或对端 %d 没有地址\n", len, rdma_ud_payload_max(ud), i);
+        return -1;
+    }
+    if (outstanding >= peer->window) {
+        return 1;
+    }
+    ret = ud_post(ud, peer, UD_MSG_DATA, peer->next_seq, data, len);
+    if (ret) {
+        return ret;
+    }
+    // 超时从窗口由空变为非空时开始计算
+    if (outstanding == 0) {
+        peer->last_ns = rdma_now_ns();
+    }
+    peer->next_seq++;
+    ud->sent++;
+    return 0;
+}
+
+// 回一个累计确认
+static int ud_ack(struct rdma_ud *ud, struct rdma_ud_peer *peer) {
+    int ret = ud_post(ud, peer, UD_MSG_ACK, peer->expect - 1, NULL, 0);
+
+    if (ret == 0) {
+        peer->unacked = 0;
+        ud->acks_sent++;
+    }
+    return ret;
+}
+
+// 接收方按序号统计：跳过的序号先记为丢失，之后迟到的再扣回
+static void ud_sequence(struct rdma_ud_peer *peer, uint32_t seq) {
+    if (seq == peer->expect) {
+        peer->expect++;
+    } else if ((int32_t)(seq - peer->expect) > 0) {
+        peer->lost  += seq - peer->expect;
+        peer->expect = seq + 1;
+    } else {
+        peer->late++;
+        if (peer->lost > 0) {
+            peer->lost--;
+        }
+    }
+    peer->received++;
+    peer->unacked++;
+}
+
+// 处理一条收到的消息，之后归还接收槽
+static int ud_recv(struct rdma_ud *ud, struct ibv_wc *wc, rdma_ud_cb cb, void *arg) {
+    char                *slot = rdma_recv_ring_slot(&ud->ring, wc->wr_id);
+    struct rdma_ud_hdr  *hdr = (struct rdma_ud_hdr *)(slot + UD_GRH_SIZE);
+    struct rdma_ud_peer *peer;
+
+    if (wc->byte_len < UD_GRH_SIZE + sizeof(*hdr) || hdr->len > wc->byte_len - UD_GRH_SIZE - sizeof(*hdr) ||
+        hdr->peer >= (uint32_t)ud->npeers) {
+        ud->dropped++;
+        return rdma_recv_ring_release(&ud->ring, wc->wr_id);
+    }
+    peer = &ud->peers[hdr->peer];
+    if (peer->ah && wc->src_qp != peer->qpn) {
+        ud->dropped++;
+        return rdma_recv_ring_release(&ud->ring, wc->wr_id);
+    }
+
+    if (hdr->type == UD_MSG_ACK) {
+        // 只接受落在已发出范围内、比已确认的更新的确认
+        if ((int32_t)(hdr->seq - peer->acked) > 0 && (int32_t)(peer->next_seq - hdr->seq) > 0) {
+            peer->acked   = hdr->seq;
+            peer->last_ns = rdma_now_ns();
+        }
+        ud->acks_received++;
+    } else if (hdr->type == UD_MSG_DATA) {
+        // 服务端从对端第一条消息的完成事件和 GRH 得到回程地址
+        if (!peer->ah) {
+            peer->ah = ibv_create_ah_from_wc(ud->conn.pd, wc, (struct ibv_grh *)slot, ud->conn.cm_id->port_num);
+            if (!peer->ah) {
+                fprintf(stderr, "ibv_create_ah_from_wc 失败\n");
+                return -1;
+            }
+            peer->qpn = wc->src_qp;
+        }
+        ud_sequence(peer, hdr->seq);
+        if (cb) {
+            cb(arg, peer, hdr + 1, hdr->len);
+        }
+        // 每收到半个窗口确认一次，发送方不必等到窗口耗尽；没有空闲发送槽时留到下一条或空闲时
+        if (peer->unacked >= (peer->window / 2 ? peer->window / 2 : 1) && ud_ack(ud, peer) < 0) {
+            return -1;
+        }
+    } else {
+        ud->dropped++;
+    }
+    return rdma_recv_ring_release(&ud->ring, wc->wr_id);
+}
+
+// 处理完成事件
+int rdma_ud_poll(struct rdma_ud *ud, int timeout_ms, rdma_ud_cb cb, void *arg) {
+    struct ibv_wc wc[PIPELINE_POLL_BATCH];
+    int           n;
+
+    n = rdma_cq_poll(&ud->conn, wc, PIPELINE_POLL_BATCH, timeout_ms);
+    if (n < 0) {
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "[UD] 完成事件错误: %s\n", ibv_wc_status_str(wc[i].status));
+            return -1;
+        }
+        if (wc[i].opcode == IBV_WC_SEND) {
+            ud->inflight--;
+        } else if (ud_recv(ud, &wc[i], cb, arg)) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+// 空闲时补发确认
+int rdma_ud_flush_acks(struct rdma_ud *ud) {
+    int pending = 0;
+
+    for (int i = 0; i < ud->npeers; ++i) {
+        struct rdma_ud_peer *peer = &ud->peers[i];
+        int                  ret;
+
+        if (peer->unacked == 0 || !peer->ah) {
+            continue;
+        }
+        ret = ud_ack(ud, peer);
+        if (ret < 0) {
+            return -1;
+        }
+        pending += ret;
+    }
+    return pending;
+}
+
+// 所有对端未确认的消息数
+uint64_t rdma_ud_pending(const struct rdma_ud *ud) {
+    uint64_t total = 0;
+
+    for (int i = 0; i < ud->npeers; ++i) {
+        total += rdma_ud_outstanding(&ud->peers[i]);
+    }
+    return total;
+}
+
+// 超时记为丢失
+uint64_t rdma_ud_expire(struct rdma_ud *ud) {
+    uint64_t now = rdma_now_ns(), total = 0;
+
+    for (int i = 0; i < ud->npeers; ++i) {
+        struct rdma_ud_peer *peer = &ud->peers[i];
+        uint32_t             outstanding = rdma_ud_outstanding(peer);
+
+        if (outstanding && now - peer->last_ns >= (uint64_t)UD_ACK_TIMEOUT_MS * 1000000) {
+            peer->expired += outstanding;
+            peer->acked    = peer->next_seq - 1;
+            total         += outstanding;
+        }
+    }
+    return total;
+}
+
+// 注册缓冲区、接收 WR 和对端表占用的内存
+size_t rdma_ud_mem_bytes(const struct rdma_ud *ud) {
+    return (size_t)ud->ring.nslots * (ud->ring.slot_size + sizeof(struct ibv_recv_wr) + sizeof(struct ibv_sge)) +
+           (size_t)UD_SEND_SLOTS * ud->mtu + (size_t)ud->max_peers * sizeof(struct rdma_ud_peer);
+}
@@ -0,0 +1,137 @@
+// rdma_ud.h
+// librdmademo: UD（不可靠数据报）传输的 Send/Recv。
+// 每端只有一个 UD QP，与任意多个对端通信，每个对端只需一个地址句柄（AH）和几个计数器，
+// 不像 RC 那样每个对端一个 QP 和各自的接收缓冲区，对端很多时内存和 HCA 上下文开销小得多。
+// 地址交换借用 rdma_cm 的 SIDR（RDMA_PS_UDP）：客户端对每个对端发起一次 rdma_connect，
+// 服务端在 CONNECT_REQUEST 时分配对端编号，用共享 QP 的编号应答后即可销毁子 cm id；
+// 客户端从 ESTABLISHED 事件取得服务端的地址、QP 编号和 Q_Key 创建 AH，服务端在收到对端第一条消息时由完成事件创建 AH。
+// 每条消息不超过路径 MTU，接收槽前 UD_GRH_SIZE 字节由 HCA 写入 GRH，消息从其后开始。
+// UD 不保证送达和顺序，每条消息带每对端递增的序号：接收方据此统计丢失和迟到（乱序或重复），
+// 每收到窗口一半的消息或空闲时回一个累计确认，发送方最多有一个窗口的消息未被确认，
+// 超过 UD_ACK_TIMEOUT_MS 没有确认时把未确认的消息记为丢失并继续发送，不重传。
+// 单线程使用。
+
+#ifndef RDMA_UD_H
+#define RDMA_UD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#include "rdma_common.h"
+#include "rdma_recv_ring.h"
+
+#define UD_GRH_SIZE             40              // 接收槽开头的 GRH
+#define UD_MAX_MTU              4096            // UD 消息（含消息头）的上限
+#define UD_DEFAULT_RECV_SLOTS   4096            // 服务端默认的接收槽数，所有对端共用
+#define UD_DEFAULT_MAX_PEERS    4096            // 服务端默认的对端数上限
+#define UD_SEND_SLOTS           256             // 发送槽数，即发送队列深度
+#define UD_ACK_TIMEOUT_MS       100             // 未确认的消息多久后记为丢失
+
+// 消息类型
+enum {
+    UD_MSG_DATA = 1,
+    UD_MSG_ACK,
+};
+
+// 消息头
+struct rdma_ud_hdr {
+    uint32_t        peer;           // 接收方为发送方分配的对端编号
+    uint32_t        seq;            // 数据的序号（从 1 开始）；确认中为收到的最大序号
+    uint16_t        type;           // UD_MSG_*
+    uint16_t        reserved;
+    uint32_t        len;            // 消息头之后的数据长度
+};
+
+// 建立对端时经 SIDR private_data 交换的信息（网络字节序）
+struct rdma_ud_join {
+    uint32_t        peer;           // 请求中为客户端的对端编号，应答中为服务端分配的编号
+    uint32_t        window;         // 客户端的发送窗口
+};
+
+// 一个对端
+struct rdma_ud_peer {
+    struct ibv_ah  *ah;             // 服务端在收到第一条消息前为 NULL
+    uint32_t        qpn;
+    uint32_t        qkey;
+    uint32_t        remote_id;      // 对端为本端分配的编号，写入发往对端的消息头
+    uint32_t        window;         // 发送窗口（服务端据此决定确认频率）
+    // 发送方
+    uint32_t        next_seq;       // 下一条消息的序号
+    uint32_t        acked;          // 已确认的最大序号
+    uint64_t        last_ns;        // 最近一次确认前进（或从空窗口开始发送）的时间
+    uint64_t        expired;        // 超时记为丢失的消息数
+    // 接收方
+    uint32_t        expect;         // 期望的下一个序号
+    uint32_t        unacked;        // 收到但尚未确认的消息数
+    uint64_t        received;
+    uint64_t        lost;           // 序号跳过的消息数，之后迟到的会扣回
+    uint64_t        late;           // 序号小于期望值的消息数（乱序或重复）
+};
+
+struct rdma_ud {
+    struct rdma_connection  conn;           // qp_type 为 IBV_QPT_UD，服务端的 QP 建在监听 cm id 上
+    struct rdma_recv_ring   ring;           // 所有对端共用的接收槽，每个 UD_GRH_SIZE + mtu 字节
+    struct ibv_mr          *send_mr;
+    char                   *send_buf;       // UD_SEND_SLOTS 个 mtu 字节的发送槽，按顺序使用
+    uint64_t                send_head;      // 已投递的发送数
+    int                     inflight;       // 已投递、尚未完成的发送数
+    uint32_t                mtu;            // 端口的当前 MTU，消息（含消息头）的上限
+    struct rdma_ud_peer    *peers;
+    int                     npeers;
+    int                     max_peers;
+    uint64_t                sent;           // 发出的数据消息数
+    uint64_t                acks_sent;
+    uint64_t                acks_received;
+    uint64_t                dropped;        // 不完整或对端编号无效的消息数
+};
+
+// 收到数据消息的回调：data 指向接收槽中的数据，回调返回后即失效
+typedef void (*rdma_ud_cb)(void *arg, struct rdma_ud_peer *peer, const void *data, uint32_t len);
+
+// 服务端：在 ip:port 上监听并创建共享 UD QP 和 recv_slots 个接收槽（<= 0 时使用默认值），最多接受 max_peers 个对端。
+// opts 中的 qp_type 和队列深度会被覆盖。失败时由调用者 rdma_ud_destroy
+int rdma_ud_server_init(struct rdma_ud *ud, const char *ip, int port, const struct rdma_conn_opts *opts,
+                        int max_peers, int recv_slots);
+
+// 客户端：创建 UD QP，向 ip:port 建立 npeers 个对端，每个对端的发送窗口为 window 条消息。
+// 接收槽只用于确认，数量按全部窗口之和。失败时由调用者 rdma_ud_destroy
+int rdma_ud_client_init(struct rdma_ud *ud, const char *ip, int port, const struct rdma_conn_opts *opts,
+                        int npeers, uint32_t window);
+
+// 服务端：非阻塞处理所有待处理的 CM 事件，接受新对端。返回新接受的对端数，出错返回 -1
+int rdma_ud_accept(struct rdma_ud *ud);
+
+// 释放所有资源
+void rdma_ud_destroy(struct rdma_ud *ud);
+
+// 每条消息的数据上限
+static inline uint32_t rdma_ud_payload_max(const struct rdma_ud *ud) {
+    return ud->mtu - sizeof(struct rdma_ud_hdr);
+}
+
+// 对端未确认的消息数
+static inline uint32_t rdma_ud_outstanding(const struct rdma_ud_peer *peer) {
+    return peer->next_seq - 1 - peer->acked;
+}
+
+// 所有对端未确认的消息数
+uint64_t rdma_ud_pending(const struct rdma_ud *ud);
+
+// 向第 peer 个对端发送 len 字节的数据。成功返回 0，窗口已满或没有空闲发送槽返回 1，出错返回 -1
+int rdma_ud_send(struct rdma_ud *ud, int peer, const void *data, uint32_t len);
+
+// 处理完成事件，按连接的轮询策略等待最多 timeout_ms 毫秒（-1 一直等待）：
+// 数据消息更新序号统计、调用 cb（可为 NULL）并按需回确认，确认推进发送窗口。返回处理的完成数，出错返回 -1
+int rdma_ud_poll(struct rdma_ud *ud, int timeout_ms, rdma_ud_cb cb, void *arg);
+
+// 为所有有未确认消息的对端回确认，空闲时调用。返回仍未能确认（没有空闲发送槽）的对端数，出错返回 -1
+int rdma_ud_flush_acks(struct rdma_ud *ud);
+
+// 把超过 UD_ACK_TIMEOUT_MS 没有确认的消息记为丢失，腾出窗口。返回本次记为丢失的消息数
+uint64_t rdma_ud_expire(struct rdma_ud *ud);
+
+// 注册缓冲区和对端表占用的内存（字节）
+size_t rdma_ud_mem_bytes(const struct rdma_ud *ud);
+
+#endif // RDMA_UD_H
@@ -3,6 +3,9 @@
 // 用法：
 // 服务器：./rdma_atomic_demo -s -a <本机IP> -p <端口> [-n <次数>]
 // 客户端：./rdma_atomic_demo -c -a <服务器IP> -p <端口> [-n <次数>]
+// 完成轮询：-P busy|event|adaptive[:<微秒>] 选择忙轮询、事件驱动或自适应
+// 基准测试：服务端 -m <线程数> 共享一组计数器，客户端 -B faa|cas [-q <QP数>] [-t <线程数>] [-d <深度>] [-k <计数器数>] [-L]
+// 锁测试：服务端 -m <线程数> 的计数器数组同时作为锁表，客户端 -B lock [-q <QP数>] [-t <线程数>] [-k <锁数>] [-e <租约毫秒>]
 //
 // 依赖：libibverbs, librdmacm
 //
@@ -14,24 +17,50 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
 #include <rdma/rdma_cma.h>
 
+#include "rdma_common.h"
+#include "rdma_cq.h"
+#include "rdma_lock.h"
+#include "rdma_multi.h"
+#include "rdma_perf.h"
+#include "rdma_server.h"
+
 #define COUNTER_SIZE        8           // 64位计数器
 #define DEFAULT_PORT        18515
 #define DEFAULT_COUNT       10
 #define ATOMIC_ADD_VALUE    1           // 每次原子加1
-
-#define ROLE_UNDEF          0
-#define ROLE_SERVER         1
-#define ROLE_CLIENT         2
+#define BENCH_COUNTERS      256         // 基准测试服务端共享的计数器数，锁测试时为锁表的槽数
+#define BENCH_COUNTER_STRIDE 64         // 计数器间隔，每个独占一个缓存行；锁测试时锁字之后是受保护的计数器
+#define BENCH_ATOMIC_ITERS  100000      // 吞吐量测试时每个 QP 的默认操作数
+
+// 基准测试的原子操作
+enum {
+    ATOMIC_OP_NONE = 0,
+    ATOMIC_OP_FAA,
+    ATOMIC_OP_CAS,
+    ATOMIC_OP_LOCK,     // 基于 CAS 的锁表
+};
 
 struct atomic_config {
     int         role;
     char        ip[64];
     int         port;
     int         count;
+    int         poll_mode;
+    int         poll_spin_us;
+    int         rd_atomic;      // 并发 RDMA Read/Atomic 数上限，0 表示按两端设备能力协商
+    int         bench_op;       // 基准测试的原子操作 ATOMIC_OP_*，0 表示不测试
+    int         depth;          // 基准测试时每个 QP 同时未完成的原子操作数
+    int         num_qps;        // 客户端连接（QP）数
+    int         threads;        // 客户端驱动 QP 的线程数
+    int         counters;       // 客户端使用的计数器数，QP i 操作第 i % counters 个
+    int         latency;        // 逐个操作测延迟
+    int         workers;        // 多客户端服务端的工作线程数，0 表示只服务一个客户端
+    uint32_t    lease_ms;       // 锁测试的租约时长（毫秒），0 表示默认值
 };
 
 void print_usage(const char *prog) {
@@ -41,6 +70,20 @@ void print_usage(const char *prog) {
     printf("  -a <IP>      指定对端IP地址\n");
     printf("  -p <端口>    指定端口 (默认%d)\n", DEFAULT_PORT);
     printf("  -n <次数>    原子操作次数 (默认%d)\n", DEFAULT_COUNT);
+    printf("  -P <策略>    完成轮询策略: busy (默认)、event、adaptive[:<微秒>] (默认忙轮询%d微秒后阻塞)\n",
+           DEFAULT_POLL_SPIN_US);
+    printf("  -O <数>      并发 RDMA Read/Atomic 数上限 (默认按两端设备能力协商)\n");
+    printf("  -B faa|cas   客户端原子操作基准测试：多个 QP 流水线执行 Fetch and Add 或 Compare and Swap，服务端需加 -m\n");
+    printf("  -d <深度>    基准测试时每个 QP 保持 <深度> 个原子操作未完成 (默认%d)\n", BENCH_DEFAULT_DEPTH);
+    printf("  -q <QP数>    基准测试建立 <QP数> 个连接 (默认 1)\n");
+    printf("  -t <线程数>  用 <线程数> 个绑核线程驱动这些 QP (默认 1)\n");
+    printf("  -k <计数器数> QP i 操作第 i %% <计数器数> 个计数器，1 为所有 QP 争用同一个 (默认 1，最多 %d)\n",
+           BENCH_COUNTERS);
+    printf("  -L           基准测试改为逐个操作测延迟，CAS 按 比较-交换-失败重试 的方式递增计数器\n");
+    printf("  -B lock      客户端锁测试：各 QP 随机选 -k 个锁之一，CAS 加锁、读-改-写受保护的计数器、解锁，服务端需加 -m\n");
+    printf("  -e <毫秒>    锁测试的租约时长，持有者超过租约未释放时等待者可抢占 (默认%d，最大%d)\n",
+           LOCK_DEFAULT_LEASE_MS, LOCK_MAX_LEASE_MS);
+    printf("  -m <线程数>  服务端多客户端模式，所有连接共享 %d 个计数器（锁测试时为锁表），Ctrl-C 退出\n", BENCH_COUNTERS);
 }
 
 int parse_args(int argc, char **argv, struct atomic_config *cfg) {
@@ -48,182 +91,96 @@ int parse_args(int argc, char **argv, struct atomic_config *cfg) {
 
     memset(cfg, 0, sizeof(*cfg));
     cfg->port  = DEFAULT_PORT;
-    cfg->count = DEFAULT_COUNT;
-    while ((opt = getopt(argc, argv, "sca:p:n:")) != -1) {
+    cfg->poll_spin_us = DEFAULT_POLL_SPIN_US;
+    while ((opt = getopt(argc, argv, "sca:p:n:P:O:B:d:q:t:k:Lm:e:")) != -1) {
         switch (opt) {
             case 's': cfg->role = ROLE_SERVER; break;
             case 'c': cfg->role = ROLE_CLIENT; break;
             case 'a': strncpy(cfg->ip, optarg, sizeof(cfg->ip)-1); break;
             case 'p': cfg->port = atoi(optarg); break;
             case 'n': cfg->count = atoi(optarg); break;
+            case 'O': cfg->rd_atomic = atoi(optarg); break;
+            case 'd': cfg->depth = atoi(optarg); break;
+            case 'q': cfg->num_qps = atoi(optarg); break;
+            case 't': cfg->threads = atoi(optarg); break;
+            case 'k': cfg->counters = atoi(optarg); break;
+            case 'L': cfg->latency = 1; break;
+            case 'm': cfg->workers = atoi(optarg); break;
+            case 'e': cfg->lease_ms = strtoul(optarg, NULL, 0); break;
+            case 'B':
+                if (strcmp(optarg, "faa") == 0) {
+                    cfg->bench_op = ATOMIC_OP_FAA;
+                } else if (strcmp(optarg, "cas") == 0) {
+                    cfg->bench_op = ATOMIC_OP_CAS;
+                } else if (strcmp(optarg, "lock") == 0) {
+                    cfg->bench_op = ATOMIC_OP_LOCK;
+                } else {
+                    fprintf(stderr, "-B 只支持 faa、cas 或 lock\n");
+                    return -1;
+                }
+                break;
+            case 'P':
+                if (rdma_parse_poll_mode(optarg, &cfg->poll_mode, &cfg->poll_spin_us)) return -1;
+                break;
             default: print_usage(argv[0]); return -1;
         }
     }
-    if (cfg->role == ROLE_UNDEF || cfg->ip[0] == '\0') {
-        print_usage(argv[0]);
+    if (!cfg->bench_op && (cfg->latency || cfg->num_qps > 0 || cfg->threads > 0 || cfg->counters > 0)) {
+        fprintf(stderr, "-L/-q/-t/-k 需配合 -B 使用\n");
         return -1;
     }
-    return 0;
-}
-
-// =================== rdma_cm 方式实现 ===================
-// 资源结构体
-struct rdma_connection {
-    struct rdma_event_channel *ec;
-    struct rdma_cm_id         *cm_id;
-    struct ibv_pd             *pd;
-    struct ibv_comp_channel   *comp_ch;
-    struct ibv_cq             *cq;
-    struct ibv_qp             *qp;
-    struct ibv_mr             *mr;
-    uint64_t                  *buf;     // 64位计数器缓冲区
-};
-
-struct atomic_mr_info {
-    uint32_t rkey;
-    uint64_t vaddr;
-};
-
-int rdma_connection_init(struct rdma_connection *conn, struct atomic_config *cfg) {
-    struct sockaddr_in addr;
-    int                ret = 0;
-
-    memset(conn, 0, sizeof(*conn));
-    conn->ec = rdma_create_event_channel();
-    if (!conn->ec) {
-        fprintf(stderr, "rdma_create_event_channel 失败\n");
-        return -1;
+    if (cfg->counters <= 0) {
+        cfg->counters = 1;
     }
-
-    ret = rdma_create_id(conn->ec, &conn->cm_id, NULL, RDMA_PS_TCP);
-    if (ret) {
-        fprintf(stderr, "rdma_create_id 失败 %d\n", ret);
+    if (cfg->counters > BENCH_COUNTERS) {
+        fprintf(stderr, "计数器数 %d 超过上限 %d\n", cfg->counters, BENCH_COUNTERS);
         return -1;
     }
-
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(cfg->port);
-    addr.sin_addr.s_addr = inet_addr(cfg->ip);
-    if (cfg->role == ROLE_SERVER) {
-        ret = rdma_bind_addr(conn->cm_id, (struct sockaddr*)&addr);
-        if (ret) {
-            fprintf(stderr, "rdma_bind_addr 失败 %d\n", ret);
-            return -1;
-        }
-        ret = rdma_listen(conn->cm_id, 1);
-        if (ret) {
-            fprintf(stderr, "rdma_listen 失败 %d\n", ret);
-            return -1;
-        }
-    } else {
-        ret = rdma_resolve_addr(conn->cm_id, NULL, (struct sockaddr*)&addr, 2000);
-        if (ret) {
-            fprintf(stderr, "rdma_resolve_addr 失败 %d\n", ret);
-            return -1;
-        }
-    }
-    return 0;
-}
-
-void rdma_connection_cleanup(struct rdma_connection *conn) {
-    if (conn->mr)      ibv_dereg_mr(conn->mr);
-    if (conn->cq)      ibv_destroy_cq(conn->cq);
-    if (conn->comp_ch) ibv_destroy_comp_channel(conn->comp_ch);
-    if (conn->pd)      ibv_dealloc_pd(conn->pd);
-    if (conn->cm_id)   rdma_destroy_id(conn->cm_id);
-    if (conn->ec)      rdma_destroy_event_channel(conn->ec);
-    if (conn->buf)     free(conn->buf);
-}
-
-int wait_event(struct rdma_connection *conn, enum rdma_cm_event_type expect, struct rdma_cm_event **evt) {
-    int ret = 0;
-
-    ret = rdma_get_cm_event(conn->ec, evt);
-    if (ret) {
-        fprintf(stderr, "rdma_get_cm_event 失败 %d\n", ret);
+    // 锁表的第 0 个槽是属主编号分配器
+    if (cfg->bench_op == ATOMIC_OP_LOCK && cfg->counters > BENCH_COUNTERS - 1) {
+        fprintf(stderr, "锁数 %d 超过上限 %d\n", cfg->counters, BENCH_COUNTERS - 1);
         return -1;
     }
-
-    if ((*evt)->event != expect) {
-        fprintf(stderr, "期望事件 %d, 实际事件 %d\n", expect, (*evt)->event);
-        rdma_ack_cm_event(*evt);
-        return -1;
-    }
-    return 0;
-}
-
-int build_qp(struct rdma_connection *conn) {
-    struct ibv_qp_init_attr init_attr;
-
-    conn->pd = ibv_alloc_pd(conn->cm_id->verbs);
-    if (!conn->pd) {
-        fprintf(stderr, "ibv_alloc_pd 失败\n");
-        return -1;
+    if (cfg->num_qps <= 0) {
+        cfg->num_qps = cfg->threads > 0 ? cfg->threads : 1;
     }
-
-    conn->comp_ch = ibv_create_comp_channel(conn->cm_id->verbs);
-    if (!conn->comp_ch) {
-        fprintf(stderr, "ibv_create_comp_channel 失败\n");
-        return -1;
-    }
-
-    conn->cq = ibv_create_cq(conn->cm_id->verbs, 10, NULL, conn->comp_ch, 0);
-    if (!conn->cq) {
-        fprintf(stderr, "ibv_create_cq 失败\n");
-        return -1;
-    }
-
-    memset(&init_attr, 0, sizeof(init_attr));
-    init_attr.send_cq          = conn->cq;
-    init_attr.recv_cq          = conn->cq;
-    init_attr.qp_type          = IBV_QPT_RC;
-    init_attr.cap.max_send_wr  = 10;
-    init_attr.cap.max_recv_wr  = 10;
-    init_attr.cap.max_send_sge = 1;
-    init_attr.cap.max_recv_sge = 1;
-    int ret = rdma_create_qp(conn->cm_id, conn->pd, &init_attr);
-    if (ret) {
-        fprintf(stderr, "rdma_create_qp 失败\n");
-        return -1;
+    if (cfg->depth <= 0) {
+        cfg->depth = BENCH_DEFAULT_DEPTH;
     }
-    conn->qp = conn->cm_id->qp;
-    return 0;
-}
-
-int reg_mem(struct rdma_connection *conn) {
-    if (posix_memalign((void**)&conn->buf, 4096, COUNTER_SIZE) != 0) {
-        fprintf(stderr, "posix_memalign 失败\n");
-        return -1;
+    if (cfg->count <= 0) {
+        if (!cfg->bench_op) {
+            cfg->count = DEFAULT_COUNT;
+        } else {
+            cfg->count = cfg->latency || cfg->bench_op == ATOMIC_OP_LOCK ? BENCH_DEFAULT_ITERS : BENCH_ATOMIC_ITERS;
+        }
     }
-    
-    // 初始化计数器为0
-    *conn->buf = 0;
-
-    // 注册内存，需要REMOTE_ATOMIC权限用于原子操作
-    conn->mr = ibv_reg_mr(conn->pd, conn->buf, COUNTER_SIZE, 
-                         IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_ATOMIC);
-    if (!conn->mr) {
-        fprintf(stderr, "ibv_reg_mr 失败\n");
+    if (cfg->role == ROLE_UNDEF || cfg->ip[0] == '\0') {
+        print_usage(argv[0]);
         return -1;
     }
     return 0;
 }
 
+// =================== rdma_cm 方式实现 ===================
 int run_server(struct atomic_config *cfg) {
     struct rdma_connection server_conn;
+    struct rdma_conn_opts  opts;
     struct rdma_cm_event  *evt = NULL;
     struct rdma_cm_id     *child = NULL;
     struct rdma_conn_param conn_param;
     int                    operation_count = 0;
-    int                    listen_sock = -1, conn_sock = -1;
-    struct atomic_mr_info  local_info, remote_info;
-    int                    sock_opt = 1;
-    struct sockaddr_in     sin;
+    struct rdma_mr_info    local_info, remote_info;
+    struct ibv_wc          wc;
     uint64_t               last_value = 0;
+    volatile uint64_t     *counter = NULL;
 
     printf("[服务端] 启动，监听 %s:%d，等待连接...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&server_conn, cfg)) {
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.initiator_depth     = cfg->rd_atomic;
+    opts.responder_resources = cfg->rd_atomic;
+    if (rdma_connection_init(&server_conn, cfg->role, cfg->ip, cfg->port, &opts)) {
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     }
@@ -233,6 +190,12 @@ int run_server(struct atomic_config *cfg) {
         goto cleanup;
     }
     child = evt->id;
+    rdma_apply_peer_param(&server_conn, evt);
+    // 客户端的 rkey/vaddr 随连接请求的 private_data 到达（服务端用不到）
+    if (rdma_unpack_mr_info(evt, &remote_info)) {
+        rdma_ack_cm_event(evt);
+        goto cleanup;
+    }
     rdma_ack_cm_event(evt);
     server_conn.cm_id = child;
     
@@ -240,18 +203,24 @@ int run_server(struct atomic_config *cfg) {
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&server_conn)) {
+    if (reg_mem(&server_conn, COUNTER_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_ATOMIC)) {
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
 
-    printf("[服务端] 共享计数器初始值: %lu\n", *server_conn.buf);
-    
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
-    conn_param.retry_count = 7;
-    conn_param.rnr_retry_count = 7;
+    // 计数器由 reg_mem 清零，远端原子操作直接修改该内存
+    counter = (volatile uint64_t *)server_conn.buf;
+    printf("[服务端] 共享计数器初始值: %lu\n", *counter);
+
+    // 客户端每次原子操作后发送零长度消息作为 ack，先预投递接收
+    if (rdma_post_empty_recv(&server_conn, server_conn.opts.max_recv_wr)) {
+        goto cleanup;
+    }
+    // 本地 rkey/vaddr 放在 rdma_accept 的 private_data 中发给客户端
+    rdma_pack_mr_info(&local_info, server_conn.buf, server_conn.buf_size, server_conn.mr);
+    rdma_fill_conn_param(&server_conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
     if (rdma_accept(server_conn.cm_id, &conn_param)) {
         fprintf(stderr, "rdma_accept 失败\n");
         goto cleanup;
@@ -262,117 +231,88 @@ int run_server(struct atomic_config *cfg) {
     }
     rdma_ack_cm_event(evt);
 
-    // 建立 socket 用于 rkey/vaddr 交换和 ack
-    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_sock < 0) {
-        fprintf(stderr, "socket 创建失败\n");
-        goto cleanup;
-    }
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &sock_opt, sizeof(sock_opt));
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(cfg->port + 1);
-    if (bind(listen_sock, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
-        fprintf(stderr, "bind 失败\n");
-        goto cleanup;
-    }
-    listen(listen_sock, 1);
-
-    conn_sock = accept(listen_sock, NULL, NULL);
-    if (conn_sock < 0) {
-        fprintf(stderr, "accept 失败\n");
-        goto cleanup;
-    }
-    
-    local_info.rkey = server_conn.mr->rkey;
-    local_info.vaddr = (uintptr_t)server_conn.buf;
-    // 发送本地 rkey/vaddr，接收对方 rkey/vaddr（客户端用不到）
-    if (write(conn_sock, &local_info, sizeof(local_info)) != sizeof(local_info)) {
-        fprintf(stderr, "write local_info 失败\n");
-        goto cleanup;
-    }
-    if (read(conn_sock, &remote_info, sizeof(remote_info)) != sizeof(remote_info)) {
-        fprintf(stderr, "read remote_info 失败\n");
-        goto cleanup;
-    }
-    printf("[服务端] 连接建立，等待客户端原子操作...\n");
+    printf("[服务端] 连接建立，为客户端保留 %d 个并发原子操作的响应资源，等待客户端原子操作...\n",
+           server_conn.responder_resources);
 
-    // 轮询等待客户端 ack，并检测计数器变化
-    char ack_buf[8];
+    // 轮询等待客户端 ack，并检测计数器变化；客户端断开时退出
     while (operation_count < cfg->count) {
-        int n = read(conn_sock, ack_buf, sizeof(ack_buf));
-        if (n > 0) {
-            operation_count++;
-            uint64_t current_value = *server_conn.buf;
-            printf("[服务端] 收到第 %d 次原子操作完成通知，计数器值: %lu -> %lu (增加: %lu)\n", 
-                   operation_count, last_value, current_value, current_value - last_value);
-            last_value = current_value;
-        } else if (n == 0) {
+        int n = rdma_cq_poll(&server_conn, &wc, 1, CQ_CHECK_INTERVAL_MS);
+        if (n < 0) {
             break;
-        } else if (errno == EINTR) {
+        }
+        if (n == 0) {
+            if (rdma_check_disconnect(&server_conn)) {
+                break;
+            }
             continue;
-        } else {
-            fprintf(stderr, "ack 读取失败\n");
+        }
+        if (wc.status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "[服务端] 完成队列错误: %s\n", ibv_wc_status_str(wc.status));
+            break;
+        }
+        if (wc.opcode != IBV_WC_RECV) {
+            continue;
+        }
+        operation_count++;
+        uint64_t current_value = *counter;
+        printf("[服务端] 收到第 %d 次原子操作完成通知，计数器值: %lu -> %lu (增加: %lu)\n", 
+               operation_count, last_value, current_value, current_value - last_value);
+        last_value = current_value;
+        if (rdma_post_empty_recv(&server_conn, 1)) {
             break;
         }
     }
-    printf("[服务端] 客户端原子操作完毕，最终计数器值: %lu，退出。\n", *server_conn.buf);
+    printf("[服务端] 客户端原子操作完毕，最终计数器值: %lu，退出。\n", counter ? *counter : 0);
     
 cleanup:
-    if (conn_sock >= 0) close(conn_sock);
-    if (listen_sock >= 0) close(listen_sock);
     rdma_connection_cleanup(&server_conn);
     return 0;
 }
 
 int run_client(struct atomic_config *cfg) {
     struct rdma_connection client_conn;
+    struct rdma_conn_opts  opts;
     struct rdma_cm_event  *evt = NULL;
     struct rdma_conn_param conn_param;
-    struct atomic_mr_info  local_info, remote_info;
+    struct rdma_mr_info    local_info, remote_info;
     struct ibv_sge         sge;
     struct ibv_send_wr     wr, *bad_wr = NULL;
-    int                    sockfd = -1;
-    struct sockaddr_in     sin;
     struct ibv_wc          wc;
     uint64_t               old_value;
 
     printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&client_conn, cfg)) {
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.initiator_depth     = cfg->rd_atomic;
+    opts.responder_resources = cfg->rd_atomic;
+    if (rdma_connection_init(&client_conn, cfg->role, cfg->ip, cfg->port, &opts)) {
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     }
     
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ADDR_RESOLVED, &evt)) {
-        fprintf(stderr, "地址解析失败\n");
-        goto cleanup;
-    }
-    rdma_ack_cm_event(evt);
-    if (rdma_resolve_route(client_conn.cm_id, 2000)) {
-        fprintf(stderr, "路由解析失败\n");
-        goto cleanup;
-    }
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ROUTE_RESOLVED, &evt)) {
-        fprintf(stderr, "路由解析事件失败\n");
+    // 地址解析、路由解析完成后才能继续创建 QP 和建立连接。
+    
+    if (rdma_client_resolve(&client_conn)) {
+    
         goto cleanup;
+    
     }
-    rdma_ack_cm_event(evt);
     
     if (build_qp(&client_conn)) {
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&client_conn)) {
+    if (reg_mem(&client_conn, COUNTER_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_ATOMIC)) {
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
     
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
-    conn_param.retry_count = 7;
-    conn_param.rnr_retry_count = 7;
+    // 本地 rkey/vaddr 随连接请求发出，服务端的在连接建立事件中返回
+    rdma_pack_mr_info(&local_info, client_conn.buf, client_conn.buf_size, client_conn.mr);
+    rdma_fill_conn_param(&client_conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
     if (rdma_connect(client_conn.cm_id, &conn_param)) {
         fprintf(stderr, "rdma_connect 失败\n");
         goto cleanup;
@@ -381,34 +321,12 @@ int run_client(struct atomic_config *cfg) {
         fprintf(stderr, "等待连接建立成功事件失败\n");
         goto cleanup;
     }
-    rdma_ack_cm_event(evt);
-
-    sleep(1);
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        fprintf(stderr, "socket 创建失败\n");
-        goto cleanup;
-    }
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = inet_addr(cfg->ip);
-    sin.sin_port = htons(cfg->port + 1);
-    if (connect(sockfd, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
-        fprintf(stderr, "connect 失败\n");
-        goto cleanup;
-    }
-    
-    // 先接收服务端 rkey/vaddr，再发送本地 rkey/vaddr（服务端用不到）
-    if (read(sockfd, &remote_info, sizeof(remote_info)) != sizeof(remote_info)) {
-        fprintf(stderr, "read remote_info 失败\n");
-        goto cleanup;
-    }
-    local_info.rkey = client_conn.mr->rkey;
-    local_info.vaddr = (uintptr_t)client_conn.buf;
-    if (write(sockfd, &local_info, sizeof(local_info)) != sizeof(local_info)) {
-        fprintf(stderr, "write local_info 失败\n");
+    rdma_apply_peer_param(&client_conn, evt);
+    if (rdma_unpack_mr_info(evt, &remote_info)) {
+        rdma_ack_cm_event(evt);
         goto cleanup;
     }
+    rdma_ack_cm_event(evt);
 
     // 设置原子操作的WR
     memset(&sge, 0, sizeof(sge));
@@ -425,7 +343,8 @@ int run_client(struct atomic_config *cfg) {
     wr.wr.atomic.rkey        = remote_info.rkey;
     wr.wr.atomic.compare_add = ATOMIC_ADD_VALUE;  // 每次加1
     
-    printf("[客户端] 连接建立，开始执行原子 Fetch and Add 操作...\n");
+    printf("[客户端] 连接建立，协商的并发原子操作数 %d，开始执行原子 Fetch and Add 操作...\n",
+           client_conn.initiator_depth);
     
     for (int i = 0; i < cfg->count; ++i) {
         if (ibv_post_send(client_conn.qp, &wr, &bad_wr)) {
@@ -434,29 +353,18 @@ int run_client(struct atomic_config *cfg) {
         }
         
         // 等待完成
-        while (1) {
-            int n = ibv_poll_cq(client_conn.cq, 1, &wc);
-            if (n < 0) {
-                fprintf(stderr, "ibv_poll_cq 失败\n");
-                goto cleanup;
-            }
-            if (n == 0) {
-                continue;
-            }
-            if (wc.status != IBV_WC_SUCCESS) {
-                fprintf(stderr, "[客户端] 完成队列错误: %s\n", ibv_wc_status_str(wc.status));
-                goto cleanup;
-            }
-            if (wc.opcode == IBV_WC_FETCH_ADD) break;
+        if (rdma_wait_completion(&client_conn, IBV_WC_FETCH_ADD, &wc)) {
+            fprintf(stderr, "[客户端] 原子操作失败\n");
+            goto cleanup;
         }
         
         // 获取原子操作返回的原始值
-        old_value = *client_conn.buf;
+        old_value = *(uint64_t *)client_conn.buf;
         printf("[客户端] 第 %d 次原子操作完成，获取的原始值: %lu，新值应为: %lu\n", 
                i+1, old_value, old_value + ATOMIC_ADD_VALUE);
         
-        // 发送 ack
-        if (write(sockfd, "ACK", 3) != 3) {
+        // 发送零长度消息作为 ack
+        if (rdma_send_empty(&client_conn) || rdma_wait_completion(&client_conn, IBV_WC_SEND, NULL)) {
             fprintf(stderr, "ack 发送失败\n");
             goto cleanup;
         }
@@ -466,11 +374,470 @@ int run_client(struct atomic_config *cfg) {
     printf("[客户端] 原子操作完毕，退出。\n");
     
 cleanup:
-    if (sockfd >= 0) close(sockfd);
     rdma_connection_cleanup(&client_conn);
     return 0;
 }
 
+// =================== 原子操作基准测试 ===================
+// 服务端：所有连接共用一块注册在服务端 PD 上的计数器数组，连接请求时把同一份 MR 信息发给每个客户端，
+// 之后不再参与数据传输
+struct bench_server_arg {
+    struct rdma_mr_info info;           // 计数器数组的 MR 信息（网络字节序）
+};
+
+static int bench_on_connect(struct rdma_server_client *cli, const struct rdma_cm_event *evt,
+                            struct rdma_conn_param *param, void *arg) {
+    struct bench_server_arg *ba = arg;
+
+    // 所有连接发送同一份 MR 信息，它在服务端退出前一直有效
+    param->private_data     = &ba->info;
+    param->private_data_len = sizeof(ba->info);
+    return 0;
+}
+
+static void bench_on_disconnect(struct rdma_server_client *cli, void *arg) {
+    printf("[服务端] 连接 %lu 断开\n", cli->id);
+}
+
+// 基准测试服务端主流程
+int run_bench_server(struct atomic_config *cfg) {
+    struct rdma_server      srv;
+    struct rdma_conn_opts   opts;
+    struct bench_server_arg ba;
+    struct rdma_server_ops  ops = {
+        .on_connect    = bench_on_connect,
+        .on_disconnect = bench_on_disconnect,
+    };
+    struct ibv_mr          *mr = NULL;
+    char                   *counters = NULL;
+    size_t                  size = (size_t)BENCH_COUNTERS * BENCH_COUNTER_STRIDE;
+    int                     ret = -1;
+
+    memset(&ba, 0, sizeof(ba));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.responder_resources = cfg->rd_atomic;
+    if (rdma_server_init(&srv, cfg->ip, cfg->port, &opts, cfg->workers, &ops, &ba)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        rdma_server_cleanup(&srv);
+        return -1;
+    }
+    if (posix_memalign((void **)&counters, 4096, size) != 0) {
+        fprintf(stderr, "posix_memalign 失败\n");
+        goto cleanup;
+    }
+    memset(counters, 0, size);
+    // 锁测试在锁内用 RDMA Read/Write 访问受保护的计数器
+    mr = ibv_reg_mr(srv.pd, counters, size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_ATOMIC |
+                                            IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+    if (!mr) {
+        fprintf(stderr, "ibv_reg_mr 失败\n");
+        goto cleanup;
+    }
+    rdma_pack_mr_info(&ba.info, counters, size, mr);
+
+    rdma_server_stop_on_sigint(&srv);
+    printf("[服务端] 多客户端模式，%d 个工作线程，监听 %s:%d，共享 %d 个计数器，Ctrl-C 退出...\n",
+           srv.nworkers, cfg->ip, cfg->port, BENCH_COUNTERS);
+    ret = rdma_server_run(&srv);
+    rdma_server_stop_on_sigint(NULL);
+    for (int i = 0; i < BENCH_COUNTERS; ++i) {
+        uint64_t value = *(volatile uint64_t *)(counters + (size_t)i * BENCH_COUNTER_STRIDE);
+
+        if (value) {
+            printf("[服务端] 计数器 %d: %lu\n", i, value);
+        }
+    }
+
+cleanup:
+    // PD 释放前必须注销 MR；此时仍连着的客户端之后的原子操作会以远端访问错误结束
+    if (mr) {
+        ibv_dereg_mr(mr);
+    }
+    rdma_server_cleanup(&srv);
+    free(counters);
+    printf("[服务端] 退出。\n");
+    return ret;
+}
+
+// 同步执行一个原子操作，取回计数器原值
+static int atomic_sync(struct rdma_connection *conn, const struct ibv_send_wr *tmpl, uint64_t *old_value) {
+    struct ibv_send_wr  wr = *tmpl, *bad_wr = NULL;
+    struct ibv_wc       wc;
+
+    wr.next       = NULL;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send (ATOMIC) 失败\n");
+        return -1;
+    }
+    if (rdma_wait_completion(conn, wr.opcode == IBV_WR_ATOMIC_CMP_AND_SWP ? IBV_WC_COMP_SWAP : IBV_WC_FETCH_ADD,
+                             &wc)) {
+        return -1;
+    }
+    *old_value = *(volatile uint64_t *)conn->buf;
+    return 0;
+}
+
+// 通过第一个 QP 用 Fetch and Add 0 读取从第 first 个槽起 n 个槽中、槽内 offset 处的计数器之和
+static int bench_counter_sum(struct rdma_multi *m, int first, int n, size_t offset, uint64_t *sum) {
+    struct rdma_multi_qp *q = &m->qps[0];
+    struct ibv_send_wr    wr = q->wr;
+    uint64_t              value;
+
+    *sum = 0;
+    wr.opcode                = IBV_WR_ATOMIC_FETCH_AND_ADD;
+    wr.wr.atomic.compare_add = 0;
+    for (int i = first; i < first + n; ++i) {
+        wr.wr.atomic.remote_addr = q->remote.vaddr + (uint64_t)i * BENCH_COUNTER_STRIDE + offset;
+        if (atomic_sync(&q->conn, &wr, &value)) {
+            return -1;
+        }
+        *sum += value;
+    }
+    return 0;
+}
+
+// 延迟测试线程：逐个执行名下各 QP 的原子操作（或加锁），记录每次递增计数器（或加锁）的耗时
+struct bench_lat_thread {
+    struct rdma_multi       *m;
+    pthread_t                tid;
+    int                      index;
+    int                     *go;            // 所有线程创建完成后置 1 同时开始，创建失败置 -1
+    int                      ret;
+    uint64_t                 cas_retries;   // CAS 因计数器已被其他 QP 改变而重试的次数
+    struct rdma_lock_client *locks;         // 锁测试时每个 QP 的锁表客户端，否则为 NULL
+    int                      nlocks;        // 锁测试使用的锁数
+    struct rdma_histogram    hist;
+};
+
+// 延迟测试线程开始前的准备：绑核并等待所有线程就绪，创建失败时返回 -1
+static int bench_thread_start(struct bench_lat_thread *t) {
+    rdma_hist_reset(&t->hist);
+    if (rdma_pin_thread(t->index)) {
+        fprintf(stderr, "线程 %d 绑定 CPU 失败\n", t->index);
+    }
+    while (__atomic_load_n(t->go, __ATOMIC_ACQUIRE) == 0) {
+    }
+    return __atomic_load_n(t->go, __ATOMIC_ACQUIRE) < 0 ? -1 : 0;
+}
+
+static void *bench_lat_main(void *arg) {
+    struct bench_lat_thread *t = arg;
+    struct rdma_multi       *m = t->m;
+    uint64_t                *expect;            // 每个 QP 对计数器当前值的猜测，CAS 以它为比较值
+
+    expect = calloc(m->nqps, sizeof(*expect));
+    if (!expect) {
+        fprintf(stderr, "分配线程 %d 的期望值失败\n", t->index);
+        t->ret = -1;
+    }
+    if (bench_thread_start(t) || !expect) {
+        free(expect);
+        return NULL;
+    }
+
+    for (uint64_t n = 0; n < m->iters; ++n) {
+        for (int i = 0; i < m->nqps; ++i) {
+            struct rdma_multi_qp *q = &m->qps[i];
+            struct ibv_send_wr    wr = q->wr;
+            uint64_t              start, old;
+
+            if (q->thread != t->index) {
+                continue;
+            }
+            start = rdma_now_ns();
+            for (;;) {
+                if (wr.opcode == IBV_WR_ATOMIC_CMP_AND_SWP) {
+                    wr.wr.atomic.compare_add = expect[i];
+                    wr.wr.atomic.swap        = expect[i] + 1;
+                }
+                if (atomic_sync(&q->conn, &wr, &old)) {
+                    t->ret = -1;
+                    free(expect);
+                    return NULL;
+                }
+                if (wr.opcode != IBV_WR_ATOMIC_CMP_AND_SWP || old == expect[i]) {
+                    expect[i] = old + 1;
+                    break;
+                }
+                // CAS 失败时返回的原值就是计数器当前值，以它为期望值重试
+                expect[i] = old;
+                t->cas_retries++;
+            }
+            rdma_hist_record(&t->hist, rdma_now_ns() - start);
+        }
+    }
+    free(expect);
+    return NULL;
+}
+
+// 锁内的临界区：用 RDMA Read/Write 对受保护的计数器做非原子的 读-加1-写回，
+// 互斥失效时会丢失更新，最终计数小于加锁次数
+static int lock_critical_section(struct rdma_multi_qp *q, uint64_t addr) {
+    uint64_t           *value = (uint64_t *)(q->conn.buf + COUNTER_SIZE);
+    struct ibv_sge      sge;
+    struct ibv_send_wr  wr, *bad_wr = NULL;
+    struct ibv_wc       wc;
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)value;
+    sge.length = COUNTER_SIZE;
+    sge.lkey   = q->conn.mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list             = &sge;
+    wr.num_sge             = 1;
+    wr.opcode              = IBV_WR_RDMA_READ;
+    wr.send_flags          = IBV_SEND_SIGNALED;
+    wr.wr.rdma.remote_addr = addr;
+    wr.wr.rdma.rkey        = q->remote.rkey;
+    if (ibv_post_send(q->conn.qp, &wr, &bad_wr) || rdma_wait_completion(&q->conn, IBV_WC_RDMA_READ, &wc)) {
+        fprintf(stderr, "读取受保护的计数器失败\n");
+        return -1;
+    }
+    (*value)++;
+    wr.opcode = IBV_WR_RDMA_WRITE;
+    if (ibv_post_send(q->conn.qp, &wr, &bad_wr) || rdma_wait_completion(&q->conn, IBV_WC_RDMA_WRITE, &wc)) {
+        fprintf(stderr, "写回受保护的计数器失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 锁测试线程：名下各 QP 轮流随机选一个锁，加锁、执行临界区、解锁，记录每次加锁的耗时
+static void *lock_bench_main(void *arg) {
+    struct bench_lat_thread *t = arg;
+    struct rdma_multi       *m = t->m;
+    unsigned int             seed = (unsigned int)rdma_now_ns() + t->index;
+
+    if (bench_thread_start(t)) {
+        return NULL;
+    }
+    for (uint64_t n = 0; n < m->iters; ++n) {
+        for (int i = 0; i < m->nqps; ++i) {
+            struct rdma_lock_client *lc = &t->locks[i];
+            uint32_t                 idx;
+            uint64_t                 start, held;
+
+            if (m->qps[i].thread != t->index) {
+                continue;
+            }
+            idx   = rand_r(&seed) % t->nlocks;
+            start = rdma_now_ns();
+            if (rdma_lock_acquire(lc, idx, &held)) {
+                t->ret = -1;
+                return NULL;
+            }
+            rdma_hist_record(&t->hist, rdma_now_ns() - start);
+            // 锁已被抢占时 rdma_lock_release 返回 1 并计入 lc->lost，测试继续
+            if (lock_critical_section(&m->qps[i], rdma_lock_addr(lc, idx) + sizeof(uint64_t)) ||
+                rdma_lock_release(lc, idx, held) < 0) {
+                t->ret = -1;
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 延迟测试：各线程同时开始，合并各线程的直方图后打印。locks 非 NULL 时为锁测试
+static int run_bench_latency(struct rdma_multi *m, struct rdma_lock_client *locks, int nlocks,
+                             uint64_t *cas_retries) {
+    struct bench_lat_thread *threads;
+    struct rdma_histogram    hist;
+    uint64_t                 start, ns;
+    int                      go = 0, started = 0, ret = 0;
+
+    // 每个线程的直方图较大，不放在栈上
+    threads = calloc(m->nthreads, sizeof(*threads));
+    if (!threads) {
+        fprintf(stderr, "分配线程失败\n");
+        return -1;
+    }
+    for (int i = 0; i < m->nthreads; ++i) {
+        threads[i].m     = m;
+        threads[i].index = i;
+        threads[i].go    = &go;
+        threads[i].locks  = locks;
+        threads[i].nlocks = nlocks;
+        if (pthread_create(&threads[i].tid, NULL, locks ? lock_bench_main : bench_lat_main, &threads[i])) {
+            fprintf(stderr, "创建线程失败\n");
+            ret = -1;
+            break;
+        }
+        started++;
+    }
+    start = rdma_now_ns();
+    __atomic_store_n(&go, ret ? -1 : 1, __ATOMIC_RELEASE);
+    rdma_hist_reset(&hist);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i].tid, NULL);
+        ret          |= threads[i].ret;
+        *cas_retries += threads[i].cas_retries;
+        rdma_hist_merge(&hist, &threads[i].hist);
+    }
+    ns = rdma_now_ns() - start;
+    if (ret == 0) {
+        printf(locks ? "每次加锁的延迟:\n" : "每次递增计数器的延迟:\n");
+        rdma_print_lat_header();
+        rdma_print_lat_row(COUNTER_SIZE, &hist);
+        printf("合计 %lu 次，%.0f ops/s\n", hist.total, ns ? hist.total / (ns / 1e9) : 0.0);
+    }
+    free(threads);
+    return ret;
+}
+
+// 基准测试客户端：num_qps 个连接由 threads 个绑核线程驱动，
+// 吞吐量测试每个 QP 保持 depth 个原子操作未完成，延迟测试逐个执行
+int run_bench_client(struct atomic_config *cfg) {
+    struct rdma_multi     m;
+    struct rdma_conn_opts opts;
+    uint64_t              before, after, expect, cas_retries = 0;
+    int                   cas = cfg->bench_op == ATOMIC_OP_CAS;
+    int                   rd_atomic = 0;
+    int                   ret = -1;
+
+    memset(&m, 0, sizeof(m));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    // 每个连接的发送队列和完成队列都要容纳一整条流水线
+    opts.max_send_wr  = cfg->depth;
+    opts.cq_depth     = cfg->depth + 1;
+    opts.initiator_depth = cfg->rd_atomic;
+    printf("[客户端] 启动，向 %s:%d 建立 %d 个连接...\n", cfg->ip, cfg->port, cfg->num_qps);
+    if (rdma_multi_connect(&m, cfg->num_qps, cfg->threads, cfg->ip, cfg->port, &opts, COUNTER_SIZE,
+                           IBV_ACCESS_LOCAL_WRITE, 1)) {
+        goto cleanup;
+    }
+    for (int i = 0; i < m.nqps; ++i) {
+        struct rdma_multi_qp *q = &m.qps[i];
+
+        if (q->remote.length < (uint64_t)cfg->counters * BENCH_COUNTER_STRIDE) {
+            fprintf(stderr, "服务端缓冲区 %u 字节，不足 %d 个计数器，服务端需加 -m\n", q->remote.length, cfg->counters);
+            goto cleanup;
+        }
+        q->wr.opcode                = cas ? IBV_WR_ATOMIC_CMP_AND_SWP : IBV_WR_ATOMIC_FETCH_AND_ADD;
+        q->wr.wr.atomic.remote_addr = q->remote.vaddr + (uint64_t)(i % cfg->counters) * BENCH_COUNTER_STRIDE;
+        q->wr.wr.atomic.rkey        = q->remote.rkey;
+        // 吞吐量测试的 CAS 比较值和交换值都为 0，不改变计数器，只测量网卡执行 CAS 的速率
+        q->wr.wr.atomic.compare_add = cas ? 0 : ATOMIC_ADD_VALUE;
+        q->wr.wr.atomic.swap        = 0;
+        if (rd_atomic == 0 || q->conn.initiator_depth < rd_atomic) {
+            rd_atomic = q->conn.initiator_depth;
+        }
+    }
+    m.iters = cfg->count;
+    rdma_pipeline_init(&m.pl, cfg->depth);
+    if (bench_counter_sum(&m, 0, cfg->counters, 0, &before)) {
+        goto cleanup;
+    }
+
+    printf("[客户端] 连接建立，%s %s测试: %d 个 QP，%d 个线程，%d 个计数器，每个 QP %lu 次",
+           cas ? "Compare and Swap" : "Fetch and Add", cfg->latency ? "延迟" : "吞吐量",
+           m.nqps, m.nthreads, cfg->counters, m.iters);
+    if (cfg->latency) {
+        printf("...\n");
+        if (run_bench_latency(&m, NULL, 0, &cas_retries)) {
+            goto cleanup;
+        }
+    } else {
+        // 超过协商的并发原子操作数的部分在发起方网卡排队，仍可分摊投递开销
+        printf("，深度 %d (协商的并发原子操作数 %d)...\n", m.pl.depth, rd_atomic);
+        if (rdma_multi_run(&m, COUNTER_SIZE)) {
+            goto cleanup;
+        }
+        rdma_multi_report(&m, COUNTER_SIZE);
+    }
+
+    if (bench_counter_sum(&m, 0, cfg->counters, 0, &after)) {
+        goto cleanup;
+    }
+    // 吞吐量测试的 CAS 不改变计数器，其余每次操作恰好加 1；其他客户端同时测试时增量会更大
+    expect = cas && !cfg->latency ? 0 : m.iters * m.nqps;
+    printf("[客户端] 计数器增量合计 %lu，本客户端预期 %lu\n", after - before, expect);
+    if (cas && cfg->latency) {
+        printf("[客户端] CAS 重试 %lu 次，平均每次递增 %.2f 次 CAS\n",
+               cas_retries, (double)(expect + cas_retries) / (expect ? expect : 1));
+    }
+    ret = 0;
+
+cleanup:
+    rdma_multi_cleanup(&m);
+    return ret;
+}
+
+// 锁测试客户端：num_qps 个连接各自作为一个锁表客户端（属主），由 threads 个绑核线程驱动，
+// 每次随机选 counters 个锁之一加锁，在锁内递增受保护的计数器后解锁
+int run_lock_client(struct atomic_config *cfg) {
+    struct rdma_multi        m;
+    struct rdma_conn_opts    opts;
+    struct rdma_lock_client *locks = NULL;
+    uint64_t                 before, after, acquires, unused = 0;
+    uint64_t                 cas_ops = 0, busy = 0, steals = 0, lost = 0;
+    int                      ret = -1;
+
+    memset(&m, 0, sizeof(m));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.initiator_depth = cfg->rd_atomic;
+    printf("[客户端] 启动，向 %s:%d 建立 %d 个连接...\n", cfg->ip, cfg->port, cfg->num_qps);
+    // 前 8 字节接收原子操作的原值，后 8 字节是临界区读写受保护计数器的本地副本
+    if (rdma_multi_connect(&m, cfg->num_qps, cfg->threads, cfg->ip, cfg->port, &opts, 2 * COUNTER_SIZE,
+                           IBV_ACCESS_LOCAL_WRITE, 1)) {
+        goto cleanup;
+    }
+    locks = calloc(m.nqps, sizeof(*locks));
+    if (!locks) {
+        fprintf(stderr, "分配锁表客户端失败\n");
+        goto cleanup;
+    }
+    for (int i = 0; i < m.nqps; ++i) {
+        if (rdma_lock_client_init(&locks[i], &m.qps[i].conn, &m.qps[i].remote, BENCH_COUNTER_STRIDE,
+                                  cfg->lease_ms)) {
+            goto cleanup;
+        }
+        if (locks[i].nlocks < (uint32_t)cfg->counters) {
+            fprintf(stderr, "服务端锁表只有 %u 个锁，少于 %d 个，服务端需加 -m\n", locks[i].nlocks, cfg->counters);
+            goto cleanup;
+        }
+    }
+    m.iters = cfg->count;
+    if (bench_counter_sum(&m, 1, cfg->counters, sizeof(uint64_t), &before)) {
+        goto cleanup;
+    }
+
+    printf("[客户端] 连接建立，锁测试: %d 个 QP，%d 个线程，随机争用 %d 个锁，租约 %u ms，每个 QP %lu 次...\n",
+           m.nqps, m.nthreads, cfg->counters, locks[0].lease_ms, m.iters);
+    if (run_bench_latency(&m, locks, cfg->counters, &unused)) {
+        goto cleanup;
+    }
+    if (bench_counter_sum(&m, 1, cfg->counters, sizeof(uint64_t), &after)) {
+        goto cleanup;
+    }
+    for (int i = 0; i < m.nqps; ++i) {
+        cas_ops += locks[i].cas_ops;
+        busy    += locks[i].busy;
+        steals  += locks[i].steals;
+        lost    += locks[i].lost;
+    }
+    acquires = m.iters * m.nqps;
+    printf("[客户端] 加锁 %lu 次，CAS %lu 次 (平均每次加锁 %.2f 次)，锁被占用 %lu 次，抢占过期的锁 %lu 次，"
+           "解锁时发现已被抢占 %lu 次\n", acquires, cas_ops, (double)cas_ops / (acquires ? acquires : 1),
+           busy, steals, lost);
+    // 其他客户端同时测试时增量会更大；少于预期说明互斥失效（如持有者超过租约被抢占）
+    printf("[客户端] 受保护计数器增量合计 %lu，本客户端预期 %lu%s\n", after - before, acquires,
+           after - before < acquires ? "，有更新丢失" : "");
+    ret = 0;
+
+cleanup:
+    free(locks);
+    rdma_multi_cleanup(&m);
+    return ret;
+}
+
 int main(int argc, char **argv) {
     struct atomic_config cfg;
 
@@ -479,8 +846,14 @@ int main(int argc, char **argv) {
         return -1;
     }
     
-    if (cfg.role == ROLE_SERVER) {
+    if (cfg.role == ROLE_SERVER && cfg.workers > 0) {
+        return run_bench_server(&cfg);
+    } else if (cfg.role == ROLE_SERVER) {
         return run_server(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.bench_op == ATOMIC_OP_LOCK) {
+        return run_lock_client(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.bench_op) {
+        return run_bench_client(&cfg);
     } else if (cfg.role == ROLE_CLIENT) {
         return run_client(&cfg);
     } else {
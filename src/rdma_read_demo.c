@@ -2,7 +2,15 @@
 // rdma read demo: 支持 IB、RoCE、iWARP，客户端通过 RDMA Read 读取服务端内存，服务端收到 ack 后统计次数。
 // 用法：
 // 服务器：./rdma_read_demo -s -a <本机IP> -p <端口> [-n <次数>]
-// 客户端：./rdma_read_demo -c -a <服务器IP> -p <端口> [-n <次数>]
+// 客户端：./rdma_read_demo -c -a <服务器IP> -p <端口> [-n <次数>] [-d <深度>]
+// 带宽扫描：服务端和客户端同时加 -S <最小>:<最大>，如 -S 4K:4M
+// 延迟测试：客户端加 -L（可配合 -S，服务端需相同 -S），打印每次 RDMA Read 往返延迟分布
+// 完成轮询：-P busy|event|adaptive[:<微秒>] 选择忙轮询、事件驱动或自适应
+// 多 QP：客户端加 -q <QP数> [-t <线程数>]，服务端加 -m <线程数>，打印每个 QP 和总体吞吐量
+// 大页内存池：多客户端服务端加 -H 2M|1G，所有连接的缓冲区从少数几个大页 MR 中分配
+// 批量读取：两端同时加 -b <对象数>，客户端每轮用链式 WR 读取服务端的全部对象，保持协商的并发读数未完成
+// 带版本对象：两端同时加 -V <对象数>，服务端不停按 seqlock 顺序更新对象，客户端检出撕裂读取并重读，两端无消息往来
+// 键值服务：两端同时加 -K <键数>，客户端 GET 用两次 RDMA Read 单边完成（-G rpc 改为双边），PUT 经 Send/Recv（-w <百分比>）
 //
 // 依赖：libibverbs, librdmacm
 //
@@ -18,22 +26,59 @@
 #include <infiniband/verbs.h>
 #include <rdma/rdma_cma.h>
 
+#include "rdma_common.h"
+#include "rdma_cq.h"
+#include "rdma_kv.h"
+#include "rdma_perf.h"
+#include "rdma_multi.h"
+#include "rdma_pipeline.h"
+#include "rdma_recv_ring.h"
+#include "rdma_seqlock.h"
+#include "rdma_server.h"
+
 #define MSG_BASE        "你好，汉为信息"
 #define MSG_SIZE        64
 #define DEFAULT_PORT    18515
 #define DEFAULT_COUNT   10
-
-#define ROLE_UNDEF      0
-#define ROLE_SERVER     1
-#define ROLE_CLIENT     2
+#define KV_DEFAULT_OPS  100000  // 键值服务模式下客户端的默认操作数
 
 struct read_config {
     int         role;
     char        ip[64];
     int         port;
     int         count;
+    int         depth;          // 带宽扫描时的流水线深度
+    size_t      size_min;       // 带宽扫描最小消息大小，0 表示不扫描
+    size_t      size_max;       // 带宽扫描最大消息大小
+    int         latency;        // 延迟测试模式
+    int         poll_mode;      // 完成队列轮询策略 RDMA_POLL_*
+    int         poll_spin_us;   // 自适应轮询的忙轮询时长（微秒）
+    int         num_qps;        // 客户端连接（QP）数
+    int         threads;        // 客户端驱动 QP 的线程数
+    int         workers;        // 多客户端服务端的工作线程数，0 表示只服务一个客户端
+    size_t      huge_page;      // 多客户端服务端内存池的大页大小，0 表示每个连接各自注册
+    int         objects;        // 批量读取模式的对象数（每个 MSG_SIZE 字节），0 表示不使用
+    int         rd_atomic;      // 并发 RDMA Read 数上限，0 表示按两端设备能力协商
+    int         versioned;      // 带版本对象模式的对象数（每个内容 MSG_SIZE 字节），0 表示不使用
+    int         update_us;      // 带版本对象模式下服务端每轮更新后的间隔（微秒）
+    int         check_crc;      // 带版本对象模式下客户端校验 CRC
+    int         kv_keys;        // 键值服务模式的键数，0 表示不使用
+    int         kv_rpc_get;     // 键值服务模式下 GET 经 Send/Recv 由服务端执行
+    int         kv_put_pct;     // 键值服务模式下 PUT 占操作数的百分比
 };
 
+// 注册缓冲区大小：带宽扫描时需容纳最大消息
+static size_t buf_size(const struct read_config *cfg) {
+    // 带版本对象模式：服务端存放全部对象，客户端每个未完成的读一个槽
+    if (cfg->versioned > 0) {
+        return rdma_seq_obj_size(MSG_SIZE) * (cfg->role == ROLE_SERVER ? cfg->versioned : cfg->depth);
+    }
+    if (cfg->objects > 0) {
+        return (size_t)cfg->objects * MSG_SIZE;
+    }
+    return cfg->size_max > MSG_SIZE ? cfg->size_max : MSG_SIZE;
+}
+
 void print_usage(const char *prog) {
     printf("用法: %s -s|-c -a <IP> -p <端口> [-n <次数>]\n", prog);
     printf("  -s           以服务端模式启动\n");
@@ -41,6 +86,25 @@ void print_usage(const char *prog) {
     printf("  -a <IP>      指定对端IP地址\n");
     printf("  -p <端口>    指定端口 (默认%d)\n", DEFAULT_PORT);
     printf("  -n <次数>    发送/接收消息次数 (默认%d)\n", DEFAULT_COUNT);
+    printf("  -d <深度>    带宽扫描时保持 <深度> 个读操作未完成 (默认%d)\n", BENCH_DEFAULT_DEPTH);
+    printf("  -S <最小>:<最大> 按 2 的幂扫描消息大小并打印带宽表格，两端需一致 (如 4K:4M)\n");
+    printf("  -L           客户端延迟测试，可配合 -S 扫描消息大小\n");
+    printf("  -P <策略>    完成轮询策略: busy (默认)、event、adaptive[:<微秒>] (默认忙轮询%d微秒后阻塞)\n",
+           DEFAULT_POLL_SPIN_US);
+    printf("  -q <QP数>    客户端建立 <QP数> 个连接并行测带宽，服务端需加 -m\n");
+    printf("  -t <线程数>  客户端用 <线程数> 个绑核线程驱动这些 QP (默认 1)\n");
+    printf("  -b <对象数>  批量读取模式：服务端暴露 <对象数> 个 %d 字节对象，客户端每轮链式读取全部对象到各自的本地槽，两端需一致\n",
+           MSG_SIZE);
+    printf("  -V <对象数>  带版本对象模式：服务端不停按 seqlock 顺序更新 <对象数> 个对象，客户端保持 -d 个读未完成，\n"
+           "               检出撕裂读取后重读，两端无消息往来，两端需一致\n");
+    printf("  -u <微秒>    带版本对象模式下服务端每轮更新全部对象后等待的时间 (默认 0，不停更新)\n");
+    printf("  -C           带版本对象模式下客户端校验 CRC，不依赖网卡按地址顺序读取\n");
+    printf("  -K <键数>    键值服务模式：服务端预置 <键数> 个键，客户端保持 -d 个操作未完成，随机访问，两端需一致\n");
+    printf("  -G read|rpc  键值服务模式下 GET 的方式：两次 RDMA Read 单边完成 (默认) 或 Send/Recv 由服务端执行\n");
+    printf("  -w <百分比>  键值服务模式下 PUT 所占的百分比，PUT 总是经 Send/Recv (默认 0)\n");
+    printf("  -O <数>      并发 RDMA Read 数上限 (默认按两端设备能力协商)\n");
+    printf("  -m <线程数>  服务端多客户端模式，连接分配给 <线程数> 个工作线程，Ctrl-C 退出\n");
+    printf("  -H 2M|1G     多客户端服务端从该大小的大页内存池分配各连接的缓冲区，没有预留大页时使用透明大页\n");
 }
 
 int parse_args(int argc, char **argv, struct read_config *cfg) {
@@ -48,164 +112,109 @@ int parse_args(int argc, char **argv, struct read_config *cfg) {
 
     memset(cfg, 0, sizeof(*cfg));
     cfg->port  = DEFAULT_PORT;
-    cfg->count = DEFAULT_COUNT;
-    while ((opt = getopt(argc, argv, "sca:p:n:")) != -1) {
+    cfg->poll_spin_us = DEFAULT_POLL_SPIN_US;
+    while ((opt = getopt(argc, argv, "sca:p:n:d:S:LP:q:t:m:H:b:O:V:u:CK:G:w:")) != -1) {
         switch (opt) {
             case 's': cfg->role = ROLE_SERVER; break;
             case 'c': cfg->role = ROLE_CLIENT; break;
             case 'a': strncpy(cfg->ip, optarg, sizeof(cfg->ip)-1); break;
             case 'p': cfg->port = atoi(optarg); break;
             case 'n': cfg->count = atoi(optarg); break;
+            case 'd': cfg->depth = atoi(optarg); break;
+            case 'S':
+                if (rdma_parse_size_range(optarg, &cfg->size_min, &cfg->size_max)) return -1;
+                break;
+            case 'L': cfg->latency = 1; break;
+            case 'q': cfg->num_qps = atoi(optarg); break;
+            case 't': cfg->threads = atoi(optarg); break;
+            case 'm': cfg->workers = atoi(optarg); break;
+            case 'b': cfg->objects = atoi(optarg); break;
+            case 'O': cfg->rd_atomic = atoi(optarg); break;
+            case 'V': cfg->versioned = atoi(optarg); break;
+            case 'u': cfg->update_us = atoi(optarg); break;
+            case 'C': cfg->check_crc = 1; break;
+            case 'K': cfg->kv_keys = atoi(optarg); break;
+            case 'w': cfg->kv_put_pct = atoi(optarg); break;
+            case 'G':
+                if (strcmp(optarg, "read") == 0) {
+                    cfg->kv_rpc_get = 0;
+                } else if (strcmp(optarg, "rpc") == 0) {
+                    cfg->kv_rpc_get = 1;
+                } else {
+                    fprintf(stderr, "-G 只支持 read 或 rpc\n");
+                    return -1;
+                }
+                break;
+            case 'H':
+                cfg->huge_page = rdma_parse_size(optarg);
+                if (cfg->huge_page != MEM_POOL_HUGE_2M && cfg->huge_page != MEM_POOL_HUGE_1G) {
+                    fprintf(stderr, "-H 只支持 2M 或 1G\n");
+                    return -1;
+                }
+                break;
+            case 'P':
+                if (rdma_parse_poll_mode(optarg, &cfg->poll_mode, &cfg->poll_spin_us)) return -1;
+                break;
             default: print_usage(argv[0]); return -1;
         }
     }
-    if (cfg->role == ROLE_UNDEF || cfg->ip[0] == '\0') {
-        print_usage(argv[0]);
+    if (cfg->objects < 0 || (cfg->objects && (cfg->size_min || cfg->latency || cfg->num_qps > 0 ||
+                                              cfg->threads > 0 || cfg->workers > 0))) {
+        fprintf(stderr, "-b 需要正的对象数，且不能与 -S/-L/-q/-t/-m 同时使用\n");
         return -1;
     }
-    return 0;
-}
-
-// =================== rdma_cm 方式实现 ===================
-// 资源结构体
-struct rdma_connection {
-    struct rdma_event_channel *ec;
-    struct rdma_cm_id         *cm_id;
-    struct ibv_pd             *pd;
-    struct ibv_comp_channel   *comp_ch;
-    struct ibv_cq             *cq;
-    struct ibv_qp             *qp;
-    struct ibv_mr             *mr;
-    char                      *buf;
-};
-
-struct read_mr_info {
-    uint32_t rkey;
-    uint64_t vaddr;
-};
-
-int rdma_connection_init(struct rdma_connection *conn, struct read_config *cfg) {
-    struct sockaddr_in addr;
-    int                ret = 0;
-
-    memset(conn, 0, sizeof(*conn));
-    conn->ec = rdma_create_event_channel();
-    if (!conn->ec) {
-        fprintf(stderr, "rdma_create_event_channel 失败\n");
+    if (cfg->versioned < 0 || (cfg->versioned && (cfg->objects || cfg->size_min || cfg->latency ||
+                                                  cfg->num_qps > 0 || cfg->threads > 0 || cfg->workers > 0))) {
+        fprintf(stderr, "-V 需要正的对象数，且不能与 -b/-S/-L/-q/-t/-m 同时使用\n");
         return -1;
     }
-
-    ret = rdma_create_id(conn->ec, &conn->cm_id, NULL, RDMA_PS_TCP);
-    if (ret) {
-        fprintf(stderr, "rdma_create_id 失败 %d\n", ret);
+    if (cfg->kv_keys < 0 || (cfg->kv_keys && (cfg->objects || cfg->versioned || cfg->size_min || cfg->latency ||
+                                              cfg->num_qps > 0 || cfg->threads > 0 || cfg->huge_page))) {
+        fprintf(stderr, "-K 需要正的键数，且不能与 -b/-V/-S/-L/-q/-t/-H 同时使用\n");
         return -1;
     }
-
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(cfg->port);
-    addr.sin_addr.s_addr = inet_addr(cfg->ip);
-    if (cfg->role == ROLE_SERVER) {
-        ret = rdma_bind_addr(conn->cm_id, (struct sockaddr*)&addr);
-        if (ret) {
-            fprintf(stderr, "rdma_bind_addr 失败 %d\n", ret);
-            return -1;
-        }
-        ret = rdma_listen(conn->cm_id, 1);
-        if (ret) {
-            fprintf(stderr, "rdma_listen 失败 %d\n", ret);
-            return -1;
-        }
-    } else {
-        ret = rdma_resolve_addr(conn->cm_id, NULL, (struct sockaddr*)&addr, 2000);
-        if (ret) {
-            fprintf(stderr, "rdma_resolve_addr 失败 %d\n", ret);
-            return -1;
-        }
-    }
-    return 0;
-}
-
-void rdma_connection_cleanup(struct rdma_connection *conn) {
-    if (conn->mr)      ibv_dereg_mr(conn->mr);
-    if (conn->cq)      ibv_destroy_cq(conn->cq);
-    if (conn->comp_ch) ibv_destroy_comp_channel(conn->comp_ch);
-    if (conn->pd)      ibv_dealloc_pd(conn->pd);
-    if (conn->cm_id)   rdma_destroy_id(conn->cm_id);
-    if (conn->ec)      rdma_destroy_event_channel(conn->ec);
-    if (conn->buf)     free(conn->buf);
-}
-
-int wait_event(struct rdma_connection *conn, enum rdma_cm_event_type expect, struct rdma_cm_event **evt) {
-    int ret = 0;
-
-    ret = rdma_get_cm_event(conn->ec, evt);
-    if (ret) {
-        fprintf(stderr, "rdma_get_cm_event 失败 %d\n", ret);
+    if (cfg->kv_put_pct < 0 || cfg->kv_put_pct > 100) {
+        fprintf(stderr, "-w 需在 0 到 100 之间\n");
         return -1;
     }
-
-    if ((*evt)->event != expect) {
-        fprintf(stderr, "期望事件 %d, 实际事件 %d\n", expect, (*evt)->event);
-        rdma_ack_cm_event(*evt);
+    // 服务端每个连接预投递 BENCH_RECV_DEPTH 个接收
+    if (cfg->kv_keys && cfg->depth > BENCH_RECV_DEPTH) {
+        fprintf(stderr, "键值服务模式下 -d 不能超过 %d\n", BENCH_RECV_DEPTH);
         return -1;
     }
-    return 0;
-}
-
-int build_qp(struct rdma_connection *conn) {
-    struct ibv_qp_init_attr init_attr;
-
-    conn->pd = ibv_alloc_pd(conn->cm_id->verbs);
-    if (!conn->pd) {
-        fprintf(stderr, "ibv_alloc_pd 失败\n");
-        return -1;
+    if (cfg->kv_keys && cfg->count <= 0) {
+        cfg->count = KV_DEFAULT_OPS;
     }
-
-    conn->comp_ch = ibv_create_comp_channel(conn->cm_id->verbs);
-    if (!conn->comp_ch) {
-        fprintf(stderr, "ibv_create_comp_channel 失败\n");
-        return -1;
+    if (cfg->latency && !cfg->size_min) {
+        cfg->size_min = cfg->size_max = MSG_SIZE;
     }
-
-    conn->cq = ibv_create_cq(conn->cm_id->verbs, 10, NULL, conn->comp_ch, 0);
-    if (!conn->cq) {
-        fprintf(stderr, "ibv_create_cq 失败\n");
-        return -1;
+    // 多 QP 属于带宽测试，未指定 -S 时使用默认消息大小
+    if (cfg->threads > 0 && cfg->num_qps <= 0) {
+        cfg->num_qps = cfg->threads;
     }
-
-    memset(&init_attr, 0, sizeof(init_attr));
-    init_attr.send_cq          = conn->cq;
-    init_attr.recv_cq          = conn->cq;
-    init_attr.qp_type          = IBV_QPT_RC;
-    init_attr.cap.max_send_wr  = 10;
-    init_attr.cap.max_recv_wr  = 10;
-    init_attr.cap.max_send_sge = 1;
-    init_attr.cap.max_recv_sge = 1;
-    int ret = rdma_create_qp(conn->cm_id, conn->pd, &init_attr);
-    if (ret) {
-        fprintf(stderr, "rdma_create_qp 失败\n");
-        return -1;
+    if (cfg->num_qps > 0) {
+        if (cfg->latency) {
+            fprintf(stderr, "-q/-t 不能与 -L 同时使用\n");
+            return -1;
+        }
+        if (!cfg->size_min) {
+            cfg->size_min = cfg->size_max = MSG_SIZE;
+        }
     }
-    conn->qp = conn->cm_id->qp;
-    return 0;
-}
-
-int reg_mem(struct rdma_connection *conn) {
-    if (posix_memalign((void**)&conn->buf, 4096, MSG_SIZE) != 0) {
-        fprintf(stderr, "posix_memalign 失败\n");
-        return -1;
+    if (cfg->count <= 0) {
+        cfg->count = cfg->size_min ? BENCH_DEFAULT_ITERS : DEFAULT_COUNT;
     }
-    memset(conn->buf, 0, MSG_SIZE);
-
-    conn->mr = ibv_reg_mr(conn->pd, conn->buf, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
-    if (!conn->mr) {
-        fprintf(stderr, "ibv_reg_mr 失败\n");
+    if (cfg->depth <= 0) {
+        cfg->depth = BENCH_DEFAULT_DEPTH;
+    }
+    if (cfg->role == ROLE_UNDEF || cfg->ip[0] == '\0') {
+        print_usage(argv[0]);
         return -1;
     }
     return 0;
 }
 
+// =================== rdma_cm 方式实现 ===================
 int modify_qp_timeout(struct rdma_connection *conn, int time) {
     struct ibv_qp_attr      qp_attr;
     struct ibv_qp_init_attr init_attr;
@@ -239,19 +248,324 @@ int modify_qp_timeout(struct rdma_connection *conn, int time) {
     return -1;
 }
 
+// 多 QP 客户端：建立 num_qps 个连接，由 threads 个绑核线程驱动，逐个消息大小打印每个 QP 和总体吞吐量
+int run_multi_client(struct read_config *cfg) {
+    struct rdma_multi     m;
+    struct rdma_conn_opts opts;
+    int                   ret = -1;
+
+    memset(&m, 0, sizeof(m));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    // 每个连接的发送队列和完成队列都要容纳一整条流水线
+    opts.max_send_wr  = cfg->depth;
+    opts.cq_depth     = cfg->depth + 1;
+    opts.initiator_depth = cfg->rd_atomic;
+    printf("[客户端] 启动，向 %s:%d 建立 %d 个连接...\n", cfg->ip, cfg->port, cfg->num_qps);
+    if (rdma_multi_connect(&m, cfg->num_qps, cfg->threads, cfg->ip, cfg->port, &opts, buf_size(cfg),
+                           IBV_ACCESS_LOCAL_WRITE, 1)) {
+        goto cleanup;
+    }
+    for (int i = 0; i < m.nqps; ++i) {
+        m.qps[i].wr.opcode              = IBV_WR_RDMA_READ;
+        m.qps[i].wr.wr.rdma.remote_addr = m.qps[i].remote.vaddr;
+        m.qps[i].wr.wr.rdma.rkey        = m.qps[i].remote.rkey;
+    }
+    m.iters = cfg->count;
+    rdma_pipeline_init(&m.pl, cfg->depth);
+    printf("[客户端] 连接建立，RDMA Read 多 QP 带宽测试 (深度 %d)...\n", m.pl.depth);
+    ret = rdma_multi_sweep(&m, cfg->size_min, cfg->size_max);
+cleanup:
+    rdma_multi_cleanup(&m);
+    return ret;
+}
+
+// 延迟测试：逐个投递 RDMA Read 并等待完成，记录完整往返时间
+static int run_latency(struct rdma_connection *conn, struct read_config *cfg, struct ibv_send_wr *wr) {
+    struct rdma_histogram hist;
+    struct ibv_send_wr   *bad_wr = NULL;
+    struct ibv_wc         wc;
+
+    printf("往返延迟 (RTT):\n");
+    rdma_print_lat_header();
+    for (size_t size = cfg->size_min; size; size = rdma_next_size(size, cfg->size_max)) {
+        wr->sg_list[0].length = size;
+        rdma_hist_reset(&hist);
+        for (int i = 0; i < cfg->count; ++i) {
+            uint64_t start = rdma_now_ns();
+
+            if (ibv_post_send(conn->qp, wr, &bad_wr)) {
+                fprintf(stderr, "ibv_post_send (RDMA_READ) 失败\n");
+                return -1;
+            }
+            if (rdma_wait_completion(conn, IBV_WC_RDMA_READ, &wc)) {
+                return -1;
+            }
+            rdma_hist_record(&hist, rdma_now_ns() - start);
+        }
+        rdma_print_lat_row(size, &hist);
+    }
+    return 0;
+}
+
+// 批量读取：第 idx 个读 WR 读取第 idx % nobjs 个对象，放到本地对应的槽
+struct bulk_read_arg {
+    uint64_t    remote;         // 服务端对象数组地址
+    uintptr_t   local;          // 本地槽数组地址
+    int         nobjs;
+};
+
+static void bulk_read_prep(struct ibv_send_wr *wr, uint64_t idx, void *arg) {
+    struct bulk_read_arg *a = arg;
+    uint64_t              obj = idx % a->nobjs;
+
+    wr->wr.rdma.remote_addr = a->remote + obj * MSG_SIZE;
+    wr->sg_list[0].addr     = a->local + obj * MSG_SIZE;
+}
+
+// 按对象序号填充服务端对象内容
+static void bulk_fill_object(char *obj, int i) {
+    snprintf(obj, MSG_SIZE, "对象 %d: %s", i, MSG_BASE);
+}
+
+// 一轮读取全部对象，返回耗时（纳秒），出错返回 0
+static uint64_t bulk_read_round(struct rdma_connection *conn, const struct ibv_send_wr *wr, int nobjs,
+                                const struct rdma_pipeline *pl) {
+    uint64_t start;
+
+    memset(conn->buf, 0, (size_t)nobjs * MSG_SIZE);
+    start = rdma_now_ns();
+    if (rdma_run_pipeline(conn, wr, nobjs, pl)) {
+        return 0;
+    }
+    return rdma_now_ns() - start;
+}
+
+// 批量读取模式：先逐个读取一轮作为对照，再按连接协商的并发读数（initiator_depth，不超过 -d）
+// 保持多个读未完成，每次 ibv_post_send 链接多个 WR 只敲一次门铃，每个对象读到本地各自的槽
+static int run_bulk_read(struct rdma_connection *conn, struct read_config *cfg, struct ibv_send_wr *wr,
+                         const struct rdma_mr_info *remote) {
+    struct bulk_read_arg    arg = { .remote = remote->vaddr, .local = (uintptr_t)conn->buf, .nobjs = cfg->objects };
+    struct rdma_pipeline    serial, pl;
+    uint64_t                ns, serial_ns, total_ns = 0;
+    int                     depth, bad = 0;
+    char                    expect[MSG_SIZE];
+
+    if (remote->length < (size_t)cfg->objects * MSG_SIZE) {
+        fprintf(stderr, "服务端缓冲区 %u 字节，不足 %d 个对象，两端 -b 需一致\n", remote->length, cfg->objects);
+        return -1;
+    }
+    depth = conn->initiator_depth > 0 ? conn->initiator_depth : 1;
+    if (depth > cfg->depth) {
+        depth = cfg->depth;
+    }
+    wr->sg_list[0].length = MSG_SIZE;
+
+    rdma_pipeline_init(&serial, 1);
+    serial.prep = bulk_read_prep;
+    serial.arg  = &arg;
+    rdma_pipeline_init(&pl, depth);
+    pl.prep = bulk_read_prep;
+    pl.arg  = &arg;
+
+    serial_ns = bulk_read_round(conn, wr, cfg->objects, &serial);
+    if (!serial_ns) {
+        return -1;
+    }
+    printf("[客户端] 逐个读取 %d 个对象: %.1f us\n", cfg->objects, serial_ns / 1e3);
+    printf("[客户端] 批量读取: 并发读数 %d (协商 initiator_depth %d)，每次门铃最多 %d 个 WR\n",
+           pl.depth, conn->initiator_depth, pl.batch);
+    for (int round = 0; round < cfg->count; ++round) {
+        ns = bulk_read_round(conn, wr, cfg->objects, &pl);
+        if (!ns) {
+            return -1;
+        }
+        total_ns += ns;
+        // 校验每个槽都读到了对应的对象
+        for (int i = 0; i < cfg->objects; ++i) {
+            bulk_fill_object(expect, i);
+            if (strncmp(conn->buf + (size_t)i * MSG_SIZE, expect, MSG_SIZE) != 0) {
+                bad++;
+            }
+        }
+    }
+    printf("[客户端] 批量读取 %d 轮，平均每轮 %.1f us (逐个读取的 %.1f%%)，校验失败 %d 个对象\n", cfg->count,
+           total_ns / 1e3 / cfg->count, 100.0 * total_ns / cfg->count / serial_ns, bad);
+    rdma_report_throughput("[客户端]", (uint64_t)cfg->count * cfg->objects, MSG_SIZE, total_ns);
+    return 0;
+}
+
+// 带版本对象的内容：重复的版本号，客户端据此核对读到的快照是否来自同一次写入
+static void seq_fill_payload(uint64_t *payload, uint64_t version) {
+    for (size_t k = 0; k < MSG_SIZE / sizeof(uint64_t); ++k) {
+        payload[k] = version;
+    }
+}
+
+// 带版本对象模式的服务端：不等待任何消息，轮流按 seqlock 顺序更新全部对象，客户端断开时退出
+static void run_seq_writer(struct rdma_connection *conn, struct read_config *cfg) {
+    size_t   obj_size = rdma_seq_obj_size(MSG_SIZE);
+    uint64_t payload[MSG_SIZE / sizeof(uint64_t)];
+    uint64_t updates = 0, start = rdma_now_ns(), last_check = start, now;
+
+    for (;;) {
+        for (int i = 0; i < cfg->versioned; ++i) {
+            char *obj = conn->buf + (size_t)i * obj_size;
+
+            seq_fill_payload(payload, rdma_seq_obj_version(obj, MSG_SIZE) + 2);
+            rdma_seq_obj_write(obj, MSG_SIZE, payload, MSG_SIZE);
+        }
+        updates += cfg->versioned;
+        if (cfg->update_us > 0) {
+            usleep(cfg->update_us);
+        }
+        now = rdma_now_ns();
+        if (now - last_check >= CQ_CHECK_INTERVAL_MS * 1000000ULL) {
+            last_check = now;
+            if (rdma_check_disconnect(conn)) {
+                break;
+            }
+        }
+    }
+    printf("[服务端] 共更新 %lu 次，%.0f 次/s\n", updates, updates / ((rdma_now_ns() - start) / 1e9));
+}
+
+// 把第 obj 个对象读到本地第 slot 个槽，wr_id 为槽号
+static int seq_post_read(struct rdma_connection *conn, const struct rdma_mr_info *remote, int slot, int obj) {
+    size_t              obj_size = rdma_seq_obj_size(MSG_SIZE);
+    struct ibv_sge      sge;
+    struct ibv_send_wr  wr, *bad_wr = NULL;
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)conn->buf + (size_t)slot * obj_size;
+    sge.length = obj_size;
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id               = slot;
+    wr.sg_list             = &sge;
+    wr.num_sge             = 1;
+    wr.opcode              = IBV_WR_RDMA_READ;
+    wr.send_flags          = IBV_SEND_SIGNALED;
+    wr.wr.rdma.remote_addr = remote->vaddr + (uint64_t)obj * obj_size;
+    wr.wr.rdma.rkey        = remote->rkey;
+    if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send (RDMA_READ) 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 带版本对象模式的客户端：先用 rdma_seq_read 同步读取每个对象一次，再保持 depth 个读未完成，
+// 轮流读取各对象到本地各自的槽。不一致的副本立即重读同一对象；一致的副本再核对内容是否全部等于版本号，
+// 不等说明有撕裂读取未被检出
+static int run_seq_read(struct rdma_connection *conn, struct read_config *cfg, const struct rdma_mr_info *remote) {
+    struct rdma_seq_reader  rd;
+    struct ibv_wc           wc[PIPELINE_POLL_BATCH];
+    size_t                  obj_size = rdma_seq_obj_size(MSG_SIZE);
+    uint64_t                payload[MSG_SIZE / sizeof(uint64_t)];
+    uint64_t                total = (uint64_t)cfg->count * cfg->versioned, posted = 0, bad = 0, version, ns;
+    int                    *slot_obj;
+    int                     depth = cfg->depth, ret = -1;
+
+    if (remote->length < (size_t)cfg->versioned * obj_size) {
+        fprintf(stderr, "服务端缓冲区 %u 字节，不足 %d 个对象，两端 -V 需一致\n", remote->length, cfg->versioned);
+        return -1;
+    }
+    slot_obj = calloc(depth, sizeof(*slot_obj));
+    if (!slot_obj) {
+        fprintf(stderr, "分配槽表失败\n");
+        return -1;
+    }
+    // 同批量读取，未完成的读数不超过协商得到的并发读数
+    if (conn->initiator_depth > 0 && depth > conn->initiator_depth) {
+        depth = conn->initiator_depth;
+    }
+    rdma_seq_reader_init(&rd, conn, remote, MSG_SIZE, cfg->check_crc);
+    for (int i = 0; i < cfg->versioned; ++i) {
+        int r = rdma_seq_read(&rd, remote->vaddr + (uint64_t)i * obj_size, conn->buf, &version);
+
+        if (r < 0) {
+            goto out;
+        }
+        if (r > 0) {
+            fprintf(stderr, "对象 %d 重读 %d 次仍不一致\n", i, rd.max_retries);
+            goto out;
+        }
+        if (i == 0) {
+            printf("[客户端] 对象 0 当前版本 %lu\n", version);
+        }
+    }
+    rd.reads = rd.retries = rd.writing = rd.torn = rd.bad_crc = 0;
+
+    printf("[客户端] 流水线读取 %d 个对象 %d 轮，深度 %d，%s CRC...\n", cfg->versioned, cfg->count, depth,
+           cfg->check_crc ? "校验" : "不校验");
+    ns = rdma_now_ns();
+    for (int slot = 0; slot < depth && posted < total; ++slot, ++posted) {
+        slot_obj[slot] = posted % cfg->versioned;
+        if (seq_post_read(conn, remote, slot, slot_obj[slot])) {
+            goto out;
+        }
+    }
+    while (rd.reads < total) {
+        int n = rdma_cq_poll(conn, wc, PIPELINE_POLL_BATCH, -1);
+
+        if (n < 0) {
+            goto out;
+        }
+        for (int i = 0; i < n; ++i) {
+            int   slot = (int)wc[i].wr_id;
+            char *local = conn->buf + (size_t)slot * obj_size;
+
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "[客户端] 读取失败: %s\n", ibv_wc_status_str(wc[i].status));
+                goto out;
+            }
+            if (rdma_seq_reader_account(&rd, rdma_seq_obj_check(local, MSG_SIZE, rd.check_crc, &version))) {
+                if (seq_post_read(conn, remote, slot, slot_obj[slot])) {
+                    goto out;
+                }
+                continue;
+            }
+            seq_fill_payload(payload, version);
+            if (memcmp(rdma_seq_obj_payload(local), payload, MSG_SIZE) != 0) {
+                bad++;
+            }
+            if (posted < total) {
+                slot_obj[slot] = posted++ % cfg->versioned;
+                if (seq_post_read(conn, remote, slot, slot_obj[slot])) {
+                    goto out;
+                }
+            }
+        }
+    }
+    ns = rdma_now_ns() - ns;
+    printf("[客户端] 一致读取 %lu 个对象，重读 %lu 次 (写入中 %lu，头尾版本不一致 %lu，CRC 不符 %lu)，"
+           "内容不一致 %lu 个\n", rd.reads, rd.retries, rd.writing, rd.torn, rd.bad_crc, bad);
+    rdma_report_throughput("[客户端]", rd.reads, obj_size, ns);
+    ret = 0;
+out:
+    free(slot_obj);
+    return ret;
+}
+
 int run_server(struct read_config *cfg) {
     struct rdma_connection server_conn;
+    struct rdma_conn_opts  opts;
     struct rdma_cm_event  *evt = NULL;
     struct rdma_cm_id     *child = NULL;
     struct rdma_conn_param conn_param;
+    struct ibv_wc          wc;
     int                    received_count = 0;
-    int                    listen_sock = -1, conn_sock = -1;
-    struct read_mr_info    local_info, remote_info;
-    int                    sock_opt = 1;
-    struct sockaddr_in     sin;
+    struct rdma_mr_info    local_info, remote_info;
 
     printf("[服务端] 启动，监听 %s:%d，等待连接...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&server_conn, cfg)) {
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.initiator_depth     = cfg->rd_atomic;
+    opts.responder_resources = cfg->rd_atomic;
+    if (rdma_connection_init(&server_conn, cfg->role, cfg->ip, cfg->port, &opts)) {
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     }
@@ -260,6 +574,12 @@ int run_server(struct read_config *cfg) {
         goto cleanup;
     }
     child = evt->id;
+    rdma_apply_peer_param(&server_conn, evt);
+    // 客户端的 rkey/vaddr 随连接请求的 private_data 到达（服务端用不到）
+    if (rdma_unpack_mr_info(evt, &remote_info)) {
+        rdma_ack_cm_event(evt);
+        goto cleanup;
+    }
     rdma_ack_cm_event(evt);
     server_conn.cm_id = child;
     
@@ -267,18 +587,35 @@ int run_server(struct read_config *cfg) {
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&server_conn)) {
+    if (reg_mem(&server_conn, buf_size(cfg), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE)) {
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
 
-    // 初始化内容为"你好，汉为信息1"
-    snprintf(server_conn.buf, MSG_SIZE, "%s1", MSG_BASE);
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
-    conn_param.retry_count = 7;        // 设置重试次数
-    conn_param.rnr_retry_count = 7;    // 设置 RNR 重试次数
+    // 初始化内容为"你好，汉为信息1"；批量读取模式下为各个对象；带版本对象模式下写入第一个版本
+    if (cfg->versioned) {
+        uint64_t payload[MSG_SIZE / sizeof(uint64_t)];
+
+        seq_fill_payload(payload, 2);
+        for (int i = 0; i < cfg->versioned; ++i) {
+            rdma_seq_obj_write(server_conn.buf + (size_t)i * rdma_seq_obj_size(MSG_SIZE), MSG_SIZE, payload, MSG_SIZE);
+        }
+    } else if (cfg->objects) {
+        for (int i = 0; i < cfg->objects; ++i) {
+            bulk_fill_object(server_conn.buf + (size_t)i * MSG_SIZE, i);
+        }
+    } else {
+        snprintf(server_conn.buf, MSG_SIZE, "%s1", MSG_BASE);
+    }
+    // 客户端每次读取后发送零长度消息作为 ack，先预投递接收
+    if (rdma_post_empty_recv(&server_conn, server_conn.opts.max_recv_wr)) {
+        goto cleanup;
+    }
+    // 本地 rkey/vaddr 放在 rdma_accept 的 private_data 中发给客户端
+    rdma_pack_mr_info(&local_info, server_conn.buf, server_conn.buf_size, server_conn.mr);
+    rdma_fill_conn_param(&server_conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
     if (rdma_accept(server_conn.cm_id, &conn_param)) {
         fprintf(stderr, "rdma_accept 失败\n");
         goto cleanup;
@@ -293,63 +630,43 @@ int run_server(struct read_config *cfg) {
         fprintf(stderr, "设置qp超时时间失败\n");
     }
 
-    // 建立 socket 用于 rkey/vaddr 交换和 ack
-    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_sock < 0) {
-        fprintf(stderr, "socket 创建失败\n");
+    printf("[服务端] 连接建立，为客户端保留 %d 个并发读的响应资源，等待客户端读取...\n",
+           server_conn.responder_resources);
+    if (cfg->versioned) {
+        // 带版本对象模式不收发消息，一直更新到客户端断开
+        run_seq_writer(&server_conn, cfg);
         goto cleanup;
     }
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &sock_opt, sizeof(sock_opt));
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(cfg->port + 1);
-    if (bind(listen_sock, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
-        fprintf(stderr, "bind 失败\n");
-        goto cleanup;
-    }
-    listen(listen_sock, 1);
 
-    conn_sock = accept(listen_sock, NULL, NULL);
-    if (conn_sock < 0) {
-        fprintf(stderr, "accept 失败\n");
-        goto cleanup;
-    }
-    local_info.rkey = server_conn.mr->rkey;
-    local_info.vaddr = (uintptr_t)server_conn.buf;
-    // 发送本地 rkey/vaddr，接收对方 rkey/vaddr（客户端用不到）
-    if (write(conn_sock, &local_info, sizeof(local_info)) != sizeof(local_info)) {
-        fprintf(stderr, "write local_info 失败\n");
-        goto cleanup;
-    }
-    if (read(conn_sock, &remote_info, sizeof(remote_info)) != sizeof(remote_info)) {
-        fprintf(stderr, "read remote_info 失败\n");
-        goto cleanup;
-    }
-    printf("[服务端] 连接建立，等待客户端读取...\n");
-
-    // 轮询等待客户端 ack
-    char ack_buf[8];
+    // 轮询等待客户端 ack；性能测试模式下客户端不发 ack，断开时退出
     while (received_count < cfg->count) {
-        int n = read(conn_sock, ack_buf, sizeof(ack_buf));
-        if (n > 0) {
-            received_count++;
-            printf("[服务端] 收到第 %d 次客户端读取 ack\n", received_count);
-            // 更新内容为"你好，汉为信息N"
-            snprintf(server_conn.buf, MSG_SIZE, "%s%d", MSG_BASE, received_count + 1);
-        } else if (n == 0) {
+        int n = rdma_cq_poll(&server_conn, &wc, 1, CQ_CHECK_INTERVAL_MS);
+        if (n < 0) {
+            break;
+        }
+        if (n == 0) {
+            if (rdma_check_disconnect(&server_conn)) {
+                break;
+            }
+            continue;
+        }
+        if (wc.status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "[服务端] 完成队列错误: %s\n", ibv_wc_status_str(wc.status));
             break;
-        } else if (errno == EINTR) {
+        }
+        if (wc.opcode != IBV_WC_RECV) {
             continue;
-        } else {
-            fprintf(stderr, "ack 读取失败\n");
+        }
+        received_count++;
+        printf("[服务端] 收到第 %d 次客户端读取 ack\n", received_count);
+        // 更新内容为"你好，汉为信息N"
+        snprintf(server_conn.buf, MSG_SIZE, "%s%d", MSG_BASE, received_count + 1);
+        if (rdma_post_empty_recv(&server_conn, 1)) {
             break;
         }
     }
     printf("[服务端] 客户端读取完毕，退出。\n");
 cleanup:
-    if (conn_sock >= 0) close(conn_sock);
-    if (listen_sock >= 0) close(listen_sock);
     rdma_connection_cleanup(&server_conn);
     return 0;
 }
@@ -358,47 +675,47 @@ int run_client(struct read_config *cfg) {
     struct rdma_connection client_conn;
     struct rdma_cm_event  *evt = NULL;
     struct rdma_conn_param conn_param;
-    struct read_mr_info    local_info, remote_info;
+    struct rdma_mr_info    local_info, remote_info;
     struct ibv_sge         sge;
     struct ibv_send_wr     wr, *bad_wr = NULL;
-    int                    sockfd = -1;
-    struct sockaddr_in     sin;
     struct ibv_wc          wc;
+    struct rdma_conn_opts  opts;
+    struct rdma_pipeline   pl;
 
     printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&client_conn, cfg)) {
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    if (cfg->size_min || cfg->objects || cfg->versioned) {
+        // 发送队列和完成队列都要容纳一整条流水线
+        opts.max_send_wr = cfg->depth;
+        opts.cq_depth    = cfg->depth + 1;
+    }
+    opts.initiator_depth     = cfg->rd_atomic;
+    opts.responder_resources = cfg->rd_atomic;
+    if (rdma_connection_init(&client_conn, cfg->role, cfg->ip, cfg->port, &opts)) {
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     }
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ADDR_RESOLVED, &evt)) {
-        fprintf(stderr, "地址解析失败\n");
-        goto cleanup;
-    }
-    rdma_ack_cm_event(evt);
-    if (rdma_resolve_route(client_conn.cm_id, 2000)) {
-        fprintf(stderr, "路由解析失败\n");
-        goto cleanup;
-    }
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ROUTE_RESOLVED, &evt)) {
-        fprintf(stderr, "路由解析事件失败\n");
+    // 地址解析、路由解析完成后才能继续创建 QP 和建立连接。
+    if (rdma_client_resolve(&client_conn)) {
         goto cleanup;
     }
-    rdma_ack_cm_event(evt);
     
     if (build_qp(&client_conn)) {
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&client_conn)) {
+    if (reg_mem(&client_conn, buf_size(cfg), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE)) {
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
     
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
-    conn_param.retry_count = 7;        // 设置重试次数
-    conn_param.rnr_retry_count = 7;    // 设置 RNR 重试次数
+    // 本地 rkey/vaddr 随连接请求发出，服务端的在连接建立事件中返回
+    rdma_pack_mr_info(&local_info, client_conn.buf, client_conn.buf_size, client_conn.mr);
+    rdma_fill_conn_param(&client_conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
     if (rdma_connect(client_conn.cm_id, &conn_param)) {
         fprintf(stderr, "rdma_connect 失败\n");
         goto cleanup;
@@ -407,38 +724,17 @@ int run_client(struct read_config *cfg) {
         fprintf(stderr, "等待连接建立成功事件失败\n");
         goto cleanup;
     }
+    rdma_apply_peer_param(&client_conn, evt);
+    if (rdma_unpack_mr_info(evt, &remote_info)) {
+        rdma_ack_cm_event(evt);
+        goto cleanup;
+    }
     rdma_ack_cm_event(evt);
 
     if (modify_qp_timeout(&client_conn,12)) {
         fprintf(stderr, "设置qp超时时间失败\n");
     }
 
-    sleep(1);
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        fprintf(stderr, "socket 创建失败\n");
-        goto cleanup;
-    }
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = inet_addr(cfg->ip);
-    sin.sin_port = htons(cfg->port + 1);
-    if (connect(sockfd, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
-        fprintf(stderr, "connect 失败\n");
-        goto cleanup;
-    }
-    // 先接收服务端 rkey/vaddr，再发送本地 rkey/vaddr（服务端用不到）
-    if (read(sockfd, &remote_info, sizeof(remote_info)) != sizeof(remote_info)) {
-        fprintf(stderr, "read remote_info 失败\n");
-        goto cleanup;
-    }
-    local_info.rkey = client_conn.mr->rkey;
-    local_info.vaddr = (uintptr_t)client_conn.buf;
-    if (write(sockfd, &local_info, sizeof(local_info)) != sizeof(local_info)) {
-        fprintf(stderr, "write local_info 失败\n");
-        goto cleanup;
-    }
-
     memset(&sge, 0, sizeof(sge));
     sge.addr   = (uintptr_t)client_conn.buf;
     sge.length = MSG_SIZE;
@@ -450,6 +746,48 @@ int run_client(struct read_config *cfg) {
     wr.send_flags = IBV_SEND_SIGNALED;
     wr.wr.rdma.remote_addr = remote_info.vaddr;
     wr.wr.rdma.rkey        = remote_info.rkey;
+    if (cfg->latency) {
+        // 延迟测试同样不发送 ack
+        printf("[客户端] 连接建立，RDMA Read 延迟测试 (每个大小 %d 次)...\n", cfg->count);
+        if (run_latency(&client_conn, cfg, &wr)) {
+            fprintf(stderr, "[客户端] 延迟测试失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->objects) {
+        // 批量读取同样不发送 ack
+        printf("[客户端] 连接建立，批量读取 %d 个对象 (%d 轮)...\n", cfg->objects, cfg->count);
+        if (run_bulk_read(&client_conn, cfg, &wr, &remote_info)) {
+            fprintf(stderr, "[客户端] 批量读取失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->versioned) {
+        // 带版本对象模式同样不发送 ack
+        printf("[客户端] 连接建立，读取 %d 个带版本对象...\n", cfg->versioned);
+        if (run_seq_read(&client_conn, cfg, &remote_info)) {
+            fprintf(stderr, "[客户端] 带版本对象读取失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->size_min) {
+        // 带宽扫描不发送 ack，断开连接后服务端退出
+        rdma_pipeline_init(&pl, cfg->depth);
+        printf("[客户端] 连接建立，RDMA Read 带宽扫描 (深度 %d，协商并发读 %d，每个大小 %d 次)...\n",
+               pl.depth, client_conn.initiator_depth, cfg->count);
+        if (rdma_run_bw_sweep(&client_conn, &wr, cfg->size_min, cfg->size_max, cfg->count, &pl)) {
+            fprintf(stderr, "[客户端] 带宽扫描失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
     printf("[客户端] 连接建立，开始 RDMA Read...\n");
     for (int i = 0; i < cfg->count; ++i) {
         if (ibv_post_send(client_conn.qp, &wr, &bad_wr)) {
@@ -457,23 +795,12 @@ int run_client(struct read_config *cfg) {
             goto cleanup;
         }
         // 等待完成
-        while (1) {
-            int n = ibv_poll_cq(client_conn.cq, 1, &wc);
-            if (n < 0) {
-                fprintf(stderr, "ibv_poll_cq 失败\n");
-                goto cleanup;
-            }
-            if (n == 0) {
-                continue;
-            }
-            if (wc.status != IBV_WC_SUCCESS) {
-                fprintf(stderr, "[客户端] 完成队列错误: %s\n", ibv_wc_status_str(wc.status));
-                goto cleanup;
-            }
-            if (wc.opcode == IBV_WC_RDMA_READ) break;
+        if (rdma_wait_completion(&client_conn, IBV_WC_RDMA_READ, &wc)) {
+            fprintf(stderr, "[客户端] 读取失败\n");
+            goto cleanup;
         }
-        // 发送 ack
-        if (write(sockfd, "ACK", 3) != 3) {
+        // 发送零长度消息作为 ack
+        if (rdma_send_empty(&client_conn) || rdma_wait_completion(&client_conn, IBV_WC_SEND, NULL)) {
             fprintf(stderr, "ack 发送失败\n");
             goto cleanup;
         }
@@ -485,11 +812,488 @@ int run_client(struct read_config *cfg) {
     }
     printf("[客户端] RDMA Read 完毕，退出。\n");
 cleanup:
-    if (sockfd >= 0) close(sockfd);
     rdma_connection_cleanup(&client_conn);
     return 0;
 }
 
+// =================== 键值服务 ===================
+// 服务端把一张 rdma_kv 表注册在服务端 PD 上，所有连接收到同一份 MR 信息；客户端 GET 默认两次 RDMA Read 单边完成，
+// PUT 和 -G rpc 时的 GET 以 struct rdma_kv_msg 经 Send/Recv 发给服务端，工作线程在接收槽上原地生成响应并发回。
+// 值由 8 个相同的 64 位字组成：{代数:32, 键:32}，客户端据此核对读到的值是否完整、是否属于该键
+
+// 键的第 gen 代值
+static void kv_fill_value(char *value, uint64_t key, uint32_t gen) {
+    uint64_t word = ((uint64_t)gen << 32) | (uint32_t)key;
+
+    for (size_t k = 0; k < KV_DEFAULT_VALUE_MAX / sizeof(word); ++k) {
+        memcpy(value + k * sizeof(word), &word, sizeof(word));
+    }
+}
+
+// 核对值：长度正确、各字相等且属于该键
+static int kv_value_ok(const char *value, uint32_t len, uint64_t key) {
+    uint64_t first, word;
+
+    if (len != KV_DEFAULT_VALUE_MAX) {
+        return 0;
+    }
+    memcpy(&first, value, sizeof(first));
+    if ((uint32_t)first != (uint32_t)key) {
+        return 0;
+    }
+    for (size_t k = 1; k < len / sizeof(word); ++k) {
+        memcpy(&word, value + k * sizeof(word), sizeof(word));
+        if (word != first) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+struct kv_server_arg {
+    struct rdma_kv_table    table;
+    struct rdma_mr_info     info;           // 表的 MR 信息（网络字节序），所有连接发送同一份
+};
+
+// 服务端每个连接的接收环，响应在接收槽上原地生成，发送完成后归还该槽
+struct kv_client_ctx {
+    struct rdma_recv_ring   ring;
+    uint64_t                requests;
+};
+
+static int kv_on_connect(struct rdma_server_client *cli, const struct rdma_cm_event *evt,
+                         struct rdma_conn_param *param, void *arg) {
+    struct kv_server_arg *ka = arg;
+    struct kv_client_ctx *ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return -1;
+    }
+    if (rdma_recv_ring_init(&ctx->ring, cli->conn.pd, cli->conn.qp, cli->conn.opts.max_recv_wr,
+                            KV_MSG_SIZE(KV_DEFAULT_VALUE_MAX), 0)) {
+        fprintf(stderr, "接收环创建失败\n");
+        rdma_recv_ring_destroy(&ctx->ring);
+        free(ctx);
+        return -1;
+    }
+    cli->ctx = ctx;
+    param->private_data     = &ka->info;
+    param->private_data_len = sizeof(ka->info);
+    return 0;
+}
+
+// 收到请求：执行并从同一个槽发回响应；响应发送完成：归还槽（工作线程）
+static int kv_on_completion(struct rdma_server_client *cli, struct ibv_wc *wc, void *arg) {
+    struct kv_server_arg *ka = arg;
+    struct kv_client_ctx *ctx = cli->ctx;
+    struct rdma_kv_msg   *msg;
+    struct ibv_sge        sge;
+    struct ibv_send_wr    wr, *bad_wr = NULL;
+    size_t                len;
+
+    if (!(wc->opcode & IBV_WC_RECV)) {
+        return rdma_recv_ring_release(&ctx->ring, wc->wr_id);
+    }
+    msg = (struct rdma_kv_msg *)rdma_recv_ring_slot(&ctx->ring, wc->wr_id);
+    if (wc->byte_len < sizeof(*msg) || wc->byte_len < sizeof(*msg) + (msg->op == KV_OP_PUT ? msg->len : 0)) {
+        fprintf(stderr, "[服务端] 连接 %lu 收到不完整的请求 (%u 字节)\n", cli->id, wc->byte_len);
+        return -1;
+    }
+    ctx->requests++;
+    len = rdma_kv_handle(&ka->table, msg, msg);
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)msg;
+    sge.length = len;
+    sge.lkey   = ctx->ring.mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id      = wc->wr_id;
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.opcode     = IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(&cli->conn, len);
+    if (ibv_post_send(cli->conn.qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败\n");
+        rdma_recv_ring_release(&ctx->ring, wc->wr_id);
+        return -1;
+    }
+    return 0;
+}
+
+static void kv_on_disconnect(struct rdma_server_client *cli, void *arg) {
+    struct kv_client_ctx *ctx = cli->ctx;
+
+    if (!ctx) {
+        return;
+    }
+    printf("[服务端] 连接 %lu 断开，共处理 %lu 个请求\n", cli->id, ctx->requests);
+    rdma_recv_ring_destroy(&ctx->ring);
+    free(ctx);
+    cli->ctx = NULL;
+}
+
+// 键值服务端：预置键 1..kv_keys，之后只处理 PUT 和双边 GET，Ctrl-C 退出
+int run_kv_server(struct read_config *cfg) {
+    struct rdma_server      srv;
+    struct rdma_conn_opts   opts;
+    struct kv_server_arg    ka;
+    struct rdma_kv_table   *t = &ka.table;
+    struct rdma_server_ops  ops = {
+        .on_connect    = kv_on_connect,
+        .on_completion = kv_on_completion,
+        .on_disconnect = kv_on_disconnect,
+    };
+    char                    value[KV_DEFAULT_VALUE_MAX];
+    int                     ret = -1;
+
+    memset(&ka, 0, sizeof(ka));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.responder_resources = cfg->rd_atomic;
+    // 每个接收槽最多有一个未完成的响应
+    opts.max_recv_wr  = BENCH_RECV_DEPTH;
+    opts.max_send_wr  = BENCH_RECV_DEPTH;
+    if (rdma_server_init(&srv, cfg->ip, cfg->port, &opts, cfg->workers, &ops, &ka)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        rdma_server_cleanup(&srv);
+        return -1;
+    }
+    if (rdma_kv_table_init(t, srv.pd, cfg->kv_keys, KV_DEFAULT_VALUE_MAX)) {
+        goto cleanup;
+    }
+    for (int k = 1; k <= cfg->kv_keys; ++k) {
+        kv_fill_value(value, k, 0);
+        if (rdma_kv_put(t, k, value, sizeof(value)) != KV_OK) {
+            fprintf(stderr, "预置键 %d 失败：两个候选桶都已满\n", k);
+            goto cleanup;
+        }
+    }
+    rdma_pack_mr_info(&ka.info, t->buf, t->size, t->mr);
+    printf("[服务端] 键值表 %zu 字节：%u 个桶，%d 个键，值 %d 字节\n",
+           t->size, t->hdr->nbuckets, cfg->kv_keys, KV_DEFAULT_VALUE_MAX);
+    t->puts = 0;
+
+    rdma_server_stop_on_sigint(&srv);
+    printf("[服务端] 多客户端模式，%d 个工作线程，监听 %s:%d，Ctrl-C 退出...\n", srv.nworkers, cfg->ip, cfg->port);
+    ret = rdma_server_run(&srv);
+    rdma_server_stop_on_sigint(NULL);
+    printf("[服务端] 共执行 PUT %lu 次，双边 GET %lu 次\n", t->puts, t->gets);
+
+cleanup:
+    // PD 释放前必须注销表的 MR
+    rdma_kv_table_destroy(t);
+    rdma_server_cleanup(&srv);
+    printf("[服务端] 退出。\n");
+    return ret;
+}
+
+// 客户端流水线槽中的一个操作
+struct kv_op {
+    uint32_t    op;             // KV_OP_GET/KV_OP_PUT
+    int         rpc;            // 经 Send/Recv 由服务端执行
+    uint64_t    key;
+    int         which;          // 单边 GET 正在读的候选桶：0 主桶，1 备用桶
+    uint64_t    slot;           // 单边 GET 读到的值对象序号
+    uint64_t    start_ns;
+};
+
+// 客户端完成事件的 wr_id：高 32 位为类型，低 32 位为流水线槽号或接收槽号
+enum {
+    KV_WR_SEND = 1,
+    KV_WR_INDEX,
+    KV_WR_VALUE,
+    KV_WR_RECV,
+};
+
+#define KV_WR_ID(kind, idx)     (((uint64_t)(kind) << 32) | (uint32_t)(idx))
+
+// 客户端状态。缓冲区布局：depth 个流水线槽 [请求消息][单边读取区]，之后是 depth 个接收槽
+struct kv_bench {
+    struct rdma_connection *conn;
+    struct rdma_kv_client   kc;
+    struct read_config     *cfg;
+    struct kv_op           *ops;
+    size_t                  msg_size;
+    size_t                  slot_size;
+    char                   *recv_base;
+    unsigned int            seed;
+    uint32_t                gen;            // PUT 的值代数
+    uint64_t                issued;
+    uint64_t                done;
+    uint64_t                bad;            // 内容不符的 GET 数
+    uint64_t                misses;         // 键不存在的 GET 数
+    uint64_t                failed;         // 服务端返回错误的操作数
+    struct rdma_histogram   hist[2];        // GET、PUT 延迟
+};
+
+static char *kv_slot(struct kv_bench *b, int slot) {
+    return b->conn->buf + (size_t)slot * b->slot_size;
+}
+
+// 投递一个 RDMA Read 或 Send，kind 决定 wr_id
+static int kv_post(struct kv_bench *b, int kind, int slot, uint64_t remote_addr, uint32_t len) {
+    struct ibv_sge      sge;
+    struct ibv_send_wr  wr, *bad_wr = NULL;
+    char               *buf = kv_slot(b, slot);
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)(kind == KV_WR_SEND ? buf : buf + b->msg_size);
+    sge.length = len;
+    sge.lkey   = b->conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id      = KV_WR_ID(kind, slot);
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    if (kind == KV_WR_SEND) {
+        wr.opcode      = IBV_WR_SEND;
+        wr.send_flags |= rdma_inline_flag(b->conn, len);
+    } else {
+        wr.opcode              = IBV_WR_RDMA_READ;
+        wr.wr.rdma.remote_addr = remote_addr;
+        wr.wr.rdma.rkey        = b->kc.rkey;
+    }
+    if (ibv_post_send(b->conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_send 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 投递一个接收槽
+static int kv_post_recv(struct kv_bench *b, int idx) {
+    struct ibv_sge      sge;
+    struct ibv_recv_wr  wr, *bad_wr = NULL;
+
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)(b->recv_base + (size_t)idx * b->msg_size);
+    sge.length = b->msg_size;
+    sge.lkey   = b->conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id   = KV_WR_ID(KV_WR_RECV, idx);
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    if (ibv_post_recv(b->conn->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "ibv_post_recv 失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 单边 GET：读键的主桶或备用桶
+static int kv_read_bucket(struct kv_bench *b, int slot, int which) {
+    struct kv_op *op = &b->ops[slot];
+
+    op->which = which;
+    b->kc.index_reads++;
+    return kv_post(b, KV_WR_INDEX, slot, rdma_kv_bucket_addr(&b->kc, op->key, which), KV_BUCKET_SIZE);
+}
+
+// 在流水线槽上开始一个新操作
+static int kv_start(struct kv_bench *b, int slot) {
+    struct kv_op       *op = &b->ops[slot];
+    struct rdma_kv_msg *req = (struct rdma_kv_msg *)kv_slot(b, slot);
+
+    op->key      = rand_r(&b->seed) % b->cfg->kv_keys + 1;
+    op->op       = (int)(rand_r(&b->seed) % 100) < b->cfg->kv_put_pct ? KV_OP_PUT : KV_OP_GET;
+    op->rpc      = op->op == KV_OP_PUT || b->cfg->kv_rpc_get;
+    op->start_ns = rdma_now_ns();
+    b->issued++;
+    if (!op->rpc) {
+        return kv_read_bucket(b, slot, 0);
+    }
+    memset(req, 0, sizeof(*req));
+    req->op  = op->op;
+    req->id  = slot;
+    req->key = op->key;
+    if (op->op == KV_OP_PUT) {
+        req->len = KV_DEFAULT_VALUE_MAX;
+        kv_fill_value(req->value, op->key, ++b->gen);
+    }
+    return kv_post(b, KV_WR_SEND, slot, 0, sizeof(*req) + req->len);
+}
+
+// 操作完成：记录延迟，还有剩余操作时在同一个槽上开始下一个
+static int kv_finish(struct kv_bench *b, int slot) {
+    struct kv_op *op = &b->ops[slot];
+
+    rdma_hist_record(&b->hist[op->op == KV_OP_PUT], rdma_now_ns() - op->start_ns);
+    b->done++;
+    return b->issued < (uint64_t)b->cfg->count ? kv_start(b, slot) : 0;
+}
+
+// 处理一个完成事件
+static int kv_on_wc(struct kv_bench *b, const struct ibv_wc *wc) {
+    int                 kind = wc->wr_id >> 32, idx = (uint32_t)wc->wr_id;
+    struct kv_op       *op = &b->ops[idx];
+    struct rdma_kv_msg *resp;
+    const char         *value;
+    uint32_t            len;
+
+    switch (kind) {
+        case KV_WR_SEND:
+            return 0;
+        case KV_WR_RECV:
+            resp = (struct rdma_kv_msg *)(b->recv_base + (size_t)idx * b->msg_size);
+            if (wc->byte_len < sizeof(*resp) || resp->id >= (uint64_t)b->cfg->depth) {
+                fprintf(stderr, "[客户端] 收到无效的响应 (%u 字节)\n", wc->byte_len);
+                return -1;
+            }
+            if (resp->status != KV_OK) {
+                b->failed++;
+            } else if (resp->op == KV_OP_GET && !kv_value_ok(resp->value, resp->len, resp->key)) {
+                b->bad++;
+            }
+            idx = resp->id;
+            // 先补投接收，再开始下一个操作，保证响应到达前接收槽已就绪
+            if (kv_post_recv(b, (uint32_t)wc->wr_id)) {
+                return -1;
+            }
+            return kv_finish(b, idx);
+        case KV_WR_INDEX:
+            switch (rdma_kv_find(&b->kc, kv_slot(b, idx) + b->msg_size, op->key, &op->slot)) {
+                case KV_FIND_HIT:
+                    break;
+                case KV_FIND_NEXT:
+                    if (op->which == 0) {
+                        return kv_read_bucket(b, idx, 1);
+                    }
+                    // fallthrough
+                default:
+                    b->misses++;
+                    return kv_finish(b, idx);
+            }
+            b->kc.value_reads++;
+            return kv_post(b, KV_WR_VALUE, idx, rdma_kv_value_addr(&b->kc, op->slot), b->kc.hdr.obj_size);
+        case KV_WR_VALUE:
+            switch (rdma_kv_check_value(&b->kc, kv_slot(b, idx) + b->msg_size, op->key, &value, &len)) {
+                case KV_READ_OK:
+                    if (!kv_value_ok(value, len, op->key)) {
+                        b->bad++;
+                    }
+                    return kv_finish(b, idx);
+                case KV_READ_VALUE:
+                    b->kc.retries++;
+                    b->kc.value_reads++;
+                    return kv_post(b, KV_WR_VALUE, idx, rdma_kv_value_addr(&b->kc, op->slot), b->kc.hdr.obj_size);
+                default:
+                    b->kc.retries++;
+                    return kv_read_bucket(b, idx, 0);
+            }
+        default:
+            fprintf(stderr, "[客户端] 未知的完成事件 %lx\n", wc->wr_id);
+            return -1;
+    }
+}
+
+// 键值服务客户端：保持 depth 个操作未完成，随机选键，按 -w 的比例混合 PUT，打印吞吐量和 GET/PUT 延迟分布
+int run_kv_client(struct read_config *cfg) {
+    struct rdma_connection client_conn;
+    struct rdma_conn_opts  opts;
+    struct rdma_mr_info    remote_info;
+    struct kv_bench        b;
+    struct ibv_wc          wc[PIPELINE_POLL_BATCH];
+    const char            *value;
+    uint32_t               len;
+    uint64_t               ns;
+    size_t                 obj_size = rdma_seq_obj_size(sizeof(uint64_t) + KV_DEFAULT_VALUE_MAX);
+    int                    depth = cfg->depth, ret = -1;
+
+    memset(&b, 0, sizeof(b));
+    b.cfg       = cfg;
+    b.conn      = &client_conn;
+    b.seed      = (unsigned int)rdma_now_ns();
+    b.msg_size  = KV_MSG_SIZE(KV_DEFAULT_VALUE_MAX);
+    b.slot_size = (b.msg_size + (obj_size > KV_BUCKET_SIZE ? obj_size : KV_BUCKET_SIZE) + 63) & ~(size_t)63;
+    b.ops       = calloc(depth, sizeof(*b.ops));
+    if (!b.ops) {
+        fprintf(stderr, "分配操作表失败\n");
+        return -1;
+    }
+    rdma_hist_reset(&b.hist[0]);
+    rdma_hist_reset(&b.hist[1]);
+
+    printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.initiator_depth     = cfg->rd_atomic;
+    opts.responder_resources = cfg->rd_atomic;
+    // 请求的发送完成可能晚于响应到达，发送队列按两倍深度预留；完成队列容纳发送、读取和接收
+    opts.max_send_wr  = 2 * depth;
+    opts.max_recv_wr  = depth;
+    opts.cq_depth     = 3 * depth + 1;
+    if (rdma_client_connect(&client_conn, cfg->ip, cfg->port, &opts,
+                            (size_t)depth * (b.slot_size + b.msg_size), IBV_ACCESS_LOCAL_WRITE, &remote_info)) {
+        goto cleanup;
+    }
+    b.recv_base = client_conn.buf + (size_t)depth * b.slot_size;
+    if (rdma_kv_client_init(&b.kc, &client_conn, &remote_info)) {
+        goto cleanup;
+    }
+    if (b.kc.hdr.value_max != KV_DEFAULT_VALUE_MAX) {
+        fprintf(stderr, "服务端值上限 %u 字节，与客户端的 %d 不一致\n", b.kc.hdr.value_max, KV_DEFAULT_VALUE_MAX);
+        goto cleanup;
+    }
+    // 先用同步 GET 核对一个键
+    if (rdma_kv_get(&b.kc, 1, client_conn.buf, &value, &len) != KV_OK || !kv_value_ok(value, len, 1)) {
+        fprintf(stderr, "[客户端] 读取键 1 失败，两端 -K 需一致\n");
+        goto cleanup;
+    }
+    b.kc.index_reads = b.kc.value_reads = b.kc.retries = 0;
+    for (int i = 0; i < depth; ++i) {
+        if (kv_post_recv(&b, i)) {
+            goto cleanup;
+        }
+    }
+
+    printf("[客户端] 连接建立，%d 个键，%d 次操作，PUT %d%%，GET 经%s，深度 %d，协商并发读 %d...\n",
+           cfg->kv_keys, cfg->count, cfg->kv_put_pct, cfg->kv_rpc_get ? " Send/Recv" : "单边读取", depth,
+           client_conn.initiator_depth);
+    ns = rdma_now_ns();
+    for (int slot = 0; slot < depth && b.issued < (uint64_t)cfg->count; ++slot) {
+        if (kv_start(&b, slot)) {
+            goto cleanup;
+        }
+    }
+    while (b.done < (uint64_t)cfg->count) {
+        int n = rdma_cq_poll(&client_conn, wc, PIPELINE_POLL_BATCH, -1);
+
+        if (n < 0) {
+            goto cleanup;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "[客户端] 操作失败: %s\n", ibv_wc_status_str(wc[i].status));
+                goto cleanup;
+            }
+            if (kv_on_wc(&b, &wc[i])) {
+                goto cleanup;
+            }
+        }
+    }
+    ns = rdma_now_ns() - ns;
+    rdma_report_throughput("[客户端]", b.done, KV_DEFAULT_VALUE_MAX, ns);
+    rdma_print_lat_header();
+    printf("[客户端] GET (%s):\n", cfg->kv_rpc_get ? "Send/Recv" : "单边读取");
+    rdma_print_lat_row(KV_DEFAULT_VALUE_MAX, &b.hist[0]);
+    printf("[客户端] PUT (Send/Recv):\n");
+    rdma_print_lat_row(KV_DEFAULT_VALUE_MAX, &b.hist[1]);
+    if (!cfg->kv_rpc_get && b.hist[0].total) {
+        printf("[客户端] 单边 GET 平均读桶 %.3f 次、读值 %.3f 次，重读 %lu 次\n",
+               (double)b.kc.index_reads / b.hist[0].total, (double)b.kc.value_reads / b.hist[0].total, b.kc.retries);
+    }
+    printf("[客户端] 键不存在 %lu 次，服务端返回错误 %lu 次，内容不符 %lu 次\n", b.misses, b.failed, b.bad);
+    ret = 0;
+    rdma_disconnect(client_conn.cm_id);
+cleanup:
+    rdma_connection_cleanup(&client_conn);
+    free(b.ops);
+    return ret;
+}
+
 int main(int argc, char **argv) {
     struct read_config cfg;
 
@@ -497,8 +1301,23 @@ int main(int argc, char **argv) {
         fprintf(stderr, "参数解析失败\n");
         return -1;
     }
-    if (cfg.role == ROLE_SERVER) {
+    if (cfg.role == ROLE_SERVER && cfg.kv_keys > 0) {
+        return run_kv_server(&cfg);
+    } else if (cfg.role == ROLE_SERVER && cfg.workers > 0) {
+        struct rdma_conn_opts opts;
+
+        rdma_conn_opts_init(&opts);
+        opts.poll_mode    = cfg.poll_mode;
+        opts.poll_spin_us = cfg.poll_spin_us;
+        opts.responder_resources = cfg.rd_atomic;
+        return rdma_run_passive_server(cfg.ip, cfg.port, &opts, cfg.workers, buf_size(&cfg),
+                                       IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ, cfg.huge_page);
+    } else if (cfg.role == ROLE_SERVER) {
         return run_server(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.kv_keys > 0) {
+        return run_kv_client(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.num_qps > 0) {
+        return run_multi_client(&cfg);
     } else if (cfg.role == ROLE_CLIENT) {
         return run_client(&cfg);
     } else {
@@ -2,7 +2,18 @@
 // rdma send demo: 支持 IB、RoCE、iWARP，客户端发送"你好，汉为信息"，服务端收到后打印。
 // 用法：
 // 服务器：./rdma_send_demo -s -a <本机IP> -p <端口> [-n <次数>]
-// 客户端：./rdma_send_demo -c -a <服务器IP> -p <端口> [-n <次数>]
+// 客户端：./rdma_send_demo -c -a <服务器IP> -p <端口> [-n <次数>] [-d <深度>]
+// 带宽扫描：服务端和客户端同时加 -S <最小>:<最大>，如 -S 4K:4M
+// 延迟测试：服务端和客户端同时加 -L（可配合 -S），客户端打印 ping-pong 延迟分布
+// 完成轮询：-P busy|event|adaptive[:<微秒>] 选择忙轮询、事件驱动或自适应
+// 多客户端：服务端加 -m <线程数>，接受任意数量的客户端，Ctrl-C 退出
+// 多 QP：客户端加 -q <QP数> [-t <线程数>]，服务端加 -m <线程数>，打印每个 QP 和总体吞吐量
+// 共享接收队列：多客户端服务端默认所有连接共用一个 SRQ，-R <槽数> 调整槽数，-R 0 改为每个连接自己的接收队列
+// 内联与聚合：-I <字节> 指定内联阈值；逐条发送时消息头和消息体两段聚合发送，-g <SGE数> 指定每个 WR 的 SGE 数
+// 注册缓存：逐条发送时消息体来自普通 malloc 的应用缓冲区，每次发送经 MR 缓存取得 lkey，-B <字节> 指定注册内存预算
+// RPC：服务端和客户端同时加 -r echo|null（可配合 -S），客户端保持 -d 个调用未完成，打印每秒调用数和调用延迟
+// UD 传输：服务端和客户端同时加 -U，客户端 -q <对端数> 经一个 UD QP 向服务端建立多个对端，-d 个消息的窗口由各对端平分，
+//          与 RC 的 -m/-q 对比消息速率和内存
 //
 // 依赖：libibverbs, librdmacm
 //
@@ -14,20 +25,32 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
+#include <signal.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
 #include <rdma/rdma_cma.h>
 
+#include "rdma_common.h"
+#include "rdma_cq.h"
+#include "rdma_mr_cache.h"
+#include "rdma_perf.h"
+#include "rdma_multi.h"
+#include "rdma_pipeline.h"
+#include "rdma_recv_ring.h"
+#include "rdma_rpc.h"
+#include "rdma_server.h"
+#include "rdma_sg.h"
+#include "rdma_ud.h"
 
 #define MSG_STR         "你好，汉为信息"
 #define MSG_SIZE        64
 #define DEFAULT_PORT    18515
 #define DEFAULT_COUNT   10
-
-// 角色定义
-#define ROLE_UNDEF      0
-#define ROLE_SERVER     1
-#define ROLE_CLIENT     2
+#define NO_INLINE_MARK  0x5a    // 延迟测试消息首字节为该值时服务端回显不使用内联
+#define HDR_SIZE        32      // 消息头区域大小，消息体放在缓冲区的 HDR_SIZE 偏移处
+#define DEFAULT_SGE     2       // 逐条发送时每个 WR 请求的 SGE 数
+#define UD_IDLE_WAIT_MS 10      // UD 服务端空闲时等待完成的时长（毫秒），之后检查新对端和 Ctrl-C
+#define UD_ACCEPT_MASK  4095    // UD 服务端忙时每 4096 轮检查一次新对端
 
 // 参数结构体
 struct send_config {
@@ -35,8 +58,30 @@ struct send_config {
     char        ip[64];         // IP地址
     int         port;           // 端口
     int         count;          // 消息收发次数
+    int         depth;          // 带宽扫描时的流水线深度
+    size_t      size_min;       // 带宽扫描最小消息大小，0 表示不扫描
+    size_t      size_max;       // 带宽扫描最大消息大小
+    int         latency;        // ping-pong 延迟测试模式
+    int         poll_mode;      // 完成队列轮询策略 RDMA_POLL_*
+    int         poll_spin_us;   // 自适应轮询的忙轮询时长（微秒）
+    int         workers;        // 多客户端服务端的工作线程数，0 表示只服务一个客户端
+    int         num_qps;        // 客户端连接（QP）数
+    int         threads;        // 客户端驱动 QP 的线程数
+    int         srq_slots;      // 多客户端服务端共享接收队列的槽数，0 表示不使用 SRQ
+    int         inline_threshold; // 内联阈值（字节），-1 表示使用设备授予的上限，0 禁用内联
+    int         sge;            // 逐条发送时每个 WR 的 SGE 数，消息头和消息体段数超过它时拆成多个 WR
+    size_t      mr_budget;      // 逐条发送时 MR 缓存的注册内存预算，0 表示默认
+    int         rpc;            // 客户端调用的 RPC 方法 RPC_METHOD_*，0 表示不使用 RPC
+    int         ud;             // 使用 UD 传输，客户端的 num_qps 为对端数
 };
 
+// 注册缓冲区大小：带宽扫描时需容纳最大消息，RPC 时还有消息头
+static size_t buf_size(const struct send_config *cfg) {
+    size_t size = cfg->size_max > MSG_SIZE ? cfg->size_max : MSG_SIZE;
+
+    return cfg->rpc ? size + sizeof(struct rdma_rpc_hdr) : size;
+}
+
 // 打印用法
 void print_usage(const char *prog) {
     printf("用法: %s -s|-c -a <IP> -p <端口> [-n <次数>]\n", prog);
@@ -45,6 +90,27 @@ void print_usage(const char *prog) {
     printf("  -a <IP>      指定对端IP地址\n");
     printf("  -p <端口>    指定端口 (默认%d)\n", DEFAULT_PORT);
     printf("  -n <次数>    发送/接收消息次数 (默认%d)\n", DEFAULT_COUNT);
+    printf("  -d <深度>    带宽扫描时保持 <深度> 个发送未完成 (默认%d)\n", BENCH_DEFAULT_DEPTH);
+    printf("  -S <最小>:<最大> 按 2 的幂扫描消息大小并打印带宽表格，两端需一致 (如 4K:4M)\n");
+    printf("  -L           ping-pong 延迟测试，两端需一致，可配合 -S 扫描消息大小\n");
+    printf("  -P <策略>    完成轮询策略: busy (默认)、event、adaptive[:<微秒>] (默认忙轮询%d微秒后阻塞)\n",
+           DEFAULT_POLL_SPIN_US);
+    printf("  -m <线程数>  服务端多客户端模式，连接分配给 <线程数> 个工作线程，Ctrl-C 退出\n");
+    printf("  -q <QP数>    客户端建立 <QP数> 个连接并行测带宽，服务端需加 -m\n");
+    printf("  -t <线程数>  客户端用 <线程数> 个绑核线程驱动这些 QP (默认 1)\n");
+    printf("  -I <字节>    不超过 <字节> 的消息使用内联发送 (默认为设备授予的上限，请求%d)，0 禁用\n",
+           DEFAULT_MAX_INLINE_DATA);
+    printf("  -g <SGE数>   逐条发送时消息头和消息体作为两段聚合发送，每个 WR 最多 <SGE数> 个 SGE (默认%d)，1 时拆成两个 WR\n",
+           DEFAULT_SGE);
+    printf("  -B <字节>    逐条发送时 MR 缓存的注册内存预算 (默认 %luM)\n", MR_CACHE_DEFAULT_BUDGET >> 20);
+    printf("  -R <槽数>    多客户端服务端所有连接共用 <槽数> 个接收槽的 SRQ (默认%d)，0 表示不使用 SRQ\n",
+           SRQ_DEFAULT_SLOTS);
+    printf("  -r <方法>    RPC 模式，两端都需指定: echo 原样返回参数，null 返回空结果；服务端不论取值都注册两个方法，\n"
+           "               默认以 %d 个工作线程服务多客户端，客户端保持 -d 个调用未完成，-S 指定参数大小\n",
+           SERVER_DEFAULT_WORKERS);
+    printf("  -U           UD 传输，两端都需指定：服务端一个 UD QP 接受最多 %d 个对端，Ctrl-C 退出；\n"
+           "               客户端 -q 指定对端数，-d 个消息的窗口由各对端平分，-S 指定消息大小 (不超过 MTU)\n",
+           UD_DEFAULT_MAX_PEERS);
 }
 
 // 参数解析
@@ -52,17 +118,96 @@ int parse_args(int argc, char **argv, struct send_config *cfg) {
     int opt;
     memset(cfg, 0, sizeof(*cfg));
     cfg->port  = DEFAULT_PORT;
-    cfg->count = DEFAULT_COUNT;
-    while ((opt = getopt(argc, argv, "sca:p:n:")) != -1) {
+    cfg->poll_spin_us = DEFAULT_POLL_SPIN_US;
+    cfg->inline_threshold = -1;
+    cfg->sge = DEFAULT_SGE;
+    cfg->srq_slots = SRQ_DEFAULT_SLOTS;
+    while ((opt = getopt(argc, argv, "sca:p:n:d:S:LP:m:q:t:R:I:g:B:r:U")) != -1) {
         switch (opt) {
             case 's': cfg->role = ROLE_SERVER; break;
             case 'c': cfg->role = ROLE_CLIENT; break;
             case 'a': strncpy(cfg->ip, optarg, sizeof(cfg->ip)-1); break;
             case 'p': cfg->port = atoi(optarg); break;
             case 'n': cfg->count = atoi(optarg); break;
+            case 'd': cfg->depth = atoi(optarg); break;
+            case 'S':
+                if (rdma_parse_size_range(optarg, &cfg->size_min, &cfg->size_max)) return -1;
+                break;
+            case 'L': cfg->latency = 1; break;
+            case 'm': cfg->workers = atoi(optarg); break;
+            case 'q': cfg->num_qps = atoi(optarg); break;
+            case 't': cfg->threads = atoi(optarg); break;
+            case 'I': cfg->inline_threshold = atoi(optarg); break;
+            case 'g': cfg->sge = atoi(optarg); break;
+            case 'R': cfg->srq_slots = atoi(optarg); break;
+            case 'B': cfg->mr_budget = rdma_parse_size(optarg); break;
+            case 'U': cfg->ud = 1; break;
+            case 'r':
+                if (strcmp(optarg, "echo") == 0) {
+                    cfg->rpc = RPC_METHOD_ECHO;
+                } else if (strcmp(optarg, "null") == 0) {
+                    cfg->rpc = RPC_METHOD_NULL;
+                } else {
+                    fprintf(stderr, "未知的 RPC 方法: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'P':
+                if (rdma_parse_poll_mode(optarg, &cfg->poll_mode, &cfg->poll_spin_us)) return -1;
+                break;
             default: print_usage(argv[0]); return -1;
         }
     }
+    if (cfg->latency && !cfg->size_min) {
+        cfg->size_min = cfg->size_max = MSG_SIZE;
+    }
+    // 多 QP 属于带宽测试，未指定 -S 时使用默认消息大小
+    if (cfg->threads > 0 && cfg->num_qps <= 0) {
+        cfg->num_qps = cfg->threads;
+    }
+    if (cfg->num_qps > 0) {
+        if (cfg->latency) {
+            fprintf(stderr, "-q/-t 不能与 -L 同时使用\n");
+            return -1;
+        }
+        if (!cfg->size_min) {
+            cfg->size_min = cfg->size_max = MSG_SIZE;
+        }
+    }
+    // RPC 属于性能测试，未指定 -S 时使用默认参数大小
+    if (cfg->rpc) {
+        if (cfg->latency || cfg->num_qps > 0) {
+            fprintf(stderr, "-r 不能与 -L/-q/-t 同时使用\n");
+            return -1;
+        }
+        if (!cfg->size_min) {
+            cfg->size_min = cfg->size_max = MSG_SIZE;
+        }
+        // 服务端每个连接预投递 BENCH_RECV_DEPTH 个接收，发送队列同样大小
+        if (cfg->depth > BENCH_RECV_DEPTH) {
+            fprintf(stderr, "RPC 模式下 -d 不能超过 %d\n", BENCH_RECV_DEPTH);
+            return -1;
+        }
+    }
+    // UD 属于性能测试，一个线程驱动所有对端
+    if (cfg->ud) {
+        if (cfg->latency || cfg->rpc || cfg->threads > 1) {
+            fprintf(stderr, "-U 不能与 -L/-r/-t 同时使用\n");
+            return -1;
+        }
+        if (cfg->num_qps <= 0) {
+            cfg->num_qps = 1;
+        }
+        if (!cfg->size_min) {
+            cfg->size_min = cfg->size_max = MSG_SIZE;
+        }
+    }
+    if (cfg->count <= 0) {
+        cfg->count = cfg->size_min ? BENCH_DEFAULT_ITERS : DEFAULT_COUNT;
+    }
+    if (cfg->depth <= 0) {
+        cfg->depth = BENCH_DEFAULT_DEPTH;
+    }
     if (cfg->role == ROLE_UNDEF || cfg->ip[0] == '\0') {
         print_usage(argv[0]);
         return -1;
@@ -71,171 +216,151 @@ int parse_args(int argc, char **argv, struct send_config *cfg) {
 }
 
 // =================== rdma_cm 方式实现 ===================
-// 资源结构体
-struct rdma_connection {
-    struct rdma_event_channel *ec;      // 事件通道
-    struct rdma_cm_id         *cm_id;   // cm id
-    struct ibv_pd             *pd;      // 保护域
-    struct ibv_comp_channel   *comp_ch; // 完成通道
-    struct ibv_cq             *cq;      // 完成队列
-    struct ibv_qp             *qp;      // 传输队列对
-    struct ibv_mr             *mr;      // 内存注册
-    char                      *buf;     // 消息缓冲区
-};
+// 性能测试接收循环：处理完的槽归还给接收环批量补投，直到客户端断开。
+// echo 非 0 时（延迟测试）直接从接收槽把消息原样发回，发送 WR 的 wr_id 为槽号，发送完成后才归还该槽
+static int bench_recv_loop(struct rdma_connection *conn, struct rdma_recv_ring *ring, int echo) {
+    struct ibv_wc       wc[PIPELINE_POLL_BATCH];
+    struct ibv_sge      sge;
+    struct ibv_send_wr  send_wr, *bad_send_wr = NULL;
+    uint64_t            msgs = 0, bytes = 0;
 
-// 初始化会话资源
-int rdma_connection_init(struct rdma_connection *conn, struct send_config *cfg) {
-    struct sockaddr_in addr;
-    int                ret = 0;
-
-    memset(conn, 0, sizeof(*conn));
-    conn->ec = rdma_create_event_channel();
-    if (!conn->ec) {
-        fprintf(stderr, "rdma_create_event_channel 失败\n");
-        return -1;
-    }
-
-  /*RDMA_PS_TCP：用于基于 TCP 的 RDMA 通信（如 RoCE、iWARP）。
-    RDMA_PS_IPOIB：用于 IP over InfiniBand。
-    RDMA_PS_UDP：用于基于 UDP 的 RDMA 通信。
-    RDMA_PS_IB：用于原生 InfiniBand 通信。
-    */
-    ret = rdma_create_id(conn->ec, &conn->cm_id, NULL, RDMA_PS_TCP);
-    if (ret) {
-        fprintf(stderr, "rdma_create_id 失败 %d\n", ret);
-        return -1;
-    }
-
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(cfg->port);
-    addr.sin_addr.s_addr = inet_addr(cfg->ip);
-
-    if (cfg->role == ROLE_SERVER) {
+    memset(&sge, 0, sizeof(sge));
+    sge.lkey   = ring->mr->lkey;
+    memset(&send_wr, 0, sizeof(send_wr));
+    send_wr.sg_list    = &sge;
+    send_wr.num_sge    = 1;
+    send_wr.opcode     = IBV_WR_SEND;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
 
-        ret = rdma_bind_addr(conn->cm_id, (struct sockaddr*)&addr);
-        if (ret) {
-            fprintf(stderr, "rdma_bind_addr 失败 %d\n", ret);
+    while (1) {
+        int n = rdma_cq_poll(conn, wc, PIPELINE_POLL_BATCH, CQ_CHECK_INTERVAL_MS);
+        if (n < 0) {
             return -1;
         }
-      /*监听
-        rdma_listen监听队列的最大长度为 1，当队列满时，新连接请求会被拒绝。
-        */
-        ret = rdma_listen(conn->cm_id, 1);
-        if (ret) {
-            fprintf(stderr, "rdma_listen 失败 %d\n", ret);
-            return -1;
+        if (n == 0) {
+            int ret = rdma_check_disconnect(conn);
+            if (ret) {
+                break;
+            }
+            continue;
         }
-    } else {
-        ret = rdma_resolve_addr(conn->cm_id, NULL, (struct sockaddr*)&addr, 2000);
-        if (ret) {
-            fprintf(stderr, "rdma_resolve_addr 失败 %d\n", ret);
-            return -1;
+        for (int i = 0; i < n; ++i) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "[服务端] 完成队列错误: %s\n", ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+            // 回显发送完成，槽可以重新接收
+            if (!(wc[i].opcode & IBV_WC_RECV)) {
+                if (rdma_recv_ring_release(ring, wc[i].wr_id)) {
+                    return -1;
+                }
+                continue;
+            }
+            msgs++;
+            bytes += wc[i].byte_len;
+            if (!echo) {
+                if (rdma_recv_ring_release(ring, wc[i].wr_id)) {
+                    return -1;
+                }
+                continue;
+            }
+            sge.addr       = (uintptr_t)rdma_recv_ring_slot(ring, wc[i].wr_id);
+            sge.length     = wc[i].byte_len;
+            send_wr.wr_id  = wc[i].wr_id;
+            send_wr.send_flags = IBV_SEND_SIGNALED;
+            if (wc[i].byte_len > 0 && *(char *)sge.addr != NO_INLINE_MARK) {
+                send_wr.send_flags |= rdma_inline_flag(conn, wc[i].byte_len);
+            }
+            if (ibv_post_send(conn->qp, &send_wr, &bad_send_wr)) {
+                fprintf(stderr, "ibv_post_send 失败\n");
+                return -1;
+            }
         }
     }
+    printf("[服务端] 客户端已断开，共接收 %lu 条消息，%lu 字节，补投接收 %lu 次\n", msgs, bytes, ring->posts);
     return 0;
 }
 
-// 资源释放
-void rdma_connection_cleanup(struct rdma_connection *conn) {
-    if (conn->mr)      ibv_dereg_mr(conn->mr);
-    if (conn->cq)      ibv_destroy_cq(conn->cq);
-    if (conn->comp_ch) ibv_destroy_comp_channel(conn->comp_ch);
-    if (conn->pd)      ibv_dealloc_pd(conn->pd);
-    if (conn->cm_id)   rdma_destroy_id(conn->cm_id);
-    if (conn->ec)      rdma_destroy_event_channel(conn->ec);
-    if (conn->buf)     free(conn->buf);
-}
+// 测量一个消息大小的 ping-pong 延迟：每次先投递接收 WR，再发送，收到服务端回显后记录 RTT/2。
+// no_inline 非 0 时禁用内联，并在消息首字节放 NO_INLINE_MARK 让服务端回显也不内联
+static int latency_one_size(struct rdma_connection *conn, struct send_config *cfg, size_t size, int no_inline,
+                            struct rdma_histogram *hist) {
+    struct ibv_sge        sge;
+    struct ibv_send_wr    wr, *bad_wr = NULL;
+    struct ibv_recv_wr    recv_wr, *bad_recv_wr = NULL;
+    struct ibv_wc         wc[PIPELINE_POLL_BATCH];
 
-// 事件等待
-int wait_event(struct rdma_connection *conn, enum rdma_cm_event_type expect, struct rdma_cm_event **evt) {
-    int ret = 0;
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)conn->buf;
+    sge.length = size;
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.opcode     = IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED | (no_inline ? 0 : rdma_inline_flag(conn, size));
+    memset(&recv_wr, 0, sizeof(recv_wr));
+    recv_wr.sg_list = &sge;
+    recv_wr.num_sge = 1;
 
-    ret = rdma_get_cm_event(conn->ec, evt);
-    if (ret) {
-        fprintf(stderr, "rdma_get_cm_event 失败 %d\n", ret);
-        return -1;
-    }
+    rdma_hist_reset(hist);
+    for (int i = 0; i < cfg->count; ++i) {
+        uint64_t start;
+        int      got_recv = 0;
 
-    if ((*evt)->event != expect) {
-        fprintf(stderr, "期望事件 %d, 实际事件 %d\n", expect, (*evt)->event);
-        rdma_ack_cm_event(*evt);
-        return -1;
+        if (ibv_post_recv(conn->qp, &recv_wr, &bad_recv_wr)) {
+            fprintf(stderr, "ibv_post_recv 失败\n");
+            return -1;
+        }
+        conn->buf[0] = no_inline ? NO_INLINE_MARK : 0;
+        start = rdma_now_ns();
+        if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+            fprintf(stderr, "ibv_post_send 失败\n");
+            return -1;
+        }
+        // 发送完成可能晚于回显到达，留到后续轮询回收
+        while (!got_recv) {
+            int n = rdma_cq_poll(conn, wc, PIPELINE_POLL_BATCH, -1);
+            if (n < 0) {
+                return -1;
+            }
+            for (int j = 0; j < n; ++j) {
+                if (wc[j].status != IBV_WC_SUCCESS) {
+                    fprintf(stderr, "[客户端] 完成队列错误: %s\n", ibv_wc_status_str(wc[j].status));
+                    return -1;
+                }
+                if (wc[j].opcode & IBV_WC_RECV) {
+                    got_recv = 1;
+                }
+            }
+        }
+        rdma_hist_record(hist, (rdma_now_ns() - start) / 2);
     }
     return 0;
 }
 
-// 创建QP等资源
-int build_qp(struct rdma_connection *conn) {
-    struct ibv_qp_init_attr qp_attr;
+// ping-pong 延迟测试。不超过内联阈值的消息大小再测一遍禁用内联的延迟，对比内联的收益
+static int run_latency(struct rdma_connection *conn, struct send_config *cfg) {
+    struct rdma_histogram hist;
 
-    conn->pd = ibv_alloc_pd(conn->cm_id->verbs);
-    if (!conn->pd) {
-        fprintf(stderr, "ibv_alloc_pd 失败\n");
-        return -1;
-    }
-    //当 CQ 上有完成事件（如发送/接收完成），并且你为 CQ 关联了 comp_channel，内核会通过该 channel 发送事件通知
-    conn->comp_ch = ibv_create_comp_channel(conn->cm_id->verbs);
-    if (!conn->comp_ch) {
-        fprintf(stderr, "ibv_create_comp_channel 失败\n");
-        return -1;
-    }
-    conn->cq = ibv_create_cq(conn->cm_id->verbs, 10, NULL, conn->comp_ch, 0);
-    if (!conn->cq) {
-        fprintf(stderr, "ibv_create_cq 失败\n");
-        return -1;
+    printf("单向延迟 (RTT/2)，内联阈值 %u 字节:\n", conn->inline_max);
+    rdma_print_lat_header();
+    for (size_t size = cfg->size_min; size; size = rdma_next_size(size, cfg->size_max)) {
+        if (latency_one_size(conn, cfg, size, 0, &hist)) {
+            return -1;
+        }
+        rdma_print_lat_row(size, &hist);
     }
-
-    //创建QP
-    memset(&qp_attr, 0, sizeof(qp_attr));
-    qp_attr.send_cq          = conn->cq;
-    qp_attr.recv_cq          = conn->cq;
-    /*
-    IBV_QPT_RC：支持可靠、面向连接的通信，保证数据可靠到达，支持 RDMA 读写和发送/接收。
-    IBV_QPT_UC：面向连接但不保证可靠性，支持 RDMA 写和发送/接收，不支持 RDMA 读。
-    IBV_QPT_UD：无连接、无可靠性保证，支持一对多通信，常用于广播/多播或管理报文。
-    IBV_QPT_RAW_PACKET：允许直接发送/接收原始以太网帧。
-    IBV_QPT_XRC_SEND：用于 XRC 发送队列。
-    IBV_QPT_XRC_RECV：用于 XRC 接收队列。
-    IBV_QPT_DRIVER：用于驱动程序特定的队列类型。
-    */
-    qp_attr.qp_type          = IBV_QPT_RC;
-    qp_attr.cap.max_send_wr  = 10;
-    qp_attr.cap.max_recv_wr  = 10;
-    qp_attr.cap.max_send_sge = 1;//一次发送操作最多能用多少个sge数
-    qp_attr.cap.max_recv_sge = 1;//一次接收操作最多能用多少个sge数
-    int ret = rdma_create_qp(conn->cm_id, conn->pd, &qp_attr);
-    if (ret) {
-        fprintf(stderr, "rdma_create_qp 失败\n");
-        return -1;
+    if (conn->inline_max == 0 || cfg->size_min > conn->inline_max) {
+        return 0;
     }
-    conn->qp = conn->cm_id->qp;
-    return 0;
-}
-
-// 注册内存
-int reg_mem(struct rdma_connection *conn) {
-    if (posix_memalign((void**)&conn->buf, 4096, MSG_SIZE) != 0) {
-        fprintf(stderr, "posix_memalign 失败\n");
-        return -1;
-    }
-
-    memset(conn->buf, 0, MSG_SIZE);
-    /*
-    IBV_ACCESS_LOCAL_WRITE：允许本地进程写该内存。
-    IBV_ACCESS_REMOTE_WRITE：允许远程节点通过 RDMA Write 操作写本地内存。
-    IBV_ACCESS_REMOTE_READ：允许远程节点通过 RDMA Read 操作读本地内存。
-    IBV_ACCESS_REMOTE_ATOMIC：允许远程节点对本地内存执行原子操作。
-    IBV_ACCESS_MW_BIND：允许该内存区域被绑定到内存窗口。
-    IBV_ACCESS_ZERO_BASED：允许注册零基址内存。
-    IBV_ACCESS_ON_DEMAND：支持按需分页。
-    IBV_ACCESS_HUGETLB：允许注册 HugeTLB（大页）内存。
-    IBV_ACCESS_RELAXED_ORDERING：允许放宽内存访问顺序。
-    */
-    conn->mr = ibv_reg_mr(conn->pd, conn->buf, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ);
-    if (!conn->mr) {
-        fprintf(stderr, "ibv_reg_mr 失败\n");
-        return -1;
+    printf("禁用内联时的单向延迟 (RTT/2):\n");
+    rdma_print_lat_header();
+    for (size_t size = cfg->size_min; size && size <= conn->inline_max; size = rdma_next_size(size, cfg->size_max)) {
+        if (latency_one_size(conn, cfg, size, 1, &hist)) {
+            return -1;
+        }
+        rdma_print_lat_row(size, &hist);
     }
     return 0;
 }
@@ -245,14 +370,32 @@ int run_server(struct send_config *cfg) {
     struct rdma_connection   server_conn;
     struct rdma_cm_event         *evt = NULL;
     struct rdma_cm_id            *child = NULL;
-    struct ibv_sge                sge;
-    struct ibv_recv_wr            wr,*bad_wr = NULL;
+    struct rdma_recv_ring         ring;
+    struct rdma_sg_reasm          reasm;
     struct rdma_conn_param        conn_param;
     struct ibv_wc                 wc;
+    struct rdma_conn_opts         opts;
     int                           received_msg_count = 0;
+    int                           recv_depth = cfg->count;
 
+    memset(&ring, 0, sizeof(ring));
+    memset(&reasm, 0, sizeof(reasm));
     printf("[服务端] 启动，监听 %s:%d，等待连接...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&server_conn, cfg)){
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    if (cfg->size_min) {
+        recv_depth = rdma_recv_ring_slots(BENCH_RECV_DEPTH, buf_size(cfg));
+    }
+    // 接收队列和完成队列要容纳全部预投递的接收 WR，延迟测试时还有回显的发送完成
+    if (recv_depth > opts.max_recv_wr) {
+        opts.max_recv_wr = recv_depth;
+    }
+    if (opts.max_recv_wr + opts.max_send_wr > opts.cq_depth) {
+        opts.cq_depth = opts.max_recv_wr + opts.max_send_wr;
+    }
+    if (rdma_connection_init(&server_conn, cfg->role, cfg->ip, cfg->port, &opts)){
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     } 
@@ -279,6 +422,7 @@ int run_server(struct send_config *cfg) {
         goto cleanup;
     }
     child = evt->id;
+    rdma_apply_peer_param(&server_conn, evt);
     //获取到事件后，必须调用 rdma_ack_cm_event() 来“归还”事件，通知内核你已经处理完毕，可以释放相关资源。
     rdma_ack_cm_event(evt);
 
@@ -288,31 +432,15 @@ int run_server(struct send_config *cfg) {
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&server_conn)) {
-        fprintf(stderr, "rdma 内存注册失败\n");
-        goto cleanup;
-    }
 
-    // 预先post recv
-    memset(&sge, 0, sizeof(sge));
-    sge.addr   = (uintptr_t)server_conn.buf;
-    sge.length = MSG_SIZE;
-    sge.lkey   = server_conn.mr->lkey;
-    memset(&wr, 0, sizeof(wr));
-    wr.sg_list = &sge;
-    wr.num_sge = 1;
-    wr.next    = NULL;
-    for (int i = 0; i < cfg->count; ++i) {
-        if (ibv_post_recv(server_conn.qp, &wr, &bad_wr)) {
-            fprintf(stderr, "ibv_post_recv 失败\n");
-            goto cleanup;
-        }
+    // 预先post recv：每条消息落在接收环的不同槽里
+    if (rdma_recv_ring_init(&ring, server_conn.pd, server_conn.qp, recv_depth, buf_size(cfg), 0)) {
+        fprintf(stderr, "接收环创建失败\n");
+        goto cleanup;
     }
 
     // 接受连接
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
+    rdma_fill_conn_param(&server_conn, &conn_param);
     if (rdma_accept(server_conn.cm_id, &conn_param)) {
         fprintf(stderr, "rdma_accept 失败\n");
         goto cleanup;
@@ -323,17 +451,23 @@ int run_server(struct send_config *cfg) {
         goto cleanup;
     }
     rdma_ack_cm_event(evt);
+    if (cfg->size_min) {
+        printf("[服务端] 连接建立，%s中...\n", cfg->latency ? "延迟测试" : "带宽扫描接收");
+        bench_recv_loop(&server_conn, &ring, cfg->latency);
+        goto cleanup;
+    }
     printf("[服务端] 连接建立，开始接收消息...\n");
     // 消息循环
     while (received_msg_count < cfg->count) {
-        int n = ibv_poll_cq(server_conn.cq, 1, &wc);
+        int n = rdma_cq_poll(&server_conn, &wc, 1, CQ_CHECK_INTERVAL_MS);
         if (n < 0) {
-            fprintf(stderr, "ibv_poll_cq 失败\n");
             goto cleanup;
         }
 
         if (n == 0) {
-            usleep(100);
+            if (rdma_check_disconnect(&server_conn)) {
+                break;
+            }
             continue;
         }
 
@@ -342,12 +476,32 @@ int run_server(struct send_config *cfg) {
             goto cleanup;
         }
         if (wc.opcode == IBV_WC_RECV) {
-            printf("[服务端] 收到消息: %s\n", server_conn.buf);
-            received_msg_count++;
+            const char *msg;
+            size_t      len;
+
+            // 消息可能被拆成多个分片，每个分片占一个接收槽
+            int ret = rdma_sg_reasm_add(&reasm, &wc, rdma_recv_ring_slot(&ring, wc.wr_id), &msg, &len);
+            if (ret < 0) {
+                goto cleanup;
+            }
+            if (ret > 0) {
+                printf("[服务端] 收到消息: %.*s\n", (int)len, msg);
+                received_msg_count++;
+            }
+            if (rdma_recv_ring_release(&ring, wc.wr_id)) {
+                goto cleanup;
+            }
         }
     }
     printf("[服务端] 消息接收完毕，退出。\n");
 cleanup:
+    // 接收环的 MR 要在 QP 销毁之后、PD 释放之前注销
+    if (server_conn.qp) {
+        rdma_destroy_qp(server_conn.cm_id);
+        server_conn.qp = NULL;
+    }
+    rdma_recv_ring_destroy(&ring);
+    rdma_sg_reasm_free(&reasm);
     rdma_connection_cleanup(&server_conn);
     return 0;
 }
@@ -357,49 +511,50 @@ int run_client(struct send_config *cfg) {
     struct rdma_connection client_conn;
     struct rdma_cm_event       *evt = NULL;
     struct rdma_conn_param      conn_param;
-    struct ibv_sge              sge;
-    struct ibv_send_wr          wr, *bad_wr = NULL;
+    struct ibv_sge              sge, segs[2];
+    struct ibv_send_wr          wr;
     struct ibv_wc               wc;
+    struct rdma_conn_opts       opts;
+    struct rdma_pipeline        pl;
+    struct rdma_mr_cache        cache;
+    struct rdma_mr_entry       *ent;
+    char                       *body = NULL;
+    size_t                      body_len = strlen(MSG_STR) + 1;
+    uint64_t                    t0, miss_ns = 0, hit_ns = 0;
+    int                         nwr = 0;
 
     printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&client_conn, cfg)){
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    opts.max_send_sge = cfg->sge > 0 ? cfg->sge : 1;
+    if (cfg->size_min) {
+        // 发送队列和完成队列都要容纳一整条流水线
+        opts.max_send_wr = cfg->depth;
+        opts.cq_depth    = cfg->depth + 1;
+    }
+    memset(&cache, 0, sizeof(cache));
+    if (rdma_connection_init(&client_conn, cfg->role, cfg->ip, cfg->port, &opts)){
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     } 
-
-    // 地址解析完成
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ADDR_RESOLVED, &evt)){
-        fprintf(stderr, "地址解析失败\n");
+    // 地址解析、路由解析完成后才能继续创建 QP 和建立连接。
+    if (rdma_client_resolve(&client_conn)) {
         goto cleanup;
     }
-    rdma_ack_cm_event(evt);
-
-    // 路由解析，地址解析成功后调用，成功后才能继续创建 QP 和建立连接。
-    if (rdma_resolve_route(client_conn.cm_id, 2000)) {
-        fprintf(stderr, "路由解析失败\n");
-        goto cleanup;
-    }
-
-    //已找到到目标的路由
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ROUTE_RESOLVED, &evt)){
-        fprintf(stderr, "路由解析事件失败\n");
-        goto cleanup;
-    }
-    rdma_ack_cm_event(evt);
 
     if (build_qp(&client_conn)){
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&client_conn)){
+    if (reg_mem(&client_conn, buf_size(cfg), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ)){
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
 
     // 连接
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
+    rdma_fill_conn_param(&client_conn, &conn_param);
     if (rdma_connect(client_conn.cm_id, &conn_param)){
         fprintf(stderr, "rdma_connect 失败\n");
         goto cleanup;
@@ -409,6 +564,7 @@ int run_client(struct send_config *cfg) {
         fprintf(stderr, "等待连接建立成功事件失败\n");
         goto cleanup;
     }
+    rdma_apply_peer_param(&client_conn, evt);
     rdma_ack_cm_event(evt);
 
     //组装消息结构
@@ -423,39 +579,528 @@ int run_client(struct send_config *cfg) {
     wr.opcode     = IBV_WR_SEND;
     wr.send_flags = IBV_SEND_SIGNALED;
     wr.next       = NULL;
-    printf("[客户端] 连接建立，开始发送消息...\n");
+    if (cfg->latency) {
+        printf("[客户端] 连接建立，Send/Recv 延迟测试 (每个大小 %d 次)...\n", cfg->count);
+        if (run_latency(&client_conn, cfg)) {
+            fprintf(stderr, "[客户端] 延迟测试失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->size_min) {
+        rdma_pipeline_init(&pl, cfg->depth);
+        printf("[客户端] 连接建立，Send 带宽扫描 (深度 %d，每个大小 %d 次)...\n", pl.depth, cfg->count);
+        if (rdma_run_bw_sweep(&client_conn, &wr, cfg->size_min, cfg->size_max, cfg->count, &pl)) {
+            fprintf(stderr, "[客户端] 带宽扫描失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    // 消息由消息头和消息体两段组成：消息头在已注册的缓冲区里，每条消息只改写消息头；
+    // 消息体是应用自己 malloc 的普通内存，每次发送经 MR 缓存取得 lkey，只有第一次需要 ibv_reg_mr。
+    // 两段由 HCA 按 SGE 聚合发送，不必拷贝到一起
+    rdma_mr_cache_init(&cache, client_conn.pd, cfg->mr_budget, IBV_ACCESS_LOCAL_WRITE);
+    body = malloc(body_len);
+    if (!body) {
+        fprintf(stderr, "分配消息体失败\n");
+        goto cleanup;
+    }
+    snprintf(body, body_len, "%s", MSG_STR);
+    memset(segs, 0, sizeof(segs));
+    segs[0].addr   = (uintptr_t)client_conn.buf;
+    segs[0].lkey   = client_conn.mr->lkey;
+    segs[1].addr   = (uintptr_t)body;
+    segs[1].length = body_len;
+    printf("[客户端] 连接建立，开始发送消息 (每个 WR 最多 %u 个 SGE，内联阈值 %u 字节)...\n",
+           client_conn.send_sge, client_conn.inline_max);
 
     // 消息循环
     for (int i = 0; i < cfg->count; ++i) {
-        if (ibv_post_send(client_conn.qp, &wr, &bad_wr)) {
-            fprintf(stderr, "ibv_post_send 失败\n");
+        segs[0].length = snprintf(client_conn.buf, HDR_SIZE, "[%d] ", i + 1);
+        t0  = rdma_now_ns();
+        ent = rdma_mr_cache_get(&cache, body, body_len);
+        if (!ent) {
             goto cleanup;
         }
-        // 等待完成
-        while (1) {
-            int n = ibv_poll_cq(client_conn.cq, 1, &wc);
-            if (n < 0) {
-                fprintf(stderr, "ibv_poll_cq 失败\n");
+        if (i == 0) {
+            miss_ns = rdma_now_ns() - t0;
+        } else {
+            hit_ns += rdma_now_ns() - t0;
+        }
+        segs[1].lkey = ent->mr->lkey;
+        nwr = rdma_post_send_sg(&client_conn, segs, 2, i, 1);
+        if (nwr < 0) {
+            rdma_mr_cache_put(&cache, ent);
+            goto cleanup;
+        }
+        // 等待完成：只有最后一个 WR 请求了完成通知，完成后 HCA 不再读消息体，才能归还
+        if (rdma_wait_completion(&client_conn, IBV_WC_SEND, &wc)) {
+            fprintf(stderr, "[客户端] 发送失败\n");
+            rdma_mr_cache_put(&cache, ent);
+            goto cleanup;
+        }
+        rdma_mr_cache_put(&cache, ent);
+        printf("[客户端] 已发送第 %d 条消息 (%d 个 WR)\n", i+1, nwr);
+    }
+    printf("[客户端] 消息发送完毕，首次注册 %.2f us", miss_ns / 1000.0);
+    if (cfg->count > 1) {
+        printf("，缓存命中平均 %.3f us", hit_ns / 1000.0 / (cfg->count - 1));
+    }
+    printf("\n");
+    rdma_mr_cache_report(&cache);
+    printf("[客户端] 退出。\n");
+cleanup:
+    // 先让缓存注销消息体所在区域再释放内存
+    if (cache.pd) {
+        rdma_mr_cache_free(&cache, body, body_len);
+        rdma_mr_cache_destroy(&cache);
+    }
+    rdma_connection_cleanup(&client_conn);
+    return 0;
+}
+
+// =================== 多客户端服务端 ===================
+// 接收缓冲区是 SRQ 的槽（所有连接共用）或每个连接自己的接收环，接收完成的 wr_id 都是槽号。
+// 回显直接从槽发送，发送 WR 的 wr_id 也是槽号，发送完成后才归还该槽
+
+// 每个客户端连接的接收状态
+struct send_client_ctx {
+    struct rdma_recv_ring   ring;       // 不使用 SRQ 时的接收环
+    struct rdma_sg_reasm    reasm;      // 逐条发送的消息可能分成多个分片
+    struct ibv_sge          echo_sge;
+    struct ibv_send_wr      echo_wr;
+    uint64_t                msgs;
+    uint64_t                bytes;
+};
+
+static uint64_t g_total_msgs;   // 所有连接累计接收消息数（原子访问）
+static uint64_t g_total_bytes;  // 所有连接累计接收字节数（原子访问）
+static struct rdma_rpc_server g_rpc;    // RPC 方法表，服务端启动前注册好，之后只读
+
+// 槽号对应的接收缓冲区
+static char *multi_slot(struct rdma_server_client *cli, uint64_t slot) {
+    struct rdma_srq        *srq = cli->worker->server->srq;
+    struct send_client_ctx *ctx = cli->ctx;
+
+    return srq ? rdma_srq_slot(srq, slot) : rdma_recv_ring_slot(&ctx->ring, slot);
+}
+
+// 归还处理完的槽
+static int multi_release(struct rdma_server_client *cli, uint64_t slot) {
+    struct rdma_srq        *srq = cli->worker->server->srq;
+    struct send_client_ctx *ctx = cli->ctx;
+
+    return srq ? rdma_srq_release(srq, slot) : rdma_recv_ring_release(&ctx->ring, slot);
+}
+
+// 新连接：准备回显 WR；不使用 SRQ 时创建接收环并全部投递（监听线程）
+static int multi_on_connect(struct rdma_server_client *cli, const struct rdma_cm_event *evt,
+                            struct rdma_conn_param *param, void *arg) {
+    struct send_config     *cfg = arg;
+    struct rdma_srq        *srq = cli->worker->server->srq;
+    struct send_client_ctx *ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return -1;
+    }
+    cli->ctx = ctx;
+    ctx->echo_wr.sg_list    = &ctx->echo_sge;
+    ctx->echo_wr.num_sge    = 1;
+    ctx->echo_wr.opcode     = IBV_WR_SEND;
+    ctx->echo_wr.send_flags = IBV_SEND_SIGNALED;
+    if (srq) {
+        ctx->echo_sge.lkey = srq->mr->lkey;
+        return 0;
+    }
+
+    if (rdma_recv_ring_init(&ctx->ring, cli->conn.pd, cli->conn.qp,
+                            rdma_recv_ring_slots(cli->conn.opts.max_recv_wr, buf_size(cfg)), buf_size(cfg), 0)) {
+        fprintf(stderr, "接收环创建失败\n");
+        rdma_recv_ring_destroy(&ctx->ring);
+        free(ctx);
+        cli->ctx = NULL;
+        return -1;
+    }
+    ctx->echo_sge.lkey = ctx->ring.mr->lkey;
+    return 0;
+}
+
+// 完成事件：统计、归还接收槽，延迟测试时回显，RPC 时执行请求后把响应从原槽发回（工作线程）
+static int multi_on_completion(struct rdma_server_client *cli, struct ibv_wc *wc, void *arg) {
+    struct send_config     *cfg = arg;
+    struct send_client_ctx *ctx = cli->ctx;
+    struct ibv_send_wr     *bad_send_wr = NULL;
+    char                   *data;
+    uint32_t                len;
+
+    // 回显发送完成，槽可以重新接收
+    if (!(wc->opcode & IBV_WC_RECV)) {
+        return multi_release(cli, wc->wr_id);
+    }
+    data = multi_slot(cli, wc->wr_id);
+    ctx->msgs++;
+    ctx->bytes += wc->byte_len;
+    if (!cfg->size_min) {
+        const char *msg;
+        size_t      len;
+
+        if (rdma_sg_reasm_add(&ctx->reasm, wc, data, &msg, &len) > 0) {
+            printf("[服务端] 连接 %lu 收到消息: %.*s\n", cli->id, (int)len, msg);
+        }
+    }
+    if (!cfg->latency && !cfg->rpc) {
+        return multi_release(cli, wc->wr_id);
+    }
+    len = wc->byte_len;
+    ctx->echo_wr.send_flags = IBV_SEND_SIGNALED;
+    if (cfg->rpc) {
+        len = rdma_rpc_dispatch(&g_rpc, data, wc->byte_len, buf_size(cfg));
+        ctx->echo_wr.send_flags |= rdma_inline_flag(&cli->conn, len);
+    } else if (len > 0 && data[0] != NO_INLINE_MARK) {
+        ctx->echo_wr.send_flags |= rdma_inline_flag(&cli->conn, len);
+    }
+    ctx->echo_sge.addr   = (uintptr_t)data;
+    ctx->echo_sge.length = len;
+    ctx->echo_wr.wr_id   = wc->wr_id;
+    if (ibv_post_send(cli->conn.qp, &ctx->echo_wr, &bad_send_wr)) {
+        fprintf(stderr, "ibv_post_send 失败\n");
+        multi_release(cli, wc->wr_id);
+        return -1;
+    }
+    return 0;
+}
+
+// 失败或连接关闭时的完成事件：归还占用的 SRQ 槽（工作线程）。
+// 接收环随连接一起释放，不再补投，否则投到出错 QP 上的 WR 又会被冲刷回来
+static void multi_on_flush(struct rdma_server_client *cli, struct ibv_wc *wc, void *arg) {
+    struct rdma_srq *srq = cli->worker->server->srq;
+
+    if (srq) {
+        rdma_srq_release(srq, wc->wr_id);
+    }
+}
+
+// 连接断开：打印该连接的统计（工作线程）
+static void multi_on_disconnect(struct rdma_server_client *cli, void *arg) {
+    struct send_client_ctx *ctx = cli->ctx;
+
+    if (!ctx) {
+        return;
+    }
+    printf("[服务端] 连接 %lu 断开，共接收 %lu 条消息，%lu 字节\n", cli->id, ctx->msgs, ctx->bytes);
+    __atomic_add_fetch(&g_total_msgs, ctx->msgs, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_total_bytes, ctx->bytes, __ATOMIC_RELAXED);
+    rdma_recv_ring_destroy(&ctx->ring);
+    rdma_sg_reasm_free(&ctx->reasm);
+    free(ctx);
+    cli->ctx = NULL;
+}
+
+// 多客户端服务端主流程
+int run_multi_server(struct send_config *cfg) {
+    struct rdma_server      srv;
+    struct rdma_conn_opts   opts;
+    struct rdma_server_ops  ops = {
+        .on_connect    = multi_on_connect,
+        .on_completion = multi_on_completion,
+        .on_flush      = multi_on_flush,
+        .on_disconnect = multi_on_disconnect,
+    };
+
+    rdma_rpc_server_init(&g_rpc);
+    rdma_rpc_register_bench(&g_rpc);
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    if (cfg->size_min) {
+        opts.max_recv_wr = BENCH_RECV_DEPTH;
+    }
+    // RPC 的每个请求都有一个响应，发送队列要容纳客户端的全部未完成调用
+    if (cfg->rpc) {
+        opts.max_send_wr = BENCH_RECV_DEPTH;
+    }
+    if (rdma_server_init(&srv, cfg->ip, cfg->port, &opts, cfg->workers, &ops, cfg)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        rdma_server_cleanup(&srv);
+        return -1;
+    }
+    if (cfg->srq_slots > 0 && rdma_server_enable_srq(&srv, cfg->srq_slots, buf_size(cfg))) {
+        rdma_server_cleanup(&srv);
+        return -1;
+    }
+    rdma_server_stop_on_sigint(&srv);
+    printf("[服务端] 多客户端模式，%d 个工作线程，监听 %s:%d，Ctrl-C 退出...\n",
+           srv.nworkers, cfg->ip, cfg->port);
+    if (srv.srq) {
+        printf("[服务端] 所有连接共用 SRQ，%d 个 %zu 字节接收槽\n", srv.srq->nslots, srv.srq->slot_size);
+    }
+    rdma_server_run(&srv);
+    rdma_server_stop_on_sigint(NULL);
+    if (srv.srq) {
+        printf("[服务端] SRQ 低水位事件 %lu 次\n", srv.srq->limit_events);
+    }
+    rdma_server_cleanup(&srv);
+    printf("[服务端] 退出，所有连接共接收 %lu 条消息，%lu 字节，常驻内存峰值 %ld KB\n",
+           g_total_msgs, g_total_bytes, rdma_rss_kb(1));
+    if (cfg->rpc) {
+        printf("[服务端] RPC 调用次数: echo %lu，null %lu\n",
+               g_rpc.methods[RPC_METHOD_ECHO].calls, g_rpc.methods[RPC_METHOD_NULL].calls);
+    }
+    return 0;
+}
+
+// 多 QP 客户端：建立 num_qps 个连接，由 threads 个绑核线程驱动，逐个消息大小打印每个 QP 和总体吞吐量
+int run_multi_client(struct send_config *cfg) {
+    struct rdma_multi     m;
+    struct rdma_conn_opts opts;
+    int                   ret = -1;
+
+    memset(&m, 0, sizeof(m));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    // 每个连接的发送队列和完成队列都要容纳一整条流水线
+    opts.max_send_wr  = cfg->depth;
+    opts.cq_depth     = cfg->depth + 1;
+    printf("[客户端] 启动，向 %s:%d 建立 %d 个连接...\n", cfg->ip, cfg->port, cfg->num_qps);
+    if (rdma_multi_connect(&m, cfg->num_qps, cfg->threads, cfg->ip, cfg->port, &opts, buf_size(cfg),
+                           IBV_ACCESS_LOCAL_WRITE, 0)) {
+        goto cleanup;
+    }
+    for (int i = 0; i < m.nqps; ++i) {
+        m.qps[i].wr.opcode              = IBV_WR_SEND;
+    }
+    m.iters = cfg->count;
+    rdma_pipeline_init(&m.pl, cfg->depth);
+    printf("[客户端] 连接建立，Send 多 QP 带宽测试 (深度 %d)...\n", m.pl.depth);
+    ret = rdma_multi_sweep(&m, cfg->size_min, cfg->size_max);
+    printf("[客户端] %d 个 QP，常驻内存峰值 %ld KB\n", m.nqps, rdma_rss_kb(1));
+cleanup:
+    rdma_multi_cleanup(&m);
+    return ret;
+}
+
+// =================== RPC 客户端 ===================
+// RPC 客户端：请求和响应都经 Send，连接后由 rdma_rpc_bench 扫描参数大小
+int run_rpc_client(struct send_config *cfg) {
+    struct rdma_connection  client_conn;
+    struct rdma_conn_opts   opts;
+    struct rdma_rpc_client  rc;
+    int                     depth = cfg->depth, ret = -1;
+
+    memset(&client_conn, 0, sizeof(client_conn));
+    memset(&rc, 0, sizeof(rc));
+    printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    // 响应接收环 2 * depth 个槽；请求的发送完成可能晚于响应到达，发送队列也按两倍深度预留
+    opts.max_send_wr  = 2 * depth;
+    opts.max_recv_wr  = 2 * depth;
+    opts.cq_depth     = 3 * depth + 1;
+    if (rdma_client_connect(&client_conn, cfg->ip, cfg->port, &opts, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE, NULL)) {
+        goto cleanup;
+    }
+    if (rdma_rpc_client_init(&rc, &client_conn, depth, buf_size(cfg))) {
+        goto cleanup;
+    }
+
+    printf("[客户端] 连接建立，RPC %s (深度 %d，每个大小 %d 次调用)...\n",
+           cfg->rpc == RPC_METHOD_ECHO ? "echo" : "null", depth, cfg->count);
+    if (rdma_rpc_bench(&rc, cfg->rpc, cfg->size_min, cfg->size_max, cfg->count)) {
+        goto cleanup;
+    }
+    ret = 0;
+    rdma_disconnect(client_conn.cm_id);
+cleanup:
+    // 接收环和请求缓冲区的 MR 要在 QP 销毁之后、PD 释放之前注销
+    if (client_conn.qp) {
+        rdma_destroy_qp(client_conn.cm_id);
+        client_conn.qp = NULL;
+    }
+    rdma_rpc_client_destroy(&rc);
+    rdma_connection_cleanup(&client_conn);
+    return ret;
+}
+
+// =================== UD 传输 ===================
+static volatile sig_atomic_t g_ud_stop;
+
+static void ud_on_sigint(int sig) {
+    g_ud_stop = 1;
+}
+
+// UD 服务端的接收统计，速率按第一条到最后一条消息的时间计算
+struct ud_server_stats {
+    uint64_t        msgs;
+    uint64_t        bytes;
+    uint64_t        first_ns;
+    uint64_t        last_ns;
+};
+
+static void ud_on_data(void *arg, struct rdma_ud_peer *peer, const void *data, uint32_t len) {
+    struct ud_server_stats *st = arg;
+
+    st->last_ns = rdma_now_ns();
+    if (st->msgs++ == 0) {
+        st->first_ns = st->last_ns;
+    }
+    st->bytes += len;
+}
+
+// UD 服务端：一个 UD QP 和一组共享接收槽服务所有对端，单线程轮询，空闲时检查新对端并补发确认，
+// Ctrl-C 退出后打印各对端的收发统计、消息速率和内存
+int run_ud_server(struct send_config *cfg) {
+    struct rdma_ud          ud;
+    struct rdma_conn_opts   opts;
+    struct ud_server_stats  st;
+    uint64_t                lost = 0, late = 0, loops = 0;
+    int                     nah = 0, ret = -1;
+
+    memset(&st, 0, sizeof(st));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    if (rdma_ud_server_init(&ud, cfg->ip, cfg->port, &opts, UD_DEFAULT_MAX_PEERS, 0)) {
+        goto cleanup;
+    }
+    signal(SIGINT, ud_on_sigint);
+    printf("[服务端] UD 模式，监听 %s:%d，MTU %u 字节，%d 个共享接收槽，Ctrl-C 退出...\n",
+           cfg->ip, cfg->port, ud.mtu, ud.ring.nslots);
+    while (!g_ud_stop) {
+        int n = rdma_ud_poll(&ud, 0, ud_on_data, &st);
+
+        if (n == 0 || (++loops & UD_ACCEPT_MASK) == 0) {
+            int accepted = rdma_ud_accept(&ud);
+
+            if (accepted < 0) {
                 goto cleanup;
             }
+            if (accepted > 0) {
+                printf("[服务端] 新增 %d 个对端，共 %d 个\n", accepted, ud.npeers);
+            }
+        }
+        // 空闲时补发确认，再阻塞等待一会儿
+        if (n == 0) {
+            n = rdma_ud_flush_acks(&ud) < 0 ? -1 : rdma_ud_poll(&ud, UD_IDLE_WAIT_MS, ud_on_data, &st);
+        }
+        if (n < 0) {
+            goto cleanup;
+        }
+    }
+    for (int i = 0; i < ud.npeers; ++i) {
+        lost += ud.peers[i].lost;
+        late += ud.peers[i].late;
+        nah  += ud.peers[i].ah != NULL;
+    }
+    printf("[服务端] 退出，%d 个对端共接收 %lu 条消息，%lu 字节，丢失 %lu 条，迟到 %lu 条，无效 %lu 条，回确认 %lu 次\n",
+           ud.npeers, st.msgs, st.bytes, lost, late, ud.dropped, ud.acks_sent);
+    if (st.msgs) {
+        rdma_report_throughput("[服务端]", st.msgs, st.bytes / st.msgs, st.last_ns - st.first_ns);
+    }
+    printf("[服务端] 内存: 1 个 QP，%d 个 AH，接收槽、发送槽和对端表 %zu KB，常驻内存峰值 %ld KB\n",
+           nah, rdma_ud_mem_bytes(&ud) >> 10, rdma_rss_kb(1));
+    ret = 0;
+cleanup:
+    signal(SIGINT, SIG_DFL);
+    rdma_ud_destroy(&ud);
+    return ret;
+}
 
-            if (n == 0) {
-                usleep(100);
-                continue;
+// UD 客户端：经一个 UD QP 向服务端建立 num_qps 个对端，每个对端的窗口为 depth / num_qps（至少 1）。
+// 按 2 的幂扫描消息大小，每个大小轮流向各对端共发送 count 条消息，等全部确认或超时后打印消息速率
+int run_ud_client(struct send_config *cfg) {
+    struct rdma_ud        ud;
+    struct rdma_conn_opts opts;
+    char                 *payload = NULL;
+    uint32_t              window = cfg->depth / cfg->num_qps > 0 ? cfg->depth / cfg->num_qps : 1;
+    uint64_t              expired = 0;
+    int                   nah = 0, next = 0, ret = -1;
+
+    memset(&ud, 0, sizeof(ud));
+    payload = malloc(cfg->size_max);
+    if (!payload) {
+        fprintf(stderr, "分配测试缓冲区失败\n");
+        goto cleanup;
+    }
+    memset(payload, 'u', cfg->size_max);
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    printf("[客户端] 启动，经 UD 向 %s:%d 建立 %d 个对端...\n", cfg->ip, cfg->port, cfg->num_qps);
+    if (rdma_ud_client_init(&ud, cfg->ip, cfg->port, &opts, cfg->num_qps, window)) {
+        goto cleanup;
+    }
+    if (cfg->size_max > rdma_ud_payload_max(&ud)) {
+        fprintf(stderr, "UD 消息不能超过 %u 字节 (MTU %u 减去消息头)\n", rdma_ud_payload_max(&ud), ud.mtu);
+        goto cleanup;
+    }
+    printf("[客户端] %d 个对端建立，MTU %u 字节，每个对端窗口 %u 条消息，每个大小 %d 条消息...\n",
+           ud.npeers, ud.mtu, window, cfg->count);
+    for (size_t size = cfg->size_min; size; size = rdma_next_size(size, cfg->size_max)) {
+        uint64_t sent = 0, lost = 0, ns = rdma_now_ns();
+
+        while (sent < (uint64_t)cfg->count) {
+            int progress = 0, n;
+
+            // 每轮向窗口未满的对端各发一条
+            for (int i = 0; i < ud.npeers && sent < (uint64_t)cfg->count; ++i) {
+                int r = rdma_ud_send(&ud, next, payload, size);
+
+                if (r < 0) {
+                    goto cleanup;
+                }
+                if (r == 0) {
+                    sent++;
+                    progress = 1;
+                }
+                next = (next + 1) % ud.npeers;
+            }
+            n = rdma_ud_poll(&ud, 0, NULL, NULL);
+            if (n < 0) {
+                goto cleanup;
+            }
+            if (!progress && n == 0) {
+                lost += rdma_ud_expire(&ud);
             }
+        }
+        // 等待全部确认或超时，发送槽也全部回收
+        while (rdma_ud_pending(&ud) > 0 || ud.inflight > 0) {
+            int n = rdma_ud_poll(&ud, 1, NULL, NULL);
 
-            if (wc.status != IBV_WC_SUCCESS) {
-                fprintf(stderr, "[客户端] 完成队列错误: %s\n", ibv_wc_status_str(wc.status));
+            if (n < 0) {
                 goto cleanup;
             }
-            if (wc.opcode == IBV_WC_SEND) break;
+            if (n == 0) {
+                lost += rdma_ud_expire(&ud);
+            }
         }
-        printf("[客户端] 已发送第 %d 条消息\n", i+1);
+        ns = rdma_now_ns() - ns;
+        rdma_report_throughput("[客户端]", sent, size, ns);
+        if (lost) {
+            printf("[客户端] %lu 条消息超时未确认，记为丢失\n", lost);
+        }
+        expired += lost;
+    }
+    for (int i = 0; i < ud.npeers; ++i) {
+        nah += ud.peers[i].ah != NULL;
     }
-    printf("[客户端] 消息发送完毕，退出。\n");
+    printf("[客户端] 共发送 %lu 条消息，收到确认 %lu 次，超时记为丢失 %lu 条\n", ud.sent, ud.acks_received, expired);
+    printf("[客户端] 内存: 1 个 QP，%d 个 AH，接收槽、发送槽和对端表 %zu KB，常驻内存峰值 %ld KB\n",
+           nah, rdma_ud_mem_bytes(&ud) >> 10, rdma_rss_kb(1));
+    ret = 0;
 cleanup:
-    rdma_connection_cleanup(&client_conn);
-    return 0;
+    rdma_ud_destroy(&ud);
+    free(payload);
+    return ret;
 }
 
 // 主函数
@@ -467,8 +1112,18 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    if (cfg.role == ROLE_SERVER) {
+    if (cfg.role == ROLE_SERVER && cfg.ud) {
+        return run_ud_server(&cfg);
+    } else if (cfg.role == ROLE_SERVER && (cfg.workers > 0 || cfg.rpc)) {
+        return run_multi_server(&cfg);
+    } else if (cfg.role == ROLE_SERVER) {
         return run_server(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.ud) {
+        return run_ud_client(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.rpc) {
+        return run_rpc_client(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.num_qps > 0) {
+        return run_multi_client(&cfg);
     } else if (cfg.role == ROLE_CLIENT) {
         return run_client(&cfg);
     } else {
@@ -2,7 +2,17 @@
 // rdma_write_demo: 支持 IB、RoCE、iWARP，客户端发送"你好，汉为信息"，服务端收到后打印。
 // 用法：
 // 服务器：./rdma_write_demo -s -a <本机IP> -p <端口> [-n <次数>]
-// 客户端：./rdma_write_demo -c -a <服务器IP> -p <端口> [-n <次数>]
+// 客户端：./rdma_write_demo -c -a <服务器IP> -p <端口> [-n <次数>] [-d <深度> [-k <间隔>]]
+// 带宽扫描：服务端和客户端同时加 -S <最小>:<最大>，如 -S 4K:4M
+// 延迟测试：服务端和客户端同时加 -L（可配合 -S），服务端用 RDMA Write 回写，客户端打印延迟分布
+// 完成轮询：-P busy|event|adaptive[:<微秒>] 选择忙轮询、事件驱动或自适应
+// 多 QP：客户端加 -q <QP数> [-t <线程数>]，服务端加 -m <线程数>，打印每个 QP 和总体吞吐量
+// 大页内存池：多客户端服务端加 -H 2M|1G，所有连接的缓冲区从少数几个大页 MR 中分配
+// 内联与聚合：-I <字节> 指定内联阈值；逐条写入时消息头和消息体两段聚合写入，-g <SGE数> 指定每个 WR 的 SGE 数
+// 立即数通知：两端同时加 -w，客户端用 RDMA Write with Immediate 写入，服务端等待接收完成而不是轮询内存
+// 环形通道：两端同时加 -r <槽数>，客户端把消息依次写入服务端的环，服务端用 RDMA Write 写回信用做流控
+// 混合 RPC：两端同时加 -C echo|null（可配合 -S），客户端把请求 RDMA Write 到服务端为它准备的请求槽，
+//   服务端轮询请求槽、执行后用 Send 发回响应，客户端保持 -d 个调用未完成
 //
 // 依赖：libibverbs, librdmacm
 //
@@ -18,16 +28,29 @@
 #include <infiniband/verbs.h>
 #include <rdma/rdma_cma.h>
 
+#include "rdma_common.h"
+#include "rdma_chan.h"
+#include "rdma_cq.h"
+#include "rdma_perf.h"
+#include "rdma_multi.h"
+#include "rdma_pipeline.h"
+#include "rdma_rpc.h"
+#include "rdma_sg.h"
+#include "rdma_server.h"
 
 #define MSG_STR         "你好，汉为信息"
 #define MSG_SIZE        64
 #define DEFAULT_PORT    18515
 #define DEFAULT_COUNT   10
-
-// 角色定义
-#define ROLE_UNDEF      0
-#define ROLE_SERVER     1
-#define ROLE_CLIENT     2
+#define HDR_SIZE        32      // 消息头区域大小，消息体放在缓冲区的 HDR_SIZE 偏移处
+#define DEFAULT_SGE     2       // 逐条写入时每个 WR 请求的 SGE 数
+#define WIMM_SLOTS      16      // 立即数通知模式下服务端缓冲区的消息槽数
+#define WIMM_RECV_DEPTH 64      // 立即数通知模式下服务端预投递的零长度接收 WR 数
+#define CHAN_SEND_DEPTH 128     // 环形通道模式下客户端的发送队列深度
+#define CHAN_PRINT_MSGS 10      // 环形通道模式下服务端逐条打印的消息数
+#define RPC_WRITE_SLOTS BENCH_RECV_DEPTH    // 混合 RPC 模式下服务端为每个客户端准备的请求槽数
+#define RPC_POLL_BATCH  16      // 混合 RPC 服务端每轮从一个连接最多取出的请求数
+#define RPC_SIGNAL_EVERY (RPC_WRITE_SLOTS / 2)  // 混合 RPC 服务端每隔多少个响应请求一次发送完成
 
 // 参数结构体
 struct write_config {
@@ -35,8 +58,42 @@ struct write_config {
     char        ip[64];         // IP地址
     int         port;           // 端口
     int         count;          // 消息收发次数
+    int         depth;          // 流水线深度（未完成写操作数），0 表示逐条等待完成
+    int         signal_every;   // 流水线模式下每隔多少个写操作请求一次完成通知
+    size_t      size_min;       // 带宽扫描最小消息大小，0 表示不扫描
+    size_t      size_max;       // 带宽扫描最大消息大小
+    int         latency;        // ping-pong 延迟测试模式
+    int         poll_mode;      // 完成队列轮询策略 RDMA_POLL_*
+    int         poll_spin_us;   // 自适应轮询的忙轮询时长（微秒）
+    int         num_qps;        // 客户端连接（QP）数
+    int         threads;        // 客户端驱动 QP 的线程数
+    int         workers;        // 多客户端服务端的工作线程数，0 表示只服务一个客户端
+    size_t      huge_page;      // 多客户端服务端内存池的大页大小，0 表示每个连接各自注册
+    int         inline_threshold; // 内联阈值（字节），-1 表示使用设备授予的上限，0 禁用内联
+    int         sge;            // 逐条写入时每个 WR 的 SGE 数，消息头和消息体段数超过它时拆成多个 WR
+    int         write_imm;      // 用 RDMA Write with Immediate 通知服务端
+    int         chan_slots;     // 环形通道的槽数，0 表示不使用
+    int         rpc;            // 混合 RPC 客户端调用的方法 RPC_METHOD_*，0 表示不使用
 };
 
+// 注册缓冲区大小：带宽扫描时需容纳最大消息，混合 RPC 时还有消息头
+static size_t buf_size(const struct write_config *cfg) {
+    size_t size = cfg->size_max > MSG_SIZE ? cfg->size_max : MSG_SIZE;
+
+    return cfg->rpc ? size + sizeof(struct rdma_rpc_hdr) : size;
+}
+
+// 延迟测试时缓冲区分为发送区和接收区两半，立即数通知模式下为 WIMM_SLOTS 个消息槽，环形通道模式下为环和信用字
+static size_t reg_size(const struct write_config *cfg) {
+    if (cfg->write_imm) {
+        return WIMM_SLOTS * MSG_SIZE;
+    }
+    if (cfg->chan_slots) {
+        return rdma_chan_buf_size(cfg->chan_slots, MSG_SIZE);
+    }
+    return cfg->latency ? 2 * buf_size(cfg) : buf_size(cfg);
+}
+
 // 打印用法
 void print_usage(const char *prog) {
     printf("用法: %s -s|-c -a <IP> -p <端口> [-n <次数>]\n", prog);
@@ -45,6 +102,26 @@ void print_usage(const char *prog) {
     printf("  -a <IP>      指定对端IP地址\n");
     printf("  -p <端口>    指定端口 (默认%d)\n", DEFAULT_PORT);
     printf("  -n <次数>    发送/接收消息次数 (默认%d)\n", DEFAULT_COUNT);
+    printf("  -d <深度>    客户端流水线模式，保持 <深度> 个写操作未完成并统计吞吐量\n");
+    printf("  -k <间隔>    流水线模式下每 <间隔> 个写操作请求一次完成通知 (默认深度/4)\n");
+    printf("  -S <最小>:<最大> 按 2 的幂扫描消息大小并打印带宽表格，两端需一致 (如 4K:4M)\n");
+    printf("  -L           ping-pong 延迟测试，两端需一致，可配合 -S 扫描消息大小\n");
+    printf("  -P <策略>    完成轮询策略: busy (默认)、event、adaptive[:<微秒>] (默认忙轮询%d微秒后阻塞)\n",
+           DEFAULT_POLL_SPIN_US);
+    printf("  -q <QP数>    客户端建立 <QP数> 个连接并行测带宽，服务端需加 -m\n");
+    printf("  -t <线程数>  客户端用 <线程数> 个绑核线程驱动这些 QP (默认 1)\n");
+    printf("  -I <字节>    不超过 <字节> 的消息使用内联发送 (默认为设备授予的上限，请求%d)，0 禁用\n",
+           DEFAULT_MAX_INLINE_DATA);
+    printf("  -g <SGE数>   逐条写入时消息头和消息体作为两段聚合写入，每个 WR 最多 <SGE数> 个 SGE (默认%d)，1 时拆成两个 WR\n",
+           DEFAULT_SGE);
+    printf("  -w           用 RDMA Write with Immediate 写入，立即数为消息序号，服务端等待接收完成，两端需一致\n");
+    printf("  -r <槽数>    环形通道模式：客户端依次写入服务端 <槽数> 个槽的环，服务端写回信用做流控，两端需一致 (如 %d)\n",
+           CHAN_DEFAULT_SLOTS);
+    printf("  -m <线程数>  服务端多客户端模式，连接分配给 <线程数> 个工作线程，Ctrl-C 退出\n");
+    printf("  -H 2M|1G     多客户端服务端从该大小的大页内存池分配各连接的缓冲区，没有预留大页时使用透明大页\n");
+    printf("  -C <方法>    混合 RPC 模式，两端都需指定: 请求经 RDMA Write 写入服务端请求槽，响应经 Send 返回；\n"
+           "               echo 原样返回参数，null 返回空结果，服务端不论取值都注册两个方法、以 -m 个工作线程忙轮询；\n"
+           "               客户端保持 -d 个调用未完成 (不超过%d)，-S 指定参数大小\n", RPC_WRITE_SLOTS);
 }
 
 // 参数解析
@@ -52,17 +129,100 @@ int parse_args(int argc, char **argv, struct write_config *cfg) {
     int opt;
     memset(cfg, 0, sizeof(*cfg));
     cfg->port  = DEFAULT_PORT;
-    cfg->count = DEFAULT_COUNT;
-    while ((opt = getopt(argc, argv, "sca:p:n:")) != -1) {
+    cfg->poll_spin_us = DEFAULT_POLL_SPIN_US;
+    cfg->inline_threshold = -1;
+    cfg->sge = DEFAULT_SGE;
+    while ((opt = getopt(argc, argv, "sca:p:n:d:k:S:LP:q:t:m:I:g:H:wr:C:")) != -1) {
         switch (opt) {
             case 's': cfg->role = ROLE_SERVER; break;
             case 'c': cfg->role = ROLE_CLIENT; break;
             case 'a': strncpy(cfg->ip, optarg, sizeof(cfg->ip)-1); break;
             case 'p': cfg->port = atoi(optarg); break;
             case 'n': cfg->count = atoi(optarg); break;
+            case 'd': cfg->depth = atoi(optarg); break;
+            case 'k': cfg->signal_every = atoi(optarg); break;
+            case 'S':
+                if (rdma_parse_size_range(optarg, &cfg->size_min, &cfg->size_max)) return -1;
+                break;
+            case 'L': cfg->latency = 1; break;
+            case 'q': cfg->num_qps = atoi(optarg); break;
+            case 't': cfg->threads = atoi(optarg); break;
+            case 'I': cfg->inline_threshold = atoi(optarg); break;
+            case 'g': cfg->sge = atoi(optarg); break;
+            case 'w': cfg->write_imm = 1; break;
+            case 'r': cfg->chan_slots = atoi(optarg); break;
+            case 'C':
+                if (strcmp(optarg, "echo") == 0) {
+                    cfg->rpc = RPC_METHOD_ECHO;
+                } else if (strcmp(optarg, "null") == 0) {
+                    cfg->rpc = RPC_METHOD_NULL;
+                } else {
+                    fprintf(stderr, "未知的 RPC 方法: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'm': cfg->workers = atoi(optarg); break;
+            case 'H':
+                cfg->huge_page = rdma_parse_size(optarg);
+                if (cfg->huge_page != MEM_POOL_HUGE_2M && cfg->huge_page != MEM_POOL_HUGE_1G) {
+                    fprintf(stderr, "-H 只支持 2M 或 1G\n");
+                    return -1;
+                }
+                break;
+            case 'P':
+                if (rdma_parse_poll_mode(optarg, &cfg->poll_mode, &cfg->poll_spin_us)) return -1;
+                break;
             default: print_usage(argv[0]); return -1;
         }
     }
+    if (cfg->write_imm && (cfg->size_min || cfg->latency || cfg->num_qps > 0 || cfg->threads > 0 || cfg->workers > 0)) {
+        fprintf(stderr, "-w 只用于逐条和流水线写入，不能与 -S/-L/-q/-t/-m 同时使用\n");
+        return -1;
+    }
+    if (cfg->chan_slots < 0 || (cfg->chan_slots && (cfg->write_imm || cfg->depth > 0))) {
+        fprintf(stderr, "-r 需要正的槽数，且不能与 -w/-d 同时使用\n");
+        return -1;
+    }
+    if (cfg->chan_slots && (cfg->size_min || cfg->latency || cfg->num_qps > 0 || cfg->threads > 0 || cfg->workers > 0)) {
+        fprintf(stderr, "-r 不能与 -S/-L/-q/-t/-m 同时使用\n");
+        return -1;
+    }
+    if (cfg->rpc) {
+        if (cfg->write_imm || cfg->chan_slots || cfg->latency || cfg->num_qps > 0 || cfg->threads > 0) {
+            fprintf(stderr, "-C 不能与 -w/-r/-L/-q/-t 同时使用\n");
+            return -1;
+        }
+        // 服务端为每个客户端准备 RPC_WRITE_SLOTS 个请求槽
+        if (cfg->depth > RPC_WRITE_SLOTS) {
+            fprintf(stderr, "混合 RPC 模式下 -d 不能超过 %d\n", RPC_WRITE_SLOTS);
+            return -1;
+        }
+        if (!cfg->size_min) {
+            cfg->size_min = cfg->size_max = MSG_SIZE;
+        }
+    }
+    if (cfg->latency && !cfg->size_min) {
+        cfg->size_min = cfg->size_max = MSG_SIZE;
+    }
+    // 多 QP 属于带宽测试，未指定 -S 时使用默认消息大小
+    if (cfg->threads > 0 && cfg->num_qps <= 0) {
+        cfg->num_qps = cfg->threads;
+    }
+    if (cfg->num_qps > 0) {
+        if (cfg->latency) {
+            fprintf(stderr, "-q/-t 不能与 -L 同时使用\n");
+            return -1;
+        }
+        if (!cfg->size_min) {
+            cfg->size_min = cfg->size_max = MSG_SIZE;
+        }
+    }
+    if (cfg->count <= 0) {
+        cfg->count = cfg->size_min ? BENCH_DEFAULT_ITERS : DEFAULT_COUNT;
+    }
+    if (cfg->size_min && cfg->depth <= 0) {
+        cfg->depth = BENCH_DEFAULT_DEPTH;
+    }
     if (cfg->role == ROLE_UNDEF || cfg->ip[0] == '\0') {
         print_usage(argv[0]);
         return -1;
@@ -71,192 +231,229 @@ int parse_args(int argc, char **argv, struct write_config *cfg) {
 }
 
 // =================== rdma_cm 方式实现 ===================
-// 资源结构体
-struct rdma_connection {
-    struct rdma_event_channel *ec;      // 事件通道
-    struct rdma_cm_id         *cm_id;   // cm id
-    struct ibv_pd             *pd;      // 保护域
-    struct ibv_comp_channel   *comp_ch; // 完成通道
-    struct ibv_cq             *cq;      // 完成队列
-    struct ibv_qp             *qp;      // 传输队列对
-    struct ibv_mr             *mr;      // 内存注册
-    char                      *buf;     // 消息缓冲区
-};
-
-// 用于交换 rkey/vaddr 的结构体
-struct write_mr_info {
-    uint32_t rkey;
-    uint64_t vaddr;
-};
-
-// 初始化会话资源
-int rdma_connection_init(struct rdma_connection *conn, struct write_config *cfg) {
-    struct sockaddr_in addr;
-    int                ret = 0;
-
-    memset(conn, 0, sizeof(*conn));
-    conn->ec = rdma_create_event_channel();
-    if (!conn->ec) {
-        fprintf(stderr, "rdma_create_event_channel 失败\n");
-        return -1;
-    }
+// ping-pong 延迟测试：双方缓冲区前半为发送区、后半为接收区，每轮把序号放在消息最后一个字节，
+// 轮询本端接收区的该字节即可知道对端的写入已全部到达（RDMA Write 按顺序写入）。
+// 客户端先写后等并记录 RTT/2，服务端先等后把接收区内容写回。
+// no_inline 非 0 时两端都禁用内联
+static int latency_one_size(struct rdma_connection *conn, struct write_config *cfg, const struct rdma_mr_info *remote,
+                            size_t size, int no_inline, struct rdma_histogram *hist) {
+    struct ibv_sge        sge;
+    struct ibv_send_wr    wr, *bad_wr = NULL;
+    size_t                half = buf_size(cfg);
+    char                 *send_buf = conn->buf;
+    volatile char        *recv_buf = conn->buf + half;
+    int                   is_client = cfg->role == ROLE_CLIENT;
 
-  /*RDMA_PS_TCP：用于基于 TCP 的 RDMA 通信（如 RoCE、iWARP）。
-    RDMA_PS_IPOIB：用于 IP over InfiniBand。
-    RDMA_PS_UDP：用于基于 UDP 的 RDMA 通信。
-    RDMA_PS_IB：用于原生 InfiniBand 通信。
-    */
-    ret = rdma_create_id(conn->ec, &conn->cm_id, NULL, RDMA_PS_TCP);
-    if (ret) {
-        fprintf(stderr, "rdma_create_id 失败 %d\n", ret);
-        return -1;
-    }
+    memset(&sge, 0, sizeof(sge));
+    sge.addr   = (uintptr_t)(is_client ? send_buf : (char *)recv_buf);
+    sge.length = size;
+    sge.lkey   = conn->mr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.sg_list    = &sge;
+    wr.num_sge    = 1;
+    wr.opcode     = IBV_WR_RDMA_WRITE;
+    wr.send_flags = IBV_SEND_SIGNALED | (no_inline ? 0 : rdma_inline_flag(conn, size));
+    wr.wr.rdma.remote_addr = remote->vaddr + half;
+    wr.wr.rdma.rkey        = remote->rkey;
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(cfg->port);
-    addr.sin_addr.s_addr = inet_addr(cfg->ip);
-    if (cfg->role == ROLE_SERVER) {
-        ret = rdma_bind_addr(conn->cm_id, (struct sockaddr*)&addr);
-        if (ret) {
-            fprintf(stderr, "rdma_bind_addr 失败 %d\n", ret);
-            return -1;
+    rdma_hist_reset(hist);
+    for (int i = 0; i < cfg->count; ++i) {
+        // 每轮的序号与上一轮不同；两遍测量分别用 1-127 和 129-255，禁用内联那遍不会误认上一遍留下的序号
+        char     seq = (char)((i % 127 + 1) | (no_inline ? 0x80 : 0));
+        uint64_t start = 0, spins = 0;
+
+        if (is_client) {
+            send_buf[size - 1] = seq;
+            start = rdma_now_ns();
+            if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+                fprintf(stderr, "ibv_post_send (RDMA_WRITE) 失败\n");
+                return -1;
+            }
         }
-      /*监听
-        rdma_listen监听队列的最大长度为 1，当队列满时，新连接请求会被拒绝。
-        */
-        ret = rdma_listen(conn->cm_id, 1);
-        if (ret) {
-            fprintf(stderr, "rdma_listen 失败 %d\n", ret);
+        while (recv_buf[size - 1] != seq) {
+            // 对端异常退出时不再空等
+            if (++spins % (1 << 20) == 0 && rdma_check_disconnect(conn)) {
+                fprintf(stderr, "对端已断开\n");
+                return -1;
+            }
+        }
+        if (is_client) {
+            rdma_hist_record(hist, (rdma_now_ns() - start) / 2);
+        } else if (ibv_post_send(conn->qp, &wr, &bad_wr)) {
+            fprintf(stderr, "ibv_post_send (RDMA_WRITE) 失败\n");
             return -1;
         }
-    } else {
-        ret = rdma_resolve_addr(conn->cm_id, NULL, (struct sockaddr*)&addr, 2000);
-        if (ret) {
-            fprintf(stderr, "rdma_resolve_addr 失败 %d\n", ret);
+        if (rdma_wait_completion(conn, IBV_WC_RDMA_WRITE, NULL)) {
             return -1;
         }
     }
     return 0;
 }
 
-// 资源释放
-void rdma_connection_cleanup(struct rdma_connection *conn) {
-    if (conn->mr)      ibv_dereg_mr(conn->mr);
-    if (conn->cq)      ibv_destroy_cq(conn->cq);
-    if (conn->comp_ch) ibv_destroy_comp_channel(conn->comp_ch);
-    if (conn->pd)      ibv_dealloc_pd(conn->pd);
-    if (conn->cm_id)   rdma_destroy_id(conn->cm_id);
-    if (conn->ec)      rdma_destroy_event_channel(conn->ec);
-    if (conn->buf)     free(conn->buf);
-}
-
-// 事件等待
-int wait_event(struct rdma_connection *conn, enum rdma_cm_event_type expect, struct rdma_cm_event **evt) {
-    int ret = 0;
+// 延迟测试：先按内联阈值自动内联测一遍，不超过 BENCH_INLINE_CMP_MAX 的消息大小再禁用内联测一遍。
+// 服务端按同样的顺序回写，两端的测量顺序必须一致
+static int run_latency(struct rdma_connection *conn, struct write_config *cfg, const struct rdma_mr_info *remote) {
+    struct rdma_histogram hist;
+    int                   is_client = cfg->role == ROLE_CLIENT;
 
-    ret = rdma_get_cm_event(conn->ec, evt);
-    if (ret) {
-        fprintf(stderr, "rdma_get_cm_event 失败 %d\n", ret);
-        return -1;
+    for (int no_inline = 0; no_inline <= 1; ++no_inline) {
+        if (no_inline && cfg->size_min > BENCH_INLINE_CMP_MAX) {
+            break;
+        }
+        if (is_client) {
+            if (no_inline) {
+                printf("禁用内联时的单向延迟 (RTT/2):\n");
+            } else {
+                printf("单向延迟 (RTT/2)，内联阈值 %u 字节:\n", conn->inline_max);
+            }
+            rdma_print_lat_header();
+        }
+        for (size_t size = cfg->size_min; size; size = rdma_next_size(size, cfg->size_max)) {
+            if (no_inline && size > BENCH_INLINE_CMP_MAX) {
+                break;
+            }
+            if (latency_one_size(conn, cfg, remote, size, no_inline, &hist)) {
+                return -1;
+            }
+            if (is_client) {
+                rdma_print_lat_row(size, &hist);
+            }
+        }
     }
+    return 0;
+}
 
-    if ((*evt)->event != expect) {
-        fprintf(stderr, "期望事件 %d, 实际事件 %d\n", expect, (*evt)->event);
-        rdma_ack_cm_event(*evt);
-        return -1;
+// 立即数通知模式的服务端接收循环：每次 Write with Immediate 在整条消息写完后消耗一个零长度接收 WR，
+// 产生 IBV_WC_RECV_RDMA_WITH_IMM 完成，立即数为消息序号，消息位于第 序号 % WIMM_SLOTS 个槽。
+// 不再轮询内存：内容相同的写入不会漏计，也不会读到写了一半的消息；等待完成期间可按 -P 阻塞。
+// 每批完成处理完后补投同样数量的接收 WR
+static int wimm_recv_loop(struct rdma_connection *conn, int count) {
+    struct ibv_wc   wc[PIPELINE_POLL_BATCH];
+    int             received = 0, n, nrecv;
+
+    while (received < count) {
+        n = rdma_cq_poll(conn, wc, PIPELINE_POLL_BATCH, CQ_CHECK_INTERVAL_MS);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            if (rdma_check_disconnect(conn)) {
+                printf("[服务端] 客户端已断开\n");
+                break;
+            }
+            continue;
+        }
+        nrecv = 0;
+        for (int i = 0; i < n; ++i) {
+            uint32_t seq;
+
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "[服务端] 完成错误: %s\n", ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+            if (wc[i].opcode != IBV_WC_RECV_RDMA_WITH_IMM) {
+                continue;
+            }
+            nrecv++;
+            seq = ntohl(wc[i].imm_data);
+            received++;
+            printf("[服务端] 收到第 %d 条消息 (序号 %u): %s\n", received, seq,
+                   conn->buf + (seq % WIMM_SLOTS) * MSG_SIZE);
+        }
+        if (nrecv && rdma_post_empty_recv(conn, nrecv)) {
+            return -1;
+        }
     }
     return 0;
 }
 
-// 创建QP等资源
-int build_qp(struct rdma_connection *conn) {
-    struct ibv_qp_init_attr qp_attr;
+// 环形通道服务端：轮询环中下一个槽的尾部序号，处理完归还，由通道按批写回信用
+static int chan_recv_loop(struct rdma_connection *conn, struct write_config *cfg, const struct rdma_mr_info *remote) {
+    struct rdma_chan    ch;
+    const char         *msg;
+    uint32_t            len;
+    uint64_t            spins = 0, start = 0;
+    int                 received = 0, ret;
 
-    conn->pd = ibv_alloc_pd(conn->cm_id->verbs);
-    if (!conn->pd) {
-        fprintf(stderr, "ibv_alloc_pd 失败\n");
-        return -1;
-    }
-    //当 CQ 上有完成事件（如发送/接收完成），并且你为 CQ 关联了 comp_channel，内核会通过该 channel 发送事件通知
-    conn->comp_ch = ibv_create_comp_channel(conn->cm_id->verbs);
-    if (!conn->comp_ch) {
-        fprintf(stderr, "ibv_create_comp_channel 失败\n");
+    if (rdma_chan_init(&ch, conn, CHAN_CONSUMER, cfg->chan_slots, MSG_SIZE, remote)) {
         return -1;
     }
-    conn->cq = ibv_create_cq(conn->cm_id->verbs, 10, NULL, conn->comp_ch, 0);
-    if (!conn->cq) {
-        fprintf(stderr, "ibv_create_cq 失败\n");
-        return -1;
+    while (received < cfg->count) {
+        ret = rdma_chan_recv(&ch, &msg, &len);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            if ((++spins & 0xffff) == 0 && rdma_check_disconnect(conn)) {
+                printf("[服务端] 客户端已断开\n");
+                break;
+            }
+            continue;
+        }
+        if (received == 0) {
+            start = rdma_now_ns();
+        }
+        if (received < CHAN_PRINT_MSGS) {
+            printf("[服务端] 收到第 %d 条消息: %.*s\n", received + 1, (int)len, msg);
+        }
+        received++;
+        if (rdma_chan_release(&ch)) {
+            return -1;
+        }
     }
-
-    //创建QP
-    memset(&qp_attr, 0, sizeof(qp_attr));
-    qp_attr.send_cq          = conn->cq;
-    qp_attr.recv_cq          = conn->cq;
-    /*
-    IBV_QPT_RC：支持可靠、面向连接的通信，保证数据可靠到达，支持 RDMA 读写和发送/接收。
-    IBV_QPT_UC：面向连接但不保证可靠性，支持 RDMA 写和发送/接收，不支持 RDMA 读。
-    IBV_QPT_UD：无连接、无可靠性保证，支持一对多通信，常用于广播/多播或管理报文。
-    IBV_QPT_RAW_PACKET：允许直接发送/接收原始以太网帧。
-    IBV_QPT_XRC_SEND：用于 XRC 发送队列。
-    IBV_QPT_XRC_RECV：用于 XRC 接收队列。
-    IBV_QPT_DRIVER：用于驱动程序特定的队列类型。
-    */
-    qp_attr.qp_type          = IBV_QPT_RC;
-    qp_attr.cap.max_send_wr  = 10;
-    qp_attr.cap.max_recv_wr  = 10;
-    qp_attr.cap.max_send_sge = 1;//一次发送操作最多能用多少个sge数
-    qp_attr.cap.max_recv_sge = 1;//一次接收操作最多能用多少个sge数
-    int ret = rdma_create_qp(conn->cm_id, conn->pd, &qp_attr);
-    if (ret) {
-        fprintf(stderr, "rdma_create_qp 失败\n");
-        return -1;
+    printf("[服务端] 共收到 %d 条消息，写回信用 %lu 次\n", received, ch.credit_writes);
+    if (received > 1) {
+        rdma_report_throughput("[服务端]", received, MSG_SIZE, rdma_now_ns() - start);
     }
-    conn->qp = conn->cm_id->qp;
     return 0;
 }
 
-// 注册内存
-int reg_mem(struct rdma_connection *conn) {
-    if (posix_memalign((void**)&conn->buf, 4096, MSG_SIZE) != 0) {
-        fprintf(stderr, "posix_memalign 失败\n");
+// 环形通道客户端：逐条写入服务端的环，环满时等待服务端写回信用
+static int chan_send_loop(struct rdma_connection *conn, struct write_config *cfg, const struct rdma_mr_info *remote) {
+    struct rdma_chan    ch;
+    char                msg[MSG_SIZE];
+    uint64_t            start;
+    int                 len;
+
+    if (rdma_chan_init(&ch, conn, CHAN_PRODUCER, cfg->chan_slots, MSG_SIZE, remote)) {
         return -1;
     }
-    memset(conn->buf, 0, MSG_SIZE);
-    /*
-    IBV_ACCESS_LOCAL_WRITE：允许本地进程写该内存。
-    IBV_ACCESS_REMOTE_WRITE：允许远程节点通过 RDMA Write 操作写本地内存。
-    IBV_ACCESS_REMOTE_READ：允许远程节点通过 RDMA Read 操作读本地内存。
-    IBV_ACCESS_REMOTE_ATOMIC：允许远程节点对本地内存执行原子操作。
-    IBV_ACCESS_MW_BIND：允许该内存区域被绑定到内存窗口。
-    IBV_ACCESS_ZERO_BASED：允许注册零基址内存。
-    IBV_ACCESS_ON_DEMAND：支持按需分页。
-    IBV_ACCESS_HUGETLB：允许注册 HugeTLB（大页）内存。
-    IBV_ACCESS_RELAXED_ORDERING：允许放宽内存访问顺序。
-    */
-    conn->mr = ibv_reg_mr(conn->pd, conn->buf, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ);
-    if (!conn->mr) {
-        fprintf(stderr, "ibv_reg_mr 失败\n");
+    start = rdma_now_ns();
+    for (int i = 0; i < cfg->count; ++i) {
+        len = snprintf(msg, sizeof(msg), "[%d] %s", i + 1, MSG_STR);
+        if (rdma_chan_send(&ch, msg, len + 1)) {
+            return -1;
+        }
+    }
+    if (rdma_chan_drain(&ch)) {
         return -1;
     }
+    rdma_report_throughput("[客户端]", cfg->count, MSG_SIZE, rdma_now_ns() - start);
+    printf("[客户端] 环满等待信用 %lu 次\n", ch.stalls);
     return 0;
 }
 
 // 服务端主流程
 int run_server(struct write_config *cfg) {
     struct rdma_connection   server_conn;
+    struct rdma_conn_opts         opts;
     struct rdma_cm_event         *evt = NULL;
     struct rdma_cm_id            *child = NULL;
     struct rdma_conn_param        conn_param;
     int                           received_msg_count = 0;
-    int                           listen_sock = -1, conn_sock = -1;
-    struct write_mr_info          local_info, remote_info;
-    int                           sock_opt = 1;
-    struct sockaddr_in            sin;
+    struct rdma_mr_info           local_info, remote_info;
 
     printf("[服务端] 启动，监听 %s:%d，等待连接...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&server_conn, cfg)){
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    if (cfg->write_imm) {
+        // 接收完成进同一个 CQ，CQ 要容纳全部预投递的接收 WR
+        opts.max_recv_wr = WIMM_RECV_DEPTH;
+        opts.cq_depth    = WIMM_RECV_DEPTH + opts.max_send_wr;
+    }
+    if (rdma_connection_init(&server_conn, cfg->role, cfg->ip, cfg->port, &opts)){
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     }
@@ -283,6 +480,12 @@ int run_server(struct write_config *cfg) {
         goto cleanup;
     }
     child = evt->id;
+    rdma_apply_peer_param(&server_conn, evt);
+    // 客户端的 rkey/vaddr 随连接请求的 private_data 一起到达，必须在 ack 之前取出
+    if (rdma_unpack_mr_info(evt, &remote_info)) {
+        rdma_ack_cm_event(evt);
+        goto cleanup;
+    }
     //获取到事件后，必须调用 rdma_ack_cm_event() 来“归还”事件，通知内核你已经处理完毕，可以释放相关资源。
     rdma_ack_cm_event(evt);
 
@@ -293,15 +496,25 @@ int run_server(struct write_config *cfg) {
         goto cleanup;
     }
 
-    if (reg_mem(&server_conn)) {
+    if (reg_mem(&server_conn, reg_size(cfg), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ)) {
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
 
+    /*vaddr 是指远程主机上注册内存区域（Memory Region, MR）的虚拟地址
+     *rkey 是远程主机上注册内存区域的“远程访问密钥”，是 RDMA 设备分配的一个 32 位整数。
+     *本地 rkey/vaddr 放在 rdma_accept 的 private_data 中发给客户端，不再需要额外的 TCP 连接。
+     */
+    rdma_pack_mr_info(&local_info, server_conn.buf, server_conn.buf_size, server_conn.mr);
+    // Write with Immediate 需要对端已投递接收 WR，否则客户端会收到 RNR 并重试
+    if (cfg->write_imm && rdma_post_empty_recv(&server_conn, WIMM_RECV_DEPTH)) {
+        goto cleanup;
+    }
+
     // 接受连接
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
+    rdma_fill_conn_param(&server_conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
     if (rdma_accept(server_conn.cm_id, &conn_param)) {
         fprintf(stderr, "rdma_accept 失败\n");
         goto cleanup;
@@ -313,116 +526,103 @@ int run_server(struct write_config *cfg) {
     }
     rdma_ack_cm_event(evt);
 
-    // 连接建立前，建立 socket 用于 rkey/vaddr 交换
-    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_sock < 0) {
-        fprintf(stderr, "socket 创建失败\n");
-        goto cleanup;
-    }
 
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &sock_opt, sizeof(sock_opt));
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(cfg->port + 1); // 用于参数交换的端口
-    if (bind(listen_sock, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
-        fprintf(stderr, "bind 失败\n");
+    if (cfg->latency) {
+        printf("[服务端] 连接建立，延迟测试中...\n");
+        run_latency(&server_conn, cfg, &remote_info);
         goto cleanup;
     }
-    listen(listen_sock, 1);
-
-    // 等待客户端 socket 连接
-    conn_sock = accept(listen_sock, NULL, NULL);
-    if (conn_sock < 0) {
-        fprintf(stderr, "accept 失败\n");
-        goto cleanup;
-    }
-
-    /*vaddr 是指远程主机上注册内存区域（Memory Region, MR）的虚拟地址
-     *rkey 是远程主机上注册内存区域的“远程访问密钥”，是 RDMA 设备分配的一个 32 位整数。
-     */
-    local_info.rkey = server_conn.mr->rkey;
-    local_info.vaddr = (uintptr_t)server_conn.buf;
-    // 发送本地 rkey/vaddr，接收对方 rkey/vaddr
-    if (write(conn_sock, &local_info, sizeof(local_info)) != sizeof(local_info)) {
-        fprintf(stderr, "write local_info 失败\n");
+    if (cfg->chan_slots) {
+        printf("[服务端] 连接建立，环形通道 %d 个槽，等待客户端写入...\n", cfg->chan_slots);
+        chan_recv_loop(&server_conn, cfg, &remote_info);
+        printf("[服务端] 消息接收完毕，退出。\n");
         goto cleanup;
     }
-    if (read(conn_sock, &remote_info, sizeof(remote_info)) != sizeof(remote_info)) {
-        fprintf(stderr, "read remote_info 失败\n");
+    if (cfg->write_imm) {
+        printf("[服务端] 连接建立，等待客户端 Write with Immediate 通知...\n");
+        wimm_recv_loop(&server_conn, cfg->count);
+        printf("[服务端] 消息接收完毕，退出。\n");
         goto cleanup;
     }
-    close(conn_sock); 
-    close(listen_sock);
-
     printf("[服务端] 连接建立，等待客户端写入...\n");
-    // 轮询本地内存，检测数据变化
+    // 轮询本地内存，检测数据变化；流水线模式下内容可能被连续覆盖，客户端断开时也退出
     char last_buf[MSG_SIZE] = {0};
     while (received_msg_count < cfg->count) {
         if (memcmp(last_buf, server_conn.buf, MSG_SIZE) != 0) {
             printf("[服务端] 收到第 %d 条消息: %s\n", received_msg_count+1, server_conn.buf);
             memcpy(last_buf, server_conn.buf, MSG_SIZE);
             received_msg_count++;
-        } 
+        } else if (rdma_check_disconnect(&server_conn)) {
+            printf("[服务端] 客户端已断开，最后内容: %s\n", server_conn.buf);
+            break;
+        }
     }
     printf("[服务端] 消息接收完毕，退出。\n");
 cleanup:
-    if (conn_sock >= 0) close(conn_sock);
-    if (listen_sock >= 0) close(listen_sock);
     rdma_connection_cleanup(&server_conn);
     return 0;
 }
 
+// 立即数通知的流水线写入：第 idx 条写到服务端第 idx % WIMM_SLOTS 个槽，立即数为序号 idx，
+// arg 为服务端缓冲区的地址
+static void wimm_write_prep(struct ibv_send_wr *wr, uint64_t idx, void *arg) {
+    uint64_t remote = *(const uint64_t *)arg;
+
+    wr->imm_data            = htonl((uint32_t)idx);
+    wr->wr.rdma.remote_addr = remote + (idx % WIMM_SLOTS) * MSG_SIZE;
+}
+
 // 客户端主流程
 int run_client(struct write_config *cfg) {
     struct rdma_connection client_conn;
+    struct rdma_conn_opts       opts;
+    struct rdma_pipeline        pl;
     struct rdma_cm_event       *evt = NULL;
     struct rdma_conn_param      conn_param;
-    struct write_mr_info        local_info, remote_info;
-    struct ibv_sge              sge;
-    struct ibv_send_wr          wr, *bad_wr = NULL;
-    int                         sockfd = -1;
-    struct sockaddr_in          sin;
+    struct rdma_mr_info         local_info, remote_info;
+    struct ibv_sge              sge, segs[2];
+    struct ibv_send_wr          wr;
     struct ibv_wc               wc;
+    int                         nwr;
 
     printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
-    if (rdma_connection_init(&client_conn, cfg)){
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    opts.max_send_sge = cfg->sge > 0 ? cfg->sge : 1;
+    if (cfg->chan_slots) {
+        opts.max_send_wr = CHAN_SEND_DEPTH;
+        opts.cq_depth    = CHAN_SEND_DEPTH + 1;
+    }
+    if (cfg->depth > 0) {
+        // 发送队列和完成队列都要容纳一整条流水线
+        opts.max_send_wr = cfg->depth;
+        opts.cq_depth    = cfg->depth + 1;
+    }
+    if (rdma_connection_init(&client_conn, cfg->role, cfg->ip, cfg->port, &opts)){
         fprintf(stderr, "初始化会话资源失败\n");
         return -1;
     }
-
-    // 地址解析完成
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ADDR_RESOLVED, &evt)){
-        fprintf(stderr, "地址解析失败\n");
-        goto cleanup;
-    }
-    rdma_ack_cm_event(evt);
-
-    // 路由解析，地址解析成功后调用，成功后才能继续创建 QP 和建立连接。
-    if (rdma_resolve_route(client_conn.cm_id, 2000)) {
-        fprintf(stderr, "路由解析失败\n");
+    // 地址解析、路由解析完成后才能继续创建 QP 和建立连接。
+    if (rdma_client_resolve(&client_conn)) {
         goto cleanup;
     }
 
-    //已找到到目标的路由
-    if (wait_event(&client_conn, RDMA_CM_EVENT_ROUTE_RESOLVED, &evt)){
-        fprintf(stderr, "路由解析事件失败\n");
-        goto cleanup;
-    }
-    rdma_ack_cm_event(evt);
-
     if (build_qp(&client_conn)){
         fprintf(stderr, "传输队列创建失败\n");
         goto cleanup;
     }
-    if (reg_mem(&client_conn)){
+    if (reg_mem(&client_conn, reg_size(cfg), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ)){
         fprintf(stderr, "rdma 内存注册失败\n");
         goto cleanup;
     }
 
-    memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 1;
-    conn_param.responder_resources = 1;
+    // 本地 rkey/vaddr 随连接请求发出，服务端的在连接建立事件中返回
+    rdma_pack_mr_info(&local_info, client_conn.buf, client_conn.buf_size, client_conn.mr);
+    rdma_fill_conn_param(&client_conn, &conn_param);
+    conn_param.private_data     = &local_info;
+    conn_param.private_data_len = sizeof(local_info);
     if (rdma_connect(client_conn.cm_id, &conn_param)){
         fprintf(stderr, "rdma_connect 失败\n");
         goto cleanup;
@@ -432,40 +632,12 @@ int run_client(struct write_config *cfg) {
         fprintf(stderr, "等待连接建立成功事件失败\n");
         goto cleanup;
     }
-    rdma_ack_cm_event(evt);
-
-    // 等待1s服务器建立
-    sleep(1);
-    // 连接建立前，连接 socket 用于 rkey/vaddr 交换
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        fprintf(stderr, "socket 创建失败\n");
+    rdma_apply_peer_param(&client_conn, evt);
+    if (rdma_unpack_mr_info(evt, &remote_info)) {
+        rdma_ack_cm_event(evt);
         goto cleanup;
     }
-
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = inet_addr(cfg->ip);
-    sin.sin_port = htons(cfg->port + 1); // 用于参数交换的端口
-    printf("socket connect 开始\n");
-    if (connect(sockfd, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
-        fprintf(stderr, "connect 失败\n");
-        goto cleanup;
-    }
-
-    // 先接收服务端 rkey/vaddr，再发送本地 rkey/vaddr
-    if (read(sockfd, &remote_info, sizeof(remote_info)) != sizeof(remote_info)) {
-        fprintf(stderr, "read remote_info 失败\n");
-        goto cleanup;
-    }
-    local_info.rkey = client_conn.mr->rkey;
-    local_info.vaddr = (uintptr_t)client_conn.buf;
-    if (write(sockfd, &local_info, sizeof(local_info)) != sizeof(local_info)) {
-        fprintf(stderr, "write local_info 失败\n");
-        goto cleanup;
-    }
-    close(sockfd);
-    sockfd = -1;
+    rdma_ack_cm_event(evt);
 
     // 组装消息结构
     memset(&sge, 0, sizeof(sge));
@@ -479,40 +651,320 @@ int run_client(struct write_config *cfg) {
     wr.send_flags = IBV_SEND_SIGNALED;
     wr.wr.rdma.remote_addr = remote_info.vaddr;
     wr.wr.rdma.rkey        = remote_info.rkey;
-    printf("[客户端] 连接建立，开始写入消息...\n");
+    if (cfg->latency) {
+        printf("[客户端] 连接建立，RDMA Write 延迟测试 (每个大小 %d 次)...\n", cfg->count);
+        if (run_latency(&client_conn, cfg, &remote_info)) {
+            fprintf(stderr, "[客户端] 延迟测试失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->size_min) {
+        rdma_pipeline_init(&pl, cfg->depth);
+        if (cfg->signal_every > 0) {
+            pl.signal_every = cfg->signal_every;
+        }
+        printf("[客户端] 连接建立，RDMA Write 带宽扫描 (深度 %d，每个大小 %d 次)...\n", pl.depth, cfg->count);
+        if (rdma_run_bw_sweep(&client_conn, &wr, cfg->size_min, cfg->size_max, cfg->count, &pl)) {
+            fprintf(stderr, "[客户端] 带宽扫描失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->chan_slots) {
+        printf("[客户端] 连接建立，环形通道写入 %d 条消息 (%d 个槽)...\n", cfg->count, cfg->chan_slots);
+        if (chan_send_loop(&client_conn, cfg, &remote_info)) {
+            fprintf(stderr, "[客户端] 环形通道写入失败\n");
+            goto cleanup;
+        }
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    if (cfg->depth > 0) {
+        uint64_t start, remote = remote_info.vaddr;    // rdma_mr_info 是紧凑结构，不直接取成员地址
+
+        // 流水线模式：所有写操作共用同一段内容，只统计吞吐量。
+        // 立即数通知模式下与逐条写入相同，第 i 条带序号 i、写到第 i % WIMM_SLOTS 个槽
+        snprintf(client_conn.buf, MSG_SIZE, "%s", MSG_STR);
+        rdma_pipeline_init(&pl, cfg->depth);
+        if (cfg->write_imm) {
+            wr.opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+            pl.prep   = wimm_write_prep;
+            pl.arg    = &remote;
+        }
+        if (cfg->signal_every > 0) {
+            pl.signal_every = cfg->signal_every;
+        }
+        printf("[客户端] 连接建立，流水线写入 %d 条消息 (深度 %d，每 %d 条通知一次)...\n",
+               cfg->count, pl.depth, pl.signal_every);
+        start = rdma_now_ns();
+        if (rdma_run_pipeline(&client_conn, &wr, cfg->count, &pl)) {
+            fprintf(stderr, "[客户端] 流水线写入失败\n");
+            goto cleanup;
+        }
+        rdma_report_throughput("[客户端]", cfg->count, MSG_SIZE, rdma_now_ns() - start);
+        rdma_disconnect(client_conn.cm_id);
+        goto cleanup;
+    }
+    // 消息由消息头和消息体两段组成：消息体只写一次，每条消息只改写消息头，
+    // 两段由 HCA 按 SGE 聚合后写到服务端缓冲区的连续区域，不必先拷贝到一起
+    snprintf(client_conn.buf + HDR_SIZE, MSG_SIZE - HDR_SIZE, "%s", MSG_STR);
+    memset(segs, 0, sizeof(segs));
+    segs[0].addr   = (uintptr_t)client_conn.buf;
+    segs[0].lkey   = client_conn.mr->lkey;
+    segs[1].addr   = (uintptr_t)(client_conn.buf + HDR_SIZE);
+    segs[1].length = strlen(MSG_STR) + 1;
+    segs[1].lkey   = client_conn.mr->lkey;
+    printf("[客户端] 连接建立，开始写入消息 (每个 WR 最多 %u 个 SGE，内联阈值 %u 字节%s)...\n",
+           client_conn.send_sge, client_conn.inline_max, cfg->write_imm ? "，立即数通知" : "");
     for (int i = 0; i < cfg->count; ++i) {
-        snprintf(client_conn.buf, MSG_SIZE, "%s%d", MSG_STR, i + 1);
-        if (ibv_post_send(client_conn.qp, &wr, &bad_wr)) {
-            fprintf(stderr, "ibv_post_send (RDMA_WRITE) 失败\n");
+        segs[0].length = snprintf(client_conn.buf, HDR_SIZE, "[%d] ", i + 1);
+        if (cfg->write_imm) {
+            // 第 i 条写到服务端第 i % 槽数 个槽，立即数为序号 i
+            uint32_t nslots = remote_info.length / MSG_SIZE;
+
+            nwr = rdma_post_write_imm_sg(&client_conn, segs, 2,
+                                         remote_info.vaddr + (uint64_t)(i % (nslots ? nslots : 1)) * MSG_SIZE,
+                                         remote_info.rkey, i, i, 1);
+        } else {
+            nwr = rdma_post_write_sg(&client_conn, segs, 2, remote_info.vaddr, remote_info.rkey, i, 1);
+        }
+        if (nwr < 0) {
             goto cleanup;
         }
-        // 等待完成
-        while (1) {
-            int n = ibv_poll_cq(client_conn.cq, 1, &wc);
-            if (n < 0) {
-                fprintf(stderr, "ibv_poll_cq 失败\n");
-                goto cleanup;
-            }
-            if (n == 0) {
-                // //等待为了均衡服务器处理速度
-                // usleep(20000);
-                continue;
-            }
-            if (wc.status != IBV_WC_SUCCESS) {
-                fprintf(stderr, "[客户端] 完成队列错误: %s\n", ibv_wc_status_str(wc.status));
-                goto cleanup;
-            }
-            if (wc.opcode == IBV_WC_RDMA_WRITE) break;
+        // 等待完成：只有最后一个 WR 请求了完成通知
+        if (rdma_wait_completion(&client_conn, IBV_WC_RDMA_WRITE, &wc)) {
+            fprintf(stderr, "[客户端] 写入失败\n");
+            goto cleanup;
         }
-        printf("[客户端] 已写入第 %d 条消息\n", i+1);
+        printf("[客户端] 已写入第 %d 条消息 (%d 个 WR)\n", i+1, nwr);
     }
     printf("[客户端] 消息写入完毕，退出。\n");
 cleanup:
-    if (sockfd >= 0) close(sockfd);
     rdma_connection_cleanup(&client_conn);
     return 0;
 }
 
+// 多 QP 客户端：建立 num_qps 个连接，由 threads 个绑核线程驱动，逐个消息大小打印每个 QP 和总体吞吐量
+int run_multi_client(struct write_config *cfg) {
+    struct rdma_multi     m;
+    struct rdma_conn_opts opts;
+    int                   ret = -1;
+
+    memset(&m, 0, sizeof(m));
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    // 每个连接的发送队列和完成队列都要容纳一整条流水线
+    opts.max_send_wr  = cfg->depth;
+    opts.cq_depth     = cfg->depth + 1;
+    printf("[客户端] 启动，向 %s:%d 建立 %d 个连接...\n", cfg->ip, cfg->port, cfg->num_qps);
+    if (rdma_multi_connect(&m, cfg->num_qps, cfg->threads, cfg->ip, cfg->port, &opts, buf_size(cfg),
+                           IBV_ACCESS_LOCAL_WRITE, 1)) {
+        goto cleanup;
+    }
+    for (int i = 0; i < m.nqps; ++i) {
+        m.qps[i].wr.opcode              = IBV_WR_RDMA_WRITE;
+        m.qps[i].wr.wr.rdma.remote_addr = m.qps[i].remote.vaddr;
+        m.qps[i].wr.wr.rdma.rkey        = m.qps[i].remote.rkey;
+    }
+    m.iters = cfg->count;
+    rdma_pipeline_init(&m.pl, cfg->depth);
+    if (cfg->signal_every > 0) {
+        m.pl.signal_every = cfg->signal_every;
+    }
+    printf("[客户端] 连接建立，RDMA Write 多 QP 带宽测试 (深度 %d)...\n", m.pl.depth);
+    ret = rdma_multi_sweep(&m, cfg->size_min, cfg->size_max);
+cleanup:
+    rdma_multi_cleanup(&m);
+    return ret;
+}
+
+// =================== 混合 RPC ===================
+// 请求经 RDMA Write 写入服务端的请求槽，不消耗服务端的接收 WR；服务端工作线程轮询各连接的下一个请求槽，
+// 在槽内就地执行后从槽内用 Send 发回响应（HERD 式）
+
+// 每个客户端连接的请求槽
+struct wrpc_client_ctx {
+    struct rdma_rpc_wslots  ws;
+    struct rdma_mr_info     info;       // 请求槽的 MR 信息，随 rdma_accept 发给客户端
+    uint64_t                requests;
+    uint64_t                sent;       // 已投递的响应数
+    uint64_t                reaped;     // 发送完成已取出的响应数，sent - reaped 为占用的发送队列项
+};
+
+static struct rdma_rpc_server g_rpc;    // RPC 方法表，服务端启动前注册好，之后只读
+
+// 新连接：创建请求槽，MR 信息放进 private_data（监听线程）
+static int wrpc_on_connect(struct rdma_server_client *cli, const struct rdma_cm_event *evt,
+                           struct rdma_conn_param *param, void *arg) {
+    struct write_config    *cfg = arg;
+    struct wrpc_client_ctx *ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return -1;
+    }
+    if (rdma_rpc_wslots_init(&ctx->ws, cli->conn.pd, RPC_WRITE_SLOTS, buf_size(cfg))) {
+        rdma_rpc_wslots_destroy(&ctx->ws);
+        free(ctx);
+        return -1;
+    }
+    rdma_pack_mr_info(&ctx->info, ctx->ws.buf, (size_t)ctx->ws.nslots * ctx->ws.slot_size, ctx->ws.mr);
+    cli->ctx = ctx;
+    param->private_data     = &ctx->info;
+    param->private_data_len = sizeof(ctx->info);
+    return 0;
+}
+
+// 轮询请求槽：按序取出请求，就地执行后从槽内发回响应（工作线程）。
+// 客户端收到响应时服务端的发送完成不一定已被取出，发送队列满时把请求留在槽里下一轮再处理
+static int wrpc_on_poll(struct rdma_server_client *cli, void *arg) {
+    struct wrpc_client_ctx *ctx = cli->ctx;
+    struct ibv_sge          sge;
+    struct ibv_send_wr      wr, *bad_wr = NULL;
+    char                   *msg;
+    uint32_t                len;
+    int                     n;
+
+    for (n = 0; n < RPC_POLL_BATCH; ++n) {
+        if (ctx->sent - ctx->reaped >= (uint64_t)cli->conn.opts.max_send_wr) {
+            break;
+        }
+        msg = rdma_rpc_wslots_poll(&ctx->ws, &len);
+        if (!msg) {
+            break;
+        }
+        len = rdma_rpc_dispatch(&g_rpc, msg, len, ctx->ws.msg_size);
+        ctx->requests++;
+        // 客户端收到响应后才会重写这个槽，发送完成只用于归还发送队列：
+        // 每 RPC_SIGNAL_EVERY 个响应请求一次完成，它的完成说明之前的响应都已发出
+        memset(&sge, 0, sizeof(sge));
+        sge.addr   = (uintptr_t)msg;
+        sge.length = len;
+        sge.lkey   = ctx->ws.mr->lkey;
+        memset(&wr, 0, sizeof(wr));
+        wr.wr_id      = ++ctx->sent;
+        wr.sg_list    = &sge;
+        wr.num_sge    = 1;
+        wr.opcode     = IBV_WR_SEND;
+        wr.send_flags = rdma_inline_flag(&cli->conn, len);
+        if (ctx->sent % RPC_SIGNAL_EVERY == 0) {
+            wr.send_flags |= IBV_SEND_SIGNALED;
+        }
+        if (ibv_post_send(cli->conn.qp, &wr, &bad_wr)) {
+            fprintf(stderr, "ibv_post_send 失败\n");
+            return -1;
+        }
+    }
+    return n;
+}
+
+// 响应的发送完成：wr_id 为该响应的序号，它和之前的响应占用的发送队列项都已归还（工作线程）
+static int wrpc_on_completion(struct rdma_server_client *cli, struct ibv_wc *wc, void *arg) {
+    struct wrpc_client_ctx *ctx = cli->ctx;
+
+    ctx->reaped = wc->wr_id;
+    return 0;
+}
+
+// 连接断开：打印该连接的请求数（工作线程）
+static void wrpc_on_disconnect(struct rdma_server_client *cli, void *arg) {
+    struct wrpc_client_ctx *ctx = cli->ctx;
+
+    if (!ctx) {
+        return;
+    }
+    printf("[服务端] 连接 %lu 断开，共处理 %lu 个请求\n", cli->id, ctx->requests);
+    rdma_rpc_wslots_destroy(&ctx->ws);
+    free(ctx);
+    cli->ctx = NULL;
+}
+
+// 混合 RPC 服务端：接受任意数量的客户端，工作线程忙轮询请求槽，Ctrl-C 退出
+int run_rpc_server(struct write_config *cfg) {
+    struct rdma_server      srv;
+    struct rdma_conn_opts   opts;
+    struct rdma_server_ops  ops = {
+        .on_connect    = wrpc_on_connect,
+        .on_completion = wrpc_on_completion,
+        .on_disconnect = wrpc_on_disconnect,
+        .on_poll       = wrpc_on_poll,
+    };
+
+    rdma_rpc_server_init(&g_rpc);
+    rdma_rpc_register_bench(&g_rpc);
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    // 请求不经接收队列；每个请求槽最多有一个未完成的响应
+    opts.max_recv_wr  = 1;
+    opts.max_send_wr  = RPC_WRITE_SLOTS;
+    if (rdma_server_init(&srv, cfg->ip, cfg->port, &opts, cfg->workers, &ops, cfg)) {
+        fprintf(stderr, "初始化会话资源失败\n");
+        rdma_server_cleanup(&srv);
+        return -1;
+    }
+    rdma_server_stop_on_sigint(&srv);
+    printf("[服务端] 混合 RPC 模式，%d 个工作线程，每个连接 %d 个 %zu 字节请求槽，监听 %s:%d，Ctrl-C 退出...\n",
+           srv.nworkers, RPC_WRITE_SLOTS, rdma_rpc_wslot_size(buf_size(cfg)), cfg->ip, cfg->port);
+    rdma_server_run(&srv);
+    rdma_server_stop_on_sigint(NULL);
+    rdma_server_cleanup(&srv);
+    printf("[服务端] 退出，RPC 调用次数: echo %lu，null %lu\n",
+           g_rpc.methods[RPC_METHOD_ECHO].calls, g_rpc.methods[RPC_METHOD_NULL].calls);
+    return 0;
+}
+
+// 混合 RPC 客户端：请求经 RDMA Write 写入服务端的请求槽，连接后由 rdma_rpc_bench 扫描参数大小
+int run_rpc_client(struct write_config *cfg) {
+    struct rdma_connection  client_conn;
+    struct rdma_conn_opts   opts;
+    struct rdma_mr_info     remote_info;
+    struct rdma_rpc_client  rc;
+    int                     depth = cfg->depth, ret = -1;
+
+    memset(&client_conn, 0, sizeof(client_conn));
+    memset(&rc, 0, sizeof(rc));
+    printf("[客户端] 启动，连接 %s:%d...\n", cfg->ip, cfg->port);
+    rdma_conn_opts_init(&opts);
+    opts.poll_mode    = cfg->poll_mode;
+    opts.poll_spin_us = cfg->poll_spin_us;
+    opts.inline_threshold = cfg->inline_threshold;
+    // 响应接收环 2 * depth 个槽；请求的写完成可能晚于响应到达，发送队列也按两倍深度预留
+    opts.max_send_wr  = 2 * depth;
+    opts.max_recv_wr  = 2 * depth;
+    opts.cq_depth     = 3 * depth + 1;
+    if (rdma_client_connect(&client_conn, cfg->ip, cfg->port, &opts, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE,
+                            &remote_info)) {
+        goto cleanup;
+    }
+    if (rdma_rpc_client_init_write(&rc, &client_conn, depth, buf_size(cfg), &remote_info)) {
+        goto cleanup;
+    }
+
+    printf("[客户端] 连接建立，混合 RPC %s (请求 RDMA Write，响应 Send，深度 %d，服务端 %d 个请求槽，每个大小 %d 次调用)...\n",
+           cfg->rpc == RPC_METHOD_ECHO ? "echo" : "null", depth, rc.remote_slots, cfg->count);
+    if (rdma_rpc_bench(&rc, cfg->rpc, cfg->size_min, cfg->size_max, cfg->count)) {
+        goto cleanup;
+    }
+    ret = 0;
+    rdma_disconnect(client_conn.cm_id);
+cleanup:
+    // 接收环和请求缓冲区的 MR 要在 QP 销毁之后、PD 释放之前注销
+    if (client_conn.qp) {
+        rdma_destroy_qp(client_conn.cm_id);
+        client_conn.qp = NULL;
+    }
+    rdma_rpc_client_destroy(&rc);
+    rdma_connection_cleanup(&client_conn);
+    return ret;
+}
+
 // 主函数
 int main(int argc, char **argv) {
     struct write_config cfg;
@@ -522,8 +974,23 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    if (cfg.role == ROLE_SERVER) {
+    if (cfg.role == ROLE_SERVER && cfg.rpc) {
+        return run_rpc_server(&cfg);
+    } else if (cfg.role == ROLE_SERVER && cfg.workers > 0) {
+        struct rdma_conn_opts opts;
+
+        rdma_conn_opts_init(&opts);
+        opts.poll_mode    = cfg.poll_mode;
+        opts.poll_spin_us = cfg.poll_spin_us;
+        opts.inline_threshold = cfg.inline_threshold;
+        return rdma_run_passive_server(cfg.ip, cfg.port, &opts, cfg.workers, buf_size(&cfg),
+                                       IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE, cfg.huge_page);
+    } else if (cfg.role == ROLE_SERVER) {
         return run_server(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.rpc) {
+        return run_rpc_client(&cfg);
+    } else if (cfg.role == ROLE_CLIENT && cfg.num_qps > 0) {
+        return run_multi_client(&cfg);
     } else if (cfg.role == ROLE_CLIENT) {
         return run_client(&cfg);
     } else {